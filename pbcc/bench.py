@@ -0,0 +1,1715 @@
+from __future__ import annotations
+
+import argparse
+import asyncio
+import concurrent.futures
+import contextlib
+import ctypes
+import dataclasses
+import gc
+import importlib
+import io
+import json
+import math
+import os
+import platform
+import random
+import re
+import statistics
+import subprocess
+import sys
+import sysconfig
+import threading
+import time
+import tracemalloc
+from array import array
+from collections.abc import Callable, Iterable, Mapping, MutableSequence, Sequence
+from types import ModuleType
+from typing import Any
+
+from google.protobuf import json_format
+from google.protobuf.descriptor import Descriptor, FieldDescriptor
+from google.protobuf.internal import api_implementation
+from google.protobuf.message import Message
+
+from .compile import compile_extension_module, compile_modules
+from .corpus import CorpusConfig, Distribution, generate_message, load_message_info
+
+# Benchmarks for pbcc, compared with google.protobuf's default (upb) backend.
+# Run this as `python -m pbcc.bench`; see --help for options. --mode selects
+# what is measured (speed, memory, latency, or build). Results are written as JSON, which can be
+# saved and passed back with --compare to check for regressions.
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+BUILD_DIR_NAME = "bench_modules"
+RESULTS_FORMAT = "pbcc_bench"
+RESULTS_VERSION = 1
+
+# .proto files built into the benchmark module. test.proto's messages are also
+# used as (small) benchmark shapes
+PROTO_MODULES: tuple[str, ...] = ("bench", "test")
+BENCH_PB2_MODULE_NAMES: tuple[str, ...] = tuple(f"{BUILD_DIR_NAME}.{name}_pb2" for name in PROTO_MODULES)
+
+
+def build_bench_modules(rebuild: bool) -> tuple[dict[str, ModuleType], ModuleType]:
+    """Generates the pb2 modules and builds the pbcc module for PROTO_MODULES.
+    Returns ({proto module name: pb2 module}, pbcc module). Build output goes
+    to stderr so that JSON results can be written to stdout."""
+    build_dir = os.path.join(BENCH_DIR, BUILD_DIR_NAME)
+    so_filename = os.path.join(build_dir, "bench_pbcc.so")
+    proto_filenames = [os.path.join(BENCH_DIR, f"{name}.proto") for name in PROTO_MODULES]
+    if BENCH_DIR not in sys.path:
+        sys.path.insert(0, BENCH_DIR)
+
+    source_filenames = [
+        *proto_filenames,
+        *(os.path.join(BENCH_DIR, n) for n in ("pymodule.in.cc", "pbcc_runtime.h", "pbcc_runtime.cc", "wire_format.h")),
+    ]
+    needs_build = (
+        rebuild
+        or not os.path.exists(so_filename)
+        or any(os.path.getmtime(so_filename) < os.path.getmtime(n) for n in source_filenames)
+    )
+    os.makedirs(build_dir, exist_ok=True)
+    subprocess.check_call(
+        (
+            sys.executable,
+            "-m",
+            "grpc_tools.protoc",
+            f"-I{BENCH_DIR}",
+            *proto_filenames,
+            f"--python_out={build_dir}",
+            f"--pyi_out={build_dir}",
+        ),
+        stdout=sys.stderr,
+    )
+    if needs_build:
+        # compile_modules names the extension module after the output path,
+        # so it must be run from the directory containing bench_modules
+        prev_cwd = os.getcwd()
+        os.chdir(BENCH_DIR)
+        try:
+            with contextlib.redirect_stdout(sys.stderr):
+                asyncio.run(compile_modules(f"{BUILD_DIR_NAME}/bench_pbcc", BENCH_PB2_MODULE_NAMES))
+        finally:
+            os.chdir(prev_cwd)
+    return load_bench_modules()
+
+
+def load_bench_modules() -> tuple[dict[str, ModuleType], ModuleType]:
+    """Imports the modules built by build_bench_modules."""
+    if BENCH_DIR not in sys.path:
+        sys.path.insert(0, BENCH_DIR)
+    pb2_modules = {
+        name: importlib.import_module(module_name) for name, module_name in zip(PROTO_MODULES, BENCH_PB2_MODULE_NAMES)
+    }
+    pbcc = importlib.import_module(f"{BUILD_DIR_NAME}.bench_pbcc")
+    return pb2_modules, pbcc
+
+
+# Sample messages. Each shape is built as a google.protobuf message with
+# deterministic contents, and the pbcc message is parsed from its serialized
+# form, so both implementations always operate on identical data. The shapes in
+# bench.proto are built by the functions below; the messages in test.proto are
+# generated by pbcc.corpus with random values (see make_random_message).
+
+
+def random_string(rng: random.Random, length: int) -> str:
+    return "".join(rng.choice("abcdefghijklmnopqrstuvwxyz0123456789 ") for _ in range(length))
+
+
+def make_wide_flat(pb2: ModuleType, rng: random.Random) -> Message:
+    return pb2.WideFlat(
+        f_int32_1=rng.randint(-(2**31), 2**31 - 1),
+        f_int32_2=rng.randint(0, 100),
+        f_int64_1=rng.randint(-(2**63), 2**63 - 1),
+        f_int64_2=rng.randint(0, 10000),
+        f_uint32_1=rng.randint(0, 2**32 - 1),
+        f_uint32_2=rng.randint(0, 100),
+        f_uint64_1=rng.randint(0, 2**64 - 1),
+        f_uint64_2=rng.randint(0, 10000),
+        f_sint32_1=rng.randint(-(2**31), 2**31 - 1),
+        f_sint32_2=rng.randint(-100, 100),
+        f_sint64_1=rng.randint(-(2**63), 2**63 - 1),
+        f_sint64_2=rng.randint(-10000, 10000),
+        f_fixed32=rng.randint(0, 2**32 - 1),
+        f_fixed64=rng.randint(0, 2**64 - 1),
+        f_sfixed32=rng.randint(-(2**31), 2**31 - 1),
+        f_sfixed64=rng.randint(-(2**63), 2**63 - 1),
+        f_bool_1=True,
+        f_bool_2=rng.random() < 0.5,
+        f_enum_1=pb2.BENCH_ENUM_ONE,
+        f_enum_2=pb2.BENCH_ENUM_TWO,
+        f_float_1=0.5,
+        f_float_2=-1024.0,
+        f_double_1=rng.random(),
+        f_double_2=rng.random() * 1e100,
+        f_string_1=random_string(rng, 16),
+        f_string_2=random_string(rng, 64),
+        f_bytes_1=rng.randbytes(16),
+        f_bytes_2=rng.randbytes(64),
+        f_optional_int64=rng.randint(0, 2**40),
+        f_optional_string=random_string(rng, 8),
+    )
+
+
+def make_deeply_nested(pb2: ModuleType, rng: random.Random, depth: int = 32) -> Message:
+    msg = pb2.DeeplyNested(value=rng.randint(0, 2**40), name=random_string(rng, 8))
+    for _ in range(depth - 1):
+        msg = pb2.DeeplyNested(child=msg, value=rng.randint(0, 2**40), name=random_string(rng, 8))
+    return msg
+
+
+def make_large_repeated(pb2: ModuleType, rng: random.Random, count: int = 10000) -> Message:
+    return pb2.LargeRepeated(
+        f_int64=[rng.randint(-(2**40), 2**40) for _ in range(count)],
+        f_sint32=[rng.randint(-1000, 1000) for _ in range(count)],
+        f_fixed32=[rng.randint(0, 2**32 - 1) for _ in range(count)],
+        f_double=[rng.random() for _ in range(count)],
+        f_bool=[rng.random() < 0.5 for _ in range(count)],
+    )
+
+
+def make_big_maps(pb2: ModuleType, rng: random.Random, count: int = 1000) -> Message:
+    return pb2.BigMaps(
+        f_string_int64={f"key{z}": rng.randint(0, 2**40) for z in range(count)},
+        f_int64_string={rng.randint(0, 2**40): random_string(rng, 12) for _ in range(count)},
+        f_string_message={
+            f"key{z}": pb2.MapValue(id=rng.randint(0, 2**40), label=random_string(rng, 12)) for z in range(count)
+        },
+    )
+
+
+def make_string_heavy(pb2: ModuleType, rng: random.Random) -> Message:
+    return pb2.StringHeavy(
+        title=random_string(rng, 80),
+        body=random_string(rng, 16384),
+        tags=[random_string(rng, 8) for _ in range(100)],
+        words=[random_string(rng, rng.randint(1, 12)) for _ in range(2000)],
+    )
+
+
+def make_bytes_heavy(pb2: ModuleType, rng: random.Random) -> Message:
+    return pb2.BytesHeavy(
+        blob=rng.randbytes(1024 * 1024),
+        chunks=[rng.randbytes(4096) for _ in range(64)],
+        checksum=rng.randbytes(32),
+    )
+
+
+def field_is_repeated(field: FieldDescriptor) -> bool:
+    # FieldDescriptor.label was removed in newer protobuf versions
+    if hasattr(field, "is_repeated"):
+        return field.is_repeated
+    return field.label == FieldDescriptor.LABEL_REPEATED
+
+
+def field_is_map(field: FieldDescriptor) -> bool:
+    return field.message_type is not None and field.message_type.GetOptions().map_entry
+
+
+# Small repeated fields, maps, strings, and bytes, and every field that isn't in
+# a oneof set, so each of test.proto's messages exercises all of its fields
+RANDOM_MESSAGE_CONFIG = CorpusConfig(
+    presence_rate=1.0,
+    repeated_length=Distribution(ranges=[(0, 8, 1)]),
+    map_size=Distribution(ranges=[(0, 8, 1)]),
+    string_length=Distribution(ranges=[(0, 32, 1)]),
+    bytes_length=Distribution(ranges=[(0, 32, 1)]),
+)
+
+
+def make_random_message(pb2: ModuleType, message_name: str, rng: random.Random) -> Message:
+    message_info = load_message_info(pb2.__name__, message_name)
+    data = generate_message(message_info, rng, RANDOM_MESSAGE_CONFIG)
+    return getattr(pb2, message_name).FromString(data)
+
+
+@dataclasses.dataclass(kw_only=True)
+class Shape:
+    proto_module: str
+    message_name: str
+    make: Callable[[ModuleType, random.Random], Message]
+
+
+BENCH_SHAPES: dict[str, Shape] = {
+    "wide_flat": Shape(proto_module="bench", message_name="WideFlat", make=make_wide_flat),
+    "deeply_nested": Shape(proto_module="bench", message_name="DeeplyNested", make=make_deeply_nested),
+    "large_repeated": Shape(proto_module="bench", message_name="LargeRepeated", make=make_large_repeated),
+    "big_maps": Shape(proto_module="bench", message_name="BigMaps", make=make_big_maps),
+    "string_heavy": Shape(proto_module="bench", message_name="StringHeavy", make=make_string_heavy),
+    "bytes_heavy": Shape(proto_module="bench", message_name="BytesHeavy", make=make_bytes_heavy),
+}
+
+
+def all_shapes(pb2_modules: dict[str, ModuleType]) -> dict[str, Shape]:
+    """Returns BENCH_SHAPES and a shape for each top-level message in
+    test.proto, named like test_primitives for TestPrimitives."""
+    shapes = dict(BENCH_SHAPES)
+    for name in pb2_modules["test"].DESCRIPTOR.message_types_by_name:
+        shape_name = re.sub(r"(?<!^)(?=[A-Z])", "_", name).lower()
+        shapes[shape_name] = Shape(
+            proto_module="test",
+            message_name=name,
+            make=lambda pb2, rng, name=name: make_random_message(pb2, name, rng),
+        )
+    return shapes
+
+
+IMPLEMENTATIONS: tuple[str, ...] = ("pbcc", "upb")
+
+MODES: tuple[str, ...] = ("speed", "memory", "latency", "build", "scaling")
+
+OPERATIONS: tuple[str, ...] = ("parse", "serialize", "as_dict", "construct", "shallow_copy", "equality")
+MEMORY_OPERATIONS: tuple[str, ...] = ("parse", "construct_default", "parse_unknown")
+LATENCY_OPERATIONS: tuple[str, ...] = ("parse", "serialize")
+BUILD_OPERATIONS: tuple[str, ...] = ("codegen", "compile", "module_size", "import")
+SCALING_OPERATIONS: tuple[str, ...] = ("parse", "serialize", "parse_batch", "serialize_batch")
+
+SCALING_EXECUTORS: tuple[str, ...] = ("threads", "subinterpreters")
+
+# Operations whose throughput is reported in bytes per second (of serialized data)
+BYTE_OPERATIONS: frozenset[str] = frozenset({"parse", "serialize"})
+
+# Operations that only pbcc has. upb's CopyFrom copies the whole message tree,
+# so it isn't comparable with pbcc's shallow proto_copy, and isn't benchmarked.
+PBCC_ONLY_OPERATIONS: frozenset[str] = frozenset({"shallow_copy"})
+
+
+@dataclasses.dataclass(kw_only=True)
+class Sample:
+    shape: str
+    data: bytes
+    num_elements: int
+    pb_cls: Any
+    pbcc_cls: Any
+    pb_msg: Any
+    pb_msg_copy: Any
+    pbcc_msg: Any
+    pbcc_msg_copy: Any
+
+
+def count_elements(msg: Message) -> int:
+    """Returns the total number of items in all repeated and map fields in msg,
+    including those in submessages."""
+    ret = 0
+    for field, value in msg.ListFields():
+        if field_is_map(field):
+            ret += len(value)
+            if field.message_type.fields_by_name["value"].message_type is not None:
+                ret += sum(count_elements(v) for v in value.values())
+        elif field_is_repeated(field):
+            ret += len(value)
+            if field.message_type is not None:
+                ret += sum(count_elements(v) for v in value)
+        elif field.message_type is not None:
+            ret += count_elements(value)
+    return ret
+
+
+def make_samples(
+    pb2_modules: dict[str, ModuleType],
+    pbcc: ModuleType,
+    shapes: dict[str, Shape],
+    shape_names: Iterable[str],
+    seed: int,
+) -> list[Sample]:
+    samples: list[Sample] = []
+    for shape_name in shape_names:
+        shape = shapes[shape_name]
+        pb_msg = shape.make(pb2_modules[shape.proto_module], random.Random(f"{seed}:{shape_name}"))
+        data = pb_msg.SerializeToString()
+        pb_cls = type(pb_msg)
+        pbcc_cls = getattr(getattr(pbcc, shape.proto_module), shape.message_name)
+        samples.append(
+            Sample(
+                shape=shape_name,
+                data=data,
+                num_elements=count_elements(pb_msg),
+                pb_cls=pb_cls,
+                pbcc_cls=pbcc_cls,
+                pb_msg=pb_msg,
+                pb_msg_copy=pb_cls.FromString(data),
+                pbcc_msg=pbcc_cls.from_proto_data(data),
+                pbcc_msg_copy=pbcc_cls.from_proto_data(data),
+            )
+        )
+    return samples
+
+
+def pbcc_attribute_names(desc: Descriptor) -> list[str]:
+    """Returns the names of the attributes of a pbcc message. Fields in a oneof
+    share one attribute, named after the oneof; proto3 optional fields are
+    implemented as oneofs internally, but have their own attributes."""
+    ret: list[str] = []
+    for field in desc.fields:
+        oneof = field.containing_oneof
+        name = field.name if (oneof is None or oneof.name == f"_{field.name}") else oneof.name
+        if name not in ret:
+            ret.append(name)
+    return ret
+
+
+def operation_fn(sample: Sample, implementation: str, operation: str) -> Callable[[], Any]:
+    """Returns a function that performs one operation on the sample."""
+    data = sample.data
+    if implementation == "pbcc":
+        cls = sample.pbcc_cls
+        msg = sample.pbcc_msg
+        other = sample.pbcc_msg_copy
+        kwargs = {name: getattr(msg, name) for name in pbcc_attribute_names(sample.pb_cls.DESCRIPTOR)}
+        fns: dict[str, Callable[[], Any]] = {
+            "parse": lambda: cls.from_proto_data(data),
+            "serialize": msg.as_proto_data,
+            "as_dict": msg.as_dict,
+            "construct": lambda: cls(**kwargs),
+            # pbcc field values are ordinary Python objects, so proto_copy is
+            # a shallow copy; this is the idiomatic way to copy a message
+            "shallow_copy": msg.proto_copy,
+            "equality": lambda: msg == other,
+        }
+    elif implementation == "upb":
+        cls = sample.pb_cls
+        msg = sample.pb_msg
+        other = sample.pb_msg_copy
+        kwargs = {}
+        for f in cls.DESCRIPTOR.fields:
+            try:
+                if not msg.HasField(f.name):
+                    continue
+            except ValueError:
+                pass  # The field doesn't track presence
+            value = getattr(msg, f.name)
+            if isinstance(value, Mapping):
+                value = dict(value)
+            elif isinstance(value, MutableSequence):
+                value = list(value)
+            kwargs[f.name] = value
+
+        fns = {
+            "parse": lambda: cls.FromString(data),
+            "serialize": msg.SerializeToString,
+            "as_dict": lambda: json_format.MessageToDict(msg, preserving_proto_field_name=True),
+            "construct": lambda: cls(**kwargs),
+            "equality": lambda: msg == other,
+        }
+    else:
+        raise ValueError(f"Unknown implementation: {implementation}")
+    return fns[operation]
+
+
+@dataclasses.dataclass(kw_only=True)
+class Timing:
+    iterations: int
+    ns_per_op_samples: list[float]
+
+    @property
+    def ns_per_op(self) -> float:
+        return statistics.mean(self.ns_per_op_samples)
+
+    @property
+    def ns_per_op_stdev(self) -> float:
+        return statistics.stdev(self.ns_per_op_samples) if len(self.ns_per_op_samples) > 1 else 0.0
+
+
+def time_loop(fn: Callable[[], Any], iterations: int) -> int:
+    r = range(iterations)
+    start = time.perf_counter_ns()
+    for _ in r:
+        fn()
+    return time.perf_counter_ns() - start
+
+
+def time_operation(fn: Callable[[], Any], min_time: float, repeats: int) -> Timing:
+    """Times fn in repeats rounds, each running it enough times to take about
+    min_time seconds. The garbage collector is disabled while timing, as in
+    timeit."""
+    gc_was_enabled = gc.isenabled()
+    gc.disable()
+    try:
+        # Find how many iterations take about min_time; the first call also
+        # warms up any caches
+        fn()
+        iterations = 1
+        while True:
+            elapsed_ns = time_loop(fn, iterations)
+            if elapsed_ns >= min_time * 1e8:  # 10% of min_time
+                iterations = max(1, math.ceil(iterations * min_time * 1e9 / elapsed_ns))
+                break
+            iterations *= 2
+        samples = [time_loop(fn, iterations) / iterations for _ in range(repeats)]
+    finally:
+        if gc_was_enabled:
+            gc.enable()
+    return Timing(iterations=iterations, ns_per_op_samples=samples)
+
+
+def result_key(result: dict[str, Any]) -> str:
+    key = f"{result['shape']}/{result['operation']}/{result['implementation']}"
+    if "threads" in result:
+        key += f"/{result['executor']}/{result['threads']}"
+    return key
+
+
+def run_speed_benchmarks(
+    samples: Sequence[Sample],
+    implementations: Sequence[str],
+    operations: Sequence[str],
+    min_time: float,
+    repeats: int,
+) -> list[dict[str, Any]]:
+    results: list[dict[str, Any]] = []
+    for sample in samples:
+        for operation in operations:
+            for implementation in implementations:
+                if (implementation != "pbcc") and (operation in PBCC_ONLY_OPERATIONS):
+                    continue
+                timing = time_operation(operation_fn(sample, implementation, operation), min_time, repeats)
+                ns_per_op = timing.ns_per_op
+                result: dict[str, Any] = {
+                    "shape": sample.shape,
+                    "operation": operation,
+                    "implementation": implementation,
+                    "encoded_size": len(sample.data),
+                    "iterations": timing.iterations,
+                    "repeats": repeats,
+                    "ns_per_op": ns_per_op,
+                    "ns_per_op_stdev": timing.ns_per_op_stdev,
+                    "ns_per_op_min": min(timing.ns_per_op_samples),
+                    "ops_per_sec": 1e9 / ns_per_op,
+                    "bytes_per_sec": (len(sample.data) * 1e9 / ns_per_op) if operation in BYTE_OPERATIONS else None,
+                }
+                results.append(result)
+                print(
+                    f"{result_key(result):<48} {ns_per_op:>14.1f} ns/op  ±{timing.ns_per_op_stdev:>10.1f}",
+                    file=sys.stderr,
+                )
+    return results
+
+
+# Memory benchmarks. Each one creates many messages and keeps them alive, and
+# measures how much memory they use in three ways:
+# - By the increase in memory allocated with malloc. Memory mode runs with
+#   PYTHONMALLOC=malloc, so this includes all allocations made by Python,
+#   google.protobuf (which allocates its messages' storage with malloc), and
+#   pbcc (including C++ allocations for unknown fields). This is the primary
+#   result, since it's exact and comparable between implementations. It's only
+#   available with glibc; otherwise the RSS increase is used instead.
+# - By the increase in the process's RSS. Free memory is returned to the OS
+#   before each measurement, so this is comparable to the above, but with page
+#   granularity.
+# - With tracemalloc, which only sees allocations made through Python's
+#   allocators, and so undercounts google.protobuf messages. This also reports
+#   the peak, which includes temporary allocations made while parsing.
+
+
+class _MallInfo2(ctypes.Structure):
+    _fields_ = [
+        (name, ctypes.c_size_t)
+        for name in (
+            "arena",
+            "ordblks",
+            "smblks",
+            "hblks",
+            "hblkhd",
+            "usmblks",
+            "fsmblks",
+            "uordblks",
+            "fordblks",
+            "keepcost",
+        )
+    ]
+
+
+try:
+    _libc = ctypes.CDLL(None)
+    _malloc_trim = _libc.malloc_trim
+    _mallinfo2 = _libc.mallinfo2
+    _mallinfo2.restype = _MallInfo2
+except (AttributeError, OSError):
+    _malloc_trim = None
+    _mallinfo2 = None
+
+
+def release_free_memory() -> None:
+    """Collects garbage and returns free memory to the OS where possible, so
+    that later allocations show up in RSS."""
+    gc.collect()
+    if _malloc_trim is not None:
+        _malloc_trim(0)
+
+
+def current_malloc_in_use() -> int | None:
+    if _mallinfo2 is None:
+        return None
+    info = _mallinfo2()
+    return info.uordblks + info.hblkhd
+
+
+def current_rss() -> int | None:
+    try:
+        with open("/proc/self/statm", "rt") as f:
+            return int(f.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+    except (OSError, ValueError):
+        return None
+
+
+@dataclasses.dataclass(kw_only=True)
+class MemoryMeasurement:
+    malloc_bytes: float | None
+    rss_bytes: float | None
+    tracemalloc_bytes: float
+    tracemalloc_peak_bytes: float
+
+    @property
+    def primary_bytes(self) -> float:
+        for v in (self.malloc_bytes, self.rss_bytes):
+            if v is not None:
+                return v
+        return self.tracemalloc_bytes
+
+
+def measure_memory(fn: Callable[[], Any], count: int) -> MemoryMeasurement:
+    """Calls fn count times, keeping all the results alive, and returns the
+    memory used per result."""
+
+    def delta(before: int | None, after: int | None) -> float | None:
+        return None if (before is None or after is None) else (after - before) / count
+
+    objs: list[Any] = [None] * count
+    gc_was_enabled = gc.isenabled()
+    gc.disable()
+    try:
+        release_free_memory()
+        rss_before = current_rss()
+        malloc_before = current_malloc_in_use()
+        for z in range(count):
+            objs[z] = fn()
+        malloc_after = current_malloc_in_use()
+        rss_after = current_rss()
+        objs[:] = [None] * count
+        release_free_memory()
+
+        tracemalloc.start()
+        try:
+            traced_before, _ = tracemalloc.get_traced_memory()
+            tracemalloc.reset_peak()
+            for z in range(count):
+                objs[z] = fn()
+            traced_after, traced_peak = tracemalloc.get_traced_memory()
+        finally:
+            tracemalloc.stop()
+        objs[:] = [None] * count
+    finally:
+        if gc_was_enabled:
+            gc.enable()
+
+    return MemoryMeasurement(
+        malloc_bytes=delta(malloc_before, malloc_after),
+        rss_bytes=delta(rss_before, rss_after),
+        tracemalloc_bytes=(traced_after - traced_before) / count,
+        tracemalloc_peak_bytes=(traced_peak - traced_before) / count,
+    )
+
+
+def memory_operation_fn(
+    sample: Sample, pb2_modules: dict[str, ModuleType], pbcc: ModuleType, implementation: str, operation: str
+) -> Callable[[], Any]:
+    """Returns a function that creates one message for a memory benchmark.
+    parse_unknown parses the sample's data as a message with no fields, so
+    every field is retained as an unknown field."""
+    data = sample.data
+    if implementation == "pbcc":
+        cls = sample.pbcc_cls
+        empty_cls = pbcc.bench.Empty
+        fns: dict[str, Callable[[], Any]] = {
+            "parse": lambda: cls.from_proto_data(data),
+            "construct_default": cls,
+            "parse_unknown": lambda: empty_cls.from_proto_data(data),
+        }
+    elif implementation == "upb":
+        cls = sample.pb_cls
+        empty_cls = pb2_modules["bench"].Empty
+        fns = {
+            "parse": lambda: cls.FromString(data),
+            "construct_default": cls,
+            "parse_unknown": lambda: empty_cls.FromString(data),
+        }
+    else:
+        raise ValueError(f"Unknown implementation: {implementation}")
+    return fns[operation]
+
+
+def run_memory_benchmarks(
+    samples: Sequence[Sample],
+    pb2_modules: dict[str, ModuleType],
+    pbcc: ModuleType,
+    implementations: Sequence[str],
+    operations: Sequence[str],
+    target_bytes: int,
+    repeats: int,
+) -> list[dict[str, Any]]:
+    results: list[dict[str, Any]] = []
+    for sample in samples:
+        for operation in operations:
+            # Create enough messages that their total size is measurable in
+            # RSS (which has page granularity) and the per-message results
+            # aren't affected by the allocator's granularity, but not too many
+            data_size = 0 if operation == "construct_default" else len(sample.data)
+            count = min(100000, max(10, target_bytes // max(data_size, 64)))
+            num_elements = sample.num_elements if operation == "parse" else 0
+            for implementation in implementations:
+                fn = memory_operation_fn(sample, pb2_modules, pbcc, implementation, operation)
+                fn()
+                measurements = [measure_memory(fn, count) for _ in range(repeats)]
+                primary = [m.primary_bytes for m in measurements]
+                bytes_per_message = statistics.mean(primary)
+                # The per-element cost excludes the fixed cost of the message
+                # itself, which is measured by constructing a default message
+                bytes_per_element: float | None = None
+                if num_elements:
+                    default_fn = memory_operation_fn(sample, pb2_modules, pbcc, implementation, "construct_default")
+                    default_fn()
+                    default_bytes = measure_memory(default_fn, count).primary_bytes
+                    bytes_per_element = (bytes_per_message - default_bytes) / num_elements
+
+                def mean_or_none(values: Iterable[float | None]) -> float | None:
+                    present = [v for v in values if v is not None]
+                    return statistics.mean(present) if present else None
+
+                result: dict[str, Any] = {
+                    "shape": sample.shape,
+                    "operation": operation,
+                    "implementation": implementation,
+                    "encoded_size": data_size,
+                    "count": count,
+                    "repeats": repeats,
+                    "bytes_per_message": bytes_per_message,
+                    "bytes_per_message_stdev": statistics.stdev(primary) if len(primary) > 1 else 0.0,
+                    "malloc_bytes_per_message": mean_or_none(m.malloc_bytes for m in measurements),
+                    "rss_bytes_per_message": mean_or_none(m.rss_bytes for m in measurements),
+                    "tracemalloc_bytes_per_message": statistics.mean(m.tracemalloc_bytes for m in measurements),
+                    "tracemalloc_peak_bytes_per_message": statistics.mean(
+                        m.tracemalloc_peak_bytes for m in measurements
+                    ),
+                    "num_elements": num_elements,
+                    "bytes_per_element": bytes_per_element,
+                }
+                results.append(result)
+                print(
+                    f"{result_key(result):<48} {bytes_per_message:>14.1f} bytes/msg  ±{result['bytes_per_message_stdev']:>10.1f}",
+                    file=sys.stderr,
+                )
+    return results
+
+
+# Latency benchmarks. These measure the distribution of the time taken by
+# individual operations under sustained load, with the garbage collector
+# enabled, since the tail of the distribution is dominated by collections
+# rather than by the operations themselves. Each benchmark:
+# - Keeps the results of the most recent operations alive in a ring buffer (the
+#   working set), so they survive into older generations and are traversed by
+#   the less frequent but longer collections of those generations, as in a
+#   long-running server.
+# - Creates some cyclic garbage after each operation (the allocation churn),
+#   which the collector has to do real work to free. This is interleaved with
+#   the operations rather than done by another thread, since with the GIL, a
+#   separate thread would only add scheduling noise.
+# - Records the duration of every GC pause with gc.callbacks. Pauses are also
+#   measured with no operation at all (only the churn), and the difference is
+#   reported as the GC time attributable to the objects the operation creates
+#   (for pbcc, the lists, dicts, and other containers in parsed messages).
+
+
+class LatencyHistogram:
+    """A histogram of latencies in nanoseconds, in the style of HdrHistogram:
+    each power-of-2 range of values is divided into the same number of
+    buckets, so any percentile's relative error is at most 1 / SUB_BUCKETS
+    regardless of its magnitude, and the histogram stays small."""
+
+    SUB_BUCKET_BITS = 7
+    SUB_BUCKETS = 1 << (SUB_BUCKET_BITS - 1)
+
+    def __init__(self) -> None:
+        self.counts: dict[int, int] = {}
+        self.total_count = 0
+        self.total_ns = 0
+        self.max_ns = 0
+
+    @classmethod
+    def bucket_for_value(cls, value: int) -> int:
+        shift = max(0, value.bit_length() - cls.SUB_BUCKET_BITS)
+        return shift * cls.SUB_BUCKETS + (value >> shift)
+
+    @classmethod
+    def lowest_value_in_bucket(cls, bucket: int) -> int:
+        shift = max(0, bucket // cls.SUB_BUCKETS - 1)
+        return (bucket - shift * cls.SUB_BUCKETS) << shift
+
+    def record_all(self, values: Iterable[int]) -> None:
+        for value in values:
+            bucket = self.bucket_for_value(value)
+            self.counts[bucket] = self.counts.get(bucket, 0) + 1
+            self.total_count += 1
+            self.total_ns += value
+            self.max_ns = max(self.max_ns, value)
+
+    def percentile(self, p: float) -> int:
+        """Returns the lowest value in the bucket containing the pth
+        percentile (0 < p <= 100)."""
+        if not self.total_count:
+            return 0
+        target = max(1, math.ceil(self.total_count * p / 100))
+        seen = 0
+        for bucket in sorted(self.counts):
+            seen += self.counts[bucket]
+            if seen >= target:
+                return min(self.lowest_value_in_bucket(bucket), self.max_ns)
+        return self.max_ns
+
+    def as_list(self) -> list[tuple[int, int]]:
+        """Returns the nonempty buckets as [(lowest value, count), ...]."""
+        return [(self.lowest_value_in_bucket(b), self.counts[b]) for b in sorted(self.counts)]
+
+
+# Percentiles reported for each latency benchmark, and their result field names
+LATENCY_PERCENTILES: tuple[tuple[float, str], ...] = (
+    (50, "p50_ns"),
+    (90, "p90_ns"),
+    (99, "p99_ns"),
+    (99.9, "p99_9_ns"),
+)
+
+
+@dataclasses.dataclass(kw_only=True)
+class LatencyRound:
+    latencies_ns: array[int]
+    gc_pauses_ns: list[int]
+    elapsed_ns: int
+
+    @property
+    def gc_pause_ns_per_op(self) -> float:
+        return sum(self.gc_pauses_ns) / len(self.latencies_ns)
+
+
+def run_latency_round(fn: Callable[[], Any], duration: float, working_set: int, churn_cycles: int) -> LatencyRound:
+    """Calls fn repeatedly for about duration seconds with the garbage
+    collector enabled, keeping the last working_set results alive and creating
+    churn_cycles reference cycles of garbage after each call. Returns the
+    latency of each call and the duration of each GC pause."""
+    ring: list[Any] = [None] * working_set
+    for z in range(working_set):
+        ring[z] = fn()
+
+    gc_pauses_ns: list[int] = []
+    gc_start_ns = 0
+
+    def on_gc(phase: str, info: dict[str, Any]) -> None:
+        nonlocal gc_start_ns
+        if phase == "start":
+            gc_start_ns = time.perf_counter_ns()
+        else:
+            gc_pauses_ns.append(time.perf_counter_ns() - gc_start_ns)
+
+    latencies_ns = array("q")
+    gc_was_enabled = gc.isenabled()
+    gc.collect()
+    gc.enable()
+    gc.callbacks.append(on_gc)
+    try:
+        round_start_ns = time.perf_counter_ns()
+        deadline_ns = round_start_ns + int(duration * 1e9)
+        z = 0
+        while True:
+            start_ns = time.perf_counter_ns()
+            ring[z] = fn()
+            end_ns = time.perf_counter_ns()
+            latencies_ns.append(end_ns - start_ns)
+            for _ in range(churn_cycles):
+                garbage: list[Any] = []
+                garbage.append(garbage)
+            if end_ns >= deadline_ns:
+                break
+            z += 1
+            if z == working_set:
+                z = 0
+    finally:
+        gc.callbacks.remove(on_gc)
+        if not gc_was_enabled:
+            gc.disable()
+    return LatencyRound(latencies_ns=latencies_ns, gc_pauses_ns=gc_pauses_ns, elapsed_ns=end_ns - round_start_ns)
+
+
+def count_gc_tracked_objects(fn: Callable[[], Any], count: int = 100) -> float:
+    """Returns the number of new objects tracked by the garbage collector that
+    are kept alive by each result of fn."""
+    gc_was_enabled = gc.isenabled()
+    gc.disable()
+    try:
+        gc.collect()
+        before = len(gc.get_objects(generation=0))
+        objs = [fn() for _ in range(count)]
+        after = len(gc.get_objects(generation=0))
+        del objs
+    finally:
+        if gc_was_enabled:
+            gc.enable()
+    return (after - before - 1) / count  # -1 for the objs list
+
+
+def run_latency_benchmarks(
+    samples: Sequence[Sample],
+    implementations: Sequence[str],
+    operations: Sequence[str],
+    duration: float,
+    working_set: int,
+    churn_cycles: int,
+    repeats: int,
+) -> tuple[list[dict[str, Any]], float]:
+    """Returns the results, and the GC time per operation caused by the churn
+    alone."""
+    churn_rounds = [run_latency_round(lambda: None, duration, working_set, churn_cycles) for _ in range(repeats)]
+    churn_gc_pause_ns_per_op = statistics.mean(r.gc_pause_ns_per_op for r in churn_rounds)
+    print(f"{'(churn only)':<48} GC {churn_gc_pause_ns_per_op:>10.1f} ns/op", file=sys.stderr)
+
+    results: list[dict[str, Any]] = []
+    for sample in samples:
+        for operation in operations:
+            for implementation in implementations:
+                fn = operation_fn(sample, implementation, operation)
+                rounds = [run_latency_round(fn, duration, working_set, churn_cycles) for _ in range(repeats)]
+                histogram = LatencyHistogram()
+                round_p99s: list[int] = []
+                for r in rounds:
+                    round_histogram = LatencyHistogram()
+                    round_histogram.record_all(r.latencies_ns)
+                    round_p99s.append(round_histogram.percentile(99))
+                    histogram.record_all(r.latencies_ns)
+                gc_pauses_ns = [p for r in rounds for p in r.gc_pauses_ns]
+                gc_pause_ns_per_op = sum(gc_pauses_ns) / histogram.total_count
+
+                result: dict[str, Any] = {
+                    "shape": sample.shape,
+                    "operation": operation,
+                    "implementation": implementation,
+                    "encoded_size": len(sample.data),
+                    "repeats": repeats,
+                    "ops": histogram.total_count,
+                    "mean_ns": histogram.total_ns / histogram.total_count,
+                }
+                for p, name in LATENCY_PERCENTILES:
+                    result[name] = histogram.percentile(p)
+                result.update(
+                    {
+                        "p99_ns_stdev": statistics.stdev(round_p99s) if len(round_p99s) > 1 else 0.0,
+                        "max_ns": histogram.max_ns,
+                        "gc_collections": len(gc_pauses_ns),
+                        "gc_pause_max_ns": max(gc_pauses_ns, default=0),
+                        "gc_pause_ns_per_op": gc_pause_ns_per_op,
+                        "gc_pause_ns_per_op_attributable": max(0.0, gc_pause_ns_per_op - churn_gc_pause_ns_per_op),
+                        "gc_time_fraction": sum(gc_pauses_ns) / sum(r.elapsed_ns for r in rounds),
+                        "gc_tracked_objects_per_op": count_gc_tracked_objects(fn),
+                        "histogram": histogram.as_list(),
+                    }
+                )
+                results.append(result)
+                print(
+                    f"{result_key(result):<48} p50 {result['p50_ns']:>10} p99 {result['p99_ns']:>10}"
+                    f" p99.9 {result['p99_9_ns']:>10} ns  GC {gc_pause_ns_per_op:>10.1f} ns/op",
+                    file=sys.stderr,
+                )
+    return results, churn_gc_pause_ns_per_op
+
+
+# Build and startup benchmarks. These generate .proto files with increasing
+# numbers of messages and enums, and measure how long each stage of building and
+# loading a module takes: generating code (protoc for upb, compile.py's code
+# generation for pbcc), compiling the C++ source, and importing the module in a
+# fresh interpreter (for pbcc, PyInit, which readies every type and creates an
+# IntEnum for every enum; for upb, building the descriptor pool). The size of
+# the built module is also reported. Unlike the other modes, these results
+# don't depend on the sample messages, so --shapes is ignored.
+
+# Fraction of each generated schema's types that are enums
+SCHEMA_ENUM_FRACTION = 0.1
+
+
+def generate_schema(name: str, num_types: int, seed: int) -> str:
+    """Returns the source of a .proto file defining num_types messages and
+    enums. Each message has a mix of scalar, repeated, map, enum, and
+    submessage fields, and some have oneofs. Submessage fields only refer to
+    earlier messages, so there are no cycles."""
+    rng = random.Random(f"{seed}:{name}")
+    num_enums = max(1, int(num_types * SCHEMA_ENUM_FRACTION))
+    num_messages = max(1, num_types - num_enums)
+    scalar_types = ("int32", "int64", "uint32", "sint64", "fixed32", "double", "float", "bool", "string", "bytes")
+
+    lines = ['syntax = "proto3";', "", f"package {name};", ""]
+    for z in range(num_enums):
+        lines.append(f"enum Enum{z} {{")
+        for v in range(rng.randint(2, 8)):
+            lines.append(f"    E{z}_VALUE{v} = {v};")
+        lines.append("}")
+    for z in range(num_messages):
+        fields: list[str] = []
+        field_num = 1
+        for _ in range(rng.randint(3, 10)):
+            fields.append(f"{rng.choice(scalar_types)} f{field_num} = {field_num};")
+            field_num += 1
+        if rng.random() < 0.5:
+            fields.append(f"repeated {rng.choice(scalar_types)} f{field_num} = {field_num};")
+            field_num += 1
+        if rng.random() < 0.3:
+            fields.append(f"Enum{rng.randrange(num_enums)} f{field_num} = {field_num};")
+            field_num += 1
+        if rng.random() < 0.2:
+            fields.append(f"map<string, int64> f{field_num} = {field_num};")
+            field_num += 1
+        if z > 0 and rng.random() < 0.5:
+            # Optional, since pbcc constructs default values for singular
+            # submessage fields
+            fields.append(f"optional Message{rng.randrange(z)} f{field_num} = {field_num};")
+            field_num += 1
+        if rng.random() < 0.1:
+            oneof_fields = [f"int64 f{field_num} = {field_num};", f"string f{field_num + 1} = {field_num + 1};"]
+            fields.append("oneof choice { " + " ".join(oneof_fields) + " }")
+            field_num += 2
+        lines.append(f"message Message{z} {{")
+        lines.extend(f"    {field}" for field in fields)
+        lines.append("}")
+    lines.append("")
+    return "\n".join(lines)
+
+
+def time_import(module_name: str, path: str) -> float:
+    """Returns the time taken to import a module in a fresh interpreter. The
+    modules that any pb2 module imports are imported before timing."""
+    code = (
+        "import importlib, time\n"
+        "from google.protobuf.internal import builder\n"
+        "start = time.perf_counter()\n"
+        f"importlib.import_module({module_name!r})\n"
+        "print(time.perf_counter() - start)\n"
+    )
+    env = {**os.environ, "PYTHONPATH": os.pathsep.join((path, os.environ.get("PYTHONPATH", "")))}
+    return float(subprocess.check_output((sys.executable, "-c", code), env=env, cwd=path))
+
+
+def run_build_benchmarks(
+    schema_sizes: Sequence[int],
+    implementations: Sequence[str],
+    operations: Sequence[str],
+    repeats: int,
+    seed: int,
+) -> list[dict[str, Any]]:
+    schema_dir = os.path.join(BENCH_DIR, BUILD_DIR_NAME, "schemas")
+    os.makedirs(schema_dir, exist_ok=True)
+    if schema_dir not in sys.path:
+        sys.path.insert(0, schema_dir)
+
+    results: list[dict[str, Any]] = []
+
+    def add_result(shape: str, operation: str, implementation: str, values: Sequence[float], unit: str) -> None:
+        result: dict[str, Any] = {
+            "shape": shape,
+            "operation": operation,
+            "implementation": implementation,
+            "repeats": len(values),
+            "value": statistics.mean(values),
+            "value_stdev": statistics.stdev(values) if len(values) > 1 else 0.0,
+            "value_min": min(values),
+            "unit": unit,
+        }
+        results.append(result)
+        print(f"{result_key(result):<48} {result['value']:>14.3f} {unit}", file=sys.stderr)
+
+    for num_types in schema_sizes:
+        shape = f"schema_{num_types}"
+        with open(os.path.join(schema_dir, f"{shape}.proto"), "wt") as f:
+            f.write(generate_schema(shape, num_types, seed))
+        pb2_module_name = f"{shape}_pb2"
+        pbcc_module_name = f"{shape}_pbcc"
+
+        # protoc is always run, since both implementations need the pb2 module
+        protoc_times: list[float] = []
+        for _ in range(repeats if ("upb" in implementations and "codegen" in operations) else 1):
+            start = time.perf_counter()
+            subprocess.check_call(
+                (sys.executable, "-m", "grpc_tools.protoc", "-I.", f"{shape}.proto", "--python_out=."),
+                cwd=schema_dir,
+            )
+            protoc_times.append(time.perf_counter() - start)
+        if "upb" in implementations:
+            if "codegen" in operations:
+                add_result(shape, "codegen", "upb", protoc_times, "s")
+            if "module_size" in operations:
+                add_result(
+                    shape,
+                    "module_size",
+                    "upb",
+                    [os.path.getsize(os.path.join(schema_dir, f"{pb2_module_name}.py"))],
+                    "bytes",
+                )
+            if "import" in operations:
+                add_result(
+                    shape, "import", "upb", [time_import(pb2_module_name, schema_dir) for _ in range(repeats)], "s"
+                )
+
+        if "pbcc" not in implementations:
+            continue
+        # compile_modules names the extension module after the output path,
+        # so it must be run from the schema directory
+        importlib.import_module(pb2_module_name)
+        prev_cwd = os.getcwd()
+        os.chdir(schema_dir)
+        try:
+            codegen_times: list[float] = []
+            cc_filenames: list[str] = []
+            for _ in range(repeats if "codegen" in operations else 1):
+                start = time.perf_counter()
+                with contextlib.redirect_stdout(io.StringIO()):
+                    cc_filenames = asyncio.run(
+                        compile_modules(pbcc_module_name, [pb2_module_name], compile_cc=False)
+                    )
+                codegen_times.append(time.perf_counter() - start)
+            if "codegen" in operations:
+                add_result(shape, "codegen", "pbcc", codegen_times, "s")
+
+            # The C++ compiler is only run once, since it dominates the time
+            # for large schemas
+            start = time.perf_counter()
+            with contextlib.redirect_stdout(sys.stderr):
+                asyncio.run(compile_extension_module(cc_filenames, f"{pbcc_module_name}.so"))
+            if "compile" in operations:
+                add_result(shape, "compile", "pbcc", [time.perf_counter() - start], "s")
+        finally:
+            os.chdir(prev_cwd)
+        if "module_size" in operations:
+            add_result(
+                shape,
+                "module_size",
+                "pbcc",
+                [os.path.getsize(os.path.join(schema_dir, f"{pbcc_module_name}.so"))],
+                "bytes",
+            )
+        if "import" in operations:
+            add_result(
+                shape, "import", "pbcc", [time_import(pbcc_module_name, schema_dir) for _ in range(repeats)], "s"
+            )
+    return results
+
+
+# Multi-thread scaling benchmarks. For each thread count, every thread (or
+# subinterpreter) runs the same number of operations on its own copy of the
+# sample, starting at the same moment, and the throughput is the total number
+# of messages processed divided by the wall time until the last one finishes.
+# Scaling efficiency is that throughput divided by the thread count times the
+# single-thread throughput. Contention is estimated from each thread's CPU time
+# (time.thread_time): a thread waiting for the GIL or a lock sleeps rather than
+# spinning, so the CPU utilization (total CPU time / (threads * wall time)) is
+# about 1/threads when the GIL serializes everything, and approaches 1 when the
+# threads really run in parallel (in a free-threaded build, or with
+# subinterpreters that each have their own GIL).
+#
+# Neither implementation has a native batch API, so the batch operations parse
+# or serialize SCALING_BATCH_SIZE messages per call in a Python loop, which is
+# how a batch-processing worker would use them; their throughput is per
+# message.
+#
+# Subinterpreters use concurrent.futures.InterpreterPoolExecutor (Python
+# 3.14+). Each interpreter imports the benchmark modules itself, so this fails
+# if a module doesn't support being loaded in a subinterpreter; the error is
+# reported and those benchmarks are skipped.
+
+SCALING_BATCH_SIZE = 100
+
+# Time allowed for all threads or interpreters to be ready before they start
+SCALING_START_DELAY = 0.1
+
+
+def default_thread_counts() -> list[int]:
+    """Returns 1, 2, 4, ... up to the number of CPUs, and that number."""
+    num_cpus = os.cpu_count() or 1
+    ret = [1]
+    while ret[-1] * 2 <= num_cpus:
+        ret.append(ret[-1] * 2)
+    if ret[-1] != num_cpus:
+        ret.append(num_cpus)
+    return ret
+
+
+def scaling_operation_fn(sample: Sample, implementation: str, operation: str) -> Callable[[], Any]:
+    """Returns a function that performs one operation (or one batch) on a
+    private copy of the sample, so threads don't share any objects."""
+    # bytes(data) would return the same object
+    data = bytes(bytearray(sample.data))
+    if implementation == "pbcc":
+        cls = sample.pbcc_cls
+        msg = cls.from_proto_data(data)
+        parse: Callable[[bytes], Any] = cls.from_proto_data
+        serialize: Callable[[Any], bytes] = cls.as_proto_data
+    elif implementation == "upb":
+        cls = sample.pb_cls
+        msg = cls.FromString(data)
+        parse = cls.FromString
+        serialize = cls.SerializeToString
+    else:
+        raise ValueError(f"Unknown implementation: {implementation}")
+
+    batch_data = [bytes(bytearray(data)) for _ in range(SCALING_BATCH_SIZE)]
+    batch_msgs = [parse(d) for d in batch_data]
+    fns: dict[str, Callable[[], Any]] = {
+        "parse": lambda: parse(data),
+        "serialize": lambda: serialize(msg),
+        "parse_batch": lambda: [parse(d) for d in batch_data],
+        "serialize_batch": lambda: [serialize(m) for m in batch_msgs],
+    }
+    return fns[operation]
+
+
+@dataclasses.dataclass(kw_only=True)
+class ScalingWorkerResult:
+    start_ns: int
+    end_ns: int
+    cpu_ns: int
+
+
+def run_scaling_worker(fn: Callable[[], Any], iterations: int, start_at_ns: int) -> ScalingWorkerResult:
+    """Waits until start_at_ns (in time.perf_counter_ns, which is the same
+    clock in all threads and interpreters), then calls fn iterations times."""
+    fn()
+    delay_ns = start_at_ns - time.perf_counter_ns()
+    if delay_ns > 0:
+        time.sleep(delay_ns / 1e9)
+    cpu_start_ns = time.thread_time_ns()
+    start_ns = time.perf_counter_ns()
+    time_loop(fn, iterations)
+    end_ns = time.perf_counter_ns()
+    return ScalingWorkerResult(start_ns=start_ns, end_ns=end_ns, cpu_ns=time.thread_time_ns() - cpu_start_ns)
+
+
+def run_scaling_worker_in_interpreter(
+    shape_name: str, implementation: str, operation: str, iterations: int, start_at_ns: int, seed: int
+) -> tuple[int, int, int]:
+    """Runs run_scaling_worker in a subinterpreter, which has to import the
+    benchmark modules and make the sample itself."""
+    pb2_modules, pbcc = load_bench_modules()
+    (sample,) = make_samples(pb2_modules, pbcc, all_shapes(pb2_modules), [shape_name], seed)
+    gc.disable()
+    r = run_scaling_worker(scaling_operation_fn(sample, implementation, operation), iterations, start_at_ns)
+    # Objects are shared between interpreters by pickling, so return a tuple
+    # rather than a dataclass defined in this module
+    return r.start_ns, r.end_ns, r.cpu_ns
+
+
+def run_scaling_round(
+    executor: str,
+    sample: Sample,
+    implementation: str,
+    operation: str,
+    num_threads: int,
+    iterations: int,
+    seed: int,
+) -> list[ScalingWorkerResult]:
+    start_at_ns = time.perf_counter_ns() + int(SCALING_START_DELAY * 1e9) * num_threads
+    if executor == "threads":
+        fns = [scaling_operation_fn(sample, implementation, operation) for _ in range(num_threads)]
+        results: list[ScalingWorkerResult | None] = [None] * num_threads
+
+        def thread_main(z: int) -> None:
+            results[z] = run_scaling_worker(fns[z], iterations, start_at_ns)
+
+        threads = [threading.Thread(target=thread_main, args=(z,)) for z in range(num_threads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        if any(r is None for r in results):
+            raise RuntimeError("A benchmark thread failed")
+        return [r for r in results if r is not None]
+
+    elif executor == "subinterpreters":
+        with concurrent.futures.InterpreterPoolExecutor(max_workers=num_threads) as pool:  # type: ignore[attr-defined]
+            futures = [
+                pool.submit(
+                    run_scaling_worker_in_interpreter,
+                    sample.shape,
+                    implementation,
+                    operation,
+                    iterations,
+                    start_at_ns,
+                    seed,
+                )
+                for _ in range(num_threads)
+            ]
+            return [
+                ScalingWorkerResult(start_ns=start_ns, end_ns=end_ns, cpu_ns=cpu_ns)
+                for start_ns, end_ns, cpu_ns in (f.result() for f in futures)
+            ]
+
+    else:
+        raise ValueError(f"Unknown executor: {executor}")
+
+
+def run_scaling_benchmarks(
+    samples: Sequence[Sample],
+    implementations: Sequence[str],
+    operations: Sequence[str],
+    executors: Sequence[str],
+    thread_counts: Sequence[int],
+    min_time: float,
+    repeats: int,
+    seed: int,
+) -> list[dict[str, Any]]:
+    results: list[dict[str, Any]] = []
+    gc_was_enabled = gc.isenabled()
+    gc.disable()
+    try:
+        for sample in samples:
+            for operation in operations:
+                messages_per_call = SCALING_BATCH_SIZE if operation.endswith("_batch") else 1
+                for implementation in implementations:
+                    # Each thread runs as many operations as one thread can run
+                    # in about min_time
+                    fn = scaling_operation_fn(sample, implementation, operation)
+                    iterations = time_operation(fn, min_time, 1).iterations
+                    for executor in executors:
+                        single_thread_ops_per_sec: float | None = None
+                        for num_threads in thread_counts:
+                            try:
+                                rounds = [
+                                    run_scaling_round(
+                                        executor, sample, implementation, operation, num_threads, iterations, seed
+                                    )
+                                    for _ in range(repeats)
+                                ]
+                            except Exception as e:
+                                print(
+                                    f"{sample.shape}/{operation}/{implementation}: {executor} failed: {e!r}",
+                                    file=sys.stderr,
+                                )
+                                break
+
+                            num_messages = num_threads * iterations * messages_per_call
+                            ns_per_op_samples: list[float] = []
+                            utilizations: list[float] = []
+                            for r in rounds:
+                                wall_ns = max(w.end_ns for w in r) - min(w.start_ns for w in r)
+                                ns_per_op_samples.append(wall_ns / num_messages)
+                                utilizations.append(sum(w.cpu_ns for w in r) / (num_threads * wall_ns))
+                            ns_per_op = statistics.mean(ns_per_op_samples)
+                            ops_per_sec = 1e9 / ns_per_op
+                            if num_threads == 1:
+                                single_thread_ops_per_sec = ops_per_sec
+                            result: dict[str, Any] = {
+                                "shape": sample.shape,
+                                "operation": operation,
+                                "implementation": implementation,
+                                "executor": executor,
+                                "threads": num_threads,
+                                "encoded_size": len(sample.data),
+                                "iterations": iterations,
+                                "repeats": repeats,
+                                "ns_per_op": ns_per_op,
+                                "ns_per_op_stdev": (
+                                    statistics.stdev(ns_per_op_samples) if len(ns_per_op_samples) > 1 else 0.0
+                                ),
+                                "ops_per_sec": ops_per_sec,
+                                "bytes_per_sec": len(sample.data) * ops_per_sec,
+                                "speedup": (
+                                    ops_per_sec / single_thread_ops_per_sec if single_thread_ops_per_sec else None
+                                ),
+                                "scaling_efficiency": (
+                                    ops_per_sec / (num_threads * single_thread_ops_per_sec)
+                                    if single_thread_ops_per_sec
+                                    else None
+                                ),
+                                "cpu_utilization": statistics.mean(utilizations),
+                            }
+                            results.append(result)
+                            efficiency = result["scaling_efficiency"]
+                            print(
+                                f"{result_key(result):<64} {ops_per_sec:>14.0f} msg/s"
+                                + (f"  efficiency {efficiency:>6.1%}" if efficiency is not None else "")
+                                + f"  CPU {result['cpu_utilization']:>6.1%}",
+                                file=sys.stderr,
+                            )
+    finally:
+        if gc_was_enabled:
+            gc.enable()
+    return results
+
+
+# For each mode, the result field that --compare checks, the field with its
+# standard deviation, and its unit. Larger values are worse for all modes.
+MODE_METRICS: dict[str, tuple[str, str, str]] = {
+    "speed": ("ns_per_op", "ns_per_op_stdev", "ns/op"),
+    "memory": ("bytes_per_message", "bytes_per_message_stdev", "bytes/msg"),
+    "latency": ("p99_ns", "p99_ns_stdev", "ns p99"),
+    # Build results have various units, given in each result
+    "build": ("value", "value_stdev", ""),
+    "scaling": ("ns_per_op", "ns_per_op_stdev", "ns/msg"),
+}
+
+
+def format_summary(results: Sequence[dict[str, Any]], mode: str) -> list[str]:
+    """Returns a table comparing pbcc with upb for each shape and operation."""
+    metric = MODE_METRICS[mode][0]
+    values = {result_key(r): r[metric] for r in results}
+    values_gc = {result_key(r): r.get("gc_pause_ns_per_op_attributable") for r in results}
+    results_by_key = {result_key(r): r for r in results}
+    lines: list[str] = []
+    for r in results:
+        if r["implementation"] != "pbcc":
+            continue
+        if mode == "scaling":
+            upb = results_by_key.get(result_key({**r, "implementation": "upb"}))
+            if upb is None or r["speedup"] is None or upb["speedup"] is None:
+                continue
+            name = f"{r['shape']}/{r['operation']}/{r['executor']}/{r['threads']}"
+            lines.append(
+                f"{name:<48} pbcc {r['speedup']:.2f}x ({r['scaling_efficiency']:.0%}),"
+                f" upb {upb['speedup']:.2f}x ({upb['scaling_efficiency']:.0%}) of 1-thread throughput"
+            )
+            continue
+        upb_value = values.get(f"{r['shape']}/{r['operation']}/upb")
+        if upb_value is None:
+            continue
+        name = r["shape"] + "/" + r["operation"]
+        if mode == "speed":
+            lines.append(f"{name:<48} pbcc is {upb_value / r[metric]:.2f}x upb")
+        elif mode == "latency":
+            upb_gc = values_gc[f"{r['shape']}/{r['operation']}/upb"]
+            lines.append(
+                f"{name:<48} pbcc's p99 is {r[metric] / upb_value:.2f}x upb's;"
+                f" GC {r['gc_pause_ns_per_op_attributable']:.1f} vs {upb_gc:.1f} ns/op attributable"
+            )
+        elif mode == "build" and upb_value > 0:
+            lines.append(
+                f"{name:<48} pbcc {r[metric]:.4g} vs upb {upb_value:.4g} {r['unit']} ({r[metric] / upb_value:.2f}x)"
+            )
+        elif upb_value > 0:
+            lines.append(f"{name:<48} pbcc uses {r[metric] / upb_value:.2f}x upb's memory")
+    return lines
+
+
+def compare_results(
+    results: Sequence[dict[str, Any]], baseline: dict[str, Any], mode: str, threshold: float
+) -> tuple[list[str], int]:
+    """Compares results with a saved baseline from the same mode. A result is a
+    regression if it is more than threshold (a fraction) worse than the
+    baseline, and the difference is larger than the combined standard
+    deviations of both runs. Only pbcc's results can regress; changes in the
+    other implementations' results are reported for information, since they
+    help to tell apart regressions from differences between machines. Returns
+    (report lines, number of regressions)."""
+    metric, stdev_metric, unit = MODE_METRICS[mode]
+    baseline_results = {result_key(r): r for r in baseline["results"]}
+    lines: list[str] = []
+    num_regressions = 0
+    for r in results:
+        key = result_key(r)
+        base = baseline_results.get(key)
+        if base is None:
+            lines.append(f"{key:<48} (not in baseline)")
+            continue
+        diff = r[metric] - base[metric]
+        ratio = (r[metric] / base[metric]) if base[metric] else math.inf if diff > 0 else 1.0
+        significant = abs(diff) > r[stdev_metric] + base[stdev_metric]
+        is_pbcc = r["implementation"] == "pbcc"
+        if ratio > 1 + threshold and significant:
+            status = "REGRESSION" if is_pbcc else "slower"
+            num_regressions += int(is_pbcc)
+        elif ratio < 1 - threshold and significant:
+            status = "improvement" if is_pbcc else "faster"
+        else:
+            status = ""
+        # Build results include seconds, which need more precision
+        fmt = ">14.4g" if mode == "build" else ">14.1f"
+        result_unit = r.get("unit", unit)
+        lines.append(
+            f"{key:<48} {base[metric]:{fmt}} -> {r[metric]:{fmt}} {result_unit} ({ratio:.3f}x) {status}".rstrip()
+        )
+    return lines, num_regressions
+
+
+def environment_metadata() -> dict[str, Any]:
+    import google.protobuf
+
+    return {
+        "python": platform.python_version(),
+        "platform": platform.platform(),
+        "machine": platform.machine(),
+        "protobuf": google.protobuf.__version__,
+        "protobuf_implementation": api_implementation.Type(),
+        "free_threaded": bool(sysconfig.get_config_var("Py_GIL_DISABLED")),
+        # Importing a module that doesn't support free threading re-enables the
+        # GIL, so this is checked after the benchmark modules are loaded
+        "gil_enabled": sys._is_gil_enabled() if hasattr(sys, "_is_gil_enabled") else True,
+        "cpu_count": os.cpu_count(),
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+    }
+
+
+def parse_list_arg(value: str | None, choices: Sequence[str], what: str) -> list[str]:
+    if not value:
+        return list(choices)
+    ret = [item.strip() for item in value.split(",") if item.strip()]
+    for item in ret:
+        if item not in choices:
+            raise ValueError(f"Unknown {what}: {item} (choices: {', '.join(choices)})")
+    return ret
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Benchmark pbcc against google.protobuf")
+    parser.add_argument(
+        "--mode",
+        type=str,
+        choices=MODES,
+        default="speed",
+        help=(
+            "what to measure: mean time per operation (speed), memory used per message (memory), or the"
+            " distribution of operations' latency with the garbage collector running (latency), the time taken to"
+            " build and import modules for generated schemas (build), or throughput with multiple threads (scaling)"
+        ),
+    )
+    parser.add_argument(
+        "--shapes",
+        type=str,
+        default=None,
+        help=(
+            "comma-separated message shapes to benchmark; the default is the shapes from bench.proto for speed"
+            f" and latency ({', '.join(BENCH_SHAPES)}), and those plus all messages from test.proto (e.g."
+            " test_primitives) for memory"
+        ),
+    )
+    parser.add_argument(
+        "--operations",
+        type=str,
+        default=None,
+        help=(
+            f"comma-separated operations to benchmark (default all: {', '.join(OPERATIONS)} for speed,"
+            f" {', '.join(MEMORY_OPERATIONS)} for memory, {', '.join(LATENCY_OPERATIONS)} for latency,"
+            f" {', '.join(BUILD_OPERATIONS)} for build, {', '.join(SCALING_OPERATIONS)} for scaling)"
+        ),
+    )
+    parser.add_argument(
+        "--implementations",
+        type=str,
+        default=None,
+        help=f"comma-separated implementations to benchmark (default all: {', '.join(IMPLEMENTATIONS)})",
+    )
+    parser.add_argument(
+        "--min-time",
+        type=float,
+        default=0.2,
+        help="approximate time in seconds for each timing round",
+    )
+    parser.add_argument(
+        "--memory-target-bytes",
+        type=int,
+        default=16 * 1024 * 1024,
+        help="in memory mode, create about this many bytes' worth of serialized messages for each measurement",
+    )
+    parser.add_argument(
+        "--latency-duration",
+        type=float,
+        default=1.0,
+        help="in latency mode, the time in seconds for each round of each benchmark",
+    )
+    parser.add_argument(
+        "--working-set",
+        type=int,
+        default=1000,
+        help="in latency mode, the number of recent results kept alive",
+    )
+    parser.add_argument(
+        "--churn-cycles",
+        type=int,
+        default=4,
+        help="in latency mode, the number of garbage reference cycles created after each operation",
+    )
+    parser.add_argument(
+        "--schema-sizes",
+        type=str,
+        default="100,1000,10000",
+        help="in build mode, comma-separated numbers of messages and enums in the generated schemas",
+    )
+    parser.add_argument(
+        "--threads",
+        type=str,
+        default=None,
+        help=(
+            "in scaling mode, comma-separated numbers of threads (default 1, 2, 4, ... up to the number of CPUs:"
+            f" {','.join(str(n) for n in default_thread_counts())})"
+        ),
+    )
+    parser.add_argument(
+        "--executors",
+        type=str,
+        default=None,
+        help=(
+            f"in scaling mode, comma-separated ways to run operations concurrently ({', '.join(SCALING_EXECUTORS)});"
+            " the default is threads, and subinterpreters if concurrent.futures.InterpreterPoolExecutor is available"
+        ),
+    )
+    parser.add_argument(
+        "--repeats",
+        type=int,
+        default=5,
+        help="number of rounds for each benchmark; the reported variance is between rounds",
+    )
+    parser.add_argument(
+        "--seed",
+        type=int,
+        default=0,
+        help="seed for generating the sample messages",
+    )
+    parser.add_argument(
+        "--output",
+        type=str,
+        default=None,
+        help="write JSON results to this file instead of stdout",
+    )
+    parser.add_argument(
+        "--compare",
+        type=str,
+        default=None,
+        help="compare results with a previous run's JSON output; exits with status 1 if any benchmark regressed",
+    )
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=0.1,
+        help="with --compare, the fractional slowdown (or memory increase) that counts as a regression",
+    )
+    parser.add_argument(
+        "--rebuild",
+        action="store_true",
+        default=False,
+        help="rebuild the benchmark module even if it's up to date",
+    )
+    args = parser.parse_args()
+
+    # See the comments about memory benchmarks above
+    if args.mode == "memory" and os.environ.get("PYTHONMALLOC") != "malloc":
+        os.execve(sys.executable, sys.orig_argv, {**os.environ, "PYTHONMALLOC": "malloc"})
+
+    baseline: dict[str, Any] | None = None
+    if args.compare:
+        with open(args.compare, "rt") as f:
+            baseline = json.load(f)
+        if baseline.get("format") != RESULTS_FORMAT:
+            parser.error(f"{args.compare} is not a pbcc benchmark result")
+        if baseline.get("mode") != args.mode:
+            parser.error(f"{args.compare} contains {baseline.get('mode')} results, not {args.mode} results")
+
+    mode_operations = {
+        "speed": OPERATIONS,
+        "memory": MEMORY_OPERATIONS,
+        "latency": LATENCY_OPERATIONS,
+        "build": BUILD_OPERATIONS,
+        "scaling": SCALING_OPERATIONS,
+    }
+    operations = parse_list_arg(args.operations, mode_operations[args.mode], "operation")
+    implementations = parse_list_arg(args.implementations, IMPLEMENTATIONS, "implementation")
+    settings: dict[str, Any] = {"repeats": args.repeats, "seed": args.seed}
+
+    if args.mode == "build":
+        try:
+            schema_sizes = [int(size) for size in args.schema_sizes.split(",")]
+        except ValueError:
+            parser.error(f"Invalid --schema-sizes: {args.schema_sizes}")
+        settings["schema_sizes"] = schema_sizes
+        results = run_build_benchmarks(schema_sizes, implementations, operations, args.repeats, args.seed)
+    else:
+        pb2_modules, pbcc = build_bench_modules(args.rebuild)
+        shapes = all_shapes(pb2_modules)
+        default_shapes = shapes if args.mode == "memory" else BENCH_SHAPES
+        shape_names = parse_list_arg(args.shapes, tuple(shapes), "shape") if args.shapes else list(default_shapes)
+        samples = make_samples(pb2_modules, pbcc, shapes, shape_names, args.seed)
+
+    if args.mode == "speed":
+        settings["min_time"] = args.min_time
+        results = run_speed_benchmarks(samples, implementations, operations, args.min_time, args.repeats)
+    elif args.mode == "memory":
+        settings["memory_target_bytes"] = args.memory_target_bytes
+        results = run_memory_benchmarks(
+            samples, pb2_modules, pbcc, implementations, operations, args.memory_target_bytes, args.repeats
+        )
+    elif args.mode == "scaling":
+        try:
+            thread_counts = [int(n) for n in args.threads.split(",")] if args.threads else default_thread_counts()
+        except ValueError:
+            parser.error(f"Invalid --threads: {args.threads}")
+        # Scaling efficiency is relative to one thread, which must run first
+        thread_counts = sorted({1, *thread_counts})
+        interpreters_available = hasattr(concurrent.futures, "InterpreterPoolExecutor")
+        if args.executors:
+            executors = parse_list_arg(args.executors, SCALING_EXECUTORS, "executor")
+            if "subinterpreters" in executors and not interpreters_available:
+                parser.error("Subinterpreters require Python 3.14 or later")
+        else:
+            executors = ["threads", "subinterpreters"] if interpreters_available else ["threads"]
+        settings["min_time"] = args.min_time
+        settings["threads"] = thread_counts
+        settings["executors"] = executors
+        settings["batch_size"] = SCALING_BATCH_SIZE
+        results = run_scaling_benchmarks(
+            samples,
+            implementations,
+            operations,
+            executors,
+            thread_counts,
+            args.min_time,
+            args.repeats,
+            args.seed,
+        )
+    elif args.mode == "latency":
+        settings["latency_duration"] = args.latency_duration
+        settings["working_set"] = args.working_set
+        settings["churn_cycles"] = args.churn_cycles
+        results, settings["churn_gc_pause_ns_per_op"] = run_latency_benchmarks(
+            samples,
+            implementations,
+            operations,
+            args.latency_duration,
+            args.working_set,
+            args.churn_cycles,
+            args.repeats,
+        )
+
+    output = {
+        "format": RESULTS_FORMAT,
+        "version": RESULTS_VERSION,
+        "mode": args.mode,
+        "environment": environment_metadata(),
+        "settings": settings,
+        "results": results,
+    }
+    if args.output:
+        with open(args.output, "wt") as f:
+            json.dump(output, f, indent=2)
+            f.write("\n")
+    else:
+        json.dump(output, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+
+    print(file=sys.stderr)
+    for line in format_summary(results, args.mode):
+        print(line, file=sys.stderr)
+
+    if baseline is not None:
+        lines, num_regressions = compare_results(results, baseline, args.mode, args.threshold)
+        print(file=sys.stderr)
+        for line in lines:
+            print(line, file=sys.stderr)
+        if num_regressions:
+            print(f"{num_regressions} benchmark(s) regressed", file=sys.stderr)
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,471 @@
+// Microbenchmarks for the wire format primitives in wire_format.h. These don't
+// involve Python at all, so changes to the primitives can be measured without
+// the noise of object allocation and the interpreter. To build and run:
+//   python -m pbcc.compile --codec-benchmark bench_codec
+//   ./bench_codec [--min-time SECONDS] [--repeats N] [FILTER...]
+// If any FILTERs are given, only benchmarks whose names contain one of them
+// are run. Each benchmark first checks that the primitives produce the
+// expected results on its data, then reports the best time per element (over
+// all rounds) and the corresponding throughput over the encoded data.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "wire_format.h"
+
+// Prevents the compiler from optimizing away a computed value
+template <typename T>
+static inline void do_not_optimize(const T& v) {
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+static constexpr size_t NUM_ELEMENTS = 4096;
+
+struct Benchmark {
+  std::string name;
+  size_t num_elements;
+  size_t num_bytes;
+  // Processes all elements once; returns a checksum of the results
+  std::function<uint64_t()> run;
+  uint64_t expected_checksum;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Data generation
+
+enum class VarintLength {
+  ONE_BYTE,
+  TWO_BYTES,
+  FIVE_BYTES,
+  TEN_BYTES,
+  MIXED,
+};
+
+static uint64_t random_varint_value(std::mt19937_64& rng, VarintLength length) {
+  uint64_t v = rng();
+  switch (length) {
+    case VarintLength::ONE_BYTE:
+      return v & 0x7F;
+    case VarintLength::TWO_BYTES:
+      return 0x80 | (v & 0x3FFF);
+    case VarintLength::FIVE_BYTES:
+      return (1ULL << 28) | (v & 0x7FFFFFFFFULL);
+    case VarintLength::TEN_BYTES:
+      return (1ULL << 63) | v;
+    case VarintLength::MIXED: {
+      // Uniformly distributed bit length, so all encoded lengths appear
+      size_t bits = rng() % 65;
+      return (bits == 64) ? v : (v & ((1ULL << bits) - 1));
+    }
+  }
+  return v;
+}
+
+static std::vector<uint64_t> random_varint_values(std::mt19937_64& rng, VarintLength length) {
+  std::vector<uint64_t> ret;
+  ret.reserve(NUM_ELEMENTS);
+  for (size_t z = 0; z < NUM_ELEMENTS; z++) {
+    ret.emplace_back(random_varint_value(rng, length));
+  }
+  return ret;
+}
+
+static uint64_t checksum_values(const std::vector<uint64_t>& values) {
+  uint64_t ret = 0;
+  for (uint64_t v : values) {
+    ret = ret * 31 + v;
+  }
+  return ret;
+}
+
+// Returns a message containing fields 1-16 with a mix of wire types, repeated
+// NUM_ELEMENTS / 16 times. Fields 1-8 are varints, 9-10 are INT32, 11-12 are
+// INT64, and 13-16 are LENGTH
+static std::string mixed_fields_message(std::mt19937_64& rng) {
+  StringWriter w;
+  for (size_t z = 0; z < NUM_ELEMENTS / 16; z++) {
+    for (uint64_t field_num = 1; field_num <= 16; field_num++) {
+      if (field_num <= 8) {
+        encode_varint(w, encode_tag(field_num, WireType::VARINT));
+        encode_varint(w, random_varint_value(rng, VarintLength::MIXED));
+      } else if (field_num <= 10) {
+        encode_varint(w, encode_tag(field_num, WireType::INT32));
+        w.put_u32l(rng());
+      } else if (field_num <= 12) {
+        encode_varint(w, encode_tag(field_num, WireType::INT64));
+        w.put_u64l(rng());
+      } else {
+        encode_varint(w, encode_tag(field_num, WireType::LENGTH));
+        std::string s(rng() % 48, 'x');
+        encode_varint(w, s.size());
+        w.write(s);
+      }
+    }
+  }
+  return std::move(w.str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+static const char* name_for_varint_length(VarintLength length) {
+  switch (length) {
+    case VarintLength::ONE_BYTE:
+      return "1B";
+    case VarintLength::TWO_BYTES:
+      return "2B";
+    case VarintLength::FIVE_BYTES:
+      return "5B";
+    case VarintLength::TEN_BYTES:
+      return "10B";
+    case VarintLength::MIXED:
+      return "mixed";
+  }
+  return "__UNKNOWN__";
+}
+
+static void add_varint_benchmarks(std::vector<Benchmark>& benchmarks, std::mt19937_64& rng) {
+  for (auto length : {VarintLength::ONE_BYTE, VarintLength::TWO_BYTES, VarintLength::FIVE_BYTES, VarintLength::TEN_BYTES, VarintLength::MIXED}) {
+    auto values = std::make_shared<std::vector<uint64_t>>(random_varint_values(rng, length));
+    auto data = std::make_shared<StringWriter>();
+    for (uint64_t v : *values) {
+      encode_varint(*data, v);
+    }
+    uint64_t expected = checksum_values(*values);
+
+    benchmarks.emplace_back(Benchmark{
+        .name = string_printf("decode_varint/%s", name_for_varint_length(length)),
+        .num_elements = values->size(),
+        .num_bytes = data->size(),
+        .run = [data]() -> uint64_t {
+          StringReader r(data->str().data(), data->size());
+          uint64_t ret = 0;
+          while (!r.eof()) {
+            ret = ret * 31 + decode_varint(r);
+          }
+          return ret;
+        },
+        .expected_checksum = expected,
+    });
+
+    auto w = std::make_shared<StringWriter>();
+    benchmarks.emplace_back(Benchmark{
+        .name = string_printf("encode_varint/%s", name_for_varint_length(length)),
+        .num_elements = values->size(),
+        .num_bytes = data->size(),
+        .run = [values, w]() -> uint64_t {
+          w->truncate(0);
+          for (uint64_t v : *values) {
+            encode_varint(*w, v);
+          }
+          do_not_optimize(w->str().data());
+          return w->size();
+        },
+        .expected_checksum = data->size(),
+    });
+  }
+}
+
+static void add_zigzag_benchmarks(std::vector<Benchmark>& benchmarks, std::mt19937_64& rng) {
+  auto values = std::make_shared<std::vector<int64_t>>();
+  for (size_t z = 0; z < NUM_ELEMENTS; z++) {
+    // Small magnitudes of both signs, which is what sint fields are for
+    values->emplace_back(static_cast<int64_t>(rng() % 200001) - 100000);
+  }
+  auto data = std::make_shared<StringWriter>();
+  uint64_t expected = 0;
+  for (int64_t v : *values) {
+    encode_varint_signed64(*data, v);
+    expected = expected * 31 + static_cast<uint64_t>(v);
+  }
+
+  benchmarks.emplace_back(Benchmark{
+      .name = "decode_varint_signed",
+      .num_elements = values->size(),
+      .num_bytes = data->size(),
+      .run = [data]() -> uint64_t {
+        StringReader r(data->str().data(), data->size());
+        uint64_t ret = 0;
+        while (!r.eof()) {
+          ret = ret * 31 + static_cast<uint64_t>(decode_varint_signed(r));
+        }
+        return ret;
+      },
+      .expected_checksum = expected,
+  });
+
+  auto w = std::make_shared<StringWriter>();
+  benchmarks.emplace_back(Benchmark{
+      .name = "encode_varint_signed64",
+      .num_elements = values->size(),
+      .num_bytes = data->size(),
+      .run = [values, w]() -> uint64_t {
+        w->truncate(0);
+        for (int64_t v : *values) {
+          encode_varint_signed64(*w, v);
+        }
+        do_not_optimize(w->str().data());
+        return w->size();
+      },
+      .expected_checksum = data->size(),
+  });
+}
+
+// Packed runs are parsed as the generated code does: read the tag and length,
+// make a sub-reader for the payload, and decode items until it's exhausted
+static void add_packed_benchmarks(std::vector<Benchmark>& benchmarks, std::mt19937_64& rng) {
+  auto values = random_varint_values(rng, VarintLength::MIXED);
+  uint64_t expected = checksum_values(values);
+  auto make_packed_field = [](const StringWriter& payload) {
+    auto ret = std::make_shared<StringWriter>();
+    encode_varint(*ret, encode_tag(1, WireType::LENGTH));
+    encode_varint(*ret, payload.size());
+    ret->write(payload.str());
+    return ret;
+  };
+
+  StringWriter varint_payload, fixed32_payload, fixed64_payload;
+  uint64_t expected32 = 0;
+  for (uint64_t v : values) {
+    encode_varint(varint_payload, v);
+    fixed32_payload.put_u32l(static_cast<uint32_t>(v));
+    fixed64_payload.put_u64l(v);
+    expected32 = expected32 * 31 + static_cast<uint32_t>(v);
+  }
+
+  auto varint_data = make_packed_field(varint_payload);
+  benchmarks.emplace_back(Benchmark{
+      .name = "packed/varint",
+      .num_elements = values.size(),
+      .num_bytes = varint_data->size(),
+      .run = [varint_data]() -> uint64_t {
+        StringReader r(varint_data->str().data(), varint_data->size());
+        decode_varint(r);
+        StringReader sub_r = r.subx(r.where(), decode_varint(r));
+        uint64_t ret = 0;
+        while (!sub_r.eof()) {
+          ret = ret * 31 + decode_varint(sub_r);
+        }
+        return ret;
+      },
+      .expected_checksum = expected,
+  });
+
+  auto fixed32_data = make_packed_field(fixed32_payload);
+  benchmarks.emplace_back(Benchmark{
+      .name = "packed/fixed32",
+      .num_elements = values.size(),
+      .num_bytes = fixed32_data->size(),
+      .run = [fixed32_data]() -> uint64_t {
+        StringReader r(fixed32_data->str().data(), fixed32_data->size());
+        decode_varint(r);
+        StringReader sub_r = r.subx(r.where(), decode_varint(r));
+        uint64_t ret = 0;
+        while (!sub_r.eof()) {
+          ret = ret * 31 + sub_r.get_u32l();
+        }
+        return ret;
+      },
+      .expected_checksum = expected32,
+  });
+
+  auto fixed64_data = make_packed_field(fixed64_payload);
+  benchmarks.emplace_back(Benchmark{
+      .name = "packed/fixed64",
+      .num_elements = values.size(),
+      .num_bytes = fixed64_data->size(),
+      .run = [fixed64_data]() -> uint64_t {
+        StringReader r(fixed64_data->str().data(), fixed64_data->size());
+        decode_varint(r);
+        StringReader sub_r = r.subx(r.where(), decode_varint(r));
+        uint64_t ret = 0;
+        while (!sub_r.eof()) {
+          ret = ret * 31 + sub_r.get_u64l();
+        }
+        return ret;
+      },
+      .expected_checksum = expected,
+  });
+}
+
+// Tag dispatch decodes each field's tag and switches on its field number, as
+// the generated parse loop does; skipping only looks at the wire type
+static void add_field_benchmarks(std::vector<Benchmark>& benchmarks, std::mt19937_64& rng) {
+  auto data = std::make_shared<std::string>(mixed_fields_message(rng));
+
+  // Both benchmarks count the fields they see, so they can check each other
+  uint64_t expected = NUM_ELEMENTS;
+
+  benchmarks.emplace_back(Benchmark{
+      .name = "tag_dispatch",
+      .num_elements = NUM_ELEMENTS,
+      .num_bytes = data->size(),
+      .run = [data]() -> uint64_t {
+        StringReader r(data->data(), data->size());
+        uint64_t num_fields = 0;
+        uint64_t sum = 0;
+        while (!r.eof()) {
+          uint64_t tag = decode_varint(r);
+          switch (field_num_for_tag(tag)) {
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+            case 5:
+            case 6:
+            case 7:
+            case 8:
+              sum += decode_varint(r);
+              break;
+            case 9:
+            case 10:
+              sum += r.get_u32l();
+              break;
+            case 11:
+            case 12:
+              sum += r.get_u64l();
+              break;
+            case 13:
+            case 14:
+            case 15:
+            case 16: {
+              size_t size = decode_varint(r);
+              sum += reinterpret_cast<uintptr_t>(r.getv(size));
+              break;
+            }
+            default:
+              skip_field(r, wire_type_for_tag(tag));
+          }
+          num_fields++;
+        }
+        do_not_optimize(sum);
+        return num_fields;
+      },
+      .expected_checksum = expected,
+  });
+
+  benchmarks.emplace_back(Benchmark{
+      .name = "skip_field",
+      .num_elements = NUM_ELEMENTS,
+      .num_bytes = data->size(),
+      .run = [data]() -> uint64_t {
+        StringReader r(data->data(), data->size());
+        uint64_t num_fields = 0;
+        while (!r.eof()) {
+          skip_field(r, wire_type_for_tag(decode_varint(r)));
+          num_fields++;
+        }
+        return num_fields;
+      },
+      .expected_checksum = expected,
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Runner
+
+static double now_ns() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the best time per element over all rounds, in nanoseconds
+static double time_benchmark(const Benchmark& b, double min_time, size_t repeats) {
+  // Find how many iterations take about min_time
+  size_t iterations = 1;
+  for (;;) {
+    double start = now_ns();
+    for (size_t z = 0; z < iterations; z++) {
+      do_not_optimize(b.run());
+    }
+    double elapsed = now_ns() - start;
+    if (elapsed >= min_time * 1e8) { // 10% of min_time
+      iterations = std::max<size_t>(1, static_cast<size_t>(iterations * min_time * 1e9 / elapsed));
+      break;
+    }
+    iterations *= 2;
+  }
+
+  double best_ns = 0.0;
+  for (size_t round = 0; round < repeats; round++) {
+    double start = now_ns();
+    for (size_t z = 0; z < iterations; z++) {
+      do_not_optimize(b.run());
+    }
+    double ns = (now_ns() - start) / (iterations * b.num_elements);
+    if ((round == 0) || (ns < best_ns)) {
+      best_ns = ns;
+    }
+  }
+  return best_ns;
+}
+
+static bool name_matches_filters(const std::string& name, const std::vector<std::string>& filters) {
+  if (filters.empty()) {
+    return true;
+  }
+  for (const auto& filter : filters) {
+    if (name.find(filter) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  double min_time = 0.1;
+  size_t repeats = 5;
+  std::vector<std::string> filters;
+  for (int z = 1; z < argc; z++) {
+    if (!strcmp(argv[z], "--min-time") && (z + 1 < argc)) {
+      min_time = atof(argv[++z]);
+    } else if (!strcmp(argv[z], "--repeats") && (z + 1 < argc)) {
+      repeats = strtoull(argv[++z], nullptr, 0);
+    } else if (argv[z][0] == '-') {
+      fprintf(stderr, "Usage: %s [--min-time SECONDS] [--repeats N] [FILTER...]\n", argv[0]);
+      return 2;
+    } else {
+      filters.emplace_back(argv[z]);
+    }
+  }
+  if ((min_time <= 0.0) || (repeats == 0)) {
+    fprintf(stderr, "--min-time and --repeats must be positive\n");
+    return 2;
+  }
+
+  std::mt19937_64 rng(0);
+  std::vector<Benchmark> benchmarks;
+  add_varint_benchmarks(benchmarks, rng);
+  add_zigzag_benchmarks(benchmarks, rng);
+  add_packed_benchmarks(benchmarks, rng);
+  add_field_benchmarks(benchmarks, rng);
+
+  int ret = 0;
+  for (const auto& b : benchmarks) {
+    if (!name_matches_filters(b.name, filters)) {
+      continue;
+    }
+    uint64_t checksum = b.run();
+    if (checksum != b.expected_checksum) {
+      fprintf(stderr, "%-28s FAILED: checksum is %016" PRIX64 ", expected %016" PRIX64 "\n",
+          b.name.c_str(), checksum, b.expected_checksum);
+      ret = 1;
+      continue;
+    }
+    double ns = time_benchmark(b, min_time, repeats);
+    double bytes_per_element = static_cast<double>(b.num_bytes) / b.num_elements;
+    fprintf(stdout, "%-28s %10.3f ns/elem %10.1f MB/s %8.2f bytes/elem\n",
+        b.name.c_str(), ns, bytes_per_element * 1e3 / ns, bytes_per_element);
+    fflush(stdout);
+  }
+  return ret;
+}
@@ -3,12 +3,17 @@ from __future__ import annotations
 import argparse
 import asyncio
 import collections
+import contextlib
 import dataclasses
 import enum
+import hashlib
 import importlib
+import io
+import json
 import logging
 import os
 import re
+import shutil
 import sys
 import tempfile
 from typing import Any, Awaitable, Iterable, Literal, Sequence, cast
@@ -24,6 +29,9 @@ from google.protobuf.descriptor import (
 
 from .async_utils import check_call_async, check_output_async
 
+# The directory containing pymodule.in.cc and the headers it includes
+PBCC_SOURCE_DIR = os.path.dirname(os.path.abspath(__file__))
+
 
 class DataType(enum.Enum):
     FLOAT = enum.auto()
@@ -46,6 +54,15 @@ class DataType(enum.Enum):
     MESSAGE = enum.auto()
 
 
+FIXED_WIDTH_DATA_TYPES: set[DataType] = {
+    DataType.FLOAT,
+    DataType.DOUBLE,
+    DataType.FIXED32,
+    DataType.SFIXED32,
+    DataType.FIXED64,
+    DataType.SFIXED64,
+}
+
 DATA_TYPE_FOR_DESCRIPTOR_TYPE: dict[int, DataType] = {
     FieldDescriptor.TYPE_FLOAT: DataType.FLOAT,
     FieldDescriptor.TYPE_DOUBLE: DataType.DOUBLE,
@@ -126,7 +143,8 @@ class EnumInfo:
 
 @dataclasses.dataclass(kw_only=True)
 class FieldInfo:
-    py_name: str
+    py_name: str  # The name of the field group (attribute) this field belongs to
+    name: str  # The field's own name, which differs from py_name for oneof members
     is_optional: bool
     is_repeated: bool
     data_type: DataType
@@ -248,6 +266,15 @@ class MessageInfo:
     field_groups: dict[str, list[FieldInfo]] = dataclasses.field(default_factory=lambda: collections.defaultdict(list))
     map_types: tuple[FieldInfo, FieldInfo] | None  # If not None, this message is a map entry message
 
+    @property
+    def is_fixed_width_only(self) -> bool:
+        # True if every field is a non-repeated fixed-width scalar (not part of a
+        # oneof), so the message can be parsed with the fixed-width fast path
+        return (len(self.field_groups) > 0) and all(
+            (len(fields) == 1) and not fields[0].is_repeated and (fields[0].data_type in FIXED_WIDTH_DATA_TYPES)
+            for fields in self.field_groups.values()
+        )
+
     def pyi_source_lines(self, indent_level: int = 0) -> list[str]:
         indent_str = "    " * indent_level
         cc_cls_name = cc_name_for_python_name(self.name)
@@ -281,23 +308,126 @@ class MessageInfo:
             f"    def from_proto_data(data: bytes, retain_unknown_fields: bool = True, ignore_incorrect_types: bool = False) -> {namespaced_name}: ..."
         )
         add_line(
-            "    def parse_proto_into_this(self, data: bytes, retain_unknown_fields: bool = True, ignore_incorrect_types: bool = False) -> None: ..."
+            "    def parse_proto_into_this(self, data: bytes, retain_unknown_fields: bool = True, ignore_incorrect_types: bool = False, reuse: bool = False) -> None: ..."
         )
+        add_line("    def clear(self) -> None: ...")
         add_line("")
         add_line("    def as_proto_data(self) -> bytes: ...")
         add_line("    def as_dict(self) -> dict[str, Any]: ...")
         add_line("")
         add_line(f"    def proto_copy({init_args_str}) -> {namespaced_name}: ...")
         add_line("")
+        add_line("    @classmethod")
+        add_line(f"    def diff(cls, a: {namespaced_name}, b: {namespaced_name}) -> list[str]: ...")
+        add_line(f"    def diff_to_patch(self, other: {namespaced_name}) -> bytes: ...")
+        add_line(f"    def merge_from(self, other: {namespaced_name}) -> None: ...")
+        add_line(f"    def update_from(self, other: {namespaced_name}, mask: Iterable[str]) -> None: ...")
+        add_line("    def __sizeof__(self) -> int: ...")
+        add_line("    def deep_sizeof(self, by_field: bool = False) -> int | dict[str, int]: ...")
+        add_line("    def explain_size(self) -> dict[str, dict[str, int]]: ...")
+        add_line("    @classmethod")
+        add_line(
+            "    def explain_proto_data_size(cls, data: bytes | Iterable[bytes]) -> dict[str, dict[str, int]]: ..."
+        )
+        add_line("")
+        if self.is_fixed_width_only:
+            add_line("    @staticmethod")
+            add_line("    def decode_repeated_columns(data: bytes, field_number: int) -> dict[str, array]: ...")
+            add_line("")
         add_line("    def has_unknown_fields(self) -> bool: ...")
         add_line("    def delete_unknown_fields(self) -> None: ...")
         return ret
 
 
+class Feature(enum.Enum):
+    """Optional features that can be compiled into a module. The value is the preprocessor macro that enables the
+    feature in the generated C++ source."""
+
+    STATS = "PBCC_STATS"  # Parse/serialize statistics, available via pbcc_stats()
+    FIELD_USAGE = "PBCC_FIELD_USAGE"  # Field access and parse counts, available via pbcc_field_usage()
+    PROFILE_FIELDS = "PBCC_PROFILE_FIELDS"  # Per-field timing, available via pbcc_field_profile()
+    ALLOC_COUNTERS = "PBCC_ALLOC_COUNTERS"  # Allocation counting, available via pbcc_count_allocations()
+    LIVE_OBJECTS = "PBCC_LIVE_OBJECTS"  # Live instance counts, available via pbcc_live_objects()
+    USDT = "PBCC_USDT"  # Static tracepoints for parse/serialize calls (requires <sys/sdt.h>)
+    SHARED_RUNTIME = "PBCC_SHARED_RUNTIME"  # Link against libpbcc_runtime instead of including pbcc_runtime.cc
+
+
+class BuildProfile(enum.Enum):
+    """How a module is optimized. These only affect the compiler's flags, not the generated source."""
+
+    DEBUG = "debug"  # No optimization, with assertions enabled
+    RELEASE = "release"  # -O3, for any CPU that Python itself supports
+    NATIVE = "native"  # -O3 and LTO for this machine's CPU (the module may not run on other machines)
+    PGO = "pgo"  # -O3 and LTO, optimized using a profile collected by running a training workload
+
+
+# These are added after Python's own flags, so they override its -O and -DNDEBUG
+PROFILE_COMPILE_ARGS: dict[BuildProfile, list[str]] = {
+    BuildProfile.DEBUG: ["-O0", "-g", "-UNDEBUG"],
+    BuildProfile.RELEASE: ["-O3"],
+    BuildProfile.NATIVE: ["-O3", "-march=native", "-mtune=native", "-flto=auto"],
+    BuildProfile.PGO: ["-O3", "-flto=auto"],
+}
+
+
+# Fields parsed less often than this fraction of the most-parsed field in the same message are considered cold
+COLD_FIELD_FRACTION = 0.01
+
+
+def load_field_frequency_profile(filename: str) -> dict[str, dict[str, int]]:
+    """Loads a JSON file containing the output of pbcc_field_usage() or pbcc_field_profile() from a module built
+    with --field-usage or --profile-fields. Returns {message_name: {field_name: parse_count}}, where message_name is
+    either the full name (module.Message) or just the message's name, and field_name is either a field group's name
+    or an individual field's name."""
+    with open(filename, "rt") as f:
+        profile = json.load(f)
+
+    ret: dict[str, dict[str, int]] = collections.defaultdict(dict)
+    if "parse" in profile:
+        # pbcc_field_profile() format: {"parse": {"fields": {"Message.field": {"count": N, ...}}}}
+        # Entries for whole messages have the data type "(message)"; their paths can contain dots too (for nested
+        # messages), so they must be skipped explicitly
+        for path, entry in profile["parse"]["fields"].items():
+            if entry.get("data_type") == "(message)":
+                continue
+            message_name, _, field_name = path.rpartition(".")
+            if message_name:
+                ret[message_name][field_name] = entry["count"]
+    else:
+        # pbcc_field_usage() format: {"module.Message": {"field": {"parses": N, ...}}}
+        for message_name, fields in profile.items():
+            for field_name, entry in fields.items():
+                ret[message_name][field_name] = entry["parses"]
+    return dict(ret)
+
+
 def cc_name_for_python_name(name: str) -> str:
     return name.replace(".", "_")
 
 
+class ShardKind(enum.Enum):
+    RUNTIME = "runtime"  # Definitions of the runtime's global state and the enum objects
+    MESSAGES = "messages"  # Implementations of some of the messages
+    INIT = "init"  # The module's functions and PyInit
+
+
+@dataclasses.dataclass(kw_only=True)
+class SourceShard:
+    """One translation unit of a module whose generated code is split into several, so they can be compiled in
+    parallel. Every shard contains the declarations of the runtime, enums, and messages; each definition appears in
+    exactly one shard."""
+
+    name: str  # Used in the shard's filename
+    kind: ShardKind
+    # For MESSAGES shards, the messages implemented in this shard, as {module name: {message name, ...}}
+    messages: dict[str, set[str]] = dataclasses.field(default_factory=dict)
+
+
+# The default number of message shards. This is fixed, rather than depending on the number of CPUs, so that the
+# generated source (and which functions the compiler sees together) is the same on every machine
+DEFAULT_NUM_MESSAGE_SHARDS = 8
+
+
 @dataclasses.dataclass(kw_only=True)
 class ModuleInfo:
     name: str
@@ -322,6 +452,48 @@ class ModuleInfo:
 class ModuleCollection:
     modules: dict[str, ModuleInfo]
     global_aliases: dict[str, MessageInfo | EnumInfo | None] = dataclasses.field(default_factory=dict)
+    features: set[Feature] = dataclasses.field(default_factory=set)
+    # {message_name: {field_name: parse_count}}; see load_field_frequency_profile
+    field_frequencies: dict[str, dict[str, int]] = dataclasses.field(default_factory=dict)
+
+    def message_field_frequencies(self, message: MessageInfo) -> dict[str, int]:
+        """Returns the field frequency profile's entry for message ({field_name: parse_count}), which is empty if
+        the message isn't in the profile."""
+        frequencies = self.field_frequencies.get(f"{message.module_name}.{message.name}")
+        if frequencies is None:
+            frequencies = self.field_frequencies.get(message.name)
+        return frequencies or {}
+
+    def is_cold_field(self, message: MessageInfo, field: FieldInfo) -> bool:
+        """Returns True if the field frequency profile shows that field is rarely parsed. Fields in messages that
+        aren't in the profile are never cold."""
+        frequencies = self.message_field_frequencies(message)
+        if not frequencies:
+            return False
+        count = frequencies.get(field.name, frequencies.get(field.py_name, 0))
+        return count < max(frequencies.values()) * COLD_FIELD_FRACTION
+
+    def predicted_next_field(self, message: MessageInfo, field: FieldInfo) -> FieldInfo | None:
+        """Returns the field whose tag usually follows field's in serialized data, according to the field frequency
+        profile: the next hot field in field number order, or field itself if it's repeated and can't be packed (so
+        its items are written one after another). Returns None if the message isn't in the profile, field is cold,
+        or the next field's tag doesn't fit in one byte (see predicted_tag_byte in pbcc_runtime.h)."""
+        if not self.message_field_frequencies(message) or self.is_cold_field(message, field):
+            return None
+        if field.is_repeated and field.data_type in (DataType.STRING, DataType.BYTES, DataType.MESSAGE, DataType.MAP):
+            next_field: FieldInfo | None = field
+        else:
+            next_field = next(
+                (
+                    f
+                    for field_num, f in sorted(message.field_for_number.items())
+                    if field_num > field.field_num and not self.is_cold_field(message, f)
+                ),
+                None,
+            )
+        if next_field is None or next_field.field_num >= 0x10:
+            return None
+        return next_field
 
     def compute_global_aliases(self) -> None:
         print("Populating global aliases")
@@ -427,6 +599,7 @@ class ModuleCollection:
                     fld_msg = None
                 fi = FieldInfo(
                     py_name=py_name,
+                    name=fld_desc.name,
                     is_optional=is_optional,
                     is_repeated=(fld_desc.label == FieldDescriptor.LABEL_REPEATED),
                     data_type=data_type,
@@ -473,7 +646,79 @@ class ModuleCollection:
         mod_info._in_progress = False
         return mod_info
 
-    def cc_source(self, so_module_name: str, add_line_directives: bool = True) -> str:
+    def source_shards(self, num_message_shards: int) -> list[SourceShard]:
+        """Splits the module into a runtime shard, an init shard, and at most num_message_shards shards of message
+        implementations, so that the shards are about equally large (by number of messages plus fields). Each module
+        gets a number of shards proportional to its size (allocated by the largest remainder method), but at least one
+        and no more than its number of messages. If there are more modules than shards, whole modules are instead
+        grouped into num_message_shards shards."""
+
+        def message_weight(message: MessageInfo) -> int:
+            return 1 + len(message.field_for_number)
+
+        messages_by_module = {
+            mod_name: [m for _, m in sorted(mod.messages.items()) if m.map_types is None]
+            for mod_name, mod in sorted(self.modules.items())
+        }
+        messages_by_module = {mod_name: messages for mod_name, messages in messages_by_module.items() if messages}
+        mod_weights = {
+            mod_name: sum(message_weight(m) for m in messages) for mod_name, messages in messages_by_module.items()
+        }
+        shards = [SourceShard(name="runtime", kind=ShardKind.RUNTIME), SourceShard(name="init", kind=ShardKind.INIT)]
+
+        if len(messages_by_module) > num_message_shards:
+            # Put each module into the currently smallest shard, largest modules first
+            shard_messages: list[dict[str, set[str]]] = [{} for _ in range(num_message_shards)]
+            shard_weights = [0] * num_message_shards
+            for mod_name in sorted(mod_weights, key=lambda mod_name: -mod_weights[mod_name]):
+                z = shard_weights.index(min(shard_weights))
+                shard_messages[z][mod_name] = {m.name for m in messages_by_module[mod_name]}
+                shard_weights[z] += mod_weights[mod_name]
+            shards.extend(
+                SourceShard(name=f"messages.{z}", kind=ShardKind.MESSAGES, messages=messages)
+                for z, messages in enumerate(shard_messages)
+            )
+            return shards
+
+        total_weight = sum(mod_weights.values())
+        quotas = {mod_name: num_message_shards * weight / total_weight for mod_name, weight in mod_weights.items()}
+        shard_counts = {
+            mod_name: max(1, min(len(messages_by_module[mod_name]), int(quota))) for mod_name, quota in quotas.items()
+        }
+        # Giving every module at least one shard may have allocated too many, so take shards back from the modules
+        # that got the most more than their quotas; then give any remaining shards to the modules with the largest
+        # remainders
+        while sum(shard_counts.values()) > num_message_shards:
+            mod_name = min(
+                (mod_name for mod_name, count in shard_counts.items() if count > 1),
+                key=lambda mod_name: quotas[mod_name] - shard_counts[mod_name],
+            )
+            shard_counts[mod_name] -= 1
+        while sum(shard_counts.values()) < num_message_shards:
+            candidates = [
+                mod_name for mod_name, count in shard_counts.items() if count < len(messages_by_module[mod_name])
+            ]
+            if not candidates:
+                break
+            mod_name = max(candidates, key=lambda mod_name: quotas[mod_name] - shard_counts[mod_name])
+            shard_counts[mod_name] += 1
+
+        for mod_name, messages in messages_by_module.items():
+            num_shards = shard_counts[mod_name]
+            shard_weight = mod_weights[mod_name] / num_shards
+            mod_shards: list[SourceShard] = []
+            weight = 0
+            for message in messages:
+                if not mod_shards or (weight >= shard_weight * len(mod_shards) and len(mod_shards) < num_shards):
+                    shard_name = mod_name if num_shards == 1 else f"{mod_name}.{len(mod_shards)}"
+                    mod_shards.append(SourceShard(name=shard_name, kind=ShardKind.MESSAGES, messages={mod_name: set()}))
+                mod_shards[-1].messages[mod_name].add(message.name)
+                weight += message_weight(message)
+            shards.extend(mod_shards)
+        return shards
+
+    def cc_source(self, so_module_name: str, add_line_directives: bool = True, shard: SourceShard | None = None) -> str:
+        """Returns the generated C++ source for the module, or if shard is given, for only that part of it."""
         template_path = os.path.relpath(os.path.join(os.path.dirname(__file__), "pymodule.in.cc"))
         with open(template_path, "rt") as f:
             template_lines = [line.rstrip() for line in f.readlines()]
@@ -507,6 +752,8 @@ class ModuleCollection:
             return line_num
 
         result_lines: list[str] = []
+        # Within a __COMPILER__IF_SHARD_MESSAGES__ block in a message shard, only that shard's messages are generated
+        shard_messages: dict[str, set[str]] | None = None
 
         def add_line_directive(line_num: int, annotations: Sequence[str]) -> None:
             if add_line_directives:
@@ -522,6 +769,7 @@ class ModuleCollection:
             env: dict[str, str],
             annotations: Sequence[str] = (),
         ) -> None:
+            nonlocal shard_messages
             add_line_directive(start_line_num, annotations)
             line_num = start_line_num
             try:
@@ -532,8 +780,19 @@ class ModuleCollection:
                         tag = comment_tag_m.group("tag")
                         block_end_line = get_block_end_line(line_num)
                         match tag:
+                            case "__COMPILER__FOREACH_FEATURE__":
+                                for feature in sorted(self.features, key=lambda f: f.value):
+                                    sub_env = {**env, "__COMPILER__FEATURE_MACRO__": feature.value}
+                                    replace_template_scope(
+                                        line_num + 1,
+                                        block_end_line - 1,
+                                        sub_env,
+                                        (*annotations, f"feat={feature.name}"),
+                                    )
                             case "__COMPILER__FOREACH_MODULE__":
                                 for mod_name in sorted(self.modules.keys()):
+                                    if shard_messages is not None and mod_name not in shard_messages:
+                                        continue
                                     sub_env = {
                                         **env,
                                         "__COMPILER__MODULE_NAME__": mod_name,
@@ -599,6 +858,8 @@ class ModuleCollection:
                                 for _, message in sorted(mod.messages.items()):
                                     if message.map_types is not None:
                                         continue
+                                    if shard_messages is not None and message.name not in shard_messages[mod.name]:
+                                        continue
                                     sub_env = {
                                         **env,
                                         "__COMPILER__MESSAGE_PYTHON_NAME__": message.name,
@@ -606,6 +867,7 @@ class ModuleCollection:
                                             message.name
                                         ),
                                         "__COMPILER__MESSAGE_CC_NAME__": cc_name_for_enum_or_message_info(message),
+                                        "__COMPILER__MESSAGE_NUM_FIELD_GROUPS__": str(len(message.field_groups)),
                                     }
                                     replace_template_scope(
                                         line_num + 1,
@@ -637,10 +899,11 @@ class ModuleCollection:
                                     message.field_groups.items(),
                                     key=lambda item: min(f.field_num for f in item[1]),
                                 )
-                                for group_name, fields in sorted_groups:
+                                for group_index, (group_name, fields) in enumerate(sorted_groups):
                                     sub_env = {
                                         **env,
                                         "__COMPILER__MESSAGE_FIELD_GROUP_NAME__": group_name,
+                                        "__COMPILER__MESSAGE_FIELD_GROUP_INDEX__": str(group_index),
                                         "__COMPILER__MESSAGE_FIELD_GROUP_DEFAULT_VALUE_CONSTRUCTOR__": default_value_constructor_for_field_group(
                                             fields
                                         ),
@@ -655,10 +918,26 @@ class ModuleCollection:
                                 mod = self.modules[env["__COMPILER__MODULE_NAME__"]]
                                 message = mod.messages[env["__COMPILER__MESSAGE_PYTHON_NAME__"]]
                                 group = message.field_groups[env["__COMPILER__MESSAGE_FIELD_GROUP_NAME__"]]
+                                predicted_field_nums = {
+                                    f.field_num
+                                    for f in (
+                                        self.predicted_next_field(message, f) for f in message.field_for_number.values()
+                                    )
+                                    if f is not None
+                                }
                                 for field in sorted(group, key=lambda f: f.field_num):
+                                    is_cold = self.is_cold_field(message, field)
+                                    predicted_next_field = self.predicted_next_field(message, field)
                                     enum_ref = "nullptr"
                                     parse_fn = "nullptr"
+                                    parse_into_fn = "nullptr"
                                     serialize_fn = "nullptr"
+                                    diff_fn = "nullptr"
+                                    serialize_patch_fn = "nullptr"
+                                    merge_fn = "nullptr"
+                                    update_fn = "nullptr"
+                                    deep_sizeof_fn = "nullptr"
+                                    explain_size_fn = "nullptr"
                                     submessage_type_obj = "nullptr"
                                     # These two should only be used within a __COMPILER__IF_MESSAGE_FIELD_TYPE_MAP__,
                                     # so we intentionally use values that won't compile
@@ -667,6 +946,9 @@ class ModuleCollection:
                                     value_enum_ref = "nullptr"
                                     value_parse_fn = "nullptr"
                                     value_serialize_fn = "nullptr"
+                                    value_merge_fn = "nullptr"
+                                    value_deep_sizeof_fn = "nullptr"
+                                    value_explain_size_fn = "nullptr"
                                     value_submessage_type_obj = "nullptr"
 
                                     if field.enum is not None:
@@ -676,7 +958,14 @@ class ModuleCollection:
                                         parse_fn = (
                                             f"reinterpret_cast<ParseMessageFn>({submsg_cc_name}::from_proto_data)"
                                         )
+                                        parse_into_fn = f"{submsg_cc_name}::parse_into_existing"
                                         serialize_fn = f"{submsg_cc_name}::as_proto_data"
+                                        diff_fn = f"{submsg_cc_name}::diff"
+                                        serialize_patch_fn = f"{submsg_cc_name}::serialize_patch"
+                                        merge_fn = f"{submsg_cc_name}::merge_from"
+                                        update_fn = f"{submsg_cc_name}::update_from"
+                                        deep_sizeof_fn = f"{submsg_cc_name}::deep_sizeof"
+                                        explain_size_fn = f"{submsg_cc_name}::explain_size"
                                         submessage_type_obj = f"&{submsg_cc_name}::py_type"
                                         if field.submessage.map_types is not None:
                                             key_field, value_field = field.submessage.map_types
@@ -693,6 +982,9 @@ class ModuleCollection:
                                                 )
                                                 value_parse_fn = f"reinterpret_cast<ParseMessageFn>({value_submsg_name}::from_proto_data)"
                                                 value_serialize_fn = f"{value_submsg_name}::as_proto_data"
+                                                value_merge_fn = f"{value_submsg_name}::merge_from"
+                                                value_deep_sizeof_fn = f"{value_submsg_name}::deep_sizeof"
+                                                value_explain_size_fn = f"{value_submsg_name}::explain_size"
                                                 value_submessage_type_obj = f"&{value_submsg_name}::py_type"
 
                                     sub_env = {
@@ -700,17 +992,54 @@ class ModuleCollection:
                                         "__COMPILER__MESSAGE_FIELD_IS_OPTIONAL__": (
                                             "true" if field.is_optional else "false"
                                         ),
+                                        "__COMPILER__MESSAGE_FIELD_NAME__": field.name,
+                                        # Cold fields are parsed out of line, so they don't take up space in the
+                                        # parse loop's hot code
+                                        "__COMPILER__MESSAGE_FIELD_PARSE_LIKELIHOOD__": (
+                                            "[[unlikely]]" if is_cold else ""
+                                        ),
+                                        "__COMPILER__MESSAGE_FIELD_PARSE_FN_ATTRIBUTES__": (
+                                            "__attribute__((cold, noinline))"
+                                            if is_cold
+                                            else "__attribute__((always_inline))"
+                                        ),
+                                        "__COMPILER__MESSAGE_FIELD_IS_PREDICTED__": (
+                                            "true" if field.field_num in predicted_field_nums else "false"
+                                        ),
+                                        "__COMPILER__MESSAGE_FIELD_PREDICTED_NEXT_NUMBER__": (
+                                            str(predicted_next_field.field_num) if predicted_next_field else "0"
+                                        ),
+                                        "__COMPILER__MESSAGE_FIELD_PREDICTED_NEXT_DATA_TYPE__": (
+                                            predicted_next_field.data_type.name
+                                            if predicted_next_field
+                                            else "__INVALID__"
+                                        ),
+                                        "__COMPILER__MESSAGE_FIELD_PREDICTED_NEXT_IS_REPEATED__": (
+                                            "true"
+                                            if predicted_next_field and predicted_next_field.is_repeated
+                                            else "false"
+                                        ),
                                         "__COMPILER__MESSAGE_FIELD_NUMBER__": str(field.field_num),
                                         "__COMPILER__MESSAGE_FIELD_DATA_TYPE__": field.data_type.name,
                                         "__COMPILER__MESSAGE_FIELD_ENUM_REF__": enum_ref,
                                         "__COMPILER__MESSAGE_FIELD_SUBMESSAGE_TYPE_OBJ__": submessage_type_obj,
                                         "__COMPILER__MESSAGE_FIELD_MESSAGE_PARSE_FN__": parse_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_PARSE_INTO_FN__": parse_into_fn,
                                         "__COMPILER__MESSAGE_FIELD_MESSAGE_SERIALIZE_FN__": serialize_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_DIFF_FN__": diff_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_SERIALIZE_PATCH_FN__": serialize_patch_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_MERGE_FN__": merge_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_UPDATE_FN__": update_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_DEEP_SIZEOF_FN__": deep_sizeof_fn,
+                                        "__COMPILER__MESSAGE_FIELD_MESSAGE_EXPLAIN_SIZE_FN__": explain_size_fn,
                                         "__COMPILER__MESSAGE_FIELD_KEY_TYPE__": key_type,
                                         "__COMPILER__MESSAGE_FIELD_VALUE_TYPE__": value_type,
                                         "__COMPILER__MESSAGE_FIELD_VALUE_ENUM_REF__": value_enum_ref,
                                         "__COMPILER__MESSAGE_FIELD_VALUE_MESSAGE_PARSE_FN__": value_parse_fn,
                                         "__COMPILER__MESSAGE_FIELD_VALUE_MESSAGE_SERIALIZE_FN__": value_serialize_fn,
+                                        "__COMPILER__MESSAGE_FIELD_VALUE_MESSAGE_MERGE_FN__": value_merge_fn,
+                                        "__COMPILER__MESSAGE_FIELD_VALUE_MESSAGE_DEEP_SIZEOF_FN__": value_deep_sizeof_fn,
+                                        "__COMPILER__MESSAGE_FIELD_VALUE_MESSAGE_EXPLAIN_SIZE_FN__": value_explain_size_fn,
                                         "__COMPILER__MESSAGE_FIELD_VALUE_SUBMESSAGE_TYPE_OBJ__": value_submessage_type_obj,
                                     }
                                     replace_template_scope(
@@ -720,6 +1049,45 @@ class ModuleCollection:
                                         (*annotations, f"fld={field.field_num}"),
                                     )
 
+                            case "__COMPILER__IF_SHARD_RUNTIME__" | "__COMPILER__IF_SHARD_INIT__":
+                                kind = ShardKind.RUNTIME if tag == "__COMPILER__IF_SHARD_RUNTIME__" else ShardKind.INIT
+                                if shard is None or shard.kind == kind:
+                                    replace_template_scope(
+                                        line_num + 1,
+                                        block_end_line - 1,
+                                        env,
+                                        (*annotations, kind.value),
+                                    )
+                            case "__COMPILER__IF_STATIC_RUNTIME__":
+                                if Feature.SHARED_RUNTIME not in self.features:
+                                    replace_template_scope(
+                                        line_num + 1,
+                                        block_end_line - 1,
+                                        env,
+                                        (*annotations, "static_runtime"),
+                                    )
+                            case "__COMPILER__IF_SHARD_MESSAGES__":
+                                if shard is None or shard.kind == ShardKind.MESSAGES:
+                                    shard_messages = shard.messages if shard is not None else None
+                                    try:
+                                        replace_template_scope(
+                                            line_num + 1,
+                                            block_end_line - 1,
+                                            env,
+                                            (*annotations, "messages"),
+                                        )
+                                    finally:
+                                        shard_messages = None
+                            case "__COMPILER__IF_MESSAGE_IS_FIXED_WIDTH_ONLY__":
+                                mod = self.modules[env["__COMPILER__MODULE_NAME__"]]
+                                message = mod.messages[env["__COMPILER__MESSAGE_PYTHON_NAME__"]]
+                                if message.is_fixed_width_only:
+                                    replace_template_scope(
+                                        line_num + 1,
+                                        block_end_line - 1,
+                                        env,
+                                        (*annotations, "iffw"),
+                                    )
                             case "__COMPILER__IF_MESSAGE_FIELD_GROUP_IS_NOT_ONEOF__":
                                 mod = self.modules[env["__COMPILER__MODULE_NAME__"]]
                                 message = mod.messages[env["__COMPILER__MESSAGE_PYTHON_NAME__"]]
@@ -744,6 +1112,22 @@ class ModuleCollection:
                                         env,
                                         (*annotations, "if1"),
                                     )
+                            case "__COMPILER__IF_MESSAGE_FIELD_IS_PREDICTED__":
+                                if env["__COMPILER__MESSAGE_FIELD_IS_PREDICTED__"] == "true":
+                                    replace_template_scope(
+                                        line_num + 1,
+                                        block_end_line - 1,
+                                        env,
+                                        (*annotations, "ifpred"),
+                                    )
+                            case "__COMPILER__IF_MESSAGE_FIELD_HAS_PREDICTED_NEXT__":
+                                if env["__COMPILER__MESSAGE_FIELD_PREDICTED_NEXT_NUMBER__"] != "0":
+                                    replace_template_scope(
+                                        line_num + 1,
+                                        block_end_line - 1,
+                                        env,
+                                        (*annotations, "ifprednext"),
+                                    )
                             case "__COMPILER__IF_MESSAGE_FIELD_TYPE_NOT_REPEATED__":
                                 mod = self.modules[env["__COMPILER__MODULE_NAME__"]]
                                 message = mod.messages[env["__COMPILER__MESSAGE_PYTHON_NAME__"]]
@@ -827,8 +1211,9 @@ class ModuleCollection:
     def pyi_source(self) -> str:
         lines = [
             "from __future__ import annotations",
+            "from array import array",
             "from enum import IntEnum",
-            "from typing import Any, TypeAlias",
+            "from typing import Any, Callable, Iterable, TypeAlias",
             "",
         ]
 
@@ -838,6 +1223,29 @@ class ModuleCollection:
             lines.append(f"class {mod_name}:")
             lines += mod_info.pyi_source_lines(indent_level=1)
 
+        # Module-level functions for optional features
+        if Feature.STATS in self.features:
+            lines.append("")
+            lines.append("def pbcc_stats() -> dict[str, dict[str, Any]]: ...")
+            lines.append("def reset_stats() -> None: ...")
+        if Feature.FIELD_USAGE in self.features:
+            lines.append("")
+            lines.append("def pbcc_field_usage(unused_only: bool = False) -> dict[str, dict[str, dict[str, int]]]: ...")
+            lines.append("def reset_field_usage() -> None: ...")
+        if Feature.PROFILE_FIELDS in self.features:
+            lines.append("")
+            lines.append("def pbcc_field_profile() -> dict[str, dict[str, dict[str, dict[str, Any]]]]: ...")
+            lines.append("def pbcc_field_profile_trace() -> str: ...")
+            lines.append("def set_field_profile_trace_sampling(interval: int, max_events: int = ...) -> None: ...")
+            lines.append("def reset_field_profile() -> None: ...")
+        if Feature.LIVE_OBJECTS in self.features:
+            lines.append("")
+            lines.append("def pbcc_live_objects() -> dict[str, dict[str, int]]: ...")
+            lines.append("def reset_live_object_peaks() -> None: ...")
+        if Feature.ALLOC_COUNTERS in self.features:
+            lines.append("")
+            lines.append("def pbcc_count_allocations(fn: Callable[[], Any]) -> dict[str, int]: ...")
+
         # Create global aliases as defined in the dicts
         lines.append("")
         lines.append("# Global aliases")
@@ -853,56 +1261,629 @@ class ModuleCollection:
         return "\n".join(lines)
 
 
-async def get_compiler_args() -> list[str]:
+async def get_compiler_args(profile: BuildProfile = BuildProfile.RELEASE) -> tuple[list[str], list[str]]:
+    """Returns (flags for compiling, flags for linking) an extension module. The compiling flags are also passed when
+    linking, which LTO requires."""
     (cflags, _), (ldflags, _) = await asyncio.gather(
         check_output_async("python3.10-config", "--cflags"),
         check_output_async("python3.10-config", "--ldflags"),
     )
-    ret = [flag.decode("utf-8") for flag in cflags.split() + ldflags.split()]
-    ret.append("-std=c++20")
-    ret.append("-Wall")
-    ret.append("-Wextra")
-    ret.append("-Werror")
-    ret.append("-fPIC")
+    compile_args = [flag.decode("utf-8") for flag in cflags.split()]
+    compile_args.append("-std=c++20")
+    compile_args.append("-Wall")
+    compile_args.append("-Wextra")
+    compile_args.append("-Werror")
+    compile_args.append("-fPIC")
+    # Only PyInit needs to be exported (PyMODINIT_FUNC marks it so). This also
+    # lets calls between shards' functions skip the PLT
+    compile_args.append("-fvisibility=hidden")
+    compile_args.append(f"-I{PBCC_SOURCE_DIR}")
+    compile_args.extend(PROFILE_COMPILE_ARGS[profile])
+    link_args = [flag.decode("utf-8") for flag in ldflags.split()]
+    return compile_args, link_args
+
+
+# The names of the files in each build cache entry
+CACHED_SO_FILENAME = "module.so"
+CACHED_PYI_FILENAME = "module.pyi"
+
+# When the build cache is larger than this, the least recently used entries are deleted
+DEFAULT_BUILD_CACHE_SIZE_LIMIT = 2 * 1024 * 1024 * 1024
+
+
+def default_cache_dir() -> str:
+    """Returns $PBCC_CACHE_DIR if it's set, or the pbcc directory within the user's cache directory."""
+    cache_dir = os.environ.get("PBCC_CACHE_DIR")
+    if cache_dir:
+        return cache_dir
+    return os.path.join(os.environ.get("XDG_CACHE_HOME") or os.path.expanduser("~/.cache"), "pbcc")
+
+
+def file_descriptors_with_dependencies(file_descs: Iterable[FileDescriptor]) -> list[FileDescriptor]:
+    """Returns the given file descriptors and everything they import, each once, in a deterministic order."""
+    ret: list[FileDescriptor] = []
+    seen: set[str] = set()
+
+    def visit(file_desc: FileDescriptor) -> None:
+        if file_desc.name in seen:
+            return
+        seen.add(file_desc.name)
+        for dep_desc in file_desc.dependencies:
+            visit(dep_desc)
+        ret.append(file_desc)
+
+    for file_desc in file_descs:
+        visit(file_desc)
+    return ret
+
+
+def hash_build_inputs(parts: Iterable[bytes | str]) -> str:
+    """Returns a hex SHA-256 hash of a sequence of byte strings (or strings, which are encoded as UTF-8). Each part's
+    length is included, so different sequences can't produce the same input to the hash."""
+    h = hashlib.sha256()
+    for part in parts:
+        if isinstance(part, str):
+            part = part.encode("utf-8")
+        h.update(len(part).to_bytes(8, "little"))
+        h.update(part)
+    return h.hexdigest()
+
+
+def read_source_files(filenames: Iterable[str]) -> list[bytes]:
+    """Returns the contents of files in the pbcc source directory."""
+    ret: list[bytes] = []
+    for filename in filenames:
+        with open(os.path.join(PBCC_SOURCE_DIR, filename), "rb") as f:
+            ret.append(f.read())
+    return ret
+
+
+# The files that the runtime library is built from
+RUNTIME_SOURCE_FILENAMES = ("pbcc_runtime.h", "pbcc_runtime.cc", "wire_format.h")
+
+
+async def build_cache_key(
+    module_names: Iterable[str],
+    so_module_name: str,
+    add_line_directives: bool = True,
+    features: Iterable[Feature] = (),
+    field_frequencies: dict[str, dict[str, int]] | None = None,
+    profile: BuildProfile = BuildProfile.RELEASE,
+    pgo_training_data: Sequence[tuple[str, str]] = (),
+    num_message_shards: int = DEFAULT_NUM_MESSAGE_SHARDS,
+) -> str:
+    """Returns the build cache key for a pbcc module. This is a hash of everything that affects the built module: the
+    serialized descriptors of the pb2 modules (and the files they import), the extension module's name, the code
+    generator, template, and runtime, the compiler's version, the compiler flags and options (including how the source
+    is split into shards, which affects what the compiler can inline), and for the native
+    profile, the CPU that -march=native targets, and for the pgo profile, the training data."""
+    (compiler_version, _), (compile_args, link_args) = await asyncio.gather(
+        check_output_async("g++", "--version"), get_compiler_args(profile)
+    )
+    parts: list[bytes | str] = []
+    file_descs = [importlib.import_module(module_name).DESCRIPTOR for module_name in module_names]
+    for file_desc in file_descriptors_with_dependencies(file_descs):
+        parts.append(file_desc.name)
+        parts.append(file_desc.serialized_pb)
+    parts.append(so_module_name)
+    parts.extend(read_source_files(("compile.py", "pymodule.in.cc", *RUNTIME_SOURCE_FILENAMES)))
+    parts.append(compiler_version)
+    parts.append(json.dumps([compile_args, link_args]))
+    parts.append(
+        json.dumps(
+            [add_line_directives, sorted(f.name for f in features), field_frequencies or {}, num_message_shards],
+            sort_keys=True,
+        )
+    )
+    if profile == BuildProfile.NATIVE:
+        # -march=native is resolved by the compiler, so the same flags produce
+        # different modules on different machines
+        target_description, _ = await check_output_async("g++", "-march=native", "-Q", "--help=target")
+        parts.append(target_description)
+    for message_name, filename in pgo_training_data:
+        parts.append(message_name)
+        with open(filename, "rb") as f:
+            parts.append(f.read())
+    return hash_build_inputs(parts)
+
+
+def make_temp_filename(filename: str) -> str:
+    """Creates an empty file with a unique name in the same directory as filename, so that it can be renamed over
+    filename atomically, and returns its name. The file has the permissions that a new file would normally have
+    (rather than being accessible only by its owner), since it will replace filename."""
+    fd, temp_filename = tempfile.mkstemp(
+        dir=os.path.dirname(filename) or ".", prefix=f".{os.path.basename(filename)}.", suffix=".tmp"
+    )
+    os.close(fd)
+    umask = os.umask(0)
+    os.umask(umask)
+    os.chmod(temp_filename, 0o666 & ~umask)
+    return temp_filename
+
+
+def copy_file_atomically(src_filename: str, dst_filename: str) -> None:
+    """Copies a file such that readers of dst_filename see either the old file or the new one. In particular, this
+    doesn't modify a .so file that may already be loaded by a running process."""
+    temp_filename = make_temp_filename(dst_filename)
+    try:
+        shutil.copyfile(src_filename, temp_filename)
+        os.replace(temp_filename, dst_filename)
+    except BaseException:
+        os.remove(temp_filename)
+        raise
+
+
+def mark_build_cache_entry_used(path: str) -> None:
+    """Updates the modification time of a build cache entry (or precompiled header directory), which
+    prune_build_cache uses to tell which entries were used least recently."""
+    try:
+        os.utime(path)
+    except FileNotFoundError:
+        pass
+
+
+def prune_build_cache(cache_dir: str, size_limit: int = DEFAULT_BUILD_CACHE_SIZE_LIMIT) -> None:
+    """Deletes the least recently used entries and precompiled headers from the build cache until its total size is
+    at most size_limit bytes. Entries that are deleted while a module is being copied or loaded from them are rebuilt
+    the next time they're needed."""
+    entries: list[tuple[float, int, str]] = []  # (mtime, size, path)
+    total_size = 0
+    for parent_dir in (cache_dir, os.path.join(cache_dir, "pch")):
+        try:
+            names = os.listdir(parent_dir)
+        except FileNotFoundError:
+            continue
+        for name in names:
+            path = os.path.join(parent_dir, name)
+            # Temporary directories belong to builds in progress
+            if name.startswith(".") or name == "pch" or not os.path.isdir(path):
+                continue
+            try:
+                size = sum(entry.stat().st_size for entry in os.scandir(path) if entry.is_file())
+                entries.append((os.stat(path).st_mtime, size, path))
+            except FileNotFoundError:
+                continue
+            total_size += size
+    entries.sort()
+    for _, size, path in entries:
+        if total_size <= size_limit:
+            break
+        shutil.rmtree(path, ignore_errors=True)
+        total_size -= size
+        print(f"Removed {path} from build cache")
+
+
+def clear_build_cache(cache_dir: str) -> None:
+    """Deletes everything in the build cache."""
+    shutil.rmtree(cache_dir, ignore_errors=True)
+    print(f"Cleared build cache {cache_dir}")
+
+
+def store_in_build_cache(
+    cache_entry_dir: str, so_filename: str, pyi_filename: str, extra_filenames: Iterable[str] = ()
+) -> None:
+    """Adds a built module to the build cache. extra_filenames are other files that the module needs at runtime (the
+    shared runtime library), which are stored in the entry under their own names. The entry is created atomically, so
+    concurrent builds of the same module are safe (the first one to finish is kept)."""
+    os.makedirs(os.path.dirname(cache_entry_dir), exist_ok=True)
+    temp_dir = tempfile.mkdtemp(dir=os.path.dirname(cache_entry_dir), prefix=".tmp-")
+    try:
+        shutil.copyfile(so_filename, os.path.join(temp_dir, CACHED_SO_FILENAME))
+        shutil.copyfile(pyi_filename, os.path.join(temp_dir, CACHED_PYI_FILENAME))
+        for filename in extra_filenames:
+            shutil.copyfile(filename, os.path.join(temp_dir, os.path.basename(filename)))
+        try:
+            os.rename(temp_dir, cache_entry_dir)
+        except OSError:
+            if not os.path.isdir(cache_entry_dir):
+                raise
+    finally:
+        shutil.rmtree(temp_dir, ignore_errors=True)
+    print(f"Stored {so_filename} in build cache {cache_entry_dir}")
+
+
+async def build_shared_runtime(output_dir: str, profile: BuildProfile = BuildProfile.RELEASE) -> str:
+    """Builds the shared runtime library in output_dir, unless it's already there, and returns its filename. The name
+    includes a hash of the runtime's source and the compiler's version and flags, and is also the library's soname.
+    Since the dynamic linker loads each soname only once, all modules built by the same version of pbcc share one copy
+    of the library in a process, even if they're in different directories, and modules built by different versions
+    don't conflict."""
+    (compiler_version, _), (compile_args, link_args) = await asyncio.gather(
+        check_output_async("g++", "--version"), get_compiler_args(profile)
+    )
+    runtime_hash = hash_build_inputs(
+        [*read_source_files(RUNTIME_SOURCE_FILENAMES), compiler_version, json.dumps([compile_args, link_args])]
+    )
+    lib_basename = f"libpbcc_runtime.{runtime_hash[:16]}.so"
+    lib_filename = os.path.join(output_dir, lib_basename)
+    if os.path.isfile(lib_filename):
+        return lib_filename
+
+    # The library is built under a temporary name, so modules that are already
+    # loaded (or being linked by a concurrent build) never see a partial file
+    temp_filename = make_temp_filename(lib_filename)
+    cmd = [
+        "g++",
+        *compile_args,
+        f"-D{Feature.SHARED_RUNTIME.value}=1",
+        os.path.join(PBCC_SOURCE_DIR, "pbcc_runtime.cc"),
+        *link_args,
+        "-shared",
+        f"-Wl,-soname,{lib_basename}",
+        "-o",
+        temp_filename,
+    ]
+    print(f"Compiling shared runtime {lib_filename}")
+    print("... " + " ".join(cmd))
+    try:
+        await check_call_async(*cmd)
+        os.replace(temp_filename, lib_filename)
+    except BaseException:
+        os.remove(temp_filename)
+        raise
+    print(f"Compiled {lib_filename}")
+    return lib_filename
+
+
+async def compile_codec_benchmark(output_filename: str) -> None:
+    # The codec benchmark doesn't use Python, so it's built without Python's
+    # compiler flags
+    cc_filename = os.path.join(PBCC_SOURCE_DIR, "bench_codec.cc")
+    cmd = ["g++", "-std=c++20", "-O3", "-Wall", "-Wextra", "-Werror", f"-I{PBCC_SOURCE_DIR}", cc_filename]
+    cmd.extend(["-o", output_filename])
+    print(f"Compiling {cc_filename} to {output_filename}")
+    print("... " + " ".join(cmd))
+    await check_call_async(*cmd)
+    print(f"Compiled {output_filename}")
+
+
+async def precompile_runtime_header(
+    cache_dir: str, features: Iterable[Feature] = (), profile: BuildProfile = BuildProfile.RELEASE
+) -> str:
+    """Precompiles pbcc_runtime.h for modules built with the given features and profile, unless it's already in the
+    build cache, and returns the directory that contains it. The precompiled header is keyed by a hash of the runtime's
+    source, the compiler's version and flags, and the features, since GCC only uses a precompiled header if it was
+    built with the same flags and macros as the file that includes it (and silently ignores it otherwise)."""
+    (compiler_version, _), (compile_args, _) = await asyncio.gather(
+        check_output_async("g++", "--version"), get_compiler_args(profile)
+    )
+    feature_args = [f"-D{feature.value}=1" for feature in sorted(features, key=lambda f: f.value)]
+    pch_hash = hash_build_inputs(
+        [*read_source_files(RUNTIME_SOURCE_FILENAMES), compiler_version, json.dumps([compile_args, feature_args])]
+    )
+    pch_dir = os.path.join(cache_dir, "pch", pch_hash)
+    gch_filename = os.path.join(pch_dir, "pbcc_runtime.h.gch")
+    if os.path.isfile(gch_filename):
+        mark_build_cache_entry_used(pch_dir)
+        return pch_dir
+
+    os.makedirs(pch_dir, exist_ok=True)
+    temp_filename = make_temp_filename(gch_filename)
+    cmd = [
+        "g++",
+        *compile_args,
+        *feature_args,
+        "-x",
+        "c++-header",
+        os.path.join(PBCC_SOURCE_DIR, "pbcc_runtime.h"),
+        "-o",
+        temp_filename,
+    ]
+    print(f"Precompiling pbcc_runtime.h to {gch_filename}")
+    print("... " + " ".join(cmd))
+    try:
+        await check_call_async(*cmd)
+        os.replace(temp_filename, gch_filename)
+    except BaseException:
+        os.remove(temp_filename)
+        raise
+    return pch_dir
+
+
+async def compile_extension_module(
+    cc_filenames: Sequence[str],
+    so_filename: str,
+    jobs: int | None = None,
+    features: Iterable[Feature] = (),
+    cache_dir: str | None = None,
+    profile: BuildProfile = BuildProfile.RELEASE,
+    extra_compile_args: Sequence[str] = (),
+) -> list[str]:
+    """Compiles generated source files into an extension module. If there are several (i.e. the module is split into
+    shards), they're compiled to object files in parallel, up to jobs at a time (by default, the number of CPUs), and
+    linked. features must be the features that the source was generated with. If cache_dir is given, pbcc_runtime.h is
+    precompiled once and kept there, so later builds don't have to parse it again. extra_compile_args are passed when
+    compiling and linking the module (but not the shared runtime library or the precompiled header). Returns the names
+    of other files that the module needs at runtime, which are in the same directory as the module (the shared runtime
+    library, if features includes SHARED_RUNTIME)."""
+    features = set(features)
+    compile_args, link_args = await get_compiler_args(profile)
+    compile_args.extend(extra_compile_args)
+    extra_filenames: list[str] = []
+    if Feature.SHARED_RUNTIME in features:
+        lib_filename = await build_shared_runtime(os.path.dirname(os.path.abspath(so_filename)), profile)
+        link_args = [lib_filename, "-Wl,-rpath,$ORIGIN", *link_args]
+        extra_filenames.append(lib_filename)
+    if cache_dir is not None:
+        # GCC looks for pbcc_runtime.h.gch in each include directory before
+        # looking for the header itself, so the precompiled header's directory
+        # goes first
+        pch_dir = await precompile_runtime_header(cache_dir, features, profile)
+        compile_args = [f"-I{pch_dir}", *compile_args]
+
+    if len(cc_filenames) == 1:
+        print(f"Compiling {cc_filenames[0]} to {so_filename}")
+        cmd = ["g++", *compile_args, cc_filenames[0], *link_args, "-shared", "-o", so_filename]
+        print("... " + " ".join(cmd))
+        await check_call_async(*cmd)
+        print(f"Compiled {so_filename}")
+        return extra_filenames
+
+    semaphore = asyncio.Semaphore(jobs or os.cpu_count() or 1)
+
+    async def compile_object(cc_filename: str) -> str:
+        o_filename = cc_filename.removesuffix(".cc") + ".o"
+        cmd = ["g++", *compile_args, "-c", cc_filename, "-o", o_filename]
+        async with semaphore:
+            print("... " + " ".join(cmd))
+            await check_call_async(*cmd)
+        return o_filename
+
+    print(f"Compiling {len(cc_filenames)} files to {so_filename}")
+    o_filenames = await asyncio.gather(*(compile_object(cc_filename) for cc_filename in cc_filenames))
+    cmd = ["g++", *compile_args, *o_filenames, *link_args, "-shared", "-o", so_filename]
+    print("... " + " ".join(cmd))
+    await check_call_async(*cmd)
+    print(f"Compiled {so_filename}")
+    return extra_filenames
+
+
+# The default training workload for the pgo profile is this many random messages of each type, from pbcc.corpus
+PGO_CORPUS_MESSAGES_PER_TYPE = 100
+# The number of times the instrumented module runs the training workload, and the number of times it's timed (taking
+# the fastest) to compare the optimized module with the release build
+PGO_TRAINING_PASSES = 10
+PGO_TIMING_PASSES = 5
+
+# Parses and serializes each message in the training data, in a separate
+# process that loads the module from its .so file. Its arguments are the .so
+# file, the module's name, the number of passes, and MESSAGE=FILE pairs. It
+# prints the fastest pass's time per message, in nanoseconds.
+PGO_WORKLOAD_SCRIPT = """
+import functools, importlib.util, sys, time
+so_filename, module_name, passes = sys.argv[1], sys.argv[2], int(sys.argv[3])
+spec = importlib.util.spec_from_file_location(module_name, so_filename)
+module = importlib.util.module_from_spec(spec)
+spec.loader.exec_module(module)
+workload = []
+for arg in sys.argv[4:]:
+    message_name, _, filename = arg.partition("=")
+    cls = functools.reduce(getattr, message_name.split("."), module)
+    with open(filename, "rb") as f:
+        data = f.read()
+    offset = 0
+    while offset < len(data):
+        length = shift = 0
+        while True:
+            b = data[offset]
+            offset += 1
+            length |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        workload.append((cls, data[offset : offset + length]))
+        offset += length
+best_ns = None
+for _ in range(passes):
+    start = time.perf_counter_ns()
+    for cls, data in workload:
+        cls.from_proto_data(data).as_proto_data()
+    elapsed_ns = time.perf_counter_ns() - start
+    best_ns = elapsed_ns if best_ns is None else min(best_ns, elapsed_ns)
+print(best_ns / max(1, len(workload)))
+"""
+
+
+def write_pgo_training_corpus(module_names: Iterable[str], output_dir: str) -> list[tuple[str, str]]:
+    """Writes the default training workload for the pgo profile to output_dir: PGO_CORPUS_MESSAGES_PER_TYPE random
+    messages of each type in the given pb2 modules and the modules they import. Returns [(message name, filename)]."""
+    # pbcc.corpus imports this module, so it can't be imported at the top
+    # level. Its messages are collected with its own ModuleCollection, since
+    # when this module is run as __main__, corpus has a separate copy of it
+    from . import corpus
+
+    mod_coll = corpus.ModuleCollection(modules={})
+    with contextlib.redirect_stdout(io.StringIO()):
+        for module_name in module_names:
+            mod_coll.add_file(importlib.import_module(module_name).DESCRIPTOR)
+    ret: list[tuple[str, str]] = []
+    for mod_info in mod_coll.modules.values():
+        for message in mod_info.messages.values():
+            if message.map_types is not None:
+                continue
+            message_name = f"{mod_info.name}.{message.name}"
+            filename = os.path.join(output_dir, f"{message_name}.bin")
+            with open(filename, "wb") as f:
+                corpus.write_delimited(f, corpus.generate_corpus(message, PGO_CORPUS_MESSAGES_PER_TYPE))
+            ret.append((message_name, filename))
     return ret
 
 
+async def compile_extension_module_with_pgo(
+    cc_filenames: Sequence[str],
+    so_filename: str,
+    so_module_name: str,
+    module_names: Iterable[str],
+    jobs: int | None = None,
+    features: Iterable[Feature] = (),
+    cache_dir: str | None = None,
+    training_data: Sequence[tuple[str, str]] = (),
+) -> list[str]:
+    """Compiles generated source files into an extension module with the pgo profile. The module is built three
+    times: with the release profile (for comparison), then instrumented to record a profile while it parses and
+    serializes the training data, and finally optimized using that profile. training_data is [(message name,
+    filename)], where the message name is as in pbcc_stats() (module.Message) and each file contains messages of that
+    type, each preceded by its length as a varint (as written by pbcc.corpus); by default, random messages of every
+    type are used. Prints how much faster the optimized module parses and serializes the training data than the
+    release build. Returns the same as compile_extension_module."""
+    features = set(features)
+    work_dir = so_filename.removesuffix(".so") + ".pgo"
+    shutil.rmtree(work_dir, ignore_errors=True)
+    os.makedirs(work_dir)
+    try:
+        if not training_data:
+            training_data = write_pgo_training_corpus(module_names, work_dir)
+        workload_args = [f"{message_name}={filename}" for message_name, filename in training_data]
+
+        async def run_workload(filename: str, passes: int) -> float:
+            stdout, _ = await check_output_async(
+                sys.executable, "-c", PGO_WORKLOAD_SCRIPT, filename, so_module_name, str(passes), *workload_args
+            )
+            return float(stdout)
+
+        release_so_filename = os.path.join(work_dir, os.path.basename(so_filename))
+        await compile_extension_module(
+            cc_filenames, release_so_filename, jobs=jobs, features=features, cache_dir=cache_dir
+        )
+
+        # The profile's data files are named after the object files (or for a
+        # single source file, the .so), so the instrumented and optimized
+        # modules must be built to the same filenames
+        profile_dir = os.path.abspath(os.path.join(work_dir, "profile"))
+        await compile_extension_module(
+            cc_filenames,
+            so_filename,
+            jobs=jobs,
+            features=features,
+            cache_dir=cache_dir,
+            profile=BuildProfile.PGO,
+            extra_compile_args=[f"-fprofile-generate={profile_dir}"],
+        )
+        print(f"Running the training workload ({len(training_data)} message types)")
+        await run_workload(so_filename, PGO_TRAINING_PASSES)
+        # Code that the training workload didn't run is optimized as it would
+        # be without a profile, rather than for size
+        extra_filenames = await compile_extension_module(
+            cc_filenames,
+            so_filename,
+            jobs=jobs,
+            features=features,
+            cache_dir=cache_dir,
+            profile=BuildProfile.PGO,
+            extra_compile_args=[f"-fprofile-use={profile_dir}", "-fprofile-partial-training", "-Wno-missing-profile"],
+        )
+
+        release_ns = await run_workload(release_so_filename, PGO_TIMING_PASSES)
+        pgo_ns = await run_workload(so_filename, PGO_TIMING_PASSES)
+        print(
+            f"Parsing and serializing the training data takes {pgo_ns:.0f} ns/message with the pgo profile and"
+            f" {release_ns:.0f} ns/message with the release profile ({release_ns / pgo_ns:.2f}x speedup)"
+        )
+        return extra_filenames
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+
 async def compile_modules(
     output_basename: str,
     module_names: Iterable[str],
     add_line_directives: bool = True,
     compile_cc: bool = True,
-) -> None:
-    mod_coll = ModuleCollection(modules={})
+    features: Iterable[Feature] = (),
+    field_frequencies: dict[str, dict[str, int]] | None = None,
+    jobs: int | None = None,
+    num_message_shards: int = DEFAULT_NUM_MESSAGE_SHARDS,
+    so_module_name: str | None = None,
+    cache_dir: str | None = None,
+    cache_size_limit: int = DEFAULT_BUILD_CACHE_SIZE_LIMIT,
+    profile: BuildProfile = BuildProfile.RELEASE,
+    pgo_training_data: Sequence[tuple[str, str]] = (),
+) -> list[str]:
+    """Generates the .pyi and C++ source files for a pbcc module, and compiles them to a .so with the given build
+    profile unless compile_cc is False (see compile_extension_module_with_pgo for pgo_training_data). The C++ source
+    is split into shards (output_basename.SHARD.cc), with up to num_message_shards shards of message implementations,
+    that are compiled in parallel, up to jobs at a time (by default, the number of CPUs); if num_message_shards is 1,
+    it's a single file (output_basename.cc) instead. so_module_name is the name
+    the module will be imported as (by default, output_basename with / replaced by .). If cache_dir is given and a
+    module was already built from the same inputs, the cached .so and .pyi files are copied instead, and no C++ source
+    is generated; after adding a module to the cache, the least recently used entries are deleted until it's at most
+    cache_size_limit bytes. Returns the names of the C++ source files."""
+    module_names = list(module_names)
+    features = set(features)
+    pyi_filename = output_basename + ".pyi"
+    so_filename = output_basename + ".so"
+    so_module_name = so_module_name or output_basename.replace("/", ".")
+
+    cache_entry_dir: str | None = None
+    if compile_cc and cache_dir is not None:
+        cache_key = await build_cache_key(
+            module_names,
+            so_module_name,
+            add_line_directives,
+            features,
+            field_frequencies,
+            profile,
+            pgo_training_data,
+            num_message_shards,
+        )
+        cache_entry_dir = os.path.join(cache_dir, cache_key)
+        if os.path.isdir(cache_entry_dir):
+            for filename in os.listdir(cache_entry_dir):
+                # The shared runtime library's name is unique to its contents,
+                # so if it's already in the output directory it can be reused
+                extra_filename = os.path.join(os.path.dirname(so_filename), filename)
+                if filename not in (CACHED_SO_FILENAME, CACHED_PYI_FILENAME) and not os.path.isfile(extra_filename):
+                    copy_file_atomically(os.path.join(cache_entry_dir, filename), extra_filename)
+            copy_file_atomically(os.path.join(cache_entry_dir, CACHED_PYI_FILENAME), pyi_filename)
+            copy_file_atomically(os.path.join(cache_entry_dir, CACHED_SO_FILENAME), so_filename)
+            mark_build_cache_entry_used(cache_entry_dir)
+            print(f"Copied {so_filename} and {pyi_filename} from build cache {cache_entry_dir}")
+            return []
+
+    mod_coll = ModuleCollection(modules={}, features=features, field_frequencies=field_frequencies or {})
     for module_name in module_names:
         mod_coll.add_file(importlib.import_module(module_name).DESCRIPTOR)
     mod_coll.compute_global_aliases()
 
-    async def write_coll(output_basename: str, mod_coll: ModuleCollection) -> None:
-        cc_filename = output_basename + ".cc"
-        pyi_filename = output_basename + ".pyi"
-        so_filename = output_basename + ".so"
-        so_module_name = output_basename.replace("/", ".")
-
-        print(f"Generating {pyi_filename}")
-        with open(pyi_filename, "wt") as f:
-            f.write(mod_coll.pyi_source())
-        print(f"Wrote {pyi_filename}")
+    print(f"Generating {pyi_filename}")
+    with open(pyi_filename, "wt") as f:
+        f.write(mod_coll.pyi_source())
+    print(f"Wrote {pyi_filename}")
 
+    shards: list[SourceShard | None]
+    if num_message_shards == 1:
+        shards = [None]
+    else:
+        shards = list(mod_coll.source_shards(num_message_shards))
+    cc_filenames: list[str] = []
+    for shard in shards:
+        cc_filename = output_basename + (f".{shard.name}.cc" if shard is not None else ".cc")
         print(f"Generating {cc_filename}")
         with open(cc_filename, "wt") as f:
-            f.write(mod_coll.cc_source(so_module_name, add_line_directives=add_line_directives))
+            f.write(mod_coll.cc_source(so_module_name, add_line_directives=add_line_directives, shard=shard))
         print(f"Wrote {cc_filename}")
-
-        if compile_cc:
-            print(f"Compiling {cc_filename} to {so_filename}")
-            py_compiler_args = await get_compiler_args()
-            cmd = ["g++", *py_compiler_args, cc_filename, "-shared", "-o", so_filename]
-            print("... " + " ".join(cmd))
-            await check_call_async(*cmd)
-            print(f"Compiled {so_filename}")
-
-    await write_coll(output_basename, mod_coll)
+        cc_filenames.append(cc_filename)
+
+    if compile_cc:
+        if profile == BuildProfile.PGO:
+            extra_filenames = await compile_extension_module_with_pgo(
+                cc_filenames,
+                so_filename,
+                so_module_name,
+                module_names,
+                jobs=jobs,
+                features=features,
+                cache_dir=cache_dir,
+                training_data=pgo_training_data,
+            )
+        else:
+            extra_filenames = await compile_extension_module(
+                cc_filenames, so_filename, jobs=jobs, features=features, cache_dir=cache_dir, profile=profile
+            )
+        if cache_dir is not None and cache_entry_dir is not None:
+            store_in_build_cache(cache_entry_dir, so_filename, pyi_filename, extra_filenames)
+            prune_build_cache(cache_dir, cache_size_limit)
+    return cc_filenames
 
 
 async def main() -> None:
@@ -910,7 +1891,7 @@ async def main() -> None:
     parser.add_argument(
         "module_names",
         type=str,
-        nargs="+",
+        nargs="*",
         help="names of pb2 modules to compile, or paths to .proto files if --proto-files is given",
     )
     parser.add_argument(
@@ -925,20 +1906,188 @@ async def main() -> None:
         default=False,
         help="just generate the .pyi and .cc files; don't compile the .so",
     )
+    parser.add_argument(
+        "--jobs",
+        type=int,
+        default=None,
+        help="compile up to this many of the generated C++ source files at once (default: the number of CPUs)",
+    )
+    parser.add_argument(
+        "--shards",
+        type=int,
+        default=DEFAULT_NUM_MESSAGE_SHARDS,
+        help=(
+            "split the message implementations in the generated C++ source into up to this many files (default:"
+            f" {DEFAULT_NUM_MESSAGE_SHARDS}); with --shards 1, a single .cc file is generated"
+        ),
+    )
+    parser.add_argument(
+        "--cache-dir",
+        type=str,
+        default=None,
+        help=(
+            "directory to cache built modules in, keyed by a hash of the schemas, code generator, compiler, and"
+            " options (default: $PBCC_CACHE_DIR, or ~/.cache/pbcc)"
+        ),
+    )
+    parser.add_argument(
+        "--no-cache",
+        action="store_true",
+        default=False,
+        help="always build the module, and don't add it to the cache",
+    )
+    parser.add_argument(
+        "--clear-cache",
+        action="store_true",
+        default=False,
+        help="delete everything in the build cache first (module_names may be omitted to only clear the cache)",
+    )
+    parser.add_argument(
+        "--cache-size-limit",
+        type=int,
+        default=DEFAULT_BUILD_CACHE_SIZE_LIMIT // (1024 * 1024),
+        help=(
+            "after adding a module to the build cache, delete the least recently used entries until the cache is at"
+            f" most this many MiB (default: {DEFAULT_BUILD_CACHE_SIZE_LIMIT // (1024 * 1024)})"
+        ),
+    )
     parser.add_argument(
         "--output-basename",
         type=str,
-        required=True,
+        default=None,
         help="the base filename (without extension) for the generated files",
     )
+    parser.add_argument(
+        "--codec-benchmark",
+        type=str,
+        default=None,
+        help="build the wire format microbenchmark (bench_codec.cc) as this executable",
+    )
     parser.add_argument(
         "--proto-files",
         action="store_true",
         default=False,
         help="treat module_names as .proto file paths instead of Python module names",
     )
+    parser.add_argument(
+        "--field-frequency-profile",
+        type=str,
+        default=None,
+        help=(
+            "JSON file containing the output of pbcc_field_usage() or pbcc_field_profile() from a representative"
+            " workload; rarely-parsed fields are moved out of the parser's hot path, and the parser predicts which"
+            " field usually follows each hot field"
+        ),
+    )
+    parser.add_argument(
+        "--stats",
+        action="store_true",
+        default=False,
+        help="record parse/serialize statistics for each message type, available via the module's pbcc_stats()",
+    )
+    parser.add_argument(
+        "--field-usage",
+        action="store_true",
+        default=False,
+        help="count reads, writes, and parses of each field, available via the module's pbcc_field_usage()",
+    )
+    parser.add_argument(
+        "--profile-fields",
+        action="store_true",
+        default=False,
+        help="time parsing and serializing of each field, available via the module's pbcc_field_profile()",
+    )
+    parser.add_argument(
+        "--count-allocations",
+        action="store_true",
+        default=False,
+        help="count Python and C++ allocations made by a function, available via the module's pbcc_count_allocations()",
+    )
+    parser.add_argument(
+        "--live-objects",
+        action="store_true",
+        default=False,
+        help="count live instances of each message type, available via the module's pbcc_live_objects()",
+    )
+    parser.add_argument(
+        "--usdt",
+        action="store_true",
+        default=False,
+        help="add USDT probes (provider pbcc) to parse/serialize calls, for use with bpftrace, perf, etc.",
+    )
+    parser.add_argument(
+        "--shared-runtime",
+        action="store_true",
+        default=False,
+        help=(
+            "link the module against a shared runtime library (libpbcc_runtime.HASH.so, built in the output directory)"
+            " instead of compiling the runtime into it, so processes that load many modules only load it once"
+        ),
+    )
+    parser.add_argument(
+        "--profile",
+        type=str,
+        choices=[profile.value for profile in BuildProfile],
+        default=BuildProfile.RELEASE.value,
+        help=(
+            "how to optimize the module: debug (no optimization, with assertions), release (-O3), native (-O3 and LTO"
+            " for this machine's CPU), or pgo (-O3 and LTO, using a profile from a training workload)"
+        ),
+    )
+    parser.add_argument(
+        "--pgo-training-data",
+        type=str,
+        action="append",
+        default=[],
+        metavar="MESSAGE=FILE",
+        help=(
+            "with --profile pgo, train on the messages in FILE (each preceded by its length as a varint, as written"
+            " by pbcc.corpus), of type MESSAGE (e.g. my_interface.MyMessage); may be given multiple times. By"
+            " default, the training workload is random messages of every type"
+        ),
+    )
     args = parser.parse_args()
 
+    if args.clear_cache:
+        clear_build_cache(args.cache_dir or default_cache_dir())
+    if args.codec_benchmark:
+        await compile_codec_benchmark(args.codec_benchmark)
+    if (args.clear_cache or args.codec_benchmark) and not args.module_names:
+        return
+    if not args.module_names or not args.output_basename:
+        parser.error("module_names and --output-basename are required")
+
+    features: set[Feature] = set()
+    if args.stats:
+        features.add(Feature.STATS)
+    if args.field_usage:
+        features.add(Feature.FIELD_USAGE)
+    if args.profile_fields:
+        features.add(Feature.PROFILE_FIELDS)
+    if args.count_allocations:
+        features.add(Feature.ALLOC_COUNTERS)
+    if args.live_objects:
+        features.add(Feature.LIVE_OBJECTS)
+    if args.usdt:
+        features.add(Feature.USDT)
+    if args.shared_runtime:
+        features.add(Feature.SHARED_RUNTIME)
+
+    profile = BuildProfile(args.profile)
+    pgo_training_data: list[tuple[str, str]] = []
+    for arg in args.pgo_training_data:
+        message_name, sep, filename = arg.partition("=")
+        if not sep or not message_name or not filename:
+            parser.error(f"--pgo-training-data must be MESSAGE=FILE, not {arg}")
+        pgo_training_data.append((message_name, os.path.abspath(filename)))
+    if pgo_training_data and profile != BuildProfile.PGO:
+        parser.error("--pgo-training-data requires --profile pgo")
+
+    field_frequencies = (
+        load_field_frequency_profile(args.field_frequency_profile) if args.field_frequency_profile else None
+    )
+    cache_dir = None if args.no_cache else (args.cache_dir or default_cache_dir())
+
     if args.proto_files:
         with tempfile.TemporaryDirectory(dir=".") as temp_dir:
             tasks: list[Awaitable[Any]] = []
@@ -962,6 +2111,14 @@ async def main() -> None:
                 temp_module_names,
                 add_line_directives=not args.no_line_directives,
                 compile_cc=not args.source_only,
+                features=features,
+                field_frequencies=field_frequencies,
+                jobs=args.jobs,
+                num_message_shards=args.shards,
+                cache_dir=cache_dir,
+                cache_size_limit=args.cache_size_limit * 1024 * 1024,
+                profile=profile,
+                pgo_training_data=pgo_training_data,
             )
     else:
         await compile_modules(
@@ -969,6 +2126,14 @@ async def main() -> None:
             args.module_names,
             add_line_directives=not args.no_line_directives,
             compile_cc=not args.source_only,
+            features=features,
+            field_frequencies=field_frequencies,
+            jobs=args.jobs,
+            num_message_shards=args.shards,
+            cache_dir=cache_dir,
+            cache_size_limit=args.cache_size_limit * 1024 * 1024,
+            profile=profile,
+            pgo_training_data=pgo_training_data,
         )
 
 
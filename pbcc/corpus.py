@@ -0,0 +1,449 @@
+from __future__ import annotations
+
+import argparse
+import contextlib
+import dataclasses
+import importlib
+import io
+import json
+import random
+import struct
+import sys
+from collections.abc import Iterator, Sequence
+from typing import Any, BinaryIO
+
+from .compile import DataType, FieldInfo, MessageInfo, ModuleCollection
+
+# Generates synthetic corpora of random messages for benchmarking, from the same
+# schema information that compile.py generates code from. Run this as
+# `python -m pbcc.corpus --module X --message Y --count N`; see --help for
+# options. The messages are written in wire format directly (not through
+# google.protobuf or pbcc), each preceded by its length as a varint, as in
+# Java's writeDelimitedTo. The distributions of field values can be configured
+# with a JSON file; see CorpusConfig.
+
+
+@dataclasses.dataclass(kw_only=True)
+class Distribution:
+    """A histogram of integers, as a list of (low, high, weight) ranges. A
+    range is chosen with probability proportional to its weight, then a value
+    is chosen uniformly from it (including both low and high)."""
+
+    ranges: list[tuple[int, int, float]]
+
+    def __post_init__(self) -> None:
+        if not self.ranges:
+            raise ValueError("A distribution must have at least one range")
+        for low, high, weight in self.ranges:
+            if low > high or weight < 0:
+                raise ValueError(f"Invalid distribution range: ({low}, {high}, {weight})")
+        self._weights = [weight for _, _, weight in self.ranges]
+
+    @classmethod
+    def from_json(cls, obj: Sequence[Sequence[float]]) -> Distribution:
+        return cls(ranges=[(int(low), int(high), float(weight)) for low, high, weight in obj])
+
+    def sample(self, rng: random.Random) -> int:
+        low, high, _ = rng.choices(self.ranges, weights=self._weights)[0]
+        return rng.randint(low, high)
+
+
+@dataclasses.dataclass(kw_only=True)
+class CorpusConfig:
+    """The distributions that generated messages are drawn from. In a JSON
+    config file, each distribution is a list of [low, high, weight] ranges,
+    and any field that isn't given has its default value."""
+
+    # Probability that each singular field, submessage, and oneof is set
+    presence_rate: float = 0.8
+    # Submessages nested more deeply than this are never set
+    max_depth: int = 3
+    # Number of items in each repeated field
+    repeated_length: Distribution = dataclasses.field(
+        default_factory=lambda: Distribution(ranges=[(0, 0, 1), (1, 4, 4), (5, 16, 2), (17, 256, 1)])
+    )
+    # Number of entries in each map field
+    map_size: Distribution = dataclasses.field(
+        default_factory=lambda: Distribution(ranges=[(0, 0, 1), (1, 8, 4), (9, 64, 1)])
+    )
+    # Length of each string field, in characters
+    string_length: Distribution = dataclasses.field(
+        default_factory=lambda: Distribution(ranges=[(0, 0, 1), (1, 8, 4), (9, 32, 3), (33, 256, 1), (257, 4096, 0.1)])
+    )
+    # Fraction of characters in strings that aren't ASCII
+    non_ascii_rate: float = 0.05
+    # Length of each bytes field
+    bytes_length: Distribution = dataclasses.field(
+        default_factory=lambda: Distribution(ranges=[(0, 0, 1), (1, 16, 4), (17, 256, 2), (257, 16384, 0.2)])
+    )
+    # Size in bytes of each varint field's encoding (1-10). This is the mix of
+    # value magnitudes; for int32 and int64 fields, 10 means a negative value
+    varint_size: Distribution = dataclasses.field(
+        default_factory=lambda: Distribution(ranges=[(1, 1, 6), (2, 2, 2), (3, 5, 1), (6, 10, 0.5)])
+    )
+
+    @classmethod
+    def from_json(cls, obj: dict[str, Any]) -> CorpusConfig:
+        kwargs: dict[str, Any] = {}
+        field_types = {f.name: f.type for f in dataclasses.fields(cls)}
+        for key, value in obj.items():
+            if key not in field_types:
+                raise ValueError(f"Unknown corpus config field: {key}")
+            kwargs[key] = Distribution.from_json(value) if field_types[key] == "Distribution" else value
+        return cls(**kwargs)
+
+
+UINT32_MASK = (1 << 32) - 1
+UINT64_MASK = (1 << 64) - 1
+
+# The characters that strings are made of
+ASCII_CHARS = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 "
+NON_ASCII_CHARS = "éüßøλжअ中文日本語🙂"
+
+WIRE_TYPE_VARINT = 0
+WIRE_TYPE_FIXED64 = 1
+WIRE_TYPE_LENGTH = 2
+WIRE_TYPE_FIXED32 = 5
+
+VARINT_DATA_TYPES: frozenset[DataType] = frozenset(
+    {
+        DataType.INT32,
+        DataType.UINT32,
+        DataType.SINT32,
+        DataType.INT64,
+        DataType.UINT64,
+        DataType.SINT64,
+        DataType.BOOL,
+        DataType.ENUM,
+    }
+)
+
+# {data_type: (struct format, wire type)} for fixed-width types
+FIXED_WIDTH_FORMATS: dict[DataType, tuple[str, int]] = {
+    DataType.FLOAT: ("<f", WIRE_TYPE_FIXED32),
+    DataType.FIXED32: ("<I", WIRE_TYPE_FIXED32),
+    DataType.SFIXED32: ("<i", WIRE_TYPE_FIXED32),
+    DataType.DOUBLE: ("<d", WIRE_TYPE_FIXED64),
+    DataType.FIXED64: ("<Q", WIRE_TYPE_FIXED64),
+    DataType.SFIXED64: ("<q", WIRE_TYPE_FIXED64),
+}
+
+
+def encode_varint(value: int) -> bytes:
+    """Encodes an unsigned varint; negative values are encoded as their 64-bit
+    two's complement, as for int32 and int64 fields."""
+    value &= UINT64_MASK
+    ret = bytearray()
+    while value >= 0x80:
+        ret.append((value & 0x7F) | 0x80)
+        value >>= 7
+    ret.append(value)
+    return bytes(ret)
+
+
+def encode_tag(field_num: int, wire_type: int) -> bytes:
+    return encode_varint((field_num << 3) | wire_type)
+
+
+def zigzag_decode(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def zigzag_encode(value: int) -> int:
+    return (value << 1) ^ (value >> 63)
+
+
+def random_varint_magnitude(rng: random.Random, config: CorpusConfig) -> tuple[int, int]:
+    """Returns (size, value), where value is a random unsigned value whose
+    varint encoding is size bytes long."""
+    size = min(10, max(1, config.varint_size.sample(rng)))
+    if size == 1:
+        return size, rng.randint(0, 0x7F)
+    return size, rng.randint(1 << (7 * (size - 1)), min(UINT64_MASK, (1 << (7 * size)) - 1))
+
+
+def random_string(rng: random.Random, config: CorpusConfig) -> str:
+    length = config.string_length.sample(rng)
+    if config.non_ascii_rate <= 0:
+        return "".join(rng.choices(ASCII_CHARS, k=length))
+    return "".join(
+        rng.choice(NON_ASCII_CHARS) if rng.random() < config.non_ascii_rate else rng.choice(ASCII_CHARS)
+        for _ in range(length)
+    )
+
+
+def random_scalar_value(field: FieldInfo, rng: random.Random, config: CorpusConfig) -> Any:
+    """Returns a random value for a field of a primitive (non-message) type."""
+    data_type = field.data_type
+    if data_type in (DataType.INT32, DataType.INT64):
+        size, value = random_varint_magnitude(rng, config)
+        bits = 31 if data_type == DataType.INT32 else 63
+        value &= (1 << bits) - 1
+        return -value - 1 if size == 10 else value
+    elif data_type == DataType.UINT32:
+        return random_varint_magnitude(rng, config)[1] & UINT32_MASK
+    elif data_type == DataType.UINT64:
+        return random_varint_magnitude(rng, config)[1]
+    elif data_type == DataType.SINT32:
+        return zigzag_decode(random_varint_magnitude(rng, config)[1] & UINT32_MASK)
+    elif data_type == DataType.SINT64:
+        return zigzag_decode(random_varint_magnitude(rng, config)[1])
+    elif data_type == DataType.BOOL:
+        return rng.random() < 0.5
+    elif data_type == DataType.ENUM:
+        assert field.enum is not None
+        return rng.choice(list(field.enum.members.values()))
+    elif data_type in (DataType.FLOAT, DataType.DOUBLE):
+        # Round floats to single precision, so they survive a round trip
+        value = rng.uniform(-1e6, 1e6)
+        return struct.unpack("<f", struct.pack("<f", value))[0] if data_type == DataType.FLOAT else value
+    elif data_type in (DataType.FIXED32, DataType.SFIXED32, DataType.FIXED64, DataType.SFIXED64):
+        bits = 32 if data_type in (DataType.FIXED32, DataType.SFIXED32) else 64
+        value = rng.getrandbits(bits)
+        if data_type in (DataType.SFIXED32, DataType.SFIXED64) and value >= (1 << (bits - 1)):
+            value -= 1 << bits
+        return value
+    elif data_type == DataType.STRING:
+        return random_string(rng, config)
+    elif data_type == DataType.BYTES:
+        return rng.randbytes(config.bytes_length.sample(rng))
+    raise ValueError(f"Not a scalar data type: {data_type}")
+
+
+def encode_scalar_payload(data_type: DataType, value: Any) -> bytes:
+    """Encodes a primitive value without its tag (and without a length prefix
+    for strings and bytes)."""
+    if data_type in (DataType.SINT32, DataType.SINT64):
+        return encode_varint(zigzag_encode(value))
+    elif data_type in VARINT_DATA_TYPES:
+        return encode_varint(int(value))
+    elif data_type in FIXED_WIDTH_FORMATS:
+        return struct.pack(FIXED_WIDTH_FORMATS[data_type][0], value)
+    elif data_type == DataType.STRING:
+        return value.encode("utf-8")
+    elif data_type == DataType.BYTES:
+        return value
+    raise ValueError(f"Not a scalar data type: {data_type}")
+
+
+def encode_field(field: FieldInfo, value: Any) -> bytes:
+    """Encodes one value of a field (for a repeated field, one item, unpacked)
+    with its tag. Message values must already be encoded."""
+    data_type = field.data_type
+    if data_type in VARINT_DATA_TYPES:
+        return encode_tag(field.field_num, WIRE_TYPE_VARINT) + encode_scalar_payload(data_type, value)
+    elif data_type in FIXED_WIDTH_FORMATS:
+        return encode_tag(field.field_num, FIXED_WIDTH_FORMATS[data_type][1]) + encode_scalar_payload(data_type, value)
+    payload = value if data_type in (DataType.MESSAGE, DataType.MAP) else encode_scalar_payload(data_type, value)
+    return encode_tag(field.field_num, WIRE_TYPE_LENGTH) + encode_varint(len(payload)) + payload
+
+
+def generate_field(field: FieldInfo, rng: random.Random, config: CorpusConfig, depth: int) -> bytes:
+    """Returns the encoded values of one field, which is always set (though a
+    repeated field may have no items)."""
+    if field.data_type == DataType.MAP:
+        assert field.submessage is not None and field.submessage.map_types is not None
+        key_field, value_field = field.submessage.map_types
+        keys: set[Any] = set()
+        num_entries = config.map_size.sample(rng)
+        if value_field.data_type == DataType.MESSAGE and depth >= config.max_depth:
+            num_entries = 0
+        # Keys are distinct, since only the last entry with each key counts
+        for _ in range(num_entries * 4):
+            if len(keys) >= num_entries:
+                break
+            keys.add(random_scalar_value(key_field, rng, config))
+        entries: list[bytes] = []
+        for key in keys:
+            if value_field.data_type == DataType.MESSAGE:
+                assert value_field.submessage is not None
+                value = generate_message(value_field.submessage, rng, config, depth + 1)
+            else:
+                value = random_scalar_value(value_field, rng, config)
+            entry = encode_field(key_field, key) + encode_field(value_field, value)
+            entries.append(encode_field(field, entry))
+        return b"".join(entries)
+
+    if field.data_type == DataType.MESSAGE:
+        assert field.submessage is not None
+        if field.is_repeated:
+            count = config.repeated_length.sample(rng) if depth < config.max_depth else 0
+            return b"".join(
+                encode_field(field, generate_message(field.submessage, rng, config, depth + 1)) for _ in range(count)
+            )
+        return encode_field(field, generate_message(field.submessage, rng, config, depth + 1))
+
+    if not field.is_repeated:
+        return encode_field(field, random_scalar_value(field, rng, config))
+
+    values = [random_scalar_value(field, rng, config) for _ in range(config.repeated_length.sample(rng))]
+    if not values:
+        return b""
+    if field.data_type in (DataType.STRING, DataType.BYTES):
+        return b"".join(encode_field(field, value) for value in values)
+    # Repeated numeric fields are packed, as proto3 does by default
+    payload = b"".join(encode_scalar_payload(field.data_type, value) for value in values)
+    return encode_tag(field.field_num, WIRE_TYPE_LENGTH) + encode_varint(len(payload)) + payload
+
+
+def generate_message(message: MessageInfo, rng: random.Random, config: CorpusConfig, depth: int = 0) -> bytes:
+    """Returns the wire format of a random message of the given type."""
+    ret: list[bytes] = []
+    for py_name, fields in message.field_groups.items():
+        is_oneof = (len(fields) > 1) or (fields[0].name != py_name)
+        if is_oneof:
+            if rng.random() < config.presence_rate:
+                field = rng.choice(fields)
+                if field.data_type != DataType.MESSAGE or depth < config.max_depth:
+                    ret.append(generate_field(field, rng, config, depth))
+            continue
+
+        field = fields[0]
+        if field.is_repeated:
+            ret.append(generate_field(field, rng, config, depth))
+        elif field.data_type == DataType.MESSAGE:
+            if depth < config.max_depth and rng.random() < config.presence_rate:
+                ret.append(generate_field(field, rng, config, depth))
+        elif rng.random() < config.presence_rate:
+            value = random_scalar_value(field, rng, config)
+            # Fields without presence aren't written if they have the default
+            # value, as protobuf's own serializers do
+            if field.is_optional or value:
+                ret.append(encode_field(field, value))
+    return b"".join(ret)
+
+
+def generate_corpus(message: MessageInfo, count: int, seed: int = 0, config: CorpusConfig | None = None) -> list[bytes]:
+    """Returns count random messages of the given type, in wire format. The
+    same seed and config always produce the same messages."""
+    rng = random.Random(seed)
+    config = config or CorpusConfig()
+    return [generate_message(message, rng, config) for _ in range(count)]
+
+
+def load_message_info(module_name: str, message_name: str) -> MessageInfo:
+    """Returns the schema information for a message defined in a pb2 module
+    (message_name is relative to the module, e.g. Outer.Inner)."""
+    mod_coll = ModuleCollection(modules={})
+    # ModuleCollection reports its progress on stdout, which may be where the
+    # corpus is written
+    with contextlib.redirect_stdout(io.StringIO()):
+        mod_info = mod_coll.add_file(importlib.import_module(module_name).DESCRIPTOR)
+    message = mod_info.messages.get(message_name)
+    if message is None or message.map_types is not None:
+        raise ValueError(f"Module {module_name} doesn't define message {message_name}")
+    return message
+
+
+def write_delimited(f: BinaryIO, messages: Sequence[bytes]) -> None:
+    for data in messages:
+        f.write(encode_varint(len(data)))
+        f.write(data)
+
+
+def iter_delimited(data: bytes) -> Iterator[bytes]:
+    """Yields each message from a corpus written by write_delimited."""
+    offset = 0
+    while offset < len(data):
+        length = 0
+        shift = 0
+        while True:
+            if offset >= len(data):
+                raise ValueError("Corpus ends within a length prefix")
+            b = data[offset]
+            offset += 1
+            length |= (b & 0x7F) << shift
+            shift += 7
+            if not (b & 0x80):
+                break
+        if offset + length > len(data):
+            raise ValueError("Corpus ends within a message")
+        yield data[offset : offset + length]
+        offset += length
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Generate a corpus of random messages for benchmarking")
+    parser.add_argument(
+        "--module",
+        type=str,
+        required=True,
+        help="name of the pb2 module that defines the message (e.g. test_modules.test_pb2)",
+    )
+    parser.add_argument(
+        "--message",
+        type=str,
+        required=True,
+        help="name of the message type within the module",
+    )
+    parser.add_argument(
+        "--count",
+        type=int,
+        required=True,
+        help="number of messages to generate",
+    )
+    parser.add_argument(
+        "--seed",
+        type=int,
+        default=0,
+        help="seed for the random number generator",
+    )
+    parser.add_argument(
+        "--config",
+        type=str,
+        default=None,
+        help="JSON file with the distributions to draw field values from (see CorpusConfig in corpus.py)",
+    )
+    parser.add_argument(
+        "--presence-rate",
+        type=float,
+        default=None,
+        help="probability that each singular field is set (overrides the config file)",
+    )
+    parser.add_argument(
+        "--max-depth",
+        type=int,
+        default=None,
+        help="maximum nesting depth of submessages (overrides the config file)",
+    )
+    parser.add_argument(
+        "--output",
+        type=str,
+        default=None,
+        help="write the corpus to this file instead of stdout",
+    )
+    args = parser.parse_args()
+
+    config_json: dict[str, Any] = {}
+    if args.config:
+        with open(args.config, "rt") as f:
+            config_json = json.load(f)
+    if args.presence_rate is not None:
+        config_json["presence_rate"] = args.presence_rate
+    if args.max_depth is not None:
+        config_json["max_depth"] = args.max_depth
+    try:
+        config = CorpusConfig.from_json(config_json)
+        message = load_message_info(args.module, args.message)
+    except ValueError as e:
+        parser.error(str(e))
+
+    messages = generate_corpus(message, args.count, seed=args.seed, config=config)
+    if args.output:
+        with open(args.output, "wb") as f:
+            write_delimited(f, messages)
+    else:
+        write_delimited(sys.stdout.buffer, messages)
+        sys.stdout.buffer.flush()
+
+    total_size = sum(len(data) for data in messages)
+    print(
+        f"Generated {len(messages)} {message.module_name}.{message.name} messages ({total_size} bytes,"
+        f" {total_size / max(1, len(messages)):.1f} bytes per message)",
+        file=sys.stderr,
+    )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,159 @@
+"""An import hook that builds pbcc modules when they're first imported.
+
+After install() is called, importing a module whose name ends with _pbcc (for example, my_package.my_interface_pbcc)
+builds it from the corresponding pb2 module (my_package.my_interface_pb2) if it can be imported, or otherwise from the
+corresponding .proto file (my_package/my_interface.proto). Modules are built through the build cache, so a module is
+only compiled the first time it's imported with a given schema, compiler, and set of options; after that, importing it
+just loads the cached .so.
+
+"""
+
+from __future__ import annotations
+
+import asyncio
+import concurrent.futures
+import contextlib
+import importlib.abc
+import importlib.machinery
+import importlib.util
+import io
+import os
+import subprocess
+import sys
+import tempfile
+from collections.abc import Coroutine, Iterable, Sequence
+from types import ModuleType
+from typing import Any
+
+from .compile import (
+    CACHED_SO_FILENAME,
+    BuildProfile,
+    Feature,
+    build_cache_key,
+    compile_modules,
+    default_cache_dir,
+    mark_build_cache_entry_used,
+)
+
+PBCC_MODULE_SUFFIX = "_pbcc"
+PB2_MODULE_SUFFIX = "_pb2"
+
+
+def run_coroutine(coro: Coroutine[Any, Any, Any]) -> Any:
+    """Runs a coroutine to completion, even if an event loop is already running in this thread (which is the case if
+    the import happens within async code)."""
+    try:
+        asyncio.get_running_loop()
+    except RuntimeError:
+        return asyncio.run(coro)
+    with concurrent.futures.ThreadPoolExecutor(max_workers=1) as executor:
+        return executor.submit(asyncio.run, coro).result()
+
+
+class PBCCImportHook(importlib.abc.MetaPathFinder):
+    """Finds pbcc modules by building them from pb2 modules or .proto files. See the module docstring."""
+
+    def __init__(
+        self,
+        cache_dir: str | None = None,
+        features: Iterable[Feature] = (),
+        jobs: int | None = None,
+        verbose: bool = False,
+        profile: BuildProfile = BuildProfile.RELEASE,
+    ):
+        self.cache_dir = os.path.abspath(cache_dir or default_cache_dir())
+        self.features = set(features)
+        self.jobs = jobs
+        self.profile = profile
+        self.verbose = verbose
+
+    def find_spec(
+        self, fullname: str, path: Sequence[str] | None, target: ModuleType | None = None
+    ) -> importlib.machinery.ModuleSpec | None:
+        if not fullname.endswith(PBCC_MODULE_SUFFIX):
+            return None
+        pb2_module_name = fullname.removesuffix(PBCC_MODULE_SUFFIX) + PB2_MODULE_SUFFIX
+        if pb2_module_name not in sys.modules and importlib.util.find_spec(pb2_module_name) is None:
+            proto_filename = self.find_proto_file(fullname, path)
+            if proto_filename is None:
+                return None
+            self.load_proto_file(proto_filename, pb2_module_name)
+
+        with contextlib.redirect_stdout(sys.stderr if self.verbose else io.StringIO()):
+            so_filename = run_coroutine(self.build(fullname, pb2_module_name))
+        loader = importlib.machinery.ExtensionFileLoader(fullname, so_filename)
+        return importlib.util.spec_from_file_location(fullname, so_filename, loader=loader)
+
+    @staticmethod
+    def find_proto_file(fullname: str, path: Sequence[str] | None) -> str | None:
+        basename = fullname.rpartition(".")[2].removesuffix(PBCC_MODULE_SUFFIX) + ".proto"
+        for dir_name in path if path is not None else sys.path:
+            proto_filename = os.path.join(dir_name or ".", basename)
+            if os.path.isfile(proto_filename):
+                return proto_filename
+        return None
+
+    @staticmethod
+    def load_proto_file(proto_filename: str, pb2_module_name: str) -> None:
+        """Generates a pb2 module from a .proto file with protoc, and imports it as pb2_module_name. The .proto file's
+        own imports must be importable as pb2 modules already."""
+        proto_dir, proto_basename = os.path.split(os.path.abspath(proto_filename))
+        with tempfile.TemporaryDirectory() as temp_dir:
+            subprocess.check_call(
+                (
+                    sys.executable,
+                    "-m",
+                    "grpc_tools.protoc",
+                    f"-I{proto_dir}",
+                    proto_basename,
+                    f"--python_out={temp_dir}",
+                ),
+                cwd=proto_dir,
+            )
+            pb2_filename = os.path.join(temp_dir, proto_basename.removesuffix(".proto") + "_pb2.py")
+            spec = importlib.util.spec_from_file_location(pb2_module_name, pb2_filename)
+            assert spec is not None and spec.loader is not None
+            module = importlib.util.module_from_spec(spec)
+            sys.modules[pb2_module_name] = module
+            try:
+                spec.loader.exec_module(module)
+            except BaseException:
+                del sys.modules[pb2_module_name]
+                raise
+
+    async def build(self, fullname: str, pb2_module_name: str) -> str:
+        """Builds the module through the build cache if it isn't already cached, and returns the cached .so's path."""
+        cache_key = await build_cache_key([pb2_module_name], fullname, features=self.features, profile=self.profile)
+        so_filename = os.path.join(self.cache_dir, cache_key, CACHED_SO_FILENAME)
+        if os.path.isfile(so_filename):
+            mark_build_cache_entry_used(os.path.dirname(so_filename))
+        else:
+            with tempfile.TemporaryDirectory() as temp_dir:
+                await compile_modules(
+                    os.path.join(temp_dir, fullname.rpartition(".")[2]),
+                    [pb2_module_name],
+                    features=self.features,
+                    jobs=self.jobs,
+                    so_module_name=fullname,
+                    cache_dir=self.cache_dir,
+                    profile=self.profile,
+                )
+        return so_filename
+
+
+def install(
+    cache_dir: str | None = None,
+    features: Iterable[Feature] = (),
+    jobs: int | None = None,
+    verbose: bool = False,
+    profile: BuildProfile = BuildProfile.RELEASE,
+) -> PBCCImportHook:
+    """Installs the import hook. It takes precedence over other finders, so a stale .so file on sys.path won't be
+    imported instead of an up-to-date build. Returns the hook, which can be passed to uninstall()."""
+    hook = PBCCImportHook(cache_dir=cache_dir, features=features, jobs=jobs, verbose=verbose, profile=profile)
+    sys.meta_path.insert(0, hook)
+    return hook
+
+
+def uninstall(hook: PBCCImportHook) -> None:
+    sys.meta_path.remove(hook)
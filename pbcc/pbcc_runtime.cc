@@ -0,0 +1,270 @@
+// Non-template functions of the pbcc runtime (see pbcc_runtime.h). This file
+// is compiled into each module's runtime shard, or built once as the shared
+// libpbcc_runtime with compile.py --shared-runtime. Nothing here may depend on
+// the optional features, since the shared library is built without them.
+
+#include "pbcc_runtime.h"
+
+std::string repr(PyObject* obj) {
+  PyObjectRef<> repr = raise_python_errors(PyObject_Repr, obj);
+  if (!PyUnicode_Check(repr.borrow())) {
+    throw std::runtime_error("repr() returned something other than a unicode object");
+  }
+  return std::string(PyUnicode_AsUTF8(repr.borrow()));
+}
+
+PyObject* py_dict_value_for_primitive_value(PyObject* obj) {
+  // Hack: If the object has a .as_dict() method, call it and use the result.
+  // Otherwise, just use the object itself.
+  int has_as_dict = PyObject_HasAttrString(obj, "as_dict");
+  if (has_as_dict == -1) {
+    throw python_error("");
+  }
+  if (has_as_dict) {
+    PyObjectRef<> method = raise_python_errors(PyObject_GetAttrString, obj, "as_dict");
+    // args must not be null (so we use an empty tuple) but kwargs can be
+    // null, according to the docs
+    PyObjectRef<> args = raise_python_errors(PyTuple_New, 0);
+    return raise_python_errors(PyObject_Call, method.borrow(), args.borrow(), nullptr);
+  } else {
+    Py_INCREF(obj);
+    return obj;
+  }
+}
+
+PyObject* py_dict_value_for_value(PyObject* obj) {
+  if (PyList_Check(obj)) {
+    ssize_t num_items = PyList_Size(obj);
+    if (num_items < 0) {
+      throw python_error("");
+    }
+    PyObjectRef<> ret = raise_python_errors(PyList_New, num_items);
+    for (ssize_t z = 0; z < num_items; z++) {
+      PyList_SET_ITEM(ret.borrow(), z, py_dict_value_for_value(PyList_GET_ITEM(obj, z)));
+    }
+    return ret.release();
+
+  } else if (PyDict_Check(obj)) {
+    PyObjectRef<> ret = raise_python_errors(PyDict_New);
+    // key and value will be borrowed references, so we don't have to DECREF them
+    PyObject* key;
+    PyObject* value;
+    Py_ssize_t pos = 0;
+    // TODO: In the free-threaded build, we'll need PY_BEGIN_CRITICAL_SECTION
+    // here, but that macro isn't (yet?) compatible with C++. See
+    // https://docs.python.org/3/c-api/dict.html#c.PyDict_Next
+    while (PyDict_Next(obj, &pos, &key, &value)) {
+      PyObjectRef<> new_value = py_dict_value_for_value(value);
+      PyDict_SetItem(ret.borrow(), key, new_value.borrow());
+    }
+    return ret.release();
+
+  } else {
+    return py_dict_value_for_primitive_value(obj);
+  }
+}
+
+[[noreturn]] void rethrow_with_prefix(const std::string& prefix, const std::exception& e) {
+  if (dynamic_cast<const std::out_of_range*>(&e)) {
+    throw std::out_of_range(prefix + e.what());
+  } else if (dynamic_cast<const incorrect_type_error*>(&e)) {
+    throw incorrect_type_error(prefix + e.what());
+  } else {
+    throw std::runtime_error(prefix + e.what());
+  }
+}
+
+[[noreturn]] void throw_incorrect_type(WireType expected_type, WireType received_type) {
+  throw incorrect_type_error(string_printf(
+      "Incorrect type: expected %s, received %s",
+      name_for_wire_type(expected_type), name_for_wire_type(received_type)));
+}
+
+bool reset_message_for_reuse(PyObject* obj, ParseIntoMessageFn parse_into_message) {
+  return parse_into_message && is_exclusively_owned(obj) && parse_into_message(obj, nullptr, 0, ParseFlag::REUSE_OBJECTS);
+}
+
+bool truncate_list_for_reuse(PyObject* obj, Py_ssize_t size) {
+  if (!PyList_Check(obj) || !is_exclusively_owned(obj)) {
+    return false;
+  }
+  Py_ssize_t existing_size = PyList_GET_SIZE(obj);
+  if ((existing_size > size) && PyList_SetSlice(obj, size, existing_size, nullptr)) {
+    throw python_error("");
+  }
+  return true;
+}
+
+bool clear_dict_for_reuse(PyObject* obj) {
+  if (!PyDict_Check(obj) || !is_exclusively_owned(obj)) {
+    return false;
+  }
+  PyDict_Clear(obj);
+  return true;
+}
+
+PyObject* iter_repeated_field_items(PyObject* obj) {
+  if (!PyUnicode_Check(obj) && !PyBytes_Check(obj) && !PyByteArray_Check(obj) && !PyDict_Check(obj)) {
+    PyObject* it = PyObject_GetIter(obj);
+    if (it) {
+      return it;
+    }
+    if (!PyErr_ExceptionMatches(PyExc_TypeError)) {
+      throw python_error("");
+    }
+    PyErr_Clear();
+  }
+  throw std::runtime_error("Value expected to be a list or other iterable but it isn\'t");
+}
+
+PyObject* make_py_array(const char* typecode, const StringWriter& column) {
+  PyObjectRef<> array_module = raise_python_errors(PyImport_ImportModule, "array");
+  PyObjectRef<> array_type = raise_python_errors(PyObject_GetAttrString, array_module.borrow(), "array");
+  return raise_python_errors(PyObject_CallFunction, array_type.borrow(), "sy#", typecode, column.str().data(), static_cast<Py_ssize_t>(column.size()));
+}
+
+bool objects_equal(PyObject* a, PyObject* b) {
+  if (a == b) {
+    return true;
+  }
+  int ret = PyObject_RichCompareBool(a, b, Py_EQ);
+  if (ret < 0) {
+    throw python_error("");
+  }
+  return ret;
+}
+
+void throw_unpatchable_value(PyObject* b) {
+  if (b == Py_None) {
+    throw std::runtime_error("Field was cleared, which can\'t be represented in a patch");
+  }
+  throw std::runtime_error("Incorrect data type for field: " + repr(b));
+}
+
+[[noreturn]] void throw_value_error(const std::string& message) {
+  PyErr_SetString(PyExc_ValueError, message.c_str());
+  throw python_error("");
+}
+
+PyObject* copy_message(PyObject* obj, ParseMessageFn parse_message, MergeMessageFn merge_message) {
+  if (!parse_message || !merge_message) {
+    throw std::logic_error("Merger not available for submessage");
+  }
+  PyObjectRef<> ret = parse_message(nullptr, 0, 0);
+  merge_message(ret.borrow(), obj);
+  return ret.release();
+}
+
+size_t unknown_fields_heap_size(const std::unordered_multimap<uint64_t, std::string>& unknown_fields) {
+  if (unknown_fields.empty()) {
+    return 0;
+  }
+  size_t ret = unknown_fields.bucket_count() * sizeof(void*);
+  for (const auto& it : unknown_fields) {
+    // Each node has a next pointer, the key/value pair, and the cached hash
+    ret += sizeof(void*) + sizeof(it) + sizeof(size_t);
+    // Short strings are stored inline, so only count the string's buffer if
+    // it's outside the string object
+    const char* data = it.second.data();
+    if ((data < reinterpret_cast<const char*>(&it.second)) || (data >= reinterpret_cast<const char*>(&it.second + 1))) {
+      ret += it.second.capacity() + 1;
+    }
+  }
+  return ret;
+}
+
+size_t py_sys_getsizeof(PyObject* obj) {
+  // This is intentionally never released, since it may hold the last
+  // reference to the sys module, which can't be destroyed after the
+  // interpreter is finalized
+  static PyObject* getsizeof_fn = nullptr;
+  if (!getsizeof_fn) {
+    PyObjectRef<> sys_module = raise_python_errors(PyImport_ImportModule, "sys");
+    getsizeof_fn = raise_python_errors(PyObject_GetAttrString, sys_module.borrow(), "getsizeof");
+  }
+  PyObjectRef<> py_size = raise_python_errors(PyObject_CallOneArg, getsizeof_fn, obj);
+  size_t ret = PyLong_AsSize_t(py_size.borrow());
+  if (ret == static_cast<size_t>(-1) && PyErr_Occurred()) {
+    throw python_error("");
+  }
+  return ret;
+}
+
+size_t deep_sizeof_generic(PyObject* obj, std::unordered_set<PyObject*>& seen) {
+  if (!deep_sizeof_should_count(obj, seen)) {
+    return 0;
+  }
+  size_t ret = py_sys_getsizeof(obj);
+  if (PyList_Check(obj) || PyTuple_Check(obj)) {
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(obj);
+    PyObject** items = PySequence_Fast_ITEMS(obj);
+    for (Py_ssize_t z = 0; z < count; z++) {
+      ret += deep_sizeof_generic(items[z], seen);
+    }
+  } else if (PyDict_Check(obj)) {
+    PyObject* key;
+    PyObject* value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(obj, &pos, &key, &value)) {
+      ret += deep_sizeof_generic(key, seen);
+      ret += deep_sizeof_generic(value, seen);
+    }
+  }
+  return ret;
+}
+
+void explain_map_entry_size(StringReader& entry_r, const std::string& path, ExplainSizeMessageFn explain_value_message, EncodedSizeExplanation& out) {
+  while (!entry_r.eof()) {
+    uint64_t tag = decode_varint(entry_r);
+    WireType received_type = wire_type_for_tag(tag);
+    if ((field_num_for_tag(tag) == 2) && (received_type == WireType::LENGTH) && explain_value_message) {
+      uint64_t size = decode_varint(entry_r);
+      StringReader value_r = entry_r.subx(entry_r.where(), size);
+      entry_r.skip(size);
+      explain_value_message(value_r, path + ".", out);
+    } else {
+      skip_field(entry_r, received_type);
+    }
+  }
+}
+
+PyObject* encoded_size_explanation_as_py_dict(const EncodedSizeExplanation& explanation, size_t num_messages, size_t total_bytes) {
+  PyObjectRef<> ret = raise_python_errors(PyDict_New);
+  EncodedSizeEntry message_entry;
+  message_entry.count = num_messages;
+  message_entry.elements = num_messages;
+  message_entry.payload_bytes = total_bytes;
+  PyObjectRef<> py_message_entry = message_entry.as_py_dict();
+  if (PyDict_SetItemString(ret.borrow(), "(message)", py_message_entry.borrow())) {
+    throw python_error("");
+  }
+  for (const auto& [path, entry] : explanation) {
+    PyObjectRef<> py_entry = entry.as_py_dict();
+    if (PyDict_SetItemString(ret.borrow(), path.c_str(), py_entry.borrow())) {
+      throw python_error("");
+    }
+  }
+  return ret.release();
+}
+
+StatsErrorReason current_exception_reason() {
+  try {
+    throw;
+  } catch (const std::out_of_range&) {
+    return StatsErrorReason::TRUNCATED_DATA;
+  } catch (const incorrect_type_error&) {
+    return StatsErrorReason::INCORRECT_TYPE;
+  } catch (const python_error&) {
+    return StatsErrorReason::PYTHON_ERROR;
+  } catch (...) {
+    return StatsErrorReason::INVALID_DATA;
+  }
+}
+
+#ifdef PBCC_SHARED_RUNTIME
+// The explicit instantiations matching the extern declarations in
+// pbcc_runtime.h
+#define PBCC_TEMPLATE_INSTANTIATION template PBCC_RUNTIME_API
+PBCC_INSTANTIATE_RUNTIME_TEMPLATES()
+#undef PBCC_TEMPLATE_INSTANTIATION
+#endif
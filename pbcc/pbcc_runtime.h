@@ -0,0 +1,2924 @@
+// The generic runtime for pbcc modules: Python object and enum references,
+// the field codecs, and the templates for repeated, map, and oneof fields,
+// diffing, merging, memory accounting, and instrumentation. Nothing here
+// depends on a particular schema; pymodule.in.cc includes this file first, so
+// it can be used as a precompiled header. The optional features are enabled
+// by defining their PBCC_* macros before including this file; the
+// instrumentation state declared here is defined once in each module (in its
+// runtime shard), even when the module uses the shared runtime library.
+
+// This uses an include guard rather than #pragma once, since GCC warns about
+// #pragma once when the file is compiled on its own as a precompiled header.
+#ifndef PBCC_RUNTIME_H
+#define PBCC_RUNTIME_H
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "wire_format.h"
+
+// Non-template functions that don't depend on the module's features are
+// defined in pbcc_runtime.cc. Normally that file is compiled into each module
+// (and these functions are hidden, like everything else in the module), but
+// with compile.py --shared-runtime, it's built once as libpbcc_runtime, which
+// exports them, and modules link against it.
+#ifdef PBCC_SHARED_RUNTIME
+#define PBCC_RUNTIME_API __attribute__((visibility("default")))
+#else
+#define PBCC_RUNTIME_API
+#endif
+
+static constexpr ssize_t REPR_STRING_MAX_CHARACTERS = 10000;
+static constexpr ssize_t REPR_STRING_MAX_BYTES = 100;
+
+class PBCC_RUNTIME_API python_error : public std::runtime_error {
+public:
+  using runtime_error::runtime_error;
+};
+
+template <typename Func, typename... ArgTs>
+PyObject* raise_python_errors(Func&& func, ArgTs&&... args) {
+  PyObject* ret = std::forward<Func>(func)(std::forward<ArgTs>(args)...);
+  if (ret == nullptr) {
+    throw python_error("");
+  }
+  return ret;
+}
+
+template <typename Func, typename... ArgTs>
+PyObject* handle_python_errors(Func&& func, ArgTs&&... args) {
+  try {
+    return reinterpret_cast<PyObject*>(std::forward<Func>(func)(std::forward<ArgTs>(args)...));
+  } catch (const python_error& e) {
+    if (!PyErr_Occurred()) {
+      throw std::logic_error("python_error exception caught without Python error state set");
+    }
+
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+
+    if (value) {
+      PyObject* prefixed_message = PyUnicode_FromFormat("%s%S", e.what(), value);
+      PyErr_Restore(type, prefixed_message, traceback);
+      Py_DECREF(value);
+    } else {
+      PyErr_Restore(type, value, traceback);
+    }
+    return nullptr;
+
+  } catch (const std::exception& e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return nullptr;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Object references
+
+// This class holds a reference to a PyObject. When constructed, this class
+// takes ownership of the passed-in reference (the caller should NOT call
+// Py_DECREF on it). This can be thought of as an analogue to std::shared_ptr,
+// but for Python objects.
+// NOTE: There is no operator PyObject*, and this is intentional - we want the
+// caller to have to think about whether they want to borrow the reference or
+// make a new reference, so they must call .borrow() or .new_ref() to get it.
+template <typename TargetT = PyObject>
+struct PyObjectRef {
+  TargetT* obj;
+
+  PyObjectRef() : obj(nullptr) {}
+  PyObjectRef(TargetT* obj) : obj(obj) {}
+  ~PyObjectRef() {
+    this->clear();
+  }
+
+  // Technically these could be made copyable, but we don't really need that
+  // functionality, and leaving the copy constructors deleted allows us to
+  // detect extraneous increfs/decrefs.
+  PyObjectRef(const PyObjectRef& other) = delete;
+  PyObjectRef& operator=(const PyObjectRef& other) = delete;
+
+  PyObjectRef(PyObjectRef&& other) : obj(other.obj) {
+    other.obj = nullptr;
+  }
+  PyObjectRef& operator=(PyObjectRef&& other) {
+    PyObject* prev_obj = this->obj;
+    this->obj = other.obj;
+    other.obj = nullptr;
+    Py_XDECREF(prev_obj);
+    return *this;
+  }
+
+  operator bool() const {
+    return !!this->obj;
+  }
+  void assign_ref(TargetT* obj) {
+    TargetT* prev_obj = this->obj;
+    this->obj = obj;
+    Py_XDECREF(prev_obj);
+  }
+  TargetT* borrow() const {
+    return this->obj;
+  }
+  TargetT* new_ref() const {
+    Py_INCREF(this->obj);
+    return this->obj;
+  }
+  TargetT* release() {
+    TargetT* ret = this->obj;
+    this->obj = nullptr;
+    return ret;
+  }
+  TargetT* operator->() const {
+    return this->obj;
+  }
+  inline void clear() {
+    this->assign_ref(nullptr);
+  }
+};
+static_assert(sizeof(PyObjectRef<>) == sizeof(PyObject*), "PyObjectRef contains more than just a single pointer");
+
+PBCC_RUNTIME_API std::string repr(PyObject* obj);
+
+////////////////////////////////////////////////////////////////////////////////
+// Enums
+
+// This class holds a reference to a constructed Python Enum class and allows
+// fast native lookups of the values and Python value objects. This should be
+// subclassed and instantiated once for each enum the caller intends to use.
+class PyEnumRef {
+public:
+  void create_py_enum() {
+    PyObjectRef<> enum_module = raise_python_errors(PyImport_ImportModule, "enum");
+    // NOTE: We intentionally don't use IntEnum here, to prevent users from
+    // accidentally assigning an enum value to an int-valued field.
+    PyObjectRef<> enum_class = raise_python_errors(PyObject_GetAttrString, enum_module.borrow(), "IntEnum");
+    PyObjectRef<> enum_name = raise_python_errors(PyUnicode_FromString, this->get_python_name());
+    PyObjectRef<> enum_members = raise_python_errors(PyDict_New);
+
+    this->populate_values(enum_members.borrow());
+
+    PyObjectRef<> args = raise_python_errors(PyTuple_Pack, 2, enum_name.borrow(), enum_members.borrow());
+    PyObjectRef<> local_py_enum = raise_python_errors(PyObject_CallObject, enum_class.borrow(), args.borrow());
+
+    // Populate the values map by iterating the constructed enum class
+    PyObjectRef<> it = raise_python_errors(PyObject_GetIter, local_py_enum.borrow());
+    while (PyObjectRef<> entry = PyIter_Next(it.borrow())) {
+      PyObjectRef<> enum_value = raise_python_errors(PyObject_GetAttrString, entry.borrow(), "value");
+
+      // Enum values can be negative in protobuf, and they just get encoded
+      // as unsigned 32-bit integers anyway (which is inefficient). To
+      // implement this behavior, we treat the Python integer as signed, then
+      // immediately discard its sign information.
+      int64_t value = PyLong_AsLongLong(enum_value.borrow());
+      if (!is_in_s32_range(value)) {
+        throw std::runtime_error("Enum value outside of signed 32-bit range");
+      } else if ((value != -1) || !PyErr_Occurred()) {
+        auto& ref = this->py_enum_value_for_int_value[value];
+        ref.assign_ref(entry.release());
+        this->int_value_for_py_enum_value.emplace(ref.borrow(), value);
+      } else {
+        throw python_error("");
+      }
+    }
+    if (PyErr_Occurred()) {
+      throw python_error("");
+    }
+
+    // It seems the enum members can't be pickled because the pickler can't
+    // look up which module they're in (it appears as importlib._bootstrap)
+    // unless we do this.
+    PyObjectRef<> module_name_str = PyUnicode_FromString(this->get_module_name());
+    PyObject_SetAttrString(local_py_enum.borrow(), "__module__", module_name_str.borrow());
+
+    this->py_enum.assign_ref(local_py_enum.release());
+  }
+
+  const PyObjectRef<>& py_enum_class() {
+    return this->py_enum;
+  }
+  bool has_py_member(const PyObject* obj) const {
+    return this->int_value_for_py_enum_value.count(obj);
+  }
+  const PyObjectRef<>& py_member_for_value(int64_t value) const {
+    try {
+      return this->py_enum_value_for_int_value.at(value);
+    } catch (const std::out_of_range&) {
+      throw std::runtime_error(string_printf("Enum member %" PRIu64 " does not exist", value));
+    }
+  }
+  int64_t value_for_py_member(const PyObject* obj) const {
+    try {
+      return this->int_value_for_py_enum_value.at(obj);
+    } catch (const std::out_of_range&) {
+      throw std::runtime_error("Value is not an enum member");
+    }
+  }
+
+protected:
+  virtual const char* get_module_name() const = 0;
+  virtual const char* get_python_name() const = 0;
+  virtual void populate_values(PyObject* dict) = 0;
+
+private:
+  std::unordered_map<const PyObject*, int64_t> int_value_for_py_enum_value;
+  std::unordered_map<int64_t, PyObjectRef<>> py_enum_value_for_int_value;
+  PyObjectRef<> py_enum;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Python C API utility functions
+
+PBCC_RUNTIME_API PyObject* py_dict_value_for_primitive_value(PyObject* obj);
+PBCC_RUNTIME_API PyObject* py_dict_value_for_value(PyObject* obj);
+
+///////////////////////////////////////////////////////////////////////////////
+// Protobuf definitions
+
+template <DataType data_type>
+  requires(is_uint_data_type(data_type) && data_type != DataType::BOOL && data_type != DataType::ENUM)
+bool obj_has_default_value(PyObject* obj, const PyEnumRef*) {
+  if (!PyLong_Check(obj)) {
+    return false;
+  }
+  uint64_t ret = PyLong_AsUnsignedLongLong(obj);
+  if (ret == 0) {
+    return true;
+  } else if ((ret != static_cast<uint64_t>(-1)) || !PyErr_Occurred()) {
+    return false;
+  } else {
+    throw python_error("");
+  }
+}
+template <DataType data_type>
+  requires(is_sint_data_type(data_type))
+bool obj_has_default_value(PyObject* obj, const PyEnumRef*) {
+  if (!PyLong_Check(obj)) {
+    return false;
+  }
+  int64_t ret = PyLong_AsLongLong(obj);
+  if (ret == 0) {
+    return true;
+  } else if ((ret != -1) || !PyErr_Occurred()) {
+    return false;
+  } else {
+    throw python_error("");
+  }
+}
+template <DataType data_type>
+  requires(is_float_data_type(data_type))
+bool obj_has_default_value(PyObject* obj, const PyEnumRef*) {
+  if (!PyFloat_Check(obj) && !PyLong_Check(obj)) {
+    return false;
+  }
+  double ret = PyFloat_AsDouble(obj);
+  if (ret == 0.0) {
+    return true;
+  } else if ((ret != -1.0) || !PyErr_Occurred()) {
+    return false;
+  } else {
+    throw python_error("");
+  }
+}
+template <DataType data_type>
+  requires(data_type == DataType::BOOL)
+bool obj_has_default_value(PyObject* obj, const PyEnumRef*) {
+  return PyBool_Check(obj) && Py_IsFalse(obj);
+}
+template <DataType data_type>
+  requires(data_type == DataType::ENUM)
+bool obj_has_default_value(PyObject* obj, const PyEnumRef* enum_ref) {
+  try {
+    return (enum_ref->value_for_py_member(obj) == 0);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+}
+template <DataType data_type>
+  requires(data_type == DataType::STRING)
+bool obj_has_default_value(PyObject* obj, const PyEnumRef*) {
+  if (!PyUnicode_Check(obj)) {
+    return false;
+  }
+  ssize_t length = PyUnicode_GetLength(obj);
+  if (length == 0) {
+    return true;
+  } else if (length != -1.0) {
+    return false;
+  } else {
+    throw python_error("");
+  }
+}
+template <DataType data_type>
+  requires(data_type == DataType::BYTES)
+bool obj_has_default_value(PyObject* obj, const PyEnumRef*) {
+  if (!PyBytes_Check(obj)) {
+    return false;
+  }
+  ssize_t length = PyBytes_Size(obj);
+  if (length == 0) {
+    return true;
+  } else if (length != -1.0) {
+    return false;
+  } else {
+    throw python_error("");
+  }
+}
+template <DataType data_type>
+  requires(is_message_data_type(data_type))
+bool obj_has_default_value(PyObject*, const PyEnumRef*) {
+  // TODO: This shouldn't always return false. This shouldn't cause any
+  // correctness issues but probably causes us to waste some space.
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Field codecs
+
+enum ParseFlag {
+  RETAIN_UNKNOWN_FIELDS = 0x01,
+  IGNORE_INCORRECT_TYPES = 0x02,
+  // Reuse the existing field objects when parsing into an existing message:
+  // each field that appears in the data replaces the field's existing value
+  // (instead of merging into it), but reuses its list, dict, or submessage
+  // object instead of constructing a new one. Fields that don't appear in the
+  // data are reset to their default values in place.
+  REUSE_OBJECTS = 0x04,
+};
+
+using ParseMessageFn = PyObject* (*)(const void* data, size_t size, uint8_t flags);
+// Returns false (and does nothing) if obj isn't an instance of the message type
+using ParseIntoMessageFn = bool (*)(PyObject* obj, const void* data, size_t size, uint8_t flags);
+using SerializeMessageFn = void (*)(PyObject* obj, StringWriter&);
+using DiffMessageFn = void (*)(PyObject* a, PyObject* b, const std::string& prefix, std::vector<std::string>& paths);
+using SerializePatchFn = void (*)(PyObject* a, PyObject* b, StringWriter& w);
+using MergeMessageFn = void (*)(PyObject* dest, PyObject* src);
+struct FieldMaskTree;
+using UpdateMessageFn = void (*)(PyObject* dest, PyObject* src, const FieldMaskTree& mask);
+
+class PBCC_RUNTIME_API incorrect_type_error : public std::runtime_error {
+public:
+  using runtime_error::runtime_error;
+};
+
+// Rethrows e with a prefix added to its message (e.g. to identify the field
+// that failed), preserving the exception categories that the statistics code
+// distinguishes
+[[noreturn]] PBCC_RUNTIME_API void rethrow_with_prefix(const std::string& prefix, const std::exception& e);
+
+[[noreturn]] PBCC_RUNTIME_API void throw_incorrect_type(WireType expected_type, WireType received_type);
+
+inline PyObject* create_py_none() {
+  Py_RETURN_NONE;
+}
+inline PyObject* create_py_false() {
+  Py_RETURN_FALSE;
+}
+inline PyObject* create_py_int_zero() {
+  return raise_python_errors(PyLong_FromLong, 0);
+}
+inline PyObject* create_py_float_zero() {
+  return raise_python_errors(PyFloat_FromDouble, 0.0);
+}
+inline PyObject* create_py_empty_str() {
+  return raise_python_errors(PyUnicode_FromStringAndSize, nullptr, 0);
+}
+inline PyObject* create_py_empty_bytes() {
+  return raise_python_errors(PyBytes_FromStringAndSize, nullptr, 0);
+}
+inline PyObject* create_py_empty_list() {
+  return raise_python_errors(PyList_New, 0);
+}
+inline PyObject* create_py_empty_dict() {
+  return raise_python_errors(PyDict_New);
+}
+
+// The following three functions are templates, specialized (via `requires`)
+// for each data type.
+
+template <DataType...>
+struct AlwaysFalse {
+  static constexpr bool v = false;
+};
+
+template <DataType data_type>
+struct TypeCodec {
+  static bool value_matches_type(PyObject*, PyEnumRef*, PyTypeObject*, bool) {
+    static_assert(AlwaysFalse<data_type>::v, "Unspecialized TypeCodec::value_matches_type should never be called");
+    return false;
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    static_assert(AlwaysFalse<data_type>::v, "Unspecialized TypeCodec::construct_default should never be called");
+    return nullptr;
+  }
+  static PyObject* parse(StringReader&, PyEnumRef*, ParseMessageFn, uint8_t) {
+    static_assert(AlwaysFalse<data_type>::v, "Unspecialized TypeCodec::parse should never be called");
+    return nullptr;
+  }
+  static void serialize_without_tag(StringWriter&, PyObject*, PyEnumRef*, SerializeMessageFn) {
+    static_assert(AlwaysFalse<data_type>::v, "Unspecialized TypeCodec::serialize_without_tag should never be called");
+  }
+};
+
+template <>
+struct TypeCodec<DataType::INT32> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromLong, static_cast<int32_t>(decode_varint(r)));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    int64_t v = PyLong_AsLongLong(obj);
+    if (v == static_cast<int64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    if (!is_in_s32_range(v)) {
+      throw std::runtime_error("Integer value out of signed 32-bit range");
+    }
+    // Note: It appears Google's protobuf library encodes this as if it were a
+    // 64-bit integer, so -1 is encoded as 10 bytes instead of 5 bytes. We do
+    // the same here, even though it's probably wrong.
+    encode_varint(w, static_cast<uint64_t>(v));
+  }
+};
+
+template <>
+struct TypeCodec<DataType::UINT32> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromUnsignedLong, decode_varint(r));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    uint64_t v = PyLong_AsUnsignedLongLong(obj);
+    if (v == static_cast<uint64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    if (!is_in_u32_range(v)) {
+      throw std::runtime_error("Integer value out of unsigned 32-bit range");
+    }
+    encode_varint(w, v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::SINT32> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromLong, decode_varint_signed(r));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    int64_t v = PyLong_AsLongLong(obj);
+    if (v == -1 && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    if (!is_in_s32_range(v)) {
+      throw std::runtime_error("Integer value out of signed 32-bit range");
+    }
+    encode_varint_signed32(w, v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::INT64> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromLongLong, static_cast<int64_t>(decode_varint(r)));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    int64_t v = PyLong_AsLongLong(obj);
+    if (v == -1 && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    encode_varint(w, static_cast<uint64_t>(v));
+  }
+};
+
+template <>
+struct TypeCodec<DataType::UINT64> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromUnsignedLongLong, decode_varint(r));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    uint64_t v = PyLong_AsUnsignedLongLong(obj);
+    if (v == static_cast<uint64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    encode_varint(w, v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::SINT64> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromLongLong, decode_varint_signed(r));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    int64_t v = PyLong_AsLongLong(obj);
+    if (v == static_cast<int64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    encode_varint_signed64(w, v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::FIXED32> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromUnsignedLong, r.get_u32l());
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    uint64_t v = PyLong_AsUnsignedLongLong(obj);
+    if (v == static_cast<uint64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    if (!is_in_u32_range(v)) {
+      throw std::runtime_error("Integer value out of unsigned 32-bit range");
+    }
+    w.put_u32l(v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::SFIXED32> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromLong, r.get_s32l());
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    int64_t v = PyLong_AsLongLong(obj);
+    if (v == -1 && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    if (!is_in_s32_range(v)) {
+      throw std::runtime_error("Integer value out of unsigned 32-bit range");
+    }
+    w.put_s32l(v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::FIXED64> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromUnsignedLongLong, r.get_u64l());
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    uint64_t v = PyLong_AsUnsignedLongLong(obj);
+    if (v == static_cast<uint64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    w.put_u64l(v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::SFIXED64> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_int_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyLong_FromLongLong, r.get_s64l());
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    int64_t v = PyLong_AsLongLong(obj);
+    if (v == static_cast<int64_t>(-1) && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    w.put_s64l(v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::BOOL> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyBool_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_false();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyBool_FromLong, decode_varint(r));
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    if (obj == Py_True) {
+      w.put_u8(0x01);
+    } else if (obj == Py_False) {
+      w.put_u8(0x00);
+    } else {
+      throw std::invalid_argument("Boolean value was neither True nor False");
+    }
+  }
+};
+
+template <>
+struct TypeCodec<DataType::FLOAT> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyFloat_Check(obj) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_float_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyFloat_FromDouble, r.get_f32l());
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    float v = PyFloat_AsDouble(obj);
+    if (v == -1.0 && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    w.put_f32l(v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::DOUBLE> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyFloat_Check(obj) || PyLong_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_float_zero();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    return raise_python_errors(PyFloat_FromDouble, r.get_f64l());
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    double v = PyFloat_AsDouble(obj);
+    if (v == -1.0 && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    w.put_f64l(v);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::BYTES> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyBytes_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_empty_bytes();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    uint64_t size = decode_varint(r);
+    return raise_python_errors(PyBytes_FromStringAndSize, reinterpret_cast<const char*>(r.getv(size)), size);
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    char* data;
+    ssize_t size;
+    if (PyBytes_AsStringAndSize(obj, &data, &size)) {
+      throw python_error("");
+    }
+    encode_varint(w, size);
+    w.write(data, size);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::STRING> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject*, bool is_optional) {
+    return (is_optional && (obj == Py_None)) || PyUnicode_Check(obj);
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn) {
+    return create_py_empty_str();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn, uint8_t) {
+    uint64_t size = decode_varint(r);
+    return raise_python_errors(PyUnicode_FromStringAndSize, reinterpret_cast<const char*>(r.getv(size)), size);
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn) {
+    ssize_t size;
+    const char* data = PyUnicode_AsUTF8AndSize(obj, &size);
+    if (!data) {
+      throw python_error("");
+    }
+    encode_varint(w, size);
+    w.write(data, size);
+  }
+};
+
+template <>
+struct TypeCodec<DataType::ENUM> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef* enum_ref, PyTypeObject*, bool is_optional) {
+    if (!enum_ref) {
+      throw std::logic_error("Enum definition is missing");
+    }
+    return (is_optional && (obj == Py_None)) || enum_ref->has_py_member(obj);
+  }
+  static PyObject* construct_default(PyEnumRef* enum_ref, ParseMessageFn) {
+    return enum_ref->py_member_for_value(0).new_ref();
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef* enum_ref, ParseMessageFn, uint8_t) {
+    if (!enum_ref) {
+      throw std::logic_error("Enum definition is missing");
+    }
+    int64_t v = static_cast<int64_t>(decode_varint(r));
+    return enum_ref->py_member_for_value(v).new_ref();
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef* enum_ref, SerializeMessageFn) {
+    encode_varint(w, enum_ref->value_for_py_member(obj));
+  }
+};
+
+template <>
+struct TypeCodec<DataType::MESSAGE> {
+  static bool value_matches_type(PyObject* obj, PyEnumRef*, PyTypeObject* type, bool is_optional) {
+    if (is_optional && (obj == Py_None)) {
+      return true;
+    }
+    int is_this_type = PyObject_IsInstance(obj, reinterpret_cast<PyObject*>(type));
+    if (is_this_type == 1) {
+      return true;
+    } else if (is_this_type == 0) {
+      return false;
+    } else {
+      throw python_error("");
+    }
+  }
+  static PyObject* construct_default(PyEnumRef*, ParseMessageFn parse) {
+    return parse(nullptr, 0, false);
+  }
+  static PyObject* parse(StringReader& r, PyEnumRef*, ParseMessageFn parse_message, uint8_t flags) {
+    uint64_t size = decode_varint(r);
+    if (!parse_message) {
+      throw std::logic_error("Parser not available for submessage");
+    }
+    return parse_message(r.getv(size), size, flags);
+  }
+  static void serialize_without_tag(StringWriter& w, PyObject* obj, PyEnumRef*, SerializeMessageFn serialize_message) {
+    if (!serialize_message) {
+      throw std::logic_error("Serializer not available for submessage");
+    }
+    StringWriter sub_w;
+    serialize_message(obj, sub_w);
+    encode_varint(w, sub_w.size());
+    w.write(sub_w.str());
+  }
+};
+
+// Serializes a field AND its tag, unless its value is the default value
+
+enum class DefaultBehavior {
+  // Don't write anything if the value is None
+  OPTIONAL = 0,
+  // Don't write anything if the value is the default
+  REQUIRED,
+  // Always write the value, even if it's the default (this is needed to make
+  // sure that default values in repeated fields are serialized properly))
+  ALWAYS_WRITE,
+};
+
+template <DataType data_type>
+void serialize_with_tag(StringWriter& w, uint64_t field_num, DefaultBehavior default_behavior, PyObject* obj, PyEnumRef* enum_ref, SerializeMessageFn serialize_message) {
+  // Optional fields are typed as `X | None`. If it's None, serialize nothing.
+  // Non-optional fields cannot be None, so serialize nothing if the field has
+  // its default value.
+  bool should_write;
+  switch (default_behavior) {
+    case DefaultBehavior::OPTIONAL:
+      should_write = (obj != Py_None);
+      break;
+    case DefaultBehavior::REQUIRED:
+      should_write = !obj_has_default_value<data_type>(obj, enum_ref);
+      break;
+    case DefaultBehavior::ALWAYS_WRITE:
+      should_write = true;
+      break;
+    default:
+      throw std::logic_error("invalid default behavior");
+  }
+  if (should_write) {
+    encode_varint(w, encode_tag(field_num, wire_type_for_data_type(data_type)));
+    TypeCodec<data_type>::serialize_without_tag(w, obj, enum_ref, serialize_message);
+  }
+}
+template <>
+inline void serialize_with_tag<DataType::MESSAGE>(StringWriter& w, uint64_t field_num, DefaultBehavior default_behavior, PyObject* obj, PyEnumRef*, SerializeMessageFn serialize_message) {
+  if ((default_behavior == DefaultBehavior::OPTIONAL) && (obj == Py_None)) {
+    return;
+  }
+  if (!serialize_message) {
+    throw std::logic_error("Serializer not available for submessage");
+  }
+  StringWriter sub_w;
+  serialize_message(obj, sub_w);
+  if ((sub_w.size() == 0) && (default_behavior == DefaultBehavior::REQUIRED)) {
+    // The submessage had no non-default values and is not optional; no need to
+    // serialize anything
+    return;
+  }
+  encode_varint(w, encode_tag(field_num, wire_type_for_data_type(DataType::MESSAGE)));
+  encode_varint(w, sub_w.size());
+  w.write(sub_w.str());
+}
+
+// Returns true if obj is referenced only by the field slot (or list or dict)
+// that holds it, so it can be modified in place. Messages, lists, and dicts
+// may be shared with other messages (proto_copy() is shallow, and the same
+// object may be passed to several constructors) or held by the caller, so
+// any other object must be copied or replaced instead of being modified.
+inline bool is_exclusively_owned(PyObject* obj) {
+  return Py_REFCNT(obj) == 1;
+}
+
+// Makes a deep copy of a message by merging it into a new, empty message
+PBCC_RUNTIME_API PyObject* copy_message(PyObject* obj, ParseMessageFn parse_message, MergeMessageFn merge_message);
+
+// Parses a non-repeated field's value into its slot. Per the protobuf spec, a
+// submessage is merged into the slot's existing value if it already holds a
+// message of the same type (copying it first if it's shared, or just replacing
+// it if the parser is reusing objects); all other values just replace the
+// existing value.
+template <DataType data_type>
+void parse_singular_field(
+    PyObjectRef<>& slot,
+    StringReader& r,
+    PyEnumRef* enum_ref,
+    PyTypeObject* py_message_type,
+    ParseMessageFn parse_message,
+    ParseIntoMessageFn parse_into_message,
+    MergeMessageFn merge_message,
+    uint8_t flags) {
+  if constexpr (data_type == DataType::MESSAGE) {
+    if (!parse_message || !parse_into_message) {
+      throw std::logic_error("Parser not available for submessage");
+    }
+    uint64_t size = decode_varint(r);
+    const void* data = r.getv(size);
+    if (PyObject_TypeCheck(slot.borrow(), py_message_type) && !is_exclusively_owned(slot.borrow())) {
+      if (flags & ParseFlag::REUSE_OBJECTS) {
+        slot.assign_ref(parse_message(data, size, flags));
+        return;
+      }
+      slot.assign_ref(copy_message(slot.borrow(), parse_message, merge_message));
+    }
+    if (!parse_into_message(slot.borrow(), data, size, flags)) {
+      slot.assign_ref(parse_message(data, size, flags));
+    }
+  } else {
+    slot.assign_ref(TypeCodec<data_type>::parse(r, enum_ref, parse_message, flags));
+  }
+}
+
+// Profile-guided tag prediction. When a field frequency profile is given to
+// compile.py, the generated parser checks after parsing each hot field whether
+// the next tag is the one that usually follows it (the next hot field in field
+// number order, since serializers write fields in that order, or the same
+// field again if it's repeated and not packed). If so, it jumps straight to
+// that field's parsing code, skipping the tag decoding and the switch. Only
+// tags that fit in one byte are predicted.
+
+// Returns the one-byte tag that a field is usually written with (repeated
+// scalar fields are usually packed)
+constexpr uint8_t predicted_tag_byte(uint64_t field_num, DataType data_type, bool is_repeated) {
+  WireType wire_type = (is_repeated && can_use_packed_repeated_format(data_type))
+      ? WireType::LENGTH
+      : wire_type_for_data_type(data_type);
+  return static_cast<uint8_t>((field_num << 3) | static_cast<uint64_t>(wire_type));
+}
+
+// Repeated field parsing/serializing
+
+// Object reuse (see ParseFlag::REUSE_OBJECTS). While parsing, the parser keeps
+// a reuse index for each field, which is -1 until the field first appears in
+// the data, then counts the items parsed into the field's list (for repeated
+// fields). After parsing, fields that didn't appear are reset in place.
+
+// Returns true if this is the first time the field appears in the data (and
+// therefore its existing value should be replaced rather than merged into)
+static inline bool begin_reuse_field(Py_ssize_t& reuse_index, uint8_t flags) {
+  if (!(flags & ParseFlag::REUSE_OBJECTS) || (reuse_index >= 0)) {
+    return false;
+  }
+  reuse_index = 0;
+  return true;
+}
+
+// Each of these returns false if obj isn't of the expected type or is shared
+// (see is_exclusively_owned), in which case the caller should replace it with
+// a new default value instead
+PBCC_RUNTIME_API bool reset_message_for_reuse(PyObject* obj, ParseIntoMessageFn parse_into_message);
+PBCC_RUNTIME_API bool truncate_list_for_reuse(PyObject* obj, Py_ssize_t size);
+PBCC_RUNTIME_API bool clear_dict_for_reuse(PyObject* obj);
+
+// Returns the list that a repeated field's items are parsed into. The field
+// may hold a sequence other than a list (for example, a tuple assigned from
+// Python) or a list that's shared with something else; it's replaced with a new
+// list first, which is empty if the parser is reusing objects (since all
+// existing items would be replaced anyway) and otherwise contains the existing
+// items, so the parsed items are merged in.
+inline PyObject* list_for_parsing_repeated_field(PyObjectRef<>& field, uint8_t flags) {
+  if (!PyList_CheckExact(field.borrow()) || !is_exclusively_owned(field.borrow())) {
+    if (flags & ParseFlag::REUSE_OBJECTS) {
+      field.assign_ref(raise_python_errors(PyList_New, 0));
+    } else {
+      field.assign_ref(raise_python_errors(PySequence_List, field.borrow()));
+    }
+  }
+  return field.borrow();
+}
+
+// Parses an item and adds it to a repeated field's list. If reuse_index isn't
+// null, the parser is reusing the field's existing list (see
+// ParseFlag::REUSE_OBJECTS) and reuse_index is the number of items parsed into
+// it so far; the existing item at that index (if any) is replaced, or reparsed
+// in place if it's a message of the right type that isn't shared.
+template <DataType data_type>
+void parse_repeated_item(
+    PyObject* list,
+    StringReader& r,
+    PyEnumRef* enum_ref,
+    ParseMessageFn parse_message,
+    ParseIntoMessageFn parse_into_message,
+    uint8_t flags,
+    Py_ssize_t* reuse_index) {
+  if (reuse_index && (*reuse_index < PyList_GET_SIZE(list))) {
+    PyObjectRef<> item;
+    if constexpr (data_type == DataType::MESSAGE) {
+      if (!parse_message || !parse_into_message) {
+        throw std::logic_error("Parser not available for submessage");
+      }
+      uint64_t size = decode_varint(r);
+      const void* data = r.getv(size);
+      PyObject* existing_item = PyList_GET_ITEM(list, *reuse_index);
+      if (!is_exclusively_owned(existing_item) || !parse_into_message(existing_item, data, size, flags)) {
+        item.assign_ref(parse_message(data, size, flags));
+        if (!item) {
+          throw python_error("");
+        }
+      }
+    } else {
+      item.assign_ref(TypeCodec<data_type>::parse(r, enum_ref, parse_message, flags));
+      if (!item) {
+        throw python_error("");
+      }
+    }
+    // PyList_SetItem steals the reference to the item, even if it fails
+    if (item && PyList_SetItem(list, *reuse_index, item.release())) {
+      throw python_error("");
+    }
+  } else {
+    PyObjectRef<> v = TypeCodec<data_type>::parse(r, enum_ref, parse_message, flags);
+    if (PyList_Append(list, v.borrow())) {
+      throw python_error("");
+    }
+  }
+  if (reuse_index) {
+    (*reuse_index)++;
+  }
+}
+
+template <DataType data_type>
+void parse_packed_repeated(
+    PyObject* list,
+    StringReader& r,
+    PyEnumRef* enum_ref,
+    ParseMessageFn parse_message,
+    ParseIntoMessageFn parse_into_message,
+    uint8_t flags,
+    Py_ssize_t* reuse_index) {
+  // Get the length, then parse as many items as possible from the following
+  // bytes and append them all to the list
+  uint64_t size = decode_varint(r);
+  StringReader sub_r = r.subx(r.where(), size);
+  r.skip(size);
+  while (!sub_r.eof()) {
+    parse_repeated_item<data_type>(list, sub_r, enum_ref, parse_message, parse_into_message, flags, reuse_index);
+  }
+}
+
+template <DataType data_type>
+void parse_unpacked_repeated(
+    PyObject* list,
+    StringReader& r,
+    PyEnumRef* enum_ref,
+    ParseMessageFn parse_message,
+    ParseIntoMessageFn parse_into_message,
+    uint8_t flags,
+    Py_ssize_t* reuse_index) {
+  // Parse a single item and append it to the list
+  parse_repeated_item<data_type>(list, r, enum_ref, parse_message, parse_into_message, flags, reuse_index);
+}
+
+// When serializing, repeated fields may hold any iterable (not only lists), so
+// huge fields can be produced from generators without materializing them.
+// Such an iterable is consumed by serializing it, so a generator can only be
+// serialized once. Strings, bytes, and dicts are iterable, but are never
+// reasonable values for repeated fields, so they're rejected.
+PBCC_RUNTIME_API PyObject* iter_repeated_field_items(PyObject* obj);
+
+// Serializes a repeated field in packed format (LENGTH). If fixed_item_size is
+// nonzero and the field is a list, the length is known before serializing the
+// items, so it's written first; otherwise, the length is inserted before the
+// items after they're all written.
+template <typename SerializeItemFn>
+void serialize_packed_repeated_with_tag(StringWriter& w, uint64_t field_num, PyObject* items, size_t fixed_item_size, SerializeItemFn&& serialize_item) {
+  PyObjectRef<> it = iter_repeated_field_items(items);
+
+  size_t start_offset = w.size();
+  encode_varint(w, encode_tag(field_num, WireType::LENGTH));
+  bool size_written = (fixed_item_size != 0) && PyList_Check(items);
+  size_t expected_end_offset = 0;
+  if (size_written) {
+    size_t data_size = PyList_GET_SIZE(items) * fixed_item_size;
+    encode_varint(w, data_size);
+    expected_end_offset = w.size() + data_size;
+  }
+  size_t data_offset = w.size();
+
+  size_t index = 0;
+  while (PyObjectRef<> item = PyIter_Next(it.borrow())) {
+    try {
+      serialize_item(item.borrow());
+    } catch (const python_error& e) {
+      throw python_error(string_printf("(Index:%zu) ", index) + e.what());
+    } catch (const std::exception& e) {
+      rethrow_with_prefix(string_printf("(Index:%zu) ", index), e);
+    }
+    index++;
+  }
+  if (PyErr_Occurred()) {
+    throw python_error("");
+  }
+
+  if (index == 0) {
+    // Empty repeated fields aren't written at all
+    w.truncate(start_offset);
+  } else if (size_written) {
+    if (expected_end_offset != w.size()) {
+      throw std::runtime_error("Serialized size does not match expected size");
+    }
+  } else {
+    StringWriter size_w;
+    encode_varint(size_w, w.size() - data_offset);
+    w.insert(data_offset, size_w.str());
+  }
+}
+
+template <DataType data_type>
+  requires(is_int32_data_type(data_type) || is_int64_data_type(data_type))
+void serialize_repeated_with_tag(StringWriter& w, uint64_t field_num, PyObject* list, PyEnumRef*, SerializeMessageFn, PyTypeObject*) {
+  serialize_packed_repeated_with_tag(w, field_num, list, is_int64_data_type(data_type) ? 8 : 4, [&](PyObject* item) -> void {
+    if (!TypeCodec<data_type>::value_matches_type(item, nullptr, nullptr, false)) {
+      throw std::runtime_error("Incorrect data type for field: " + repr(item));
+    }
+    TypeCodec<data_type>::serialize_without_tag(w, item, nullptr, nullptr);
+  });
+}
+
+template <DataType data_type>
+  requires(is_varint_data_type(data_type))
+void serialize_repeated_with_tag(StringWriter& w, uint64_t field_num, PyObject* list, PyEnumRef* enum_ref, SerializeMessageFn, PyTypeObject*) {
+  serialize_packed_repeated_with_tag(w, field_num, list, 0, [&](PyObject* item) -> void {
+    if (!TypeCodec<data_type>::value_matches_type(item, enum_ref, nullptr, false)) {
+      throw std::runtime_error("Incorrect data type for field: " + repr(item));
+    }
+    TypeCodec<data_type>::serialize_without_tag(w, item, enum_ref, nullptr);
+  });
+}
+
+template <DataType data_type>
+  requires(is_string_data_type(data_type) || (data_type == DataType::MESSAGE))
+void serialize_repeated_with_tag(StringWriter& w, uint64_t field_num, PyObject* list, PyEnumRef*, SerializeMessageFn serialize_message, PyTypeObject* py_message_type) {
+  // Serialize in standard (non-packed) repeated format
+  PyObjectRef<> it = iter_repeated_field_items(list);
+  size_t index = 0;
+  while (PyObjectRef<> item = PyIter_Next(it.borrow())) {
+    try {
+      if (!TypeCodec<data_type>::value_matches_type(item.borrow(), nullptr, py_message_type, false)) {
+        throw std::runtime_error("Incorrect data type for field: " + repr(item.borrow()));
+      }
+      serialize_with_tag<data_type>(w, field_num, DefaultBehavior::ALWAYS_WRITE, item.borrow(), nullptr, serialize_message);
+    } catch (const python_error& e) {
+      throw python_error(string_printf("(Index:%zu) ", index) + e.what());
+    } catch (const std::exception& e) {
+      rethrow_with_prefix(string_printf("(Index:%zu) ", index), e);
+    }
+    index++;
+  }
+  if (PyErr_Occurred()) {
+    throw python_error("");
+  }
+}
+
+// Map field parsing/serializing
+
+// Returns the dict that a map field's entries are parsed into. If reuse is
+// true (the parser is reusing objects and this is the field's first appearance
+// in the data), the existing dict is cleared or replaced with a new empty dict;
+// otherwise a shared dict is replaced with a copy, so the parsed entries are
+// added to the existing ones without affecting anything else.
+inline PyObject* dict_for_parsing_map_field(PyObjectRef<>& field, bool reuse) {
+  if (reuse) {
+    if (!clear_dict_for_reuse(field.borrow())) {
+      field.assign_ref(create_py_empty_dict());
+    }
+  } else if (PyDict_Check(field.borrow()) && !is_exclusively_owned(field.borrow())) {
+    field.assign_ref(raise_python_errors(PyDict_Copy, field.borrow()));
+  }
+  return field.borrow();
+}
+
+template <DataType key_type, DataType value_type>
+void parse_map(
+    PyObject* dict,
+    StringReader& r,
+    PyEnumRef* value_enum_ref,
+    ParseMessageFn value_parse_message,
+    uint8_t flags) {
+  // We don't bother with "proper" message decoding here, since the key and
+  // value types are known and there can only be two fields in the submessage.
+  uint64_t size = decode_varint(r);
+  StringReader sub_r = r.subx(r.where(), size);
+  r.skip(size);
+  PyObjectRef<> key, value;
+  while (!sub_r.eof()) {
+    uint64_t tag = decode_varint(sub_r);
+    WireType wire_type = wire_type_for_tag(tag);
+    uint64_t field_num = field_num_for_tag(tag);
+    // TODO: It'd be nice to store unknown fields here due to incorrect types;
+    // currently we always raise in such situations
+    if (field_num == 1) {
+      if (wire_type != wire_type_for_data_type(key_type)) {
+        throw_incorrect_type(wire_type_for_data_type(key_type), wire_type);
+      }
+      key.assign_ref(TypeCodec<key_type>::parse(sub_r, nullptr, nullptr, flags));
+    } else if (field_num == 2) {
+      if (wire_type != wire_type_for_data_type(value_type)) {
+        throw_incorrect_type(wire_type_for_data_type(value_type), wire_type);
+      }
+      value.assign_ref(TypeCodec<value_type>::parse(sub_r, value_enum_ref, value_parse_message, flags));
+    }
+  }
+  // If either the key or value is missing, parse an empty string to construct the default value
+  if (!key) {
+    key.assign_ref(TypeCodec<key_type>::construct_default(nullptr, nullptr));
+  }
+  if (!value) {
+    value.assign_ref(TypeCodec<value_type>::construct_default(value_enum_ref, value_parse_message));
+  }
+  if (PyDict_SetItem(dict, key.borrow(), value.borrow())) {
+    throw python_error("");
+  }
+}
+template <DataType key_type, DataType value_type>
+void serialize_map_entry_with_tag(
+    StringWriter& w,
+    uint64_t field_num,
+    PyObject* key,
+    PyObject* value,
+    PyEnumRef* value_enum_ref,
+    SerializeMessageFn value_serialize_message,
+    PyTypeObject* py_value_message_type) {
+  if (!TypeCodec<key_type>::value_matches_type(key, nullptr, nullptr, false)) {
+    throw std::runtime_error("Incorrect data type for key field: " + repr(key));
+  }
+  if (!TypeCodec<value_type>::value_matches_type(value, value_enum_ref, py_value_message_type, false)) {
+    throw std::runtime_error("Incorrect data type for value field: " + repr(value));
+  }
+  // Technically there should be a sub-message here, but we just cheese it
+  // since it would be annoying to implement "properly". The message will
+  // always have fields 1 (key) and 2 (value), according to official protobuf
+  // documentation.
+  StringWriter item_w;
+  // Apparently Google's protobuf library always writes these fields, even if
+  // they have the default values, so we do so here too.
+  serialize_with_tag<key_type>(item_w, 1, DefaultBehavior::ALWAYS_WRITE, key, nullptr, nullptr);
+  serialize_with_tag<value_type>(item_w, 2, DefaultBehavior::ALWAYS_WRITE, value, value_enum_ref, value_serialize_message);
+  encode_varint(w, encode_tag(field_num, WireType::LENGTH));
+  encode_varint(w, item_w.size());
+  w.write(item_w.str());
+}
+
+template <DataType key_type, DataType value_type>
+void serialize_map_with_tag(
+    StringWriter& w,
+    uint64_t field_num,
+    PyObject* dict,
+    PyEnumRef* value_enum_ref,
+    SerializeMessageFn value_serialize_message,
+    PyTypeObject* py_value_message_type) {
+  if (!PyDict_Check(dict)) {
+    throw std::runtime_error("Value is not a dictionary");
+  }
+
+  // key and value will be borrowed references, so we don't have to DECREF them
+  PyObject* key;
+  PyObject* value;
+  Py_ssize_t pos = 0;
+  // TODO: In the free-threaded build, we'll need PY_BEGIN_CRITICAL_SECTION
+  // here, but that macro isn't (yet?) compatible with C++. See
+  // https://docs.python.org/3/c-api/dict.html#c.PyDict_Next
+  while (PyDict_Next(dict, &pos, &key, &value)) {
+    serialize_map_entry_with_tag<key_type, value_type>(
+        w, field_num, key, value, value_enum_ref, value_serialize_message, py_value_message_type);
+  }
+}
+
+// Oneof serializing (parsing doesn't require any special logic, but for
+// serializing, we have to use isinstance() to figure out what to serialize)
+
+struct SerializeOneofParams {
+  uint64_t field_num = 0;
+  bool is_optional = false;
+  PyEnumRef* enum_ref = nullptr;
+  SerializeMessageFn serialize_message = nullptr;
+  PyTypeObject* message_type_obj = nullptr;
+};
+
+// Serializes obj as the oneof field described by params if it's of that
+// field's type, and returns whether it was
+template <DataType data_type>
+bool serialize_oneof_field_with_tag(StringWriter& w, PyObject* obj, const SerializeOneofParams* params) {
+  if (!TypeCodec<data_type>::value_matches_type(obj, params->enum_ref, params->message_type_obj, false)) {
+    return false;
+  }
+  auto default_behavior = params->is_optional ? DefaultBehavior::OPTIONAL : DefaultBehavior::REQUIRED;
+  serialize_with_tag<data_type>(w, params->field_num, default_behavior, obj, params->enum_ref, params->serialize_message);
+  return true;
+}
+
+// Recursive case: serialize it if it's the first type; if it's not, try the
+// remaining types recursively
+template <DataType data_type, DataType... RemainingTs>
+void serialize_oneof_with_tag(StringWriter& w, PyObject* obj, const SerializeOneofParams* params) {
+  if (!serialize_oneof_field_with_tag<data_type>(w, obj, params)) {
+    serialize_oneof_with_tag<RemainingTs...>(w, obj, params + 1);
+  }
+}
+
+// Base case: no types matched (the caller always puts UNKNOWN at the end of
+// the template args)
+template <>
+inline void serialize_oneof_with_tag<DataType::UNKNOWN>(StringWriter&, PyObject*, const SerializeOneofParams*) {
+  // Base case - no types matched
+  throw std::runtime_error("Value for oneof field was not any of the expected types");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Instantiations in the shared runtime
+
+// The templates above that the generated code calls to parse and serialize
+// fields depend only on the fields' data types, not on the schema. With the
+// shared runtime, they're instantiated once in libpbcc_runtime for every data
+// type (and every map key and value type), and these extern declarations stop
+// each module from instantiating its own copies; the end of pbcc_runtime.cc
+// expands the same lists with PBCC_TEMPLATE_INSTANTIATION redefined to make
+// the explicit instantiations. Without the shared runtime, each module
+// instantiates just the ones it uses, as usual. TypeCodec is fully
+// specialized, so it has nothing to instantiate; its functions are inlined
+// into these templates.
+
+#define PBCC_FOR_EACH_SCALAR_DATA_TYPE(X) \
+  X(FLOAT) \
+  X(DOUBLE) \
+  X(INT32) \
+  X(UINT32) \
+  X(SINT32) \
+  X(INT64) \
+  X(UINT64) \
+  X(SINT64) \
+  X(FIXED32) \
+  X(SFIXED32) \
+  X(FIXED64) \
+  X(SFIXED64) \
+  X(BOOL) \
+  X(ENUM)
+
+#define PBCC_FOR_EACH_MAP_KEY_DATA_TYPE(X) \
+  X(INT32) \
+  X(UINT32) \
+  X(SINT32) \
+  X(INT64) \
+  X(UINT64) \
+  X(SINT64) \
+  X(FIXED32) \
+  X(SFIXED32) \
+  X(FIXED64) \
+  X(SFIXED64) \
+  X(BOOL) \
+  X(STRING)
+
+#define PBCC_FOR_EACH_MAP_VALUE_DATA_TYPE(X, key_type) \
+  X(key_type, FLOAT) \
+  X(key_type, DOUBLE) \
+  X(key_type, INT32) \
+  X(key_type, UINT32) \
+  X(key_type, SINT32) \
+  X(key_type, INT64) \
+  X(key_type, UINT64) \
+  X(key_type, SINT64) \
+  X(key_type, FIXED32) \
+  X(key_type, SFIXED32) \
+  X(key_type, FIXED64) \
+  X(key_type, SFIXED64) \
+  X(key_type, BOOL) \
+  X(key_type, ENUM) \
+  X(key_type, STRING) \
+  X(key_type, BYTES) \
+  X(key_type, MESSAGE)
+
+// Templates for every field data type (singular, repeated, or in a oneof)
+#define PBCC_INSTANTIATE_FIELD_TEMPLATES(data_type) \
+  PBCC_TEMPLATE_INSTANTIATION void parse_singular_field<DataType::data_type>( \
+      PyObjectRef<>&, StringReader&, PyEnumRef*, PyTypeObject*, ParseMessageFn, \
+      ParseIntoMessageFn, MergeMessageFn, uint8_t); \
+  PBCC_TEMPLATE_INSTANTIATION void parse_unpacked_repeated<DataType::data_type>( \
+      PyObject*, StringReader&, PyEnumRef*, ParseMessageFn, ParseIntoMessageFn, \
+      uint8_t, Py_ssize_t*); \
+  PBCC_TEMPLATE_INSTANTIATION void serialize_repeated_with_tag<DataType::data_type>( \
+      StringWriter&, uint64_t, PyObject*, PyEnumRef*, SerializeMessageFn, PyTypeObject*); \
+  PBCC_TEMPLATE_INSTANTIATION bool serialize_oneof_field_with_tag<DataType::data_type>( \
+      StringWriter&, PyObject*, const SerializeOneofParams*);
+
+// Templates for the scalar data types, which can be packed
+#define PBCC_INSTANTIATE_SCALAR_FIELD_TEMPLATES(data_type) \
+  PBCC_TEMPLATE_INSTANTIATION void serialize_with_tag<DataType::data_type>( \
+      StringWriter&, uint64_t, DefaultBehavior, PyObject*, PyEnumRef*, SerializeMessageFn); \
+  PBCC_TEMPLATE_INSTANTIATION void parse_packed_repeated<DataType::data_type>( \
+      PyObject*, StringReader&, PyEnumRef*, ParseMessageFn, ParseIntoMessageFn, \
+      uint8_t, Py_ssize_t*);
+
+// serialize_with_tag is fully specialized for MESSAGE, so of the
+// length-delimited types, only STRING and BYTES need it
+#define PBCC_INSTANTIATE_STRING_FIELD_TEMPLATES(data_type) \
+  PBCC_TEMPLATE_INSTANTIATION void serialize_with_tag<DataType::data_type>( \
+      StringWriter&, uint64_t, DefaultBehavior, PyObject*, PyEnumRef*, SerializeMessageFn);
+
+#define PBCC_INSTANTIATE_MAP_TEMPLATES(key_type, value_type) \
+  PBCC_TEMPLATE_INSTANTIATION void parse_map<DataType::key_type, DataType::value_type>( \
+      PyObject*, StringReader&, PyEnumRef*, ParseMessageFn, uint8_t); \
+  PBCC_TEMPLATE_INSTANTIATION void serialize_map_with_tag<DataType::key_type, DataType::value_type>( \
+      StringWriter&, uint64_t, PyObject*, PyEnumRef*, SerializeMessageFn, PyTypeObject*);
+
+#define PBCC_INSTANTIATE_MAP_TEMPLATES_FOR_KEY(key_type) \
+  PBCC_FOR_EACH_MAP_VALUE_DATA_TYPE(PBCC_INSTANTIATE_MAP_TEMPLATES, key_type)
+
+#define PBCC_INSTANTIATE_RUNTIME_TEMPLATES() \
+  PBCC_FOR_EACH_SCALAR_DATA_TYPE(PBCC_INSTANTIATE_FIELD_TEMPLATES) \
+  PBCC_INSTANTIATE_FIELD_TEMPLATES(STRING) \
+  PBCC_INSTANTIATE_FIELD_TEMPLATES(BYTES) \
+  PBCC_INSTANTIATE_FIELD_TEMPLATES(MESSAGE) \
+  PBCC_FOR_EACH_SCALAR_DATA_TYPE(PBCC_INSTANTIATE_SCALAR_FIELD_TEMPLATES) \
+  PBCC_INSTANTIATE_STRING_FIELD_TEMPLATES(STRING) \
+  PBCC_INSTANTIATE_STRING_FIELD_TEMPLATES(BYTES) \
+  PBCC_FOR_EACH_MAP_KEY_DATA_TYPE(PBCC_INSTANTIATE_MAP_TEMPLATES_FOR_KEY)
+
+#ifdef PBCC_SHARED_RUNTIME
+#define PBCC_TEMPLATE_INSTANTIATION extern template PBCC_RUNTIME_API
+PBCC_INSTANTIATE_RUNTIME_TEMPLATES()
+#undef PBCC_TEMPLATE_INSTANTIATION
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Fixed-width-only messages
+
+// Messages whose fields are all fixed-width scalars (e.g. points or sensor
+// samples) get a fast path that assumes the fields appear in canonical order
+// (increasing field number, each at most once), which is how all common
+// serializers write them. Each field is matched by comparing its entire
+// encoded tag at once, instead of decoding the tag and dispatching on it. If
+// the data isn't in canonical order, the caller falls back to the general
+// parser.
+
+// The encoded tag for a fixed-width field, computed at compile time
+template <DataType data_type, uint64_t field_num>
+struct FixedWidthFieldTag {
+  static constexpr uint64_t tag = (field_num << 3) | static_cast<uint64_t>(wire_type_for_data_type(data_type));
+  static constexpr size_t size = (tag < 0x80) ? 1 : (tag < 0x4000) ? 2 : (tag < 0x200000) ? 3 : (tag < 0x10000000) ? 4 : 5;
+  static constexpr std::array<uint8_t, 5> bytes = []() {
+    std::array<uint8_t, 5> ret{};
+    uint64_t v = tag;
+    for (size_t z = 0; z < size; z++) {
+      ret[z] = static_cast<uint8_t>((v & 0x7F) | ((z + 1 < size) ? 0x80 : 0x00));
+      v >>= 7;
+    }
+    return ret;
+  }();
+  static constexpr size_t value_size = is_int64_data_type(data_type) ? 8 : 4;
+};
+
+// If the next field in the data is the given field, advances p past it and
+// returns a pointer to its value; otherwise, returns nullptr
+template <DataType data_type, uint64_t field_num>
+inline const uint8_t* match_fixed_width_field(const uint8_t*& p, const uint8_t* end) {
+  using Tag = FixedWidthFieldTag<data_type, field_num>;
+  if ((static_cast<size_t>(end - p) < Tag::size + Tag::value_size) || memcmp(p, Tag::bytes.data(), Tag::size)) {
+    return nullptr;
+  }
+  const uint8_t* value = p + Tag::size;
+  p = value + Tag::value_size;
+  return value;
+}
+
+template <DataType data_type>
+PyObject* decode_fixed_width_value(const uint8_t* value) {
+  StringReader r(value, is_int64_data_type(data_type) ? 8 : 4);
+  return TypeCodec<data_type>::parse(r, nullptr, nullptr, 0);
+}
+
+// Appends a value to a column for decode_repeated_columns, or a zero if the
+// field was missing. Values are copied as-is, since the wire format is
+// little-endian and array.array uses the native representation.
+template <DataType data_type>
+void append_fixed_width_column_value(StringWriter& column, const uint8_t* value) {
+  static_assert(std::endian::native == std::endian::little, "Fixed-width columns assume a little-endian host");
+  if (value) {
+    column.write(value, is_int64_data_type(data_type) ? 8 : 4);
+  } else if constexpr (is_int64_data_type(data_type)) {
+    column.put_u64l(0);
+  } else {
+    column.put_u32l(0);
+  }
+}
+
+// Returns the array.array typecode for a fixed-width data type
+template <DataType data_type>
+constexpr const char* array_typecode_for_fixed_width_data_type() {
+  if constexpr (data_type == DataType::FLOAT) {
+    return "f";
+  } else if constexpr (data_type == DataType::DOUBLE) {
+    return "d";
+  } else if constexpr (data_type == DataType::FIXED32) {
+    return "I";
+  } else if constexpr (data_type == DataType::SFIXED32) {
+    return "i";
+  } else if constexpr (data_type == DataType::FIXED64) {
+    return "Q";
+  } else if constexpr (data_type == DataType::SFIXED64) {
+    return "q";
+  } else {
+    static_assert(AlwaysFalse<data_type>::v, "Data type is not fixed-width");
+  }
+}
+
+PBCC_RUNTIME_API PyObject* make_py_array(const char* typecode, const StringWriter& column);
+
+////////////////////////////////////////////////////////////////////////////////
+// Message diffing and patching
+
+// Field slots often hold the same object (e.g. cached small ints, interned
+// strings, or values that were copied from one message to another), so all of
+// these functions check identity first before doing any real comparisons.
+
+PBCC_RUNTIME_API bool objects_equal(PyObject* a, PyObject* b);
+
+template <DataType data_type>
+bool values_equal(PyObject* a, PyObject* b) {
+  if (a == b) {
+    return true;
+  }
+  if constexpr ((data_type == DataType::FLOAT) || (data_type == DataType::DOUBLE)) {
+    if (PyFloat_CheckExact(a) && PyFloat_CheckExact(b)) {
+      return PyFloat_AS_DOUBLE(a) == PyFloat_AS_DOUBLE(b);
+    }
+  } else if constexpr (data_type == DataType::BYTES) {
+    if (PyBytes_CheckExact(a) && PyBytes_CheckExact(b)) {
+      return (PyBytes_GET_SIZE(a) == PyBytes_GET_SIZE(b)) &&
+          !memcmp(PyBytes_AS_STRING(a), PyBytes_AS_STRING(b), PyBytes_GET_SIZE(a));
+    }
+  } else if constexpr (data_type == DataType::BOOL) {
+    // True and False are singletons, so if they aren't the same object, they
+    // aren't equal
+    if (PyBool_Check(a) && PyBool_Check(b)) {
+      return false;
+    }
+  }
+  return objects_equal(a, b);
+}
+
+// Compares the first count items of two lists, which must both have at least
+// that many items.
+template <DataType data_type>
+bool repeated_values_equal(PyObject* a, PyObject* b, Py_ssize_t count) {
+  for (Py_ssize_t z = 0; z < count; z++) {
+    if (!values_equal<data_type>(PyList_GET_ITEM(a, z), PyList_GET_ITEM(b, z))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if the value for each key in a is equal to the value for the
+// same key in b. This doesn't check for keys in b that aren't in a.
+template <DataType value_type>
+bool map_values_equal(PyObject* a, PyObject* b) {
+  PyObject* key;
+  PyObject* a_value;
+  Py_ssize_t pos = 0;
+  while (PyDict_Next(a, &pos, &key, &a_value)) {
+    PyObject* b_value = PyDict_GetItemWithError(b, key);
+    if (!b_value) {
+      if (PyErr_Occurred()) {
+        throw python_error("");
+      }
+      return false;
+    }
+    if (!values_equal<value_type>(a_value, b_value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The diff_* functions append the paths of changed fields to paths. Like the
+// paths in a FieldMask, these can only refer to whole repeated and map fields,
+// not to individual items within them. Each returns false without doing
+// anything if the values aren't of the expected type, so the caller can try
+// the next field in a oneof.
+
+template <DataType data_type>
+bool diff_field(
+    PyObject* a,
+    PyObject* b,
+    PyEnumRef* enum_ref,
+    PyTypeObject* py_message_type,
+    DiffMessageFn diff_message,
+    const std::string& path,
+    std::vector<std::string>& paths) {
+  if (!TypeCodec<data_type>::value_matches_type(a, enum_ref, py_message_type, false) ||
+      !TypeCodec<data_type>::value_matches_type(b, enum_ref, py_message_type, false)) {
+    return false;
+  }
+  if constexpr (data_type == DataType::MESSAGE) {
+    if (!diff_message) {
+      throw std::logic_error("Differ not available for submessage");
+    }
+    diff_message(a, b, path + ".", paths);
+  } else if (!values_equal<data_type>(a, b)) {
+    paths.emplace_back(path);
+  }
+  return true;
+}
+
+template <DataType data_type>
+bool diff_repeated_field(PyObject* a, PyObject* b, const std::string& path, std::vector<std::string>& paths) {
+  if (!PyList_Check(a) || !PyList_Check(b)) {
+    return false;
+  }
+  Py_ssize_t count = PyList_GET_SIZE(a);
+  if ((count != PyList_GET_SIZE(b)) || !repeated_values_equal<data_type>(a, b, count)) {
+    paths.emplace_back(path);
+  }
+  return true;
+}
+
+template <DataType value_type>
+bool diff_map_field(PyObject* a, PyObject* b, const std::string& path, std::vector<std::string>& paths) {
+  if (!PyDict_Check(a) || !PyDict_Check(b)) {
+    return false;
+  }
+  if ((PyDict_GET_SIZE(a) != PyDict_GET_SIZE(b)) || !map_values_equal<value_type>(a, b)) {
+    paths.emplace_back(path);
+  }
+  return true;
+}
+
+// The serialize_*_patch functions write the fields needed to turn a into b
+// when merged into a (via parse_proto_into_this). Like the diff_* functions,
+// each returns false without doing anything if b isn't of the expected type.
+// Merging can't remove anything, so changes that would require removing data
+// (clearing an optional field, or removing items from a repeated or map
+// field) can't be represented in a patch; these raise instead.
+
+template <DataType data_type>
+bool serialize_field_patch(
+    StringWriter& w,
+    uint64_t field_num,
+    PyObject* a,
+    PyObject* b,
+    PyEnumRef* enum_ref,
+    PyTypeObject* py_message_type,
+    SerializeMessageFn serialize_message,
+    SerializePatchFn serialize_message_patch) {
+  if (!TypeCodec<data_type>::value_matches_type(b, enum_ref, py_message_type, false)) {
+    return false;
+  }
+  if constexpr (data_type == DataType::MESSAGE) {
+    // If the existing value is a message of the same type, the patch is merged
+    // into it, so only its changed fields need to be written
+    if (PyObject_TypeCheck(a, py_message_type)) {
+      if (!serialize_message_patch) {
+        throw std::logic_error("Patch serializer not available for submessage");
+      }
+      StringWriter sub_w;
+      serialize_message_patch(a, b, sub_w);
+      if (sub_w.size() > 0) {
+        encode_varint(w, encode_tag(field_num, WireType::LENGTH));
+        encode_varint(w, sub_w.size());
+        w.write(sub_w.str());
+      }
+      return true;
+    }
+  } else if (values_equal<data_type>(a, b)) {
+    return true;
+  }
+  serialize_with_tag<data_type>(w, field_num, DefaultBehavior::ALWAYS_WRITE, b, enum_ref, serialize_message);
+  return true;
+}
+
+template <DataType data_type>
+bool serialize_repeated_field_patch(
+    StringWriter& w,
+    uint64_t field_num,
+    PyObject* a,
+    PyObject* b,
+    PyEnumRef* enum_ref,
+    PyTypeObject* py_message_type,
+    SerializeMessageFn serialize_message) {
+  if (!PyList_Check(a) || !PyList_Check(b)) {
+    return false;
+  }
+  Py_ssize_t a_count = PyList_GET_SIZE(a);
+  Py_ssize_t b_count = PyList_GET_SIZE(b);
+  if ((a_count > b_count) || !repeated_values_equal<data_type>(a, b, a_count)) {
+    throw std::runtime_error("Repeated field was changed other than by appending items, which can\'t be represented in a patch");
+  }
+  if (a_count < b_count) {
+    PyObjectRef<> appended_items = raise_python_errors(PyList_GetSlice, b, a_count, b_count);
+    serialize_repeated_with_tag<data_type>(w, field_num, appended_items.borrow(), enum_ref, serialize_message, py_message_type);
+  }
+  return true;
+}
+
+template <DataType key_type, DataType value_type>
+bool serialize_map_field_patch(
+    StringWriter& w,
+    uint64_t field_num,
+    PyObject* a,
+    PyObject* b,
+    PyEnumRef* value_enum_ref,
+    PyTypeObject* py_value_message_type,
+    SerializeMessageFn value_serialize_message) {
+  if (!PyDict_Check(a) || !PyDict_Check(b)) {
+    return false;
+  }
+  PyObject* key;
+  PyObject* a_value;
+  Py_ssize_t pos = 0;
+  while (PyDict_Next(a, &pos, &key, &a_value)) {
+    int contains = PyDict_Contains(b, key);
+    if (contains < 0) {
+      throw python_error("");
+    } else if (contains == 0) {
+      throw std::runtime_error("Map field had a key removed, which can\'t be represented in a patch: " + repr(key));
+    }
+  }
+
+  // Map entries are replaced (not merged) when parsed, so write the entire
+  // entry for each key whose value changed
+  PyObject* b_value;
+  pos = 0;
+  while (PyDict_Next(b, &pos, &key, &b_value)) {
+    a_value = PyDict_GetItemWithError(a, key);
+    if (!a_value && PyErr_Occurred()) {
+      throw python_error("");
+    }
+    if (!a_value || !values_equal<value_type>(a_value, b_value)) {
+      serialize_map_entry_with_tag<key_type, value_type>(
+          w, field_num, key, b_value, value_enum_ref, value_serialize_message, py_value_message_type);
+    }
+  }
+  return true;
+}
+
+// Called when no serialize_*_patch function accepted the new value
+PBCC_RUNTIME_API void throw_unpatchable_value(PyObject* b);
+
+////////////////////////////////////////////////////////////////////////////////
+// Message merging
+
+// Raises ValueError instead of the RuntimeError that handle_python_errors
+// would produce for a C++ exception
+[[noreturn]] PBCC_RUNTIME_API void throw_value_error(const std::string& message);
+
+// A set of field paths, as in a FieldMask. A node with no children refers to
+// the entire field (or, for the root, to nothing at all).
+struct FieldMaskTree {
+  std::map<std::string, FieldMaskTree> children;
+
+  void add_path(const std::string& path) {
+    FieldMaskTree* node = this;
+    size_t offset = 0;
+    for (;;) {
+      size_t dot_pos = path.find('.', offset);
+      std::string name = path.substr(offset, (dot_pos == std::string::npos) ? std::string::npos : (dot_pos - offset));
+      if (name.empty()) {
+        throw_value_error("Field mask path is not valid: " + path);
+      }
+      auto [it, inserted] = node->children.try_emplace(std::move(name));
+      if (!inserted && it->second.children.empty()) {
+        return; // The entire field is already in the mask
+      }
+      node = &it->second;
+      if (dot_pos == std::string::npos) {
+        node->children.clear();
+        return;
+      }
+      offset = dot_pos + 1;
+    }
+  }
+};
+
+// The copy_* functions return a new reference to a copy of obj that doesn't
+// share any mutable state with it, or nullptr if obj isn't of the expected
+// type (or doesn't need to be copied because it's immutable).
+
+template <DataType data_type>
+PyObject* copy_field_value(PyObject* obj, PyTypeObject* py_message_type, ParseMessageFn parse_message, MergeMessageFn merge_message) {
+  if constexpr (data_type == DataType::MESSAGE) {
+    if (PyObject_TypeCheck(obj, py_message_type)) {
+      return copy_message(obj, parse_message, merge_message);
+    }
+  }
+  return nullptr;
+}
+
+template <DataType data_type>
+PyObject* copy_repeated_field_value(PyObject* obj, PyTypeObject* py_message_type, ParseMessageFn parse_message, MergeMessageFn merge_message) {
+  if (!PyList_Check(obj)) {
+    return nullptr;
+  }
+  if constexpr (data_type == DataType::MESSAGE) {
+    Py_ssize_t count = PyList_GET_SIZE(obj);
+    PyObjectRef<> ret = raise_python_errors(PyList_New, count);
+    for (Py_ssize_t z = 0; z < count; z++) {
+      PyObject* item = PyList_GET_ITEM(obj, z);
+      PyObject* item_copy = copy_field_value<data_type>(item, py_message_type, parse_message, merge_message);
+      if (!item_copy) {
+        throw std::runtime_error(string_printf("(Index:%zd) Incorrect data type for item: ", z) + repr(item));
+      }
+      PyList_SET_ITEM(ret.borrow(), z, item_copy);
+    }
+    return ret.release();
+  } else {
+    return raise_python_errors(PyList_GetSlice, obj, 0, PyList_GET_SIZE(obj));
+  }
+}
+
+template <DataType value_type>
+PyObject* copy_map_field_value(PyObject* obj, PyTypeObject* py_value_message_type, ParseMessageFn value_parse_message, MergeMessageFn value_merge_message) {
+  if (!PyDict_Check(obj)) {
+    return nullptr;
+  }
+  PyObjectRef<> ret = raise_python_errors(PyDict_Copy, obj);
+  if constexpr (value_type == DataType::MESSAGE) {
+    PyObject* key;
+    PyObject* value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(obj, &pos, &key, &value)) {
+      PyObjectRef<> value_copy = copy_field_value<value_type>(value, py_value_message_type, value_parse_message, value_merge_message);
+      if (!value_copy) {
+        throw std::runtime_error("Incorrect data type for value field: " + repr(value));
+      }
+      if (PyDict_SetItem(ret.borrow(), key, value_copy.borrow())) {
+        throw python_error("");
+      }
+    }
+  }
+  return ret.release();
+}
+
+// The merge_* functions merge src into a field's slot with the same result as
+// serializing src and parsing it into the slot's message would have: scalars
+// are overwritten only if they would have been serialized, submessages are
+// merged recursively, repeated fields are extended, and maps are updated. Like
+// the diff_* functions, each returns false without doing anything if src isn't
+// of the expected type. Submessages, lists, and dicts in the slot are only
+// modified in place if the slot holds the only reference to them; otherwise
+// they're copied first, so other messages that share them aren't affected.
+
+template <DataType data_type>
+bool merge_field(
+    PyObjectRef<>& slot,
+    PyObject* src,
+    bool is_optional,
+    PyEnumRef* enum_ref,
+    PyTypeObject* py_message_type,
+    ParseMessageFn parse_message,
+    MergeMessageFn merge_message) {
+  if (is_optional && (src == Py_None)) {
+    return true;
+  }
+  if (!TypeCodec<data_type>::value_matches_type(src, enum_ref, py_message_type, false)) {
+    return false;
+  }
+  if constexpr (data_type == DataType::MESSAGE) {
+    if (PyObject_TypeCheck(slot.borrow(), py_message_type)) {
+      if (!is_exclusively_owned(slot.borrow())) {
+        slot.assign_ref(copy_message(slot.borrow(), parse_message, merge_message));
+      }
+      merge_message(slot.borrow(), src);
+    } else {
+      slot.assign_ref(copy_message(src, parse_message, merge_message));
+    }
+  } else if (is_optional || !obj_has_default_value<data_type>(src, enum_ref)) {
+    Py_INCREF(src);
+    slot.assign_ref(src);
+  }
+  return true;
+}
+
+template <DataType data_type>
+bool merge_repeated_field(PyObjectRef<>& slot, PyObject* src, PyTypeObject* py_message_type, ParseMessageFn parse_message, MergeMessageFn merge_message) {
+  if (!PyList_Check(src)) {
+    return false;
+  }
+  // Other iterables are replaced with lists, as when parsing
+  if (!PyList_Check(slot.borrow()) || !is_exclusively_owned(slot.borrow())) {
+    PyObjectRef<> it = iter_repeated_field_items(slot.borrow());
+    slot.assign_ref(raise_python_errors(PySequence_List, it.borrow()));
+  }
+  PyObject* list = slot.borrow();
+  if constexpr (data_type == DataType::MESSAGE) {
+    // src may be the same list as list, so don't use its size after appending
+    Py_ssize_t count = PyList_GET_SIZE(src);
+    for (Py_ssize_t z = 0; z < count; z++) {
+      PyObject* item = PyList_GET_ITEM(src, z);
+      PyObjectRef<> item_copy = copy_field_value<data_type>(item, py_message_type, parse_message, merge_message);
+      if (!item_copy) {
+        throw std::runtime_error(string_printf("(Index:%zd) Incorrect data type for item: ", z) + repr(item));
+      }
+      if (PyList_Append(list, item_copy.borrow())) {
+        throw python_error("");
+      }
+    }
+  } else {
+    Py_ssize_t end = PyList_GET_SIZE(list);
+    if (PyList_SetSlice(list, end, end, src)) {
+      throw python_error("");
+    }
+  }
+  return true;
+}
+
+template <DataType value_type>
+bool merge_map_field(PyObjectRef<>& slot, PyObject* src, PyTypeObject* py_value_message_type, ParseMessageFn value_parse_message, MergeMessageFn value_merge_message) {
+  if (!PyDict_Check(src)) {
+    return false;
+  }
+  if (!PyDict_Check(slot.borrow())) {
+    throw std::runtime_error("Incorrect data type for field: " + repr(slot.borrow()));
+  }
+  if (!is_exclusively_owned(slot.borrow())) {
+    slot.assign_ref(raise_python_errors(PyDict_Copy, slot.borrow()));
+  }
+  PyObject* dict = slot.borrow();
+  if constexpr (value_type == DataType::MESSAGE) {
+    // Map entries are replaced (not merged) when parsed, so the values must be
+    // copied
+    PyObjectRef<> src_copy = copy_map_field_value<value_type>(src, py_value_message_type, value_parse_message, value_merge_message);
+    if (PyDict_Update(dict, src_copy.borrow())) {
+      throw python_error("");
+    }
+  } else if (PyDict_Update(dict, src)) {
+    throw python_error("");
+  }
+  return true;
+}
+
+// Applies a field mask to a submessage field. Returns false without doing
+// anything if src isn't a message of the expected type; if src is None (e.g.
+// an unset optional field), the masked fields are reset to their defaults.
+// Like the merge_* functions, this copies the submessage first if it's shared.
+template <DataType data_type>
+bool update_message_field(
+    PyObjectRef<>& slot,
+    PyObject* src,
+    const FieldMaskTree& mask,
+    PyTypeObject* py_message_type,
+    ParseMessageFn parse_message,
+    MergeMessageFn merge_message,
+    UpdateMessageFn update_message) {
+  if constexpr (data_type == DataType::MESSAGE) {
+    if (!parse_message || !merge_message || !update_message) {
+      throw std::logic_error("Updater not available for submessage");
+    }
+    PyObjectRef<> default_src;
+    if (src == Py_None) {
+      default_src.assign_ref(parse_message(nullptr, 0, 0));
+      src = default_src.borrow();
+    } else if (!PyObject_TypeCheck(src, py_message_type)) {
+      return false;
+    }
+    if (!PyObject_TypeCheck(slot.borrow(), py_message_type)) {
+      slot.assign_ref(parse_message(nullptr, 0, 0));
+    } else if (!is_exclusively_owned(slot.borrow())) {
+      slot.assign_ref(copy_message(slot.borrow(), parse_message, merge_message));
+    }
+    update_message(slot.borrow(), src, mask);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Memory accounting
+
+// The deep_sizeof_* functions return the memory used by a field's value,
+// including all objects it references (list items, dict keys and values, and
+// submessages and their fields). Each object is counted only once, even if
+// it's referenced multiple times, since seen tracks all objects already
+// counted. The sizes of individual objects are the same as sys.getsizeof
+// reports. Enum members and the None/True/False singletons belong to their
+// classes, not to any message, so they aren't counted.
+
+using DeepSizeofMessageFn = size_t (*)(PyObject* obj, std::unordered_set<PyObject*>& seen, size_t* field_sizes);
+
+// Returns the number of bytes used by the unknown fields' storage outside of
+// the message object itself. This is an estimate, since the node layout of
+// unordered_multimap is implementation-defined.
+PBCC_RUNTIME_API size_t unknown_fields_heap_size(const std::unordered_multimap<uint64_t, std::string>& unknown_fields);
+
+PBCC_RUNTIME_API size_t py_sys_getsizeof(PyObject* obj);
+
+// Returns true if obj should be counted (and marks it as counted)
+static inline bool deep_sizeof_should_count(PyObject* obj, std::unordered_set<PyObject*>& seen) {
+  return (obj != Py_None) && (obj != Py_True) && (obj != Py_False) && seen.emplace(obj).second;
+}
+
+// Used for values that don't have the expected type for their field
+PBCC_RUNTIME_API size_t deep_sizeof_generic(PyObject* obj, std::unordered_set<PyObject*>& seen);
+
+template <DataType data_type>
+size_t deep_sizeof_value(PyObject* obj, DeepSizeofMessageFn deep_sizeof_message, std::unordered_set<PyObject*>& seen) {
+  if constexpr (data_type == DataType::ENUM) {
+    return 0;
+  } else if constexpr (data_type == DataType::MESSAGE) {
+    // The message function falls back to deep_sizeof_generic if obj has the
+    // wrong type
+    return deep_sizeof_message ? deep_sizeof_message(obj, seen, nullptr) : deep_sizeof_generic(obj, seen);
+  } else {
+    return deep_sizeof_generic(obj, seen);
+  }
+}
+
+template <DataType data_type>
+size_t deep_sizeof_repeated(PyObject* list, DeepSizeofMessageFn deep_sizeof_message, std::unordered_set<PyObject*>& seen) {
+  if (!PyList_Check(list)) {
+    return deep_sizeof_generic(list, seen);
+  }
+  if (!deep_sizeof_should_count(list, seen)) {
+    return 0;
+  }
+  size_t ret = py_sys_getsizeof(list);
+  for (Py_ssize_t z = 0; z < PyList_GET_SIZE(list); z++) {
+    ret += deep_sizeof_value<data_type>(PyList_GET_ITEM(list, z), deep_sizeof_message, seen);
+  }
+  return ret;
+}
+
+template <DataType value_type>
+size_t deep_sizeof_map(PyObject* dict, DeepSizeofMessageFn deep_sizeof_value_message, std::unordered_set<PyObject*>& seen) {
+  if (!PyDict_Check(dict)) {
+    return deep_sizeof_generic(dict, seen);
+  }
+  if (!deep_sizeof_should_count(dict, seen)) {
+    return 0;
+  }
+  size_t ret = py_sys_getsizeof(dict);
+  PyObject* key;
+  PyObject* value;
+  Py_ssize_t pos = 0;
+  while (PyDict_Next(dict, &pos, &key, &value)) {
+    ret += deep_sizeof_generic(key, seen);
+    ret += deep_sizeof_value<value_type>(value, deep_sizeof_value_message, seen);
+  }
+  return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Encoded size explanation
+
+// The explain_size functions walk serialized data (without creating any
+// Python objects) and attribute each byte to the field it belongs to. Fields
+// within submessages (and message-valued maps) are also attributed to their
+// own paths, like "f_sub.f_int", in addition to being included in the
+// submessage field's payload.
+
+struct EncodedSizeEntry {
+  uint64_t count = 0; // Number of times the field appeared in the data
+  uint64_t elements = 0; // Same as count, except packed fields count each value
+  uint64_t tag_bytes = 0;
+  uint64_t length_bytes = 0;
+  uint64_t payload_bytes = 0;
+
+  PyObject* as_py_dict() const {
+    return raise_python_errors(Py_BuildValue, "{sKsKsKsKsKsK}",
+        "count", static_cast<unsigned long long>(this->count),
+        "elements", static_cast<unsigned long long>(this->elements),
+        "tag_bytes", static_cast<unsigned long long>(this->tag_bytes),
+        "length_bytes", static_cast<unsigned long long>(this->length_bytes),
+        "payload_bytes", static_cast<unsigned long long>(this->payload_bytes),
+        "bytes", static_cast<unsigned long long>(this->tag_bytes + this->length_bytes + this->payload_bytes));
+  }
+};
+
+// {field_path: entry}
+using EncodedSizeExplanation = std::map<std::string, EncodedSizeEntry>;
+
+using ExplainSizeMessageFn = void (*)(StringReader& r, const std::string& prefix, EncodedSizeExplanation& out);
+
+// Returns the number of values in a packed field's payload
+template <DataType data_type>
+size_t count_packed_values(const StringReader& payload) {
+  constexpr WireType wire_type = wire_type_for_data_type(data_type);
+  if constexpr (wire_type == WireType::INT32) {
+    return payload.size() / 4;
+  } else if constexpr (wire_type == WireType::INT64) {
+    return payload.size() / 8;
+  } else {
+    // Each varint ends with a byte that doesn't have the high bit set
+    size_t ret = 0;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(payload.pgetv(0, payload.size()));
+    for (size_t z = 0; z < payload.size(); z++) {
+      ret += !(data[z] & 0x80);
+    }
+    return ret;
+  }
+}
+
+// Skips the field at r's current position (immediately after its tag) and
+// attributes its size to path. Returns a reader over the field's payload if
+// it's length-delimited, or an empty reader otherwise.
+template <DataType data_type>
+StringReader explain_field_size(
+    StringReader& r, WireType received_type, size_t tag_bytes, const std::string& path, ExplainSizeMessageFn explain_message, EncodedSizeExplanation& out) {
+  EncodedSizeEntry& entry = out[path];
+  entry.count++;
+  entry.tag_bytes += tag_bytes;
+  if (received_type != WireType::LENGTH) {
+    size_t start_offset = r.where();
+    skip_field(r, received_type);
+    entry.elements++;
+    entry.payload_bytes += r.where() - start_offset;
+    return StringReader();
+  }
+
+  size_t start_offset = r.where();
+  uint64_t size = decode_varint(r);
+  entry.length_bytes += r.where() - start_offset;
+  entry.payload_bytes += size;
+  StringReader payload = r.subx(r.where(), size);
+  r.skip(size);
+
+  if constexpr (can_use_packed_repeated_format(data_type)) {
+    entry.elements += count_packed_values<data_type>(payload);
+  } else {
+    entry.elements++;
+    if constexpr (data_type == DataType::MESSAGE) {
+      if (explain_message) {
+        StringReader sub_r = payload;
+        explain_message(sub_r, path + ".", out);
+      }
+    }
+  }
+  return payload;
+}
+
+// Attributes the fields within a map entry to the map's path. If the map's
+// values are messages, their fields are attributed to paths within the map's
+// path, as for submessage fields.
+PBCC_RUNTIME_API void explain_map_entry_size(StringReader& entry_r, const std::string& path, ExplainSizeMessageFn explain_value_message, EncodedSizeExplanation& out);
+
+// Returns {path: entry} for all fields in explanation, plus an entry for the
+// messages as a whole, whose count is the number of messages
+PBCC_RUNTIME_API PyObject* encoded_size_explanation_as_py_dict(const EncodedSizeExplanation& explanation, size_t num_messages, size_t total_bytes);
+
+///////////////////////////////////////////////////////////////////////////////
+// Runtime statistics
+
+// If the module is compiled with --stats, each message type records counts,
+// sizes, and latencies of parse and serialize calls made from Python (nested
+// submessages are accounted to the top-level call's type), which can be
+// retrieved with the module's pbcc_stats() function. Otherwise, all of these
+// structures are empty and all of the recording functions do nothing.
+
+// All counters are only ever incremented (except when reset), so relaxed
+// ordering is sufficient; readers may see slightly inconsistent totals while
+// other threads are recording, which is fine for monitoring purposes. This is
+// also used by the other instrumentation features below.
+[[maybe_unused]] static inline void stats_add(std::atomic<uint64_t>& counter, uint64_t v = 1) {
+  counter.fetch_add(v, std::memory_order_relaxed);
+}
+
+#if defined(PBCC_STATS) || defined(PBCC_PROFILE_FIELDS) || defined(PBCC_USDT)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Returns a cheap, monotonic timestamp in arbitrary units. The ratio of these
+// units to nanoseconds is computed when the stats are read.
+static inline uint64_t stats_clock_now() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ret;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ret));
+  return ret;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+extern uint64_t stats_clock_base_ticks;
+extern std::chrono::steady_clock::time_point stats_clock_base_time;
+
+inline double stats_clock_ticks_per_ns() {
+  uint64_t ticks = stats_clock_now() - stats_clock_base_ticks;
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stats_clock_base_time).count();
+  return (ns && ticks) ? (static_cast<double>(ticks) / ns) : 1.0;
+}
+
+#endif // PBCC_STATS || PBCC_PROFILE_FIELDS || PBCC_USDT
+
+// Outcomes of parse and serialize calls. The USDT probes report these as
+// status codes, with 0 meaning success and N meaning reason N - 1.
+enum StatsErrorReason {
+  TRUNCATED_DATA = 0,
+  INCORRECT_TYPE,
+  INVALID_DATA,
+  PYTHON_ERROR,
+  NUM_STATS_ERROR_REASONS,
+};
+
+// Returns the reason for the exception currently being handled. Must only be
+// called from within a catch block.
+PBCC_RUNTIME_API StatsErrorReason current_exception_reason();
+
+#ifdef PBCC_STATS
+
+// Histogram with power-of-two buckets: bucket 0 counts zeroes, and bucket N
+// counts values in [2^(N-1), 2^N).
+struct StatsHistogram {
+  std::array<std::atomic<uint64_t>, 65> buckets{};
+
+  inline void add(uint64_t v) {
+    stats_add(this->buckets[std::bit_width(v)]);
+  }
+
+  void reset() {
+    for (auto& bucket : this->buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns {bucket_lower_bound: count} for all nonempty buckets, with the
+  // bounds divided by scale
+  PyObject* as_py_dict(double scale) const {
+    PyObjectRef<> ret = raise_python_errors(PyDict_New);
+    for (size_t z = 0; z < this->buckets.size(); z++) {
+      uint64_t count = this->buckets[z].load(std::memory_order_relaxed);
+      if (!count) {
+        continue;
+      }
+      uint64_t lower_bound = z ? (1ULL << (z - 1)) : 0;
+      PyObjectRef<> py_key = raise_python_errors(PyLong_FromUnsignedLongLong, static_cast<unsigned long long>(lower_bound / scale));
+      PyObjectRef<> py_count = raise_python_errors(PyLong_FromUnsignedLongLong, count);
+      if (PyDict_SetItem(ret.borrow(), py_key.borrow(), py_count.borrow())) {
+        throw python_error("");
+      }
+    }
+    return ret.release();
+  }
+};
+
+static const char* const stats_error_reason_names[NUM_STATS_ERROR_REASONS] = {
+    "truncated_data",
+    "incorrect_type",
+    "invalid_data",
+    "python_error",
+};
+
+struct OperationStats {
+  static constexpr bool enabled = true;
+
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> total_ticks;
+  std::array<std::atomic<uint64_t>, NUM_STATS_ERROR_REASONS> errors{};
+  StatsHistogram sizes;
+  StatsHistogram latencies;
+
+  inline void record_call() {
+    stats_add(this->calls);
+  }
+  inline void record_success(size_t bytes, uint64_t ticks) {
+    stats_add(this->bytes, bytes);
+    stats_add(this->total_ticks, ticks);
+    this->sizes.add(bytes);
+    this->latencies.add(ticks);
+  }
+  inline void record_error(StatsErrorReason reason) {
+    stats_add(this->errors[reason]);
+  }
+
+  void reset() {
+    this->calls.store(0, std::memory_order_relaxed);
+    this->bytes.store(0, std::memory_order_relaxed);
+    this->total_ticks.store(0, std::memory_order_relaxed);
+    for (auto& count : this->errors) {
+      count.store(0, std::memory_order_relaxed);
+    }
+    this->sizes.reset();
+    this->latencies.reset();
+  }
+
+  PyObject* as_py_dict(double ticks_per_ns) const {
+    PyObjectRef<> errors = raise_python_errors(PyDict_New);
+    for (size_t z = 0; z < NUM_STATS_ERROR_REASONS; z++) {
+      PyObjectRef<> count = raise_python_errors(PyLong_FromUnsignedLongLong, this->errors[z].load(std::memory_order_relaxed));
+      if (PyDict_SetItemString(errors.borrow(), stats_error_reason_names[z], count.borrow())) {
+        throw python_error("");
+      }
+    }
+    PyObjectRef<> sizes = this->sizes.as_py_dict(1.0);
+    PyObjectRef<> latencies = this->latencies.as_py_dict(ticks_per_ns);
+    return raise_python_errors(Py_BuildValue, "{sKsKsdsOsOsO}",
+        "calls", static_cast<unsigned long long>(this->calls.load(std::memory_order_relaxed)),
+        "bytes", static_cast<unsigned long long>(this->bytes.load(std::memory_order_relaxed)),
+        "total_ns", this->total_ticks.load(std::memory_order_relaxed) / ticks_per_ns,
+        "errors", errors.borrow(),
+        "size_histogram", sizes.borrow(),
+        "latency_histogram_ns", latencies.borrow());
+  }
+};
+
+struct MessageStats {
+  OperationStats parse;
+  OperationStats serialize;
+  // Includes fields skipped due to incorrect types
+  std::atomic<uint64_t> unknown_fields;
+  std::atomic<uint64_t> incorrect_type_fallbacks;
+
+  void reset() {
+    this->parse.reset();
+    this->serialize.reset();
+    this->unknown_fields.store(0, std::memory_order_relaxed);
+    this->incorrect_type_fallbacks.store(0, std::memory_order_relaxed);
+  }
+
+  PyObject* as_py_dict(double ticks_per_ns) const {
+    PyObjectRef<> parse = this->parse.as_py_dict(ticks_per_ns);
+    PyObjectRef<> serialize = this->serialize.as_py_dict(ticks_per_ns);
+    return raise_python_errors(Py_BuildValue, "{sOsOsKsK}",
+        "parse", parse.borrow(),
+        "serialize", serialize.borrow(),
+        "unknown_fields", static_cast<unsigned long long>(this->unknown_fields.load(std::memory_order_relaxed)),
+        "incorrect_type_fallbacks", static_cast<unsigned long long>(this->incorrect_type_fallbacks.load(std::memory_order_relaxed)));
+  }
+};
+
+static inline void record_unknown_field(MessageStats& stats) {
+  stats_add(stats.unknown_fields);
+}
+static inline void record_incorrect_type_fallback(MessageStats& stats) {
+  stats_add(stats.incorrect_type_fallbacks);
+}
+
+#else // PBCC_STATS
+
+struct OperationStats {
+  static constexpr bool enabled = false;
+
+  inline void record_call() {}
+  inline void record_success(size_t, uint64_t) {}
+  inline void record_error(StatsErrorReason) {}
+};
+struct MessageStats {
+  OperationStats parse;
+  OperationStats serialize;
+};
+
+static inline void record_unknown_field(MessageStats&) {}
+static inline void record_incorrect_type_fallback(MessageStats&) {}
+
+#endif // PBCC_STATS
+
+///////////////////////////////////////////////////////////////////////////////
+// Static tracepoints
+
+// If the module is compiled with --usdt, parse and serialize calls made from
+// Python fire USDT probes (provider "pbcc"), which tools like bpftrace and
+// perf can attach to in running processes:
+//   parse__start(const char* type, uint64_t size)
+//   parse__done(const char* type, int status, uint64_t ns)
+//   serialize__start(const char* type)
+//   serialize__done(const char* type, int status, uint64_t size, uint64_t ns)
+//   unknown__field(const char* type, uint64_t tag)
+// type is the message's full name (as in pbcc_stats()), and status is 0 on
+// success or a StatsErrorReason + 1 on failure. Each probe site is a nop; the
+// arguments (including the timestamps) are only computed while a tracer is
+// attached, which is indicated by the probe's semaphore being nonzero.
+
+enum class ProbeOperation {
+  PARSE = 0,
+  SERIALIZE,
+};
+
+#ifdef PBCC_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PBCC_PROBE_SEMAPHORE(name) extern volatile unsigned short pbcc_##name##_semaphore
+PBCC_PROBE_SEMAPHORE(parse__start);
+PBCC_PROBE_SEMAPHORE(parse__done);
+PBCC_PROBE_SEMAPHORE(serialize__start);
+PBCC_PROBE_SEMAPHORE(serialize__done);
+PBCC_PROBE_SEMAPHORE(unknown__field);
+#undef PBCC_PROBE_SEMAPHORE
+
+#define PBCC_PROBE_ENABLED(name) __builtin_expect(pbcc_##name##_semaphore != 0, 0)
+
+// Fires the start probe for operation, and returns true if the corresponding
+// done probe should be fired when the operation is complete
+template <ProbeOperation operation>
+static inline bool probe_operation_start(const char* type_name, size_t input_size) {
+  if constexpr (operation == ProbeOperation::PARSE) {
+    if (PBCC_PROBE_ENABLED(parse__start)) {
+      DTRACE_PROBE2(pbcc, parse__start, type_name, static_cast<uint64_t>(input_size));
+    }
+    return PBCC_PROBE_ENABLED(parse__done);
+  } else {
+    if (PBCC_PROBE_ENABLED(serialize__start)) {
+      DTRACE_PROBE1(pbcc, serialize__start, type_name);
+    }
+    return PBCC_PROBE_ENABLED(serialize__done);
+  }
+}
+
+template <ProbeOperation operation>
+void probe_operation_done(const char* type_name, int status, size_t bytes, uint64_t ticks) {
+  uint64_t ns = ticks / stats_clock_ticks_per_ns();
+  if constexpr (operation == ProbeOperation::PARSE) {
+    DTRACE_PROBE3(pbcc, parse__done, type_name, status, ns);
+  } else {
+    DTRACE_PROBE4(pbcc, serialize__done, type_name, status, static_cast<uint64_t>(bytes), ns);
+  }
+}
+
+static inline void probe_unknown_field(const char* type_name, uint64_t tag) {
+  if (PBCC_PROBE_ENABLED(unknown__field)) {
+    DTRACE_PROBE2(pbcc, unknown__field, type_name, tag);
+  }
+}
+
+#else // PBCC_USDT
+
+template <ProbeOperation operation>
+static inline bool probe_operation_start(const char*, size_t) {
+  return false;
+}
+template <ProbeOperation operation>
+static inline void probe_operation_done(const char*, int, size_t, uint64_t) {}
+static inline void probe_unknown_field(const char*, uint64_t) {}
+
+#endif // PBCC_USDT
+
+// Calls fn(bytes), which should set bytes to the size of the input or output
+// data (bytes is initially input_size), records the call's statistics in stats,
+// and fires the USDT probes for operation
+template <ProbeOperation operation, typename Func>
+PyObject* call_instrumented(OperationStats& stats, const char* type_name, size_t input_size, Func&& fn) {
+  size_t bytes = input_size;
+#if defined(PBCC_STATS) || defined(PBCC_USDT)
+  stats.record_call();
+  bool probe_done = probe_operation_start<operation>(type_name, input_size);
+  bool timed = OperationStats::enabled || probe_done;
+  uint64_t start_ticks = timed ? stats_clock_now() : 0;
+  try {
+    PyObject* ret = std::forward<Func>(fn)(bytes);
+    uint64_t ticks = timed ? (stats_clock_now() - start_ticks) : 0;
+    stats.record_success(bytes, ticks);
+    if (probe_done) {
+      probe_operation_done<operation>(type_name, 0, bytes, ticks);
+    }
+    return ret;
+  } catch (...) {
+    StatsErrorReason reason = current_exception_reason();
+    stats.record_error(reason);
+    if (probe_done) {
+      probe_operation_done<operation>(type_name, reason + 1, bytes, stats_clock_now() - start_ticks);
+    }
+    throw;
+  }
+#else
+  (void)stats;
+  (void)type_name;
+  return std::forward<Func>(fn)(bytes);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Field usage telemetry
+
+// If the module is compiled with --field-usage, message fields are exposed to
+// Python via getters and setters that count reads and writes, and the parser
+// counts how many times (and how many bytes) each field was parsed. Fields
+// that are parsed often but never read are candidates for removal from the
+// schema or for skipping during parsing. Only attribute accesses from Python
+// are counted; as_dict, proto_copy, etc. don't count as reads.
+
+#ifdef PBCC_FIELD_USAGE
+
+struct FieldUsage {
+  const char* name;
+  size_t offset; // Offset of the field's PyObjectRef within the message object
+  std::atomic<uint64_t> reads = 0;
+  std::atomic<uint64_t> writes = 0;
+  std::atomic<uint64_t> parses = 0;
+  std::atomic<uint64_t> parsed_bytes = 0; // Including tags and length prefixes
+
+  void reset() {
+    this->reads.store(0, std::memory_order_relaxed);
+    this->writes.store(0, std::memory_order_relaxed);
+    this->parses.store(0, std::memory_order_relaxed);
+    this->parsed_bytes.store(0, std::memory_order_relaxed);
+  }
+
+  bool is_unused() const {
+    return this->parses.load(std::memory_order_relaxed) && !this->reads.load(std::memory_order_relaxed);
+  }
+
+  PyObject* as_py_dict() const {
+    return raise_python_errors(Py_BuildValue, "{sKsKsKsK}",
+        "reads", static_cast<unsigned long long>(this->reads.load(std::memory_order_relaxed)),
+        "writes", static_cast<unsigned long long>(this->writes.load(std::memory_order_relaxed)),
+        "parses", static_cast<unsigned long long>(this->parses.load(std::memory_order_relaxed)),
+        "parsed_bytes", static_cast<unsigned long long>(this->parsed_bytes.load(std::memory_order_relaxed)));
+  }
+};
+
+static inline void record_field_parsed(FieldUsage& usage, size_t bytes) {
+  stats_add(usage.parses);
+  stats_add(usage.parsed_bytes, bytes);
+}
+
+static inline PyObject*& field_slot_for_usage(PyObject* py_self, const FieldUsage* usage) {
+  return *reinterpret_cast<PyObject**>(reinterpret_cast<uint8_t*>(py_self) + usage->offset);
+}
+
+// These behave the same as T_OBJECT_EX members, but also count accesses
+inline PyObject* get_field_with_usage(PyObject* py_self, void* closure) {
+  auto* usage = reinterpret_cast<FieldUsage*>(closure);
+  stats_add(usage->reads);
+  PyObject* value = field_slot_for_usage(py_self, usage);
+  if (!value) {
+    PyErr_Format(PyExc_AttributeError, "'%s' object has no attribute '%s'", Py_TYPE(py_self)->tp_name, usage->name);
+    return nullptr;
+  }
+  Py_INCREF(value);
+  return value;
+}
+
+inline int set_field_with_usage(PyObject* py_self, PyObject* value, void* closure) {
+  auto* usage = reinterpret_cast<FieldUsage*>(closure);
+  stats_add(usage->writes);
+  PyObject*& slot = field_slot_for_usage(py_self, usage);
+  if (!value && !slot) {
+    PyErr_SetString(PyExc_AttributeError, usage->name);
+    return -1;
+  }
+  PyObject* old_value = slot;
+  Py_XINCREF(value);
+  slot = value;
+  Py_XDECREF(old_value);
+  return 0;
+}
+
+template <size_t NumFields>
+PyObject* field_usage_as_py_dict(const std::array<FieldUsage, NumFields>& usages, bool unused_only) {
+  PyObjectRef<> ret = raise_python_errors(PyDict_New);
+  for (const auto& usage : usages) {
+    if (unused_only && !usage.is_unused()) {
+      continue;
+    }
+    PyObjectRef<> usage_dict = usage.as_py_dict();
+    if (PyDict_SetItemString(ret.borrow(), usage.name, usage_dict.borrow())) {
+      throw python_error("");
+    }
+  }
+  return ret.release();
+}
+
+#endif // PBCC_FIELD_USAGE
+
+///////////////////////////////////////////////////////////////////////////////
+// Per-field profiling
+
+// If the module is compiled with --profile-fields, the parser and serializer
+// time each field (and each message as a whole) with the same clock used for
+// statistics. Each profile entry accumulates its total time and its self time
+// (excluding nested entries, e.g. the fields of a submessage), so the self
+// times of all entries add up to the total time spent in pbcc. In addition, a
+// sample of top-level calls is recorded as a Chrome trace (viewable in
+// chrome://tracing or Perfetto), which shows the nesting of fields within
+// submessages. Without --profile-fields, these structures are all empty.
+
+#ifdef PBCC_PROFILE_FIELDS
+
+struct FieldProfile {
+  const char* operation; // "parse" or "serialize"
+  const char* name; // Message.field
+  const char* data_type_name;
+  std::atomic<uint64_t> count = 0;
+  std::atomic<uint64_t> total_ticks = 0;
+  std::atomic<uint64_t> self_ticks = 0;
+  bool registered = false;
+
+  constexpr FieldProfile(const char* operation, const char* name, const char* data_type_name)
+      : operation(operation),
+        name(name),
+        data_type_name(data_type_name) {}
+};
+
+struct FieldProfileTraceEvent {
+  const FieldProfile* profile;
+  uint64_t start_ticks;
+  uint64_t duration_ticks;
+  unsigned long thread_id;
+};
+
+// All of these are only modified while holding the GIL
+extern std::vector<FieldProfile*> all_field_profiles;
+extern std::vector<FieldProfileTraceEvent> field_profile_trace_events;
+extern uint64_t field_profile_trace_interval; // 0 = tracing disabled
+extern size_t field_profile_trace_max_events;
+extern uint64_t field_profile_top_level_calls;
+
+class FieldProfileScope {
+public:
+  explicit FieldProfileScope(FieldProfile& profile)
+      : profile(profile),
+        parent(FieldProfileScope::current),
+        child_ticks(0) {
+    if (!profile.registered) {
+      profile.registered = true;
+      all_field_profiles.emplace_back(&profile);
+    }
+    if (this->parent) {
+      this->sampled = this->parent->sampled;
+    } else {
+      this->sampled = field_profile_trace_interval &&
+          ((field_profile_top_level_calls++ % field_profile_trace_interval) == 0) &&
+          (field_profile_trace_events.size() < field_profile_trace_max_events);
+    }
+    FieldProfileScope::current = this;
+    this->start_ticks = stats_clock_now();
+  }
+  FieldProfileScope(const FieldProfileScope&) = delete;
+  FieldProfileScope& operator=(const FieldProfileScope&) = delete;
+
+  ~FieldProfileScope() {
+    uint64_t ticks = stats_clock_now() - this->start_ticks;
+    FieldProfileScope::current = this->parent;
+    if (this->parent) {
+      this->parent->child_ticks += ticks;
+    }
+    stats_add(this->profile.count);
+    stats_add(this->profile.total_ticks, ticks);
+    stats_add(this->profile.self_ticks, ticks - std::min(ticks, this->child_ticks));
+    if (this->sampled && (field_profile_trace_events.size() < field_profile_trace_max_events)) {
+      field_profile_trace_events.emplace_back(FieldProfileTraceEvent{
+          .profile = &this->profile,
+          .start_ticks = this->start_ticks,
+          .duration_ticks = ticks,
+          .thread_id = PyThread_get_thread_ident(),
+      });
+    }
+  }
+
+private:
+  static thread_local FieldProfileScope* current;
+
+  FieldProfile& profile;
+  FieldProfileScope* parent;
+  bool sampled;
+  uint64_t start_ticks;
+  uint64_t child_ticks;
+};
+
+inline PyObject* field_profile_as_py_dict() {
+  double ticks_per_ns = stats_clock_ticks_per_ns();
+  PyObjectRef<> ret = raise_python_errors(PyDict_New);
+  for (const char* operation : {"parse", "serialize"}) {
+    PyObjectRef<> fields = raise_python_errors(PyDict_New);
+    std::map<std::string, std::pair<uint64_t, uint64_t>> data_types; // {name: (count, self_ticks)}
+    for (const FieldProfile* profile : all_field_profiles) {
+      if (strcmp(profile->operation, operation)) {
+        continue;
+      }
+      uint64_t count = profile->count.load(std::memory_order_relaxed);
+      uint64_t self_ticks = profile->self_ticks.load(std::memory_order_relaxed);
+      PyObjectRef<> field = raise_python_errors(Py_BuildValue, "{sssKsdsd}",
+          "data_type", profile->data_type_name,
+          "count", static_cast<unsigned long long>(count),
+          "total_ns", profile->total_ticks.load(std::memory_order_relaxed) / ticks_per_ns,
+          "self_ns", self_ticks / ticks_per_ns);
+      if (PyDict_SetItemString(fields.borrow(), profile->name, field.borrow())) {
+        throw python_error("");
+      }
+      auto& data_type_totals = data_types[profile->data_type_name];
+      data_type_totals.first += count;
+      data_type_totals.second += self_ticks;
+    }
+
+    PyObjectRef<> py_data_types = raise_python_errors(PyDict_New);
+    for (const auto& [data_type_name, totals] : data_types) {
+      PyObjectRef<> data_type = raise_python_errors(Py_BuildValue, "{sKsd}",
+          "count", static_cast<unsigned long long>(totals.first),
+          "self_ns", totals.second / ticks_per_ns);
+      if (PyDict_SetItemString(py_data_types.borrow(), data_type_name.c_str(), data_type.borrow())) {
+        throw python_error("");
+      }
+    }
+
+    PyObjectRef<> operation_dict = raise_python_errors(Py_BuildValue, "{sOsO}",
+        "fields", fields.borrow(),
+        "data_types", py_data_types.borrow());
+    if (PyDict_SetItemString(ret.borrow(), operation, operation_dict.borrow())) {
+      throw python_error("");
+    }
+  }
+  return ret.release();
+}
+
+// Returns the sampled calls in Chrome's trace event format. All names are
+// Python identifiers, so they don't need to be escaped.
+inline PyObject* field_profile_trace_as_json() {
+  double ticks_per_us = stats_clock_ticks_per_ns() * 1000.0;
+  std::string ret = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for (size_t z = 0; z < field_profile_trace_events.size(); z++) {
+    const auto& event = field_profile_trace_events[z];
+    ret += string_printf(
+        "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%lu,\"args\":{\"data_type\":\"%s\"}}",
+        z ? "," : "",
+        event.profile->name,
+        event.profile->operation,
+        (event.start_ticks - stats_clock_base_ticks) / ticks_per_us,
+        event.duration_ticks / ticks_per_us,
+        event.thread_id,
+        event.profile->data_type_name);
+  }
+  ret += "\n]}\n";
+  return raise_python_errors(PyUnicode_FromStringAndSize, ret.data(), static_cast<Py_ssize_t>(ret.size()));
+}
+
+inline void reset_field_profile() {
+  for (FieldProfile* profile : all_field_profiles) {
+    profile->count.store(0, std::memory_order_relaxed);
+    profile->total_ticks.store(0, std::memory_order_relaxed);
+    profile->self_ticks.store(0, std::memory_order_relaxed);
+  }
+  field_profile_trace_events.clear();
+  field_profile_top_level_calls = 0;
+}
+
+#else // PBCC_PROFILE_FIELDS
+
+struct FieldProfile {
+  constexpr FieldProfile(const char*, const char*, const char*) {}
+};
+
+class FieldProfileScope {
+public:
+  explicit FieldProfileScope(FieldProfile&) {}
+};
+
+#endif // PBCC_PROFILE_FIELDS
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation counting
+
+// If the module is compiled with --count-allocations, pbcc_count_allocations
+// calls a function and counts the allocations made while it runs: Python
+// object allocations (PyObject_Malloc etc.) and other Python allocations
+// (PyMem_Malloc etc.), which are counted by temporarily wrapping Python's
+// allocators, and C++ allocations (operator new) made by this module, which
+// are counted by replacing operator new. Allocations made by all threads are
+// counted, so this is only meaningful when no other threads are running.
+
+#ifdef PBCC_ALLOC_COUNTERS
+
+#include <cstdlib>
+#include <new>
+
+struct AllocationCounter {
+  std::atomic<uint64_t> allocations = 0;
+  std::atomic<uint64_t> bytes = 0;
+
+  inline void add(size_t size) {
+    stats_add(this->allocations);
+    stats_add(this->bytes, size);
+  }
+  void reset() {
+    this->allocations.store(0, std::memory_order_relaxed);
+    this->bytes.store(0, std::memory_order_relaxed);
+  }
+};
+
+extern std::atomic<bool> counting_allocations;
+extern AllocationCounter object_allocation_counter;
+extern AllocationCounter mem_allocation_counter;
+extern AllocationCounter cpp_allocation_counter;
+
+// The wrapped allocator's ctx points to one of these
+struct CountingAllocatorContext {
+  PyMemAllocatorEx original;
+  AllocationCounter* counter;
+};
+
+inline void* counting_malloc(void* ctx, size_t size) {
+  auto* c = reinterpret_cast<CountingAllocatorContext*>(ctx);
+  c->counter->add(size);
+  return c->original.malloc(c->original.ctx, size);
+}
+
+inline void* counting_calloc(void* ctx, size_t nelem, size_t elsize) {
+  auto* c = reinterpret_cast<CountingAllocatorContext*>(ctx);
+  c->counter->add(nelem * elsize);
+  return c->original.calloc(c->original.ctx, nelem, elsize);
+}
+
+// Reallocations are counted as allocations of the new size
+inline void* counting_realloc(void* ctx, void* ptr, size_t new_size) {
+  auto* c = reinterpret_cast<CountingAllocatorContext*>(ctx);
+  c->counter->add(new_size);
+  return c->original.realloc(c->original.ctx, ptr, new_size);
+}
+
+inline void counting_free(void* ctx, void* ptr) {
+  auto* c = reinterpret_cast<CountingAllocatorContext*>(ctx);
+  c->original.free(c->original.ctx, ptr);
+}
+
+// Calls fn() with Python's object and mem allocators wrapped, and returns a
+// dict of the allocation counts. Allocations of the raw domain aren't counted,
+// since its allocator may be called without the GIL held.
+inline PyObject* count_allocations(PyObject*, PyObject* fn) {
+  if (counting_allocations.exchange(true)) {
+    PyErr_SetString(PyExc_RuntimeError, "pbcc_count_allocations calls cannot be nested");
+    return nullptr;
+  }
+  object_allocation_counter.reset();
+  mem_allocation_counter.reset();
+  cpp_allocation_counter.reset();
+
+  CountingAllocatorContext object_ctx{{}, &object_allocation_counter};
+  CountingAllocatorContext mem_ctx{{}, &mem_allocation_counter};
+  PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &object_ctx.original);
+  PyMem_GetAllocator(PYMEM_DOMAIN_MEM, &mem_ctx.original);
+  PyMemAllocatorEx object_allocator{&object_ctx, counting_malloc, counting_calloc, counting_realloc, counting_free};
+  PyMemAllocatorEx mem_allocator{&mem_ctx, counting_malloc, counting_calloc, counting_realloc, counting_free};
+  PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &object_allocator);
+  PyMem_SetAllocator(PYMEM_DOMAIN_MEM, &mem_allocator);
+
+  PyObject* result = PyObject_CallNoArgs(fn);
+
+  PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &object_ctx.original);
+  PyMem_SetAllocator(PYMEM_DOMAIN_MEM, &mem_ctx.original);
+  counting_allocations.store(false);
+  if (!result) {
+    return nullptr;
+  }
+  Py_DECREF(result);
+
+  return Py_BuildValue("{sKsKsKsKsKsK}",
+      "object_allocations", static_cast<unsigned long long>(object_allocation_counter.allocations.load()),
+      "object_bytes", static_cast<unsigned long long>(object_allocation_counter.bytes.load()),
+      "mem_allocations", static_cast<unsigned long long>(mem_allocation_counter.allocations.load()),
+      "mem_bytes", static_cast<unsigned long long>(mem_allocation_counter.bytes.load()),
+      "cpp_allocations", static_cast<unsigned long long>(cpp_allocation_counter.allocations.load()),
+      "cpp_bytes", static_cast<unsigned long long>(cpp_allocation_counter.bytes.load()));
+}
+
+#endif // PBCC_ALLOC_COUNTERS
+
+///////////////////////////////////////////////////////////////////////////////
+// Live object gauges
+
+// If the module is compiled with --live-objects, each message type counts its
+// live instances (including instances of Python subclasses), the peak number
+// of live instances, the total number ever created, and the shallow size of
+// the live instances (the size of the instance objects themselves, not
+// including their field values or unknown fields; deep_sizeof can be used for
+// those). These are returned by pbcc_live_objects(), which is
+// cheap enough to be polled by a metrics exporter. Without --live-objects,
+// LiveObjectCounter is empty and does nothing.
+
+#ifdef PBCC_LIVE_OBJECTS
+
+struct LiveObjectCounter {
+  std::atomic<uint64_t> live = 0;
+  std::atomic<uint64_t> peak = 0;
+  std::atomic<uint64_t> created = 0;
+  std::atomic<uint64_t> shallow_bytes = 0;
+
+  inline void add(PyObject* obj) {
+    stats_add(this->created);
+    stats_add(this->shallow_bytes, Py_TYPE(obj)->tp_basicsize);
+    uint64_t live = this->live.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t peak = this->peak.load(std::memory_order_relaxed);
+    while ((live > peak) && !this->peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+  }
+  inline void remove(PyObject* obj) {
+    this->live.fetch_sub(1, std::memory_order_relaxed);
+    this->shallow_bytes.fetch_sub(Py_TYPE(obj)->tp_basicsize, std::memory_order_relaxed);
+  }
+
+  // Resets the peak to the current number of live instances, so the next
+  // pbcc_live_objects() call returns the peak since now
+  void reset_peak() {
+    this->peak.store(this->live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  PyObject* as_py_dict() const {
+    return raise_python_errors(Py_BuildValue, "{sKsKsKsK}",
+        "live", static_cast<unsigned long long>(this->live.load(std::memory_order_relaxed)),
+        "peak", static_cast<unsigned long long>(this->peak.load(std::memory_order_relaxed)),
+        "created", static_cast<unsigned long long>(this->created.load(std::memory_order_relaxed)),
+        "shallow_bytes", static_cast<unsigned long long>(this->shallow_bytes.load(std::memory_order_relaxed)));
+  }
+};
+
+#else // PBCC_LIVE_OBJECTS
+
+struct LiveObjectCounter {
+  inline void add(PyObject*) {}
+  inline void remove(PyObject*) {}
+};
+
+#endif // PBCC_LIVE_OBJECTS
+
+#endif // PBCC_RUNTIME_H
@@ -5,11 +5,15 @@ compiles pb2 and pbcc modules at import time, so it can then import them.
 
 """
 
+import glob
+import json
 import os
 import pickle
 import subprocess
 import sys
 import traceback
+from array import array
+from enum import Enum
 from types import FunctionType
 from typing import Any, ClassVar, Protocol, Sequence, cast
 
@@ -30,12 +34,70 @@ subprocess.check_call(
 )
 import test_modules.test_pb2 as pb  # noqa: E402
 
+# The test modules are built through a cache in test_modules, so they're only
+# rebuilt when the code generator, runtime, schema, or options change. The
+# build cache tests use the same cache
+BUILD_CACHE_DIR = "test_modules/build_cache"
+
 print("Building test_pbcc")
 subprocess.check_call(
-    (sys.executable, "compile.py", "test_modules.test_pb2", "--output-basename", "test_modules/test_pbcc")
+    (
+        sys.executable,
+        "compile.py",
+        "test_modules.test_pb2",
+        "--output-basename",
+        "test_modules/test_pbcc",
+        "--shards",
+        "1",
+        "--cache-dir",
+        BUILD_CACHE_DIR,
+    )
 )
 import test_modules.test_pbcc as pbcc  # noqa: E402
 
+# This build has all of the optional instrumentation features enabled (USDT
+# probes require systemtap's sdt.h, so they're only enabled if it's present)
+HAS_SDT_HEADER = os.path.exists("/usr/include/sys/sdt.h")
+# This build also uses a field frequency profile (in the format returned by
+# pbcc_field_usage) in which most of TestPrimitives' fields are cold. It's
+# split into several source files, while test_pbcc is a single file, so both
+# kinds of build are tested
+with open("test_modules/field_usage_profile.json", "wt") as f:
+    json.dump(
+        {
+            "test.TestPrimitives": {
+                "f_int32": {"reads": 0, "writes": 0, "parses": 1000, "parsed_bytes": 2000},
+                "f_string": {"reads": 0, "writes": 0, "parses": 500, "parsed_bytes": 5000},
+                "f_double": {"reads": 0, "writes": 0, "parses": 800, "parsed_bytes": 7200},
+                "f_bool": {"reads": 0, "writes": 0, "parses": 5, "parsed_bytes": 10},
+            },
+        },
+        f,
+    )
+print("Building test_pbcc_instrumented")
+subprocess.check_call(
+    (
+        sys.executable,
+        "compile.py",
+        "test_modules.test_pb2",
+        "--output-basename",
+        "test_modules/test_pbcc_instrumented",
+        "--shards",
+        "4",
+        "--cache-dir",
+        BUILD_CACHE_DIR,
+        "--stats",
+        "--field-usage",
+        "--profile-fields",
+        "--count-allocations",
+        "--live-objects",
+        "--field-frequency-profile",
+        "test_modules/field_usage_profile.json",
+        *(("--usdt",) if HAS_SDT_HEADER else ()),
+    )
+)
+import test_modules.test_pbcc_instrumented as pbcc_instrumented  # noqa: E402
+
 
 class PBCCMessage(Protocol):
     @staticmethod
@@ -2307,6 +2369,25 @@ def test_field_ordering() -> None:
     assert msg3 == msg, "Deserialized message should equal original"
 
 
+@test_case
+def test_empty_message() -> None:
+    msg = pbcc.TestEmpty()
+    assert msg.as_proto_data() == b""
+    assert msg.as_dict() == {}
+    assert repr(msg) == "test_pbcc.test.TestEmpty()", repr(msg)
+    assert msg == pbcc.TestEmpty()
+    assert msg.proto_copy() == msg
+    assert pbcc.TestEmpty.diff(msg, pbcc.TestEmpty()) == []
+
+    # All fields in any data are unknown fields, and are retained by default
+    data = pb.TestPrimitives(f_int32=5, f_string="abc").SerializeToString()
+    msg = pbcc.TestEmpty.from_proto_data(data)
+    assert msg.has_unknown_fields()
+    # Unknown fields aren't necessarily serialized in their original order
+    assert pb.TestPrimitives.FromString(msg.as_proto_data()) == pb.TestPrimitives.FromString(data)
+    assert not pbcc.TestEmpty.from_proto_data(data, retain_unknown_fields=False).has_unknown_fields()
+
+
 @test_case
 def test_long_field_repr() -> None:
     # Create a long string and long bytes
@@ -2331,6 +2412,1612 @@ def test_long_field_repr() -> None:
     assert msg.f_bytes == long_bytes
 
 
+@test_case
+def test_diff_and_patch() -> None:
+    def check_patch(a: Any, b: Any) -> bytes:
+        patch = a.diff_to_patch(b)
+        a_data = a.as_proto_data()
+        a.parse_proto_into_this(patch)
+        assert a == b, f"{a!r} != {b!r}"
+        # Applying the patch with Google's library should give the same result
+        pb_a = getattr(pb, type(a).__name__).FromString(a_data)
+        pb_a.MergeFromString(patch)
+        assert pb_a.SerializeToString(deterministic=True) == b.as_proto_data()
+        return patch
+
+    # Identical messages have no differences
+    a = pbcc.TestPrimitives(f_int32=3, f_string="abc")
+    assert pbcc.TestPrimitives.diff(a, a.proto_copy()) == []
+    assert a.diff_to_patch(a.proto_copy()) == b""
+
+    # Changes to scalar fields, including changes back to the default value
+    b = a.proto_copy(f_int32=0, f_double=2.5, f_bytes=b"\x00\x01")
+    assert pbcc.TestPrimitives.diff(a, b) == ["f_int32", "f_double", "f_bytes"]
+    patch = check_patch(a, b)
+    assert pbcc.TestPrimitives.from_proto_data(patch).f_string == ""
+
+    # Changes within submessages are reported with dotted paths, and the patch
+    # only contains the changed fields of the submessage
+    a = pbcc.TestSubmessages(f_primitives=pbcc.TestPrimitives(f_int32=1, f_string="x" * 100))
+    b = pbcc.TestSubmessages(f_primitives=pbcc.TestPrimitives(f_int32=2, f_string="x" * 100))
+    assert pbcc.TestSubmessages.diff(a, b) == ["f_primitives.f_int32"]
+    patch = check_patch(a, b)
+    assert len(patch) < 10, patch
+
+    # proto_copy is shallow, so applying a patch to a copy must not modify the
+    # submessages it shares with the original
+    a = pbcc.TestSubmessages(f_primitives=pbcc.TestPrimitives(f_int32=1, f_string="x" * 100))
+    c = a.proto_copy()
+    c.parse_proto_into_this(patch)
+    assert c == b, f"{c!r} != {b!r}"
+    assert a.f_primitives == pbcc.TestPrimitives(f_int32=1, f_string="x" * 100)
+
+    # Optional submessages that are set or replaced are written in full
+    a = pbcc.TestSubmessages()
+    b = pbcc.TestSubmessages(f_optional_msg_primitives=pbcc.TestPrimitives(f_uint64=7))
+    assert pbcc.TestSubmessages.diff(a, b) == ["f_optional_msg_primitives"]
+    check_patch(a, b)
+
+    # Repeated and map fields are reported as a whole; appended items and
+    # changed map entries can be patched
+    a = pbcc.TestSubmessages(
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=1)],
+        f_maps=pbcc.TestMaps(f_string_double={"a": 1.0, "b": 2.0}),
+        f_string_primitives={"x": pbcc.TestPrimitives(f_int32=1)},
+    )
+    b = pbcc.TestSubmessages(
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=1), pbcc.TestPrimitives(f_int32=2)],
+        f_maps=pbcc.TestMaps(f_string_double={"a": 1.0, "b": 3.0, "c": 0.0}),
+        f_string_primitives={"x": pbcc.TestPrimitives(f_int32=1), "y": pbcc.TestPrimitives()},
+    )
+    assert pbcc.TestSubmessages.diff(a, b) == [
+        "f_maps.f_string_double",
+        "f_string_primitives",
+        "f_repeated_msg_primitives",
+    ]
+    check_patch(a, b)
+    for values in ([1, 2], [1, 3, 4], [2, 3]):
+        assert pbcc.TestListPrimitives.diff(
+            pbcc.TestListPrimitives(f_int32=[1, 3]), pbcc.TestListPrimitives(f_int32=values)
+        ) == ["f_int32"]
+    check_patch(pbcc.TestListPrimitives(f_float=[1.0]), pbcc.TestListPrimitives(f_float=[1.0, 2.0, 3.0]))
+
+    # Oneofs are compared according to the type of their current values
+    a = pbcc.TestOneofs(f_int_or_bytes=5, f_submessage=pbcc.TestPrimitives(f_int32=1))
+    b = pbcc.TestOneofs(f_int_or_bytes=b"5", f_submessage=pbcc.TestPrimitives(f_int32=2))
+    assert pbcc.TestOneofs.diff(a, b) == ["f_int_or_bytes", "f_submessage.f_int32"]
+    check_patch(a, b)
+    a = pbcc.TestOneofs(f_int_or_bytes=5, f_submessage=pbcc.TestPrimitives(f_int32=1))
+    b = pbcc.TestOneofs(f_int_or_bytes=5, f_submessage=pbcc.TestListPrimitives(f_int32=[1]))
+    assert pbcc.TestOneofs.diff(a, b) == ["f_submessage"]
+    check_patch(a, b)
+
+    # Changes that can't be represented as a merge should raise
+    unpatchable_changes: list[tuple[Any, Any]] = [
+        (pbcc.TestListPrimitives(f_int32=[1, 2]), pbcc.TestListPrimitives(f_int32=[1])),
+        (pbcc.TestListPrimitives(f_int32=[1, 2]), pbcc.TestListPrimitives(f_int32=[2, 2])),
+        (pbcc.TestMaps(f_string_int32={"a": 1}), pbcc.TestMaps(f_string_int32={})),
+        (pbcc.TestOptionalPrimitives(f_int32=1), pbcc.TestOptionalPrimitives()),
+        (pbcc.TestPrimitives(), pbcc.TestPrimitives(f_int32="1")),
+    ]
+    for a, b in unpatchable_changes:
+        try:
+            a.diff_to_patch(b)
+            raise AssertionError(f"diff_to_patch did not raise for {a!r} -> {b!r}")
+        except RuntimeError:
+            pass
+
+    # Messages of different types can't be compared
+    for args in ((pbcc.TestPrimitives(), pbcc.TestMaps()), (pbcc.TestPrimitives(), None)):
+        try:
+            pbcc.TestPrimitives.diff(*args)
+            raise AssertionError("diff did not raise for mismatched types")
+        except TypeError:
+            pass
+    try:
+        pbcc.TestPrimitives().diff_to_patch(pbcc.TestMaps())
+        raise AssertionError("diff_to_patch did not raise for mismatched types")
+    except TypeError:
+        pass
+
+
+@test_case
+def test_merge_and_update() -> None:
+    def check_merge(a: Any, b: Any) -> None:
+        # proto_copy is shallow, so we use a serialized copy instead
+        expected = type(a).from_proto_data(a.as_proto_data())
+        expected.parse_proto_into_this(b.as_proto_data())
+        b_data = b.as_proto_data()
+        a.merge_from(b)
+        assert a == expected, f"{a!r} != {expected!r}"
+        if a is not b:
+            assert b.as_proto_data() == b_data  # b should not have been modified
+
+    # Scalars are only overwritten by non-default values (or set optional values)
+    check_merge(pbcc.TestPrimitives(f_int32=1, f_string="a"), pbcc.TestPrimitives(f_int64=2, f_string="b"))
+    check_merge(pbcc.TestOptionalPrimitives(f_int32=1, f_bool=True), pbcc.TestOptionalPrimitives(f_int32=0))
+    a = pbcc.TestPrimitives(f_int32=1)
+    a.merge_from(pbcc.TestPrimitives(f_uint32=3))
+    assert a.f_int32 == 1 and a.f_uint32 == 3
+
+    # Submessages are merged, repeated fields are extended, and maps are updated
+    a = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int32=1),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[1], f_string=["a"]),
+        f_string_primitives={"x": pbcc.TestPrimitives(f_int32=1)},
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=1)],
+    )
+    b = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int64=2),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[2, 3]),
+        f_maps=pbcc.TestMaps(f_string_int32={"a": 1}),
+        f_string_primitives={"x": pbcc.TestPrimitives(f_int64=2), "y": pbcc.TestPrimitives()},
+        f_optional_msg_primitives=pbcc.TestPrimitives(f_double=1.5),
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=2)],
+    )
+    check_merge(a, b)
+    assert a.f_primitives.f_int32 == 1 and a.f_primitives.f_int64 == 2
+    assert a.f_list_primitives.f_int32 == [1, 2, 3]
+    # Merged messages must not share any mutable state with the source
+    assert a.f_optional_msg_primitives is not b.f_optional_msg_primitives
+    assert a.f_repeated_msg_primitives[1] is not b.f_repeated_msg_primitives[0]
+    assert a.f_string_primitives["y"] is not b.f_string_primitives["y"]
+    assert a.f_maps.f_string_int32 is not b.f_maps.f_string_int32
+
+    # Merging into a shallow copy must not modify the submessages, lists, and
+    # dicts it shares with the original
+    a = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int64=1),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[1]),
+        f_string_primitives={"x": pbcc.TestPrimitives(f_int32=1)},
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=1)],
+    )
+    a_data = a.as_proto_data()
+    c = a.proto_copy()
+    check_merge(c, b)
+    assert c.f_primitives.f_int64 == 2
+    assert a.as_proto_data() == a_data
+    assert a.f_primitives == pbcc.TestPrimitives(f_int64=1)
+
+    # Merging a message into itself behaves like parsing its own data into it
+    check_merge(a, a)
+    check_merge(
+        pbcc.TestOneofs(f_int_or_bytes=3, f_submessage=pbcc.TestPrimitives(f_int32=1)),
+        pbcc.TestOneofs(f_int_or_bytes=b"x", f_submessage=pbcc.TestListPrimitives(f_int32=[1])),
+    )
+
+    # Unknown fields are merged too
+    floats_m = pbcc.TestFloatPrimitivesOnly.from_proto_data(pbcc.TestPrimitives(f_uint64=64).as_proto_data())
+    a = pbcc.TestFloatPrimitivesOnly(f_float=1.0)
+    a.merge_from(floats_m)
+    assert a.has_unknown_fields()
+    assert pbcc.TestPrimitives.from_proto_data(a.as_proto_data()).f_uint64 == 64
+
+    # update_from replaces exactly the fields in the mask, and can use the paths
+    # returned by diff()
+    a = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int32=1, f_int64=1),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[1, 2]),
+        f_string_primitives={"x": pbcc.TestPrimitives(f_int32=1)},
+    )
+    b = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int32=2, f_int64=2),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[3]),
+        f_optional_msg_primitives=pbcc.TestPrimitives(f_string="b"),
+    )
+    a_data = a.as_proto_data()
+    c = a.proto_copy()
+    c.update_from(b, ["f_primitives.f_int64", "f_list_primitives", "f_string_primitives"])
+    assert c.f_primitives == pbcc.TestPrimitives(f_int32=1, f_int64=2)
+    assert c.f_list_primitives == b.f_list_primitives
+    assert c.f_list_primitives is not b.f_list_primitives
+    assert c.f_list_primitives.f_int32 is not b.f_list_primitives.f_int32
+    assert c.f_string_primitives == {}
+    assert c.f_optional_msg_primitives is None
+    # proto_copy is shallow, so the submessages that c shares with a must have
+    # been copied rather than updated in place
+    assert a.as_proto_data() == a_data
+    assert a.f_primitives == pbcc.TestPrimitives(f_int32=1, f_int64=1)
+    a.update_from(b, pbcc.TestSubmessages.diff(a, b))
+    assert a == b
+    assert a.f_optional_msg_primitives is not b.f_optional_msg_primitives
+
+    # Subfields of unset optional submessages are treated as default values
+    a = pbcc.TestSubmessages(f_optional_msg_primitives=pbcc.TestPrimitives(f_int32=5, f_int64=6))
+    a.update_from(pbcc.TestSubmessages(), ["f_optional_msg_primitives.f_int32"])
+    assert a.f_optional_msg_primitives == pbcc.TestPrimitives(f_int64=6)
+    a = pbcc.TestSubmessages()
+    a.update_from(
+        pbcc.TestSubmessages(f_optional_msg_primitives=pbcc.TestPrimitives(f_int32=5)),
+        ["f_optional_msg_primitives.f_int32"],
+    )
+    assert a.f_optional_msg_primitives == pbcc.TestPrimitives(f_int32=5)
+
+    # A whole field in the mask takes precedence over its subfields
+    a = pbcc.TestSubmessages(f_primitives=pbcc.TestPrimitives(f_int32=1, f_int64=1))
+    a.update_from(pbcc.TestSubmessages(), ["f_primitives.f_int32", "f_primitives", "f_primitives.f_int64"])
+    assert a.f_primitives == pbcc.TestPrimitives()
+
+    # Invalid masks should raise
+    for mask in (["f_nonexistent"], ["f_primitives.f_nonexistent"], ["f_maps.f_string_int32.x"], [""], ["a..b"]):
+        try:
+            pbcc.TestSubmessages().update_from(pbcc.TestSubmessages(), mask)
+            raise AssertionError(f"update_from did not raise for {mask!r}")
+        except ValueError:
+            pass
+    for args in ((pbcc.TestPrimitives(), []), (pbcc.TestSubmessages(), "f_primitives")):
+        try:
+            pbcc.TestSubmessages().update_from(*args)
+            raise AssertionError(f"update_from did not raise for {args!r}")
+        except TypeError:
+            pass
+
+
+@test_case
+def test_reuse_parsing() -> None:
+    messages = [
+        pbcc.TestSubmessages(
+            f_primitives=pbcc.TestPrimitives(f_int32=1, f_string="a"),
+            f_list_primitives=pbcc.TestListPrimitives(f_int32=[1, 2, 3], f_string=["a", "b"]),
+            f_maps=pbcc.TestMaps(f_string_int32={"a": 1, "b": 2}),
+            f_string_primitives={"x": pbcc.TestPrimitives(f_int32=1)},
+            f_optional_msg_primitives=pbcc.TestPrimitives(f_int64=5),
+            f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=1), pbcc.TestPrimitives(f_int32=2)],
+        ),
+        pbcc.TestSubmessages(
+            f_primitives=pbcc.TestPrimitives(f_int64=2),
+            f_list_primitives=pbcc.TestListPrimitives(f_int32=[4], f_double=[1.5]),
+            f_repeated_msg_primitives=[pbcc.TestPrimitives(f_string="c")] * 3,
+        ),
+        pbcc.TestSubmessages(),
+    ]
+
+    # Objects that are referenced from elsewhere aren't reused, so this only
+    # keeps the objects' ids (which can't be reused by the replacement objects,
+    # since they're created before the objects they replace are destroyed)
+    def object_ids(m: Any) -> list[int]:
+        return [
+            id(m.f_primitives),
+            id(m.f_list_primitives),
+            id(m.f_list_primitives.f_int32),
+            id(m.f_repeated_msg_primitives),
+            id(m.f_string_primitives),
+        ]
+
+    m = pbcc.TestSubmessages()
+    ids = object_ids(m)
+    for _ in range(2):
+        for expected in messages:
+            data = expected.as_proto_data()
+            m.parse_proto_into_this(data, reuse=True)
+            assert m == expected, f"{m!r} != {expected!r}"
+            assert m.as_proto_data() == data
+            # The existing containers and submessages should have been reused
+            assert object_ids(m) == ids
+
+    # Items in repeated message fields are reused too
+    m.parse_proto_into_this(messages[0].as_proto_data(), reuse=True)
+    first_item_id = id(m.f_repeated_msg_primitives[0])
+    m.parse_proto_into_this(messages[1].as_proto_data(), reuse=True)
+    assert id(m.f_repeated_msg_primitives[0]) == first_item_id
+    assert m.f_repeated_msg_primitives == messages[1].f_repeated_msg_primitives
+
+    # Objects that are shared with other messages or held by the caller are
+    # replaced rather than reused, so they aren't modified
+    data = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int64=3),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[4, 5]),
+        f_string_primitives={"y": pbcc.TestPrimitives()},
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=z) for z in (1, 2, 3)],
+    ).as_proto_data()
+    x = pbcc.TestPrimitives(f_int32=5)
+    m = pbcc.TestSubmessages(f_repeated_msg_primitives=[x] * 3)
+    m.parse_proto_into_this(data, reuse=True)
+    assert [item.f_int32 for item in m.f_repeated_msg_primitives] == [1, 2, 3]
+    assert x == pbcc.TestPrimitives(f_int32=5)
+    shared = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int32=5),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[1]),
+        f_string_primitives={"x": pbcc.TestPrimitives()},
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int32=9)],
+    )
+    shared_data = shared.as_proto_data()
+    m1 = shared.proto_copy()
+    m2 = pbcc.TestSubmessages(f_primitives=shared.f_primitives)
+    m1.parse_proto_into_this(data, reuse=True)
+    m2.parse_proto_into_this(data, reuse=True)
+    assert m1 == pbcc.TestSubmessages.from_proto_data(data)
+    assert m2 == pbcc.TestSubmessages.from_proto_data(data)
+    assert shared.as_proto_data() == shared_data
+    m1.parse_proto_into_this(b"", reuse=True)
+    assert shared.as_proto_data() == shared_data
+
+    # Repeated appearances of a submessage in the data are still merged
+    data = pbcc.TestSubmessages(f_primitives=pbcc.TestPrimitives(f_int32=7)).as_proto_data()
+    data += pbcc.TestSubmessages(f_primitives=pbcc.TestPrimitives(f_int64=8)).as_proto_data()
+    m.parse_proto_into_this(data, reuse=True)
+    assert m == pbcc.TestSubmessages.from_proto_data(data)
+    assert m.f_primitives == pbcc.TestPrimitives(f_int32=7, f_int64=8)
+
+    # Unknown fields are replaced as well
+    floats_m = pbcc.TestFloatPrimitivesOnly()
+    floats_m.parse_proto_into_this(pbcc.TestPrimitives(f_uint64=64).as_proto_data(), reuse=True)
+    assert floats_m.has_unknown_fields()
+    floats_m.parse_proto_into_this(pbcc.TestPrimitives(f_float=1.0).as_proto_data(), reuse=True)
+    assert not floats_m.has_unknown_fields()
+    assert floats_m.f_float == 1.0
+
+    # Oneofs and optional fields are reset too
+    m = pbcc.TestOneofs(f_int_or_bytes=b"x", f_submessage=pbcc.TestListPrimitives(f_int32=[1]))
+    m.parse_proto_into_this(pbcc.TestOneofs(f_string_or_float="a").as_proto_data(), reuse=True)
+    assert m == pbcc.TestOneofs(f_string_or_float="a")
+    m = pbcc.TestOptionalPrimitives(f_int32=1, f_string="a")
+    m.parse_proto_into_this(pbcc.TestOptionalPrimitives(f_bool=False).as_proto_data(), reuse=True)
+    assert m == pbcc.TestOptionalPrimitives(f_bool=False)
+
+    # Repeated fields holding sequences other than lists are replaced with
+    # lists, whether or not the existing items are reused
+    expected = messages[0]
+    data = expected.as_proto_data()
+    m = pbcc.TestSubmessages()
+    m.f_list_primitives.f_int32 = (9, 8, 7, 6)
+    m.f_list_primitives.f_string = range(0)
+    m.f_repeated_msg_primitives = tuple(pbcc.TestPrimitives(f_int32=9) for _ in range(3))
+    m.parse_proto_into_this(data, reuse=True)
+    assert m == expected, f"{m!r} != {expected!r}"
+    assert isinstance(m.f_list_primitives.f_int32, list)
+    assert isinstance(m.f_repeated_msg_primitives, list)
+    m = pbcc.TestListPrimitives()
+    m.f_int32 = (9, 8)
+    m.f_string = range(0)
+    m.parse_proto_into_this(expected.f_list_primitives.as_proto_data())
+    assert m.f_int32 == [9, 8, 1, 2, 3]
+    assert m.f_string == ["a", "b"]
+
+    # clear() resets everything in place, except objects that are shared
+    m = pbcc.TestSubmessages.from_proto_data(messages[0].as_proto_data())
+    list_primitives_id = id(m.f_list_primitives)
+    primitives = m.f_primitives
+    m.clear()
+    assert m == pbcc.TestSubmessages()
+    assert id(m.f_list_primitives) == list_primitives_id
+    assert m.f_optional_msg_primitives is None
+    assert primitives == messages[0].f_primitives
+
+
+@test_case
+def test_serialize_repeated_iterables() -> None:
+    # Repeated fields may hold any iterable when serializing, and should
+    # produce the same data as the equivalent lists
+    values: dict[str, list[Any]] = {
+        "f_int32": [1, -1, 0x7FFFFFFF],
+        "f_uint64": [0, 1, 0xFFFFFFFFFFFFFFFF],
+        "f_sint32": [-5, 5],
+        "f_fixed32": [1, 2, 3],
+        "f_sfixed64": [-1, 1],
+        "f_bool": [True, False],
+        "f_enum1": [pbcc.TestEnum1.TEST_E1_VALUE2, pbcc.TestEnum1.TEST_E1_VALUE1],
+        "f_float": [1.0, 2.5],
+        "f_double": [0.0, -3.5],
+        "f_bytes": [b"", b"abc"],
+        "f_string": ["x", ""],
+    }
+    for field_name, field_values in values.items():
+        expected = pbcc.TestListPrimitives(**{field_name: field_values}).as_proto_data()
+        for iterable in (tuple(field_values), (v for v in field_values), iter(field_values)):
+            m = pbcc.TestListPrimitives(**{field_name: iterable})
+            assert m.as_proto_data() == expected, f"{field_name}: {iterable!r}"
+        # Empty iterables produce no data at all
+        assert pbcc.TestListPrimitives(**{field_name: (v for v in ())}).as_proto_data() == b""
+
+    # Iterables are kept as they are (not converted to lists), and are
+    # consumed by serializing them, so a generator can only be serialized once
+    m = pbcc.TestListPrimitives(f_int32=[1, 2], f_string=("a", "b"))
+    m.f_double = (x / 2 for x in range(3))
+    data = m.as_proto_data()
+    assert pbcc.TestListPrimitives.from_proto_data(data) == pbcc.TestListPrimitives(
+        f_int32=[1, 2], f_string=["a", "b"], f_double=[0.0, 0.5, 1.0]
+    )
+    assert isinstance(m.f_string, tuple)
+    assert not isinstance(m.f_double, list)
+    assert pbcc.TestListPrimitives.from_proto_data(m.as_proto_data()) == pbcc.TestListPrimitives(
+        f_int32=[1, 2], f_string=["a", "b"]
+    )
+    m = m.proto_copy(f_uint32=iter([4, 5]))
+    assert pbcc.TestListPrimitives.from_proto_data(m.as_proto_data()).f_uint32 == [4, 5]
+
+    # Large fields can be serialized straight from generators, without building
+    # lists first
+    m = pbcc.TestListPrimitives()
+    m.f_uint32 = range(100000)
+    m.f_double = (x / 2 for x in range(100000))
+    parsed = pbcc.TestListPrimitives.from_proto_data(m.as_proto_data())
+    assert parsed.f_uint32 == list(range(100000))
+    assert parsed.f_double == [x / 2 for x in range(100000)]
+    assert isinstance(m.f_uint32, range)
+    m = pbcc.TestSubmessages(f_repeated_msg_primitives=(pbcc.TestPrimitives(f_int32=x) for x in range(3)))
+    parsed = pbcc.TestSubmessages.from_proto_data(m.as_proto_data())
+    assert [x.f_int32 for x in parsed.f_repeated_msg_primitives] == [0, 1, 2]
+
+    # Iterables that aren't sensible repeated field values should still raise,
+    # as should errors raised by the iterable itself
+    def failing_generator():
+        yield 1
+        raise KeyError("expected")
+
+    for value in ("str", b"bytes", bytearray(b"x"), {1: 2}, None, 3):
+        try:
+            pbcc.TestListPrimitives(f_int32=value).as_proto_data()
+            raise AssertionError(f"Serializing {value!r} did not raise")
+        except RuntimeError:
+            pass
+    try:
+        pbcc.TestListPrimitives(f_int32=failing_generator()).as_proto_data()
+        raise AssertionError("Serializing a failing generator did not raise")
+    except KeyError:
+        pass
+
+
+@test_case
+def test_fixed_width_fast_path() -> None:
+    # Messages with only fixed-width fields should parse the same way whether
+    # or not the fields are in canonical order
+    m = pbcc.TestFixedWidthOnly(
+        f_fixed32=0xFFFFFFFF,
+        f_sfixed64=-0x8000000000000000,
+        f_float=1.5,
+        f_double=-2.25,
+        f_optional_fixed64=0,
+        f_sfixed32=-7,
+    )
+    canonical = m.as_proto_data()
+    assert pbcc.TestFixedWidthOnly.from_proto_data(canonical) == m
+    field_data = [
+        pbcc.TestFixedWidthOnly(**{name: getattr(m, name)}).as_proto_data()
+        for name in ("f_fixed32", "f_sfixed64", "f_float", "f_double", "f_optional_fixed64", "f_sfixed32")
+    ]
+    assert b"".join(field_data) == canonical
+    reordered = pbcc.TestFixedWidthOnly.from_proto_data(b"".join(reversed(field_data)))
+    assert reordered == m
+    # Repeated fields use the last value, even if the first was in order
+    repeated = pbcc.TestFixedWidthOnly.from_proto_data(field_data[0] + field_data[0].replace(b"\xff", b"\x01"))
+    assert repeated.f_fixed32 == 0x01010101
+
+    # Parsing into an existing object should merge, unless reuse is given
+    partial_data = pbcc.TestFixedWidthOnly(f_float=3.0).as_proto_data()
+    merged = pbcc.TestFixedWidthOnly.from_proto_data(canonical)
+    merged.parse_proto_into_this(partial_data)
+    assert merged == m.proto_copy(f_float=3.0)
+    merged.parse_proto_into_this(partial_data, reuse=True)
+    assert merged == pbcc.TestFixedWidthOnly(f_float=3.0)
+
+    # decode_repeated_columns should produce the same values as parsing the
+    # container message, with missing values as zeroes
+    items = [
+        m,
+        pbcc.TestFixedWidthOnly(),
+        pbcc.TestFixedWidthOnly(f_fixed32=5, f_optional_fixed64=9),
+        pbcc.TestFixedWidthOnly.from_proto_data(b"".join(reversed(field_data))),
+    ]
+    container_data = pbcc.TestFixedWidthList(items=items, name="test").as_proto_data()
+    container_data += pbcc.TestFixedWidthList(items=[pbcc.TestFixedWidthOnly(f_sfixed32=3)]).as_proto_data()
+    parsed_items = pbcc.TestFixedWidthList.from_proto_data(container_data).items
+    columns = pbcc.TestFixedWidthOnly.decode_repeated_columns(container_data, 1)
+    assert sorted(columns) == sorted(m.as_dict())
+    for name, column in columns.items():
+        assert isinstance(column, array)
+        expected = [getattr(item, name) or 0 for item in parsed_items]
+        assert column.tolist() == expected, f"{name}: {column.tolist()} != {expected}"
+    assert len(pbcc.TestFixedWidthOnly.decode_repeated_columns(container_data, 3)["f_float"]) == 0
+    try:
+        pbcc.TestFixedWidthOnly.decode_repeated_columns(b"\x08\x01", 1)
+        raise AssertionError("decode_repeated_columns did not raise for a varint field")
+    except RuntimeError:
+        pass
+
+    # It's a static method, as declared in the .pyi file
+    assert isinstance(pbcc.TestFixedWidthOnly.__dict__["decode_repeated_columns"], staticmethod)
+    assert m.decode_repeated_columns(container_data, 1).keys() == columns.keys()
+
+    # Only messages with entirely fixed-width fields have this function
+    assert not hasattr(pbcc.TestPrimitives, "decode_repeated_columns")
+
+
+@test_case
+def test_stats() -> None:
+    # Stats are only available if enabled at compile time
+    assert not hasattr(pbcc, "pbcc_stats")
+    pbcc_instrumented.reset_stats()
+    stats = pbcc_instrumented.pbcc_stats()
+    assert set(stats) >= {"test.TestPrimitives", "test.TestSubmessages", "test.TestFloatPrimitivesOnly"}
+    assert stats["test.TestPrimitives"]["parse"]["calls"] == 0
+
+    # Successful calls should record sizes and latencies
+    msg = pbcc_instrumented.TestPrimitives(f_int32=5, f_string="hello")
+    data = msg.as_proto_data()
+    for _ in range(10):
+        pbcc_instrumented.TestPrimitives.from_proto_data(data)
+    msg.parse_proto_into_this(data)
+    stats = pbcc_instrumented.pbcc_stats()["test.TestPrimitives"]
+    parse_stats = stats["parse"]
+    assert parse_stats["calls"] == 11
+    assert parse_stats["bytes"] == 11 * len(data)
+    assert parse_stats["size_histogram"] == {1 << (len(data).bit_length() - 1): 11}
+    assert sum(parse_stats["latency_histogram_ns"].values()) == 11
+    assert parse_stats["total_ns"] > 0
+    assert all(count == 0 for count in parse_stats["errors"].values())
+    assert stats["serialize"]["calls"] == 1
+    assert stats["serialize"]["bytes"] == len(data)
+
+    # Errors should be counted by reason, and not recorded as successful calls
+    bad_inputs = [
+        b"\x08",  # Truncated varint
+        b"\x0d\x01\x00\x00\x00",  # f_int32 as a fixed32
+        b"\xa7\x06",  # Unknown field with an invalid wire type
+    ]
+    for bad_data in bad_inputs:
+        try:
+            pbcc_instrumented.TestPrimitives.from_proto_data(bad_data)
+            raise AssertionError(f"Parsing {bad_data!r} did not raise")
+        except RuntimeError:
+            pass
+    try:
+        pbcc_instrumented.TestPrimitives(f_int32=1 << 40).as_proto_data()
+        raise AssertionError("Serializing an out-of-range value did not raise")
+    except RuntimeError:
+        pass
+    stats = pbcc_instrumented.pbcc_stats()["test.TestPrimitives"]
+    assert stats["parse"]["calls"] == 14
+    assert stats["parse"]["bytes"] == 11 * len(data)
+    assert stats["parse"]["errors"] == {
+        "truncated_data": 1,
+        "incorrect_type": 1,
+        "invalid_data": 1,
+        "python_error": 0,
+    }
+    assert stats["serialize"]["calls"] == 2
+    assert stats["serialize"]["errors"]["invalid_data"] == 1
+
+    # Unknown fields and incorrect types that are skipped should be counted
+    pbcc_instrumented.TestFloatPrimitivesOnly.from_proto_data(data)
+    pbcc_instrumented.TestPrimitives.from_proto_data(b"\x0d\x01\x00\x00\x00", ignore_incorrect_types=True)
+    stats = pbcc_instrumented.pbcc_stats()
+    assert stats["test.TestFloatPrimitivesOnly"]["unknown_fields"] == 2
+    assert stats["test.TestPrimitives"]["incorrect_type_fallbacks"] == 1
+
+    # Resetting should clear everything
+    pbcc_instrumented.reset_stats()
+    stats = pbcc_instrumented.pbcc_stats()["test.TestPrimitives"]
+    assert stats["parse"]["calls"] == 0
+    assert stats["parse"]["size_histogram"] == {}
+    assert stats["incorrect_type_fallbacks"] == 0
+
+
+@test_case
+def test_field_usage() -> None:
+    assert not hasattr(pbcc, "pbcc_field_usage")
+    pbcc_instrumented.reset_field_usage()
+    usage = pbcc_instrumented.pbcc_field_usage()
+    assert usage["test.TestPrimitives"]["f_int32"] == {"reads": 0, "writes": 0, "parses": 0, "parsed_bytes": 0}
+    assert pbcc_instrumented.pbcc_field_usage(unused_only=True) == {}
+
+    data = pbcc_instrumented.TestSubmessages(
+        f_primitives=pbcc_instrumented.TestPrimitives(f_int32=3, f_string="abcd"),
+        f_repeated_msg_primitives=[pbcc_instrumented.TestPrimitives(f_uint32=1)] * 3,
+    ).as_proto_data()
+    for _ in range(2):
+        msg = pbcc_instrumented.TestSubmessages.from_proto_data(data)
+    assert msg.f_primitives.f_int32 == 3
+    msg.f_primitives.f_string = "x"
+    del msg.f_primitives.f_bytes
+    try:
+        msg.f_primitives.f_bytes
+        raise AssertionError("Reading a deleted field did not raise")
+    except AttributeError:
+        pass
+    msg.f_primitives.f_bytes = b""
+
+    usage = pbcc_instrumented.pbcc_field_usage()
+    assert usage["test.TestSubmessages"]["f_primitives"]["reads"] == 5
+    assert usage["test.TestSubmessages"]["f_primitives"]["parses"] == 2
+    assert usage["test.TestSubmessages"]["f_repeated_msg_primitives"]["parses"] == 6
+    primitives_usage = usage["test.TestPrimitives"]
+    assert primitives_usage["f_int32"] == {"reads": 1, "writes": 0, "parses": 2, "parsed_bytes": 4}
+    assert primitives_usage["f_string"] == {"reads": 0, "writes": 1, "parses": 2, "parsed_bytes": 14}
+    assert primitives_usage["f_bytes"] == {"reads": 1, "writes": 2, "parses": 0, "parsed_bytes": 0}
+    assert primitives_usage["f_uint32"] == {"reads": 0, "writes": 0, "parses": 6, "parsed_bytes": 12}
+
+    # unused_only should show only fields that were parsed but never read
+    unused = pbcc_instrumented.pbcc_field_usage(unused_only=True)
+    assert sorted(unused) == ["test.TestPrimitives", "test.TestSubmessages"]
+    assert sorted(unused["test.TestPrimitives"]) == ["f_string", "f_uint32"]
+    assert sorted(unused["test.TestSubmessages"]) == ["f_repeated_msg_primitives"]
+
+    # The fixed-width fast path should also record parses
+    pbcc_instrumented.TestFixedWidthOnly.from_proto_data(
+        pbcc_instrumented.TestFixedWidthOnly(f_fixed32=1, f_sfixed32=2).as_proto_data()
+    )
+    usage = pbcc_instrumented.pbcc_field_usage()["test.TestFixedWidthOnly"]
+    assert usage["f_fixed32"]["parsed_bytes"] == 5
+    assert usage["f_sfixed32"]["parsed_bytes"] == 6
+    assert usage["f_float"]["parses"] == 0
+
+    pbcc_instrumented.reset_field_usage()
+    assert pbcc_instrumented.pbcc_field_usage(unused_only=True) == {}
+
+
+@test_case
+def test_field_profile() -> None:
+    assert not hasattr(pbcc, "pbcc_field_profile")
+    pbcc_instrumented.reset_field_profile()
+    pbcc_instrumented.set_field_profile_trace_sampling(2, max_events=1000)
+
+    msg = pbcc_instrumented.TestSubmessages(
+        f_primitives=pbcc_instrumented.TestPrimitives(f_int32=3, f_string="abcd"),
+        f_repeated_msg_primitives=[pbcc_instrumented.TestPrimitives(f_double=1.5)] * 3,
+    )
+    oneofs = pbcc_instrumented.TestOneofs(f_int_or_bytes=b"abc")
+    for _ in range(4):
+        data = msg.as_proto_data()
+        pbcc_instrumented.TestSubmessages.from_proto_data(data)
+        pbcc_instrumented.TestOneofs.from_proto_data(oneofs.as_proto_data())
+
+    profile = pbcc_instrumented.pbcc_field_profile()
+    parse_fields = profile["parse"]["fields"]
+    assert parse_fields["TestSubmessages"]["count"] == 4
+    assert parse_fields["TestSubmessages.f_primitives"]["count"] == 4
+    assert parse_fields["TestSubmessages.f_primitives"]["data_type"] == "MESSAGE"
+    assert parse_fields["TestSubmessages.f_repeated_msg_primitives"]["count"] == 12
+    assert parse_fields["TestPrimitives"]["count"] == 16
+    assert parse_fields["TestPrimitives.f_string"] == {
+        "data_type": "STRING",
+        "count": 4,
+        "total_ns": parse_fields["TestPrimitives.f_string"]["total_ns"],
+        "self_ns": parse_fields["TestPrimitives.f_string"]["self_ns"],
+    }
+    assert parse_fields["TestPrimitives.f_double"]["count"] == 12
+    assert parse_fields["TestOneofs.f_bytes"]["data_type"] == "BYTES"
+    assert "TestPrimitives.f_bool" not in parse_fields
+    for name, field in parse_fields.items():
+        assert 0 <= field["self_ns"] <= field["total_ns"], name
+
+    # Self times should add up to the total time of the top-level messages
+    total_ns = parse_fields["TestSubmessages"]["total_ns"] + parse_fields["TestOneofs"]["total_ns"]
+    self_ns = sum(f["self_ns"] for f in parse_fields.values())
+    assert abs(total_ns - self_ns) <= total_ns * 0.01 + 1, (total_ns, self_ns)
+    assert profile["parse"]["data_types"]["DOUBLE"]["count"] == 12
+    assert profile["parse"]["data_types"]["(message)"]["count"] == 24
+
+    serialize_fields = profile["serialize"]["fields"]
+    assert serialize_fields["TestSubmessages.f_primitives"]["count"] == 4
+    assert serialize_fields["TestOneofs.f_int_or_bytes"]["data_type"] == "ONEOF"
+    # TestOneofs.f_submessage's default value is also a TestPrimitives
+    assert serialize_fields["TestPrimitives.f_bool"]["count"] == 20
+
+    # Every second top-level call should have been traced, including all of
+    # its nested fields. The calls alternate between serializing and parsing,
+    # so only the serialize calls are traced here
+    trace = json.loads(pbcc_instrumented.pbcc_field_profile_trace())
+    events = trace["traceEvents"]
+    top_level_names = [e["name"] for e in events if e["name"] in ("TestSubmessages", "TestOneofs")]
+    assert sorted(top_level_names) == ["TestOneofs"] * 4 + ["TestSubmessages"] * 4, top_level_names
+    assert all(e["cat"] == "serialize" for e in events)
+    assert sum(e["name"] == "TestPrimitives.f_double" for e in events) == 20
+    for event in events:
+        assert event["ph"] == "X"
+        assert event["dur"] >= 0
+
+    # Tracing should stop when the event limit is reached
+    pbcc_instrumented.reset_field_profile()
+    pbcc_instrumented.set_field_profile_trace_sampling(1, max_events=5)
+    for _ in range(4):
+        msg.as_proto_data()
+    assert len(json.loads(pbcc_instrumented.pbcc_field_profile_trace())["traceEvents"]) == 5
+    pbcc_instrumented.set_field_profile_trace_sampling(0)
+    pbcc_instrumented.reset_field_profile()
+    msg.as_proto_data()
+    assert json.loads(pbcc_instrumented.pbcc_field_profile_trace())["traceEvents"] == []
+    assert pbcc_instrumented.pbcc_field_profile()["serialize"]["fields"]["TestSubmessages"]["count"] == 1
+
+
+@test_case
+def test_sizeof() -> None:
+    # __sizeof__ should include the unknown fields' storage
+    msg = pbcc.TestPrimitives()
+    base_size = msg.__sizeof__()
+    assert base_size == type(msg).__basicsize__
+    msg.parse_proto_into_this(b"\xa2\x06\x40" + b"x" * 0x40)  # Field 100, 64 bytes
+    assert msg.has_unknown_fields()
+    assert msg.__sizeof__() > base_size + 0x40
+    assert sys.getsizeof(msg) >= msg.__sizeof__()
+    msg.delete_unknown_fields()
+    assert msg.__sizeof__() == base_size
+
+    # deep_sizeof should match a Python implementation of the same accounting,
+    # which counts every referenced object once and skips enums and singletons
+    def field_names(obj: Any) -> list[str]:
+        return [name for name in dir(obj) if name.startswith("f_")]
+
+    def expected_deep_sizeof(obj: Any, seen: set[int]) -> int:
+        if obj is None or obj is True or obj is False or isinstance(obj, Enum) or id(obj) in seen:
+            return 0
+        seen.add(id(obj))
+        ret = obj.__sizeof__() if hasattr(obj, "deep_sizeof") else sys.getsizeof(obj)
+        if isinstance(obj, (list, tuple)):
+            ret += sum(expected_deep_sizeof(item, seen) for item in obj)
+        elif isinstance(obj, dict):
+            ret += sum(expected_deep_sizeof(k, seen) + expected_deep_sizeof(v, seen) for k, v in obj.items())
+        elif hasattr(obj, "deep_sizeof"):
+            ret += sum(expected_deep_sizeof(getattr(obj, name), seen) for name in field_names(obj))
+        return ret
+
+    primitives = pbcc.TestPrimitives(f_int32=123456789, f_string="hello" * 100, f_bytes=b"x" * 1000)
+    msg = pbcc.TestSubmessages(
+        f_primitives=primitives,
+        f_list_primitives=pbcc.TestListPrimitives(
+            f_string=["a" * 50, "b" * 60], f_enum1=[pbcc.TestEnum1.TEST_E1_VALUE2]
+        ),
+        f_maps=pbcc.TestMaps(f_string_string={"k" * 30: "v" * 40}),
+        f_string_primitives={"p1": primitives, "p2": pbcc.TestPrimitives(f_double=2.5)},
+        f_repeated_msg_primitives=[primitives, primitives],
+    )
+    total = msg.deep_sizeof()
+    assert total == expected_deep_sizeof(msg, set()), (total, expected_deep_sizeof(msg, set()))
+
+    # The shared submessage should only be counted once, and the per-field
+    # breakdown should attribute it to the first field that references it
+    by_field = msg.deep_sizeof(by_field=True)
+    assert set(by_field) == {"(message)"} | set(field_names(msg))
+    assert sum(by_field.values()) == total
+    assert by_field["(message)"] == msg.__sizeof__()
+    assert by_field["f_primitives"] == expected_deep_sizeof(primitives, set())
+    assert by_field["f_primitives"] > 1500
+    assert by_field["f_repeated_msg_primitives"] == sys.getsizeof(msg.f_repeated_msg_primitives)
+    assert by_field["f_optional_msg_primitives"] == 0
+
+    # Fields holding values of unexpected types should still be counted
+    msg = pbcc.TestPrimitives()
+    msg.f_int32 = ["x" * 100]  # type: ignore[assignment]
+    assert msg.deep_sizeof(by_field=True)["f_int32"] == sys.getsizeof(msg.f_int32) + sys.getsizeof("x" * 100)
+    assert msg.deep_sizeof() == expected_deep_sizeof(msg, set())
+
+
+@test_case
+def test_explain_size() -> None:
+    def entry(count: int, tag_bytes: int, length_bytes: int, payload_bytes: int, elements: int | None = None):
+        return {
+            "count": count,
+            "elements": count if elements is None else elements,
+            "tag_bytes": tag_bytes,
+            "length_bytes": length_bytes,
+            "payload_bytes": payload_bytes,
+            "bytes": tag_bytes + length_bytes + payload_bytes,
+        }
+
+    msg = pbcc.TestPrimitives(f_int32=5, f_string="hello")
+    assert msg.explain_size() == {
+        "(message)": entry(1, 0, 0, 10),
+        "f_int32": entry(1, 1, 0, 1),
+        "f_string": entry(1, 2, 1, 5),  # Field 17 needs a 2-byte tag
+    }
+
+    # Fields within submessages should be attributed to dotted paths, and
+    # packed fields should count each value as an element
+    msg = pbcc.TestSubmessages(
+        f_primitives=pbcc.TestPrimitives(f_int32=5),
+        f_list_primitives=pbcc.TestListPrimitives(f_int32=[1, 2, 300], f_string=["a", "bc"]),
+        f_string_primitives={"a": pbcc.TestPrimitives(f_int32=1)},
+        f_repeated_msg_primitives=[pbcc.TestPrimitives(f_int64=1), pbcc.TestPrimitives(f_int64=2)],
+    )
+    explanation = msg.explain_size()
+    assert explanation["f_primitives"] == entry(1, 1, 1, 2)
+    assert explanation["f_primitives.f_int32"] == entry(1, 1, 0, 1)
+    assert explanation["f_list_primitives.f_int32"] == entry(1, 1, 1, 4, elements=3)
+    assert explanation["f_list_primitives.f_string"] == entry(2, 4, 2, 3)
+    assert explanation["f_string_primitives"] == entry(1, 1, 1, 7)  # Key (3 bytes) and value (4 bytes)
+    assert explanation["f_string_primitives.f_int32"] == entry(1, 1, 0, 1)
+    assert explanation["f_repeated_msg_primitives"] == entry(2, 2, 2, 4)
+    assert explanation["f_repeated_msg_primitives.f_int64"] == entry(2, 2, 0, 2)
+    total_bytes = len(msg.as_proto_data())
+    assert explanation["(message)"]["bytes"] == total_bytes
+    assert sum(e["bytes"] for path, e in explanation.items() if "." not in path and path != "(message)") == total_bytes
+
+    # Oneof fields should be attributed to the field, not the oneof
+    msg = pbcc.TestOneofs(f_int_or_bytes=b"xy")
+    assert msg.explain_size()["f_bytes"] == entry(1, 1, 1, 2)
+
+    # explain_proto_data_size should aggregate over all of the given messages,
+    # including unknown fields
+    data1 = pbcc.TestPrimitives(f_int32=5).as_proto_data()
+    data2 = pbcc.TestPrimitives(f_int32=300, f_bool=True).as_proto_data() + b"\xa0\x06\x01"
+    assert pbcc.TestPrimitives.explain_proto_data_size(data1) == pbcc.TestPrimitives(f_int32=5).explain_size()
+    assert pbcc.TestPrimitives.explain_proto_data_size(iter([data1, data2])) == {
+        "(message)": entry(2, 0, 0, len(data1) + len(data2)),
+        "(unknown)": entry(1, 2, 0, 1),
+        "f_bool": entry(1, 1, 0, 1),
+        "f_int32": entry(2, 2, 0, 3),
+    }
+    assert pbcc.TestPrimitives.explain_proto_data_size([]) == {"(message)": entry(0, 0, 0, 0)}
+    for bad_arg in (["not bytes"], 7):
+        try:
+            pbcc.TestPrimitives.explain_proto_data_size(bad_arg)  # type: ignore[arg-type]
+            raise AssertionError(f"explain_proto_data_size({bad_arg!r}) did not raise")
+        except TypeError:
+            pass
+    try:
+        pbcc.TestPrimitives.explain_proto_data_size(b"\x0a\x05abc")
+        raise AssertionError("Explaining truncated data did not raise")
+    except RuntimeError:
+        pass
+
+
+@test_case
+def test_live_objects() -> None:
+    assert not hasattr(pbcc, "pbcc_live_objects")
+
+    def live_objects(name: str) -> dict[str, int]:
+        return pbcc_instrumented.pbcc_live_objects()[f"test.{name}"]
+
+    class PrimitivesSubclass(pbcc_instrumented.TestPrimitives):
+        pass
+
+    basic_size = pbcc_instrumented.TestPrimitives.__basicsize__
+    before = live_objects("TestPrimitives")
+    data = pbcc_instrumented.TestPrimitives(f_int32=5).as_proto_data()
+    msgs = [pbcc_instrumented.TestPrimitives() for _ in range(10)]
+    msgs += [pbcc_instrumented.TestPrimitives.from_proto_data(data) for _ in range(5)]
+    msgs += [msgs[0].proto_copy(f_int32=3) for _ in range(5)]
+    during = live_objects("TestPrimitives")
+    assert during["live"] == before["live"] + 20
+    assert during["created"] == before["created"] + 21  # Including the one that was serialized
+    assert during["peak"] >= during["live"]
+    assert during["shallow_bytes"] == before["shallow_bytes"] + 20 * basic_size
+
+    # Submessages and instances of subclasses should be counted too
+    sub_before = live_objects("TestSubmessages")
+    msgs.append(pbcc_instrumented.TestSubmessages())
+    subclass_obj = PrimitivesSubclass()
+    assert live_objects("TestSubmessages")["live"] == sub_before["live"] + 1
+    assert live_objects("TestPrimitives")["live"] == during["live"] + 2  # f_primitives and subclass_obj
+    assert live_objects("TestPrimitives")["shallow_bytes"] == during["shallow_bytes"] + basic_size + type(subclass_obj).__basicsize__
+
+    del msgs, subclass_obj
+    after = live_objects("TestPrimitives")
+    assert after["live"] == before["live"]
+    assert after["shallow_bytes"] == before["shallow_bytes"]
+    assert after["peak"] >= before["live"] + 22
+    assert live_objects("TestSubmessages")["live"] == sub_before["live"]
+
+    pbcc_instrumented.reset_live_object_peaks()
+    assert live_objects("TestPrimitives")["peak"] == before["live"]
+
+
+@test_case
+def test_field_frequency_profile() -> None:
+    # With the instrumented build's profile, all fields of TestPrimitives
+    # except f_int32, f_double, and f_string should be parsed out of line, and
+    # other messages are unaffected. The instrumented build may have come from
+    # the build cache (without generating any source), so the source is
+    # generated again here, split into several files like that build
+    for cc_filename in glob.glob("test_modules/test_pbcc_usage_profiled.*.cc"):
+        os.remove(cc_filename)
+    subprocess.check_call(
+        (
+            sys.executable,
+            "compile.py",
+            "test_modules.test_pb2",
+            "--output-basename",
+            "test_modules/test_pbcc_usage_profiled",
+            "--source-only",
+            "--shards",
+            "4",
+            "--field-frequency-profile",
+            "test_modules/field_usage_profile.json",
+        ),
+        stdout=subprocess.DEVNULL,
+    )
+    cc_source = ""
+    for cc_filename in glob.glob("test_modules/test_pbcc_usage_profiled.*.cc"):
+        with open(cc_filename, "rt") as f:
+            cc_source += f.read()
+    assert cc_source.count("[[unlikely]] case") == 14
+    assert cc_source.count("__attribute__((cold, noinline))") == 14
+    assert "[[unlikely]] case 1:" not in cc_source
+    assert "[[unlikely]] case 11:" in cc_source
+    # f_int32 is predicted to be followed by f_double; f_string's tag is too
+    # long to be predicted
+    assert cc_source.count("goto parse_field_") == 1
+    assert "goto parse_field_15;" in cc_source
+
+    # Parsing with the instrumented build should work the same regardless of
+    # which fields are cold, and whether or not the predicted field follows
+    # f_int32
+    pb_msg = pb.TestPrimitives(f_int32=-5, f_bool=True, f_double=2.5, f_bytes=b"abc", f_string="hello", f_sint64=-7)
+    data = pb_msg.SerializeToString()
+    msg = pbcc_instrumented.TestPrimitives.from_proto_data(data)
+    assert msg.as_proto_data() == data
+    assert (msg.f_int32, msg.f_bool, msg.f_double, msg.f_bytes, msg.f_string, msg.f_sint64) == (
+        -5,
+        True,
+        2.5,
+        b"abc",
+        "hello",
+        -7,
+    )
+    for pb_msg in (
+        pb.TestPrimitives(f_int32=-5, f_double=2.5, f_string="hello"),
+        pb.TestPrimitives(f_int32=-5, f_double=2.5),
+        pb.TestPrimitives(f_int32=-5),
+        pb.TestPrimitives(f_int32=-5, f_float=1.5, f_double=2.5),
+    ):
+        data = pb_msg.SerializeToString()
+        assert pbcc_instrumented.TestPrimitives.from_proto_data(data).as_proto_data() == data
+    # A tag with the predicted field's number but another wire type isn't
+    # predicted, and is still treated as having the wrong type
+    data = pb.TestPrimitives(f_int32=-5).SerializeToString() + b"\x78\x01"
+    try:
+        pbcc_instrumented.TestPrimitives.from_proto_data(data)
+        raise AssertionError("from_proto_data did not raise for an incorrect type after a predicted field")
+    except RuntimeError:
+        pass
+    msg = pbcc_instrumented.TestPrimitives.from_proto_data(data, ignore_incorrect_types=True)
+    assert msg.f_int32 == -5 and msg.f_double == 0.0
+
+    # Profiles from pbcc_field_profile should also be accepted; fields that
+    # don't appear in the profile are cold
+    with open("test_modules/field_profile_profile.json", "wt") as f:
+        json.dump(
+            {
+                "parse": {
+                    "fields": {
+                        "TestOneofs": {"data_type": "(message)", "count": 100, "total_ns": 0, "self_ns": 0},
+                        # Entries for nested messages look like fields of their
+                        # parent messages, but they aren't
+                        "TestOneofs.Nested": {"data_type": "(message)", "count": 100000, "total_ns": 0, "self_ns": 0},
+                        "TestOneofs.f_int": {"data_type": "UINT64", "count": 100, "total_ns": 0, "self_ns": 0},
+                        "TestOneofs.f_float": {"data_type": "FLOAT", "count": 90, "total_ns": 0, "self_ns": 0},
+                    },
+                    "data_types": {},
+                },
+                "serialize": {"fields": {}, "data_types": {}},
+            },
+            f,
+        )
+    subprocess.check_call(
+        (
+            sys.executable,
+            "compile.py",
+            "test_modules.test_pb2",
+            "--output-basename",
+            "test_modules/test_pbcc_profiled",
+            "--source-only",
+            "--shards",
+            "1",
+            "--field-frequency-profile",
+            "test_modules/field_profile_profile.json",
+        ),
+        stdout=subprocess.DEVNULL,
+    )
+    with open("test_modules/test_pbcc_profiled.cc", "rt") as f:
+        cc_source = f.read()
+    num_oneofs_fields = len(pb.TestOneofs.DESCRIPTOR.fields)
+    assert cc_source.count("[[unlikely]] case") == num_oneofs_fields - 2
+    assert "[[unlikely]] case 1:" not in cc_source
+    assert "[[unlikely]] case 4:" not in cc_source
+    assert "[[unlikely]] case 2:" in cc_source
+    # f_int is predicted to be followed by f_float, the next hot field
+    assert "goto parse_field_4;" in cc_source
+    assert "goto parse_field_1;" not in cc_source
+
+
+@test_case
+def test_source_shards() -> None:
+    from google.protobuf import duration_pb2, timestamp_pb2
+
+    import compile
+
+    mod_coll = compile.ModuleCollection(modules={})
+    for descriptor in (pb.DESCRIPTOR, duration_pb2.DESCRIPTOR, timestamp_pb2.DESCRIPTOR):
+        mod_coll.add_file(descriptor)
+    all_messages = {
+        (mod_name, message_name)
+        for mod_name, mod in mod_coll.modules.items()
+        for message_name, message in mod.messages.items()
+        if message.map_types is None
+    }
+    # There are never more message shards than requested, even when there are
+    # more modules than shards, and each message is in exactly one shard
+    for num_message_shards in (1, 2, 3, 4, 8, 1000):
+        shards = mod_coll.source_shards(num_message_shards)
+        assert [shard.kind for shard in shards[:2]] == [compile.ShardKind.RUNTIME, compile.ShardKind.INIT]
+        message_shards = shards[2:]
+        assert 0 < len(message_shards) <= num_message_shards, (num_message_shards, len(message_shards))
+        assert len({shard.name for shard in shards}) == len(shards)
+        shard_messages = [
+            (mod_name, message_name)
+            for shard in message_shards
+            for mod_name, message_names in shard.messages.items()
+            for message_name in message_names
+        ]
+        assert sorted(shard_messages) == sorted(all_messages)
+        # Each module gets its own shards if there are enough of them
+        if num_message_shards >= 3:
+            assert all(len(shard.messages) == 1 for shard in message_shards)
+    assert len(mod_coll.source_shards(4)) == 6
+
+
+@test_case
+def test_bench_compare_results() -> None:
+    import bench
+
+    def result(implementation: str, ns_per_op: float, stdev: float = 1.0, shape: str = "flat") -> dict[str, Any]:
+        return {
+            "shape": shape,
+            "operation": "parse",
+            "implementation": implementation,
+            "ns_per_op": ns_per_op,
+            "ns_per_op_stdev": stdev,
+        }
+
+    baseline = {"results": [result("pbcc", 100.0), result("upb", 100.0)]}
+
+    # A result is only a regression if it's worse than the threshold allows
+    # and the difference is larger than both runs' standard deviations
+    for ns_per_op, stdev in ((105.0, 1.0), (150.0, 60.0)):
+        lines, num_regressions = bench.compare_results([result("pbcc", ns_per_op, stdev)], baseline, "speed", 0.1)
+        assert num_regressions == 0, lines
+        assert lines[0].endswith("x)"), lines
+    lines, num_regressions = bench.compare_results([result("pbcc", 120.0)], baseline, "speed", 0.1)
+    assert num_regressions == 1, lines
+    assert lines[0].endswith("REGRESSION"), lines
+    lines, num_regressions = bench.compare_results([result("pbcc", 80.0)], baseline, "speed", 0.1)
+    assert num_regressions == 0, lines
+    assert lines[0].endswith("improvement"), lines
+
+    # Other implementations' changes are reported, but aren't regressions
+    results = [result("upb", 200.0), result("upb", 50.0, shape="flat2"), result("pbcc", 100.0, shape="new")]
+    baseline["results"].append(result("upb", 100.0, shape="flat2"))
+    lines, num_regressions = bench.compare_results(results, baseline, "speed", 0.1)
+    assert num_regressions == 0, lines
+    assert lines[0].endswith("slower"), lines
+    assert lines[1].endswith("faster"), lines
+    assert lines[2].endswith("(not in baseline)"), lines
+
+    assert bench.parse_list_arg(None, ("a", "b"), "shape") == ["a", "b"]
+    assert bench.parse_list_arg(" b, a,", ("a", "b"), "shape") == ["b", "a"]
+    try:
+        bench.parse_list_arg("a,c", ("a", "b"), "shape")
+        raise AssertionError("parse_list_arg accepted an unknown item")
+    except ValueError as e:
+        assert "Unknown shape: c" in str(e), str(e)
+
+
+@test_case
+def test_bench_latency_histogram() -> None:
+    import bench
+
+    Histogram = bench.LatencyHistogram
+    # Small values have buckets of their own, and larger values are in
+    # buckets whose lowest value is within 1 / SUB_BUCKETS of them
+    for value in range(2 * Histogram.SUB_BUCKETS):
+        assert Histogram.lowest_value_in_bucket(Histogram.bucket_for_value(value)) == value
+    for value in (128, 129, 1000, 123456789, 2**40 + 12345):
+        bucket = Histogram.bucket_for_value(value)
+        lowest = Histogram.lowest_value_in_bucket(bucket)
+        assert lowest <= value and value - lowest <= value / Histogram.SUB_BUCKETS, (value, lowest)
+        assert Histogram.bucket_for_value(lowest) == bucket
+        assert Histogram.bucket_for_value(value + 1) in (bucket, bucket + 1)
+
+    h = Histogram()
+    assert h.percentile(50) == 0
+    h.record_all(range(1, 101))
+    assert (h.percentile(50), h.percentile(99), h.percentile(100)) == (50, 99, 100)
+    assert (h.total_count, h.total_ns, h.max_ns) == (100, 5050, 100)
+
+    h = Histogram()
+    h.record_all([10**6] * 999 + [10**9])
+    assert abs(h.percentile(50) - 10**6) <= 10**6 / Histogram.SUB_BUCKETS
+    assert h.percentile(99.9) == h.percentile(50)
+    assert 10**9 - h.percentile(100) <= 10**9 / Histogram.SUB_BUCKETS
+    assert sum(count for _, count in h.as_list()) == 1000
+
+
+@test_case
+def test_bench_smoke() -> None:
+    # Runs a small speed benchmark, then compares a second run against it
+    # (with a threshold that noise can't exceed)
+    results_filename = "test_modules/bench_results.json"
+    bench_args = (
+        sys.executable,
+        "bench.py",
+        "--mode",
+        "speed",
+        "--shapes",
+        "test_primitives",
+        "--operations",
+        "parse,serialize,shallow_copy",
+        "--min-time",
+        "0.001",
+        "--repeats",
+        "1",
+    )
+    subprocess.check_call((*bench_args, "--output", results_filename), stderr=subprocess.DEVNULL)
+    with open(results_filename, "rt") as f:
+        output = json.load(f)
+    assert output["mode"] == "speed"
+    keys = {(r["operation"], r["implementation"]) for r in output["results"]}
+    # shallow_copy has no upb equivalent, so it's only run for pbcc
+    expected_keys = {(op, impl) for op in ("parse", "serialize") for impl in ("pbcc", "upb")}
+    assert keys == expected_keys | {("shallow_copy", "pbcc")}, keys
+    assert all(r["ns_per_op"] > 0 for r in output["results"])
+    subprocess.check_call(
+        (*bench_args, "--compare", results_filename, "--threshold", "1000"),
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+    )
+
+
+def run_bench(*args: str) -> dict[str, Any]:
+    """Runs bench.py with the given arguments and returns its JSON output."""
+    results_filename = "test_modules/bench_mode_results.json"
+    subprocess.check_call(
+        (sys.executable, "bench.py", *args, "--repeats", "1", "--output", results_filename),
+        stderr=subprocess.DEVNULL,
+    )
+    with open(results_filename, "rt") as f:
+        return json.load(f)
+
+
+@test_case
+def test_bench_memory_mode() -> None:
+    output = run_bench(
+        "--mode",
+        "memory",
+        "--shapes",
+        "test_list_primitives",
+        "--operations",
+        "parse",
+        "--memory-target-bytes",
+        "100000",
+    )
+    assert {r["implementation"] for r in output["results"]} == {"pbcc", "upb"}
+    for r in output["results"]:
+        # The per-element cost excludes the message's own size
+        assert r["num_elements"] > 0, r
+        assert 0 < r["bytes_per_element"] * r["num_elements"] < r["bytes_per_message"], r
+
+
+@test_case
+def test_bench_build_mode() -> None:
+    output = run_bench("--mode", "build", "--operations", "codegen", "--schema-sizes", "5")
+    results = {(r["shape"], r["implementation"]): r for r in output["results"]}
+    assert set(results) == {("schema_5", "pbcc"), ("schema_5", "upb")}, results
+    assert all(r["value"] > 0 and r["unit"] == "s" for r in results.values()), results
+
+
+@test_case
+def test_bench_scaling_mode() -> None:
+    output = run_bench(
+        "--mode",
+        "scaling",
+        "--shapes",
+        "test_primitives",
+        "--operations",
+        "parse",
+        "--threads",
+        "2",
+        "--executors",
+        "threads",
+        "--min-time",
+        "0.001",
+    )
+    # One thread always runs first, as the baseline for the others
+    assert sorted((r["implementation"], r["threads"]) for r in output["results"]) == [
+        ("pbcc", 1),
+        ("pbcc", 2),
+        ("upb", 1),
+        ("upb", 2),
+    ]
+    assert all(r["ns_per_op"] > 0 for r in output["results"])
+
+
+@test_case
+def test_codec_benchmark() -> None:
+    # The codec benchmark checks the primitives' results on its own data
+    # before timing them, and exits with a nonzero status if any are wrong
+    subprocess.check_call(
+        (sys.executable, "compile.py", "--codec-benchmark", "test_modules/bench_codec"),
+        stdout=subprocess.DEVNULL,
+    )
+    output = subprocess.check_output(("test_modules/bench_codec", "--min-time", "0.001", "--repeats", "1"))
+    names = [line.split()[0] for line in output.decode("utf-8").splitlines()]
+    for name in ("decode_varint/mixed", "encode_varint/10B", "packed/varint", "tag_dispatch", "skip_field"):
+        assert name in names, name
+    output = subprocess.check_output(("test_modules/bench_codec", "--min-time", "0.001", "--repeats", "1", "packed/"))
+    assert all(line.startswith("packed/") for line in output.decode("utf-8").splitlines())
+
+
+def read_delimited(filename: str) -> list[bytes]:
+    with open(filename, "rb") as f:
+        data = f.read()
+    ret: list[bytes] = []
+    offset = 0
+    while offset < len(data):
+        length = 0
+        shift = 0
+        while True:
+            b = data[offset]
+            offset += 1
+            length |= (b & 0x7F) << shift
+            shift += 7
+            if not (b & 0x80):
+                break
+        ret.append(data[offset : offset + length])
+        offset += length
+    return ret
+
+
+def generate_corpus(message_name: str, filename: str, *args: str) -> list[bytes]:
+    subprocess.check_call(
+        (
+            sys.executable,
+            "corpus.py",
+            "--module",
+            "test_modules.test_pb2",
+            "--message",
+            message_name,
+            "--output",
+            filename,
+            *args,
+        )
+    )
+    return read_delimited(filename)
+
+
+@test_case
+def test_corpus():
+    # Generated messages must be valid, and must parse the same way in pbcc
+    # and google.protobuf (pbcc is compared with itself after a round trip
+    # through google.protobuf, since message bytes aren't canonical)
+    for message_name in (
+        "TestPrimitives",
+        "TestListPrimitives",
+        "TestOptionalPrimitives",
+        "TestMaps",
+        "TestSubmessages",
+        "TestOneofs",
+    ):
+        corpus = generate_corpus(message_name, f"test_modules/corpus_{message_name}.bin", "--count", "50")
+        assert len(corpus) == 50
+        assert any(corpus)
+        pb_cls = getattr(pb, message_name)
+        pbcc_cls = getattr(pbcc, message_name)
+        for data in corpus:
+            pb_msg = pb_cls.FromString(data)
+            pbcc_msg = pbcc_cls.from_proto_data(data)
+            assert not pbcc_msg.has_unknown_fields()
+            assert pbcc_msg == pbcc_cls.from_proto_data(pb_msg.SerializeToString())
+
+    # The same seed always produces the same corpus
+    corpus = generate_corpus("TestPrimitives", "test_modules/corpus_seed.bin", "--count", "20", "--seed", "5")
+    assert generate_corpus("TestPrimitives", "test_modules/corpus_seed.bin", "--count", "20", "--seed", "5") == corpus
+    assert generate_corpus("TestPrimitives", "test_modules/corpus_seed.bin", "--count", "20", "--seed", "6") != corpus
+
+    # Distributions can be configured
+    with open("test_modules/corpus_config.json", "wt") as f:
+        json.dump({"presence_rate": 0.0, "repeated_length": [[3, 3, 1]], "varint_size": [[1, 1, 1]]}, f)
+    corpus = generate_corpus(
+        "TestOptionalPrimitives",
+        "test_modules/corpus_config.bin",
+        "--count",
+        "10",
+        "--config",
+        "test_modules/corpus_config.json",
+    )
+    assert corpus == [b""] * 10
+    corpus = generate_corpus(
+        "TestListPrimitives",
+        "test_modules/corpus_config.bin",
+        "--count",
+        "10",
+        "--config",
+        "test_modules/corpus_config.json",
+    )
+    for data in corpus:
+        msg = pb.TestListPrimitives.FromString(data)
+        assert len(msg.f_int64) == 3
+        assert all(0 <= v < 0x80 for v in msg.f_int64)
+
+
+# Maximum numbers of (Python, C++) allocations for each scenario in
+# test_allocation_budgets. These are somewhat above the actual counts, which
+# vary slightly between Python versions (e.g. due to free lists).
+ALLOCATION_BUDGETS: dict[tuple[str, str], tuple[int, int]] = {
+    ("TestPrimitives", "from_proto_data"): (8, 0),
+    ("TestPrimitives", "parse_reuse"): (8, 0),
+    ("TestPrimitives", "as_proto_data"): (2, 4),
+    ("TestPrimitives", "as_dict"): (130, 0),
+    ("TestListPrimitives", "from_proto_data"): (50, 0),
+    ("TestListPrimitives", "parse_reuse"): (20, 0),
+    ("TestListPrimitives", "as_proto_data"): (25, 10),
+    ("TestListPrimitives", "as_dict"): (1300, 0),
+    ("TestMaps", "from_proto_data"): (8, 0),
+    ("TestMaps", "parse_reuse"): (8, 0),
+    ("TestMaps", "as_proto_data"): (2, 8),
+    ("TestMaps", "as_dict"): (170, 0),
+    ("TestSubmessages", "from_proto_data"): (65, 0),
+    ("TestSubmessages", "parse_reuse"): (45, 0),
+    ("TestSubmessages", "as_proto_data"): (25, 35),
+    ("TestSubmessages", "as_dict"): (1700, 0),
+    ("TestOneofs", "from_proto_data"): (6, 0),
+    ("TestOneofs", "parse_reuse"): (8, 0),
+    ("TestOneofs", "as_proto_data"): (2, 2),
+    ("TestOneofs", "as_dict"): (150, 0),
+}
+
+
+@test_case
+def test_allocation_budgets() -> None:
+    count_allocations = pbcc_instrumented.pbcc_count_allocations
+    assert count_allocations(lambda: None) == {
+        "object_allocations": 0,
+        "object_bytes": 0,
+        "mem_allocations": 0,
+        "mem_bytes": 0,
+        "cpp_allocations": 0,
+        "cpp_bytes": 0,
+    }
+    counts = count_allocations(lambda: [None] * 1000)
+    assert counts["object_allocations"] + counts["mem_allocations"] >= 1
+    assert counts["object_bytes"] + counts["mem_bytes"] >= 8000
+
+    primitives = pbcc_instrumented.TestPrimitives(
+        f_int32=5, f_int64=1 << 40, f_double=1.5, f_string="hello", f_bytes=b"abc"
+    )
+    messages = [
+        primitives,
+        pbcc_instrumented.TestListPrimitives(f_int32=list(range(100)), f_double=[0.5] * 100, f_string=["abc"] * 10),
+        pbcc_instrumented.TestMaps(f_int32_string={z: "x" for z in range(20)}),
+        pbcc_instrumented.TestSubmessages(f_primitives=primitives, f_repeated_msg_primitives=[primitives] * 10),
+        pbcc_instrumented.TestOneofs(f_int_or_bytes=b"abc"),
+    ]
+    report: list[str] = []
+    over_budget: list[str] = []
+    for msg in messages:
+        cls = type(msg)
+        data = msg.as_proto_data()
+        reused = cls.from_proto_data(data)
+        scenarios = {
+            "from_proto_data": lambda cls=cls, data=data: cls.from_proto_data(data),
+            "parse_reuse": lambda reused=reused, data=data: reused.parse_proto_into_this(data, reuse=True),
+            "as_proto_data": msg.as_proto_data,
+            "as_dict": msg.as_dict,
+        }
+        for scenario_name, fn in scenarios.items():
+            fn()  # Warm up any caches and free lists
+            counts = count_allocations(fn)
+            py_allocations = counts["object_allocations"] + counts["mem_allocations"]
+            py_bytes = counts["object_bytes"] + counts["mem_bytes"]
+            line = (
+                f"{cls.__name__}.{scenario_name}: {py_allocations} Python allocations ({py_bytes} bytes),"
+                f" {counts['cpp_allocations']} C++ allocations ({counts['cpp_bytes']} bytes)"
+            )
+            report.append(line)
+            max_py_allocations, max_cpp_allocations = ALLOCATION_BUDGETS[(cls.__name__, scenario_name)]
+            if py_allocations > max_py_allocations or counts["cpp_allocations"] > max_cpp_allocations:
+                over_budget.append(line)
+    assert not over_budget, (
+        "Allocation budgets exceeded:\n" + "\n".join(over_budget) + "\nAll counts:\n" + "\n".join(report)
+    )
+
+    # Serializing should allocate in C++ (at least the output buffer), but
+    # parsing into a reused object should not
+    counts = count_allocations(primitives.as_proto_data)
+    assert counts["cpp_allocations"] >= 1
+    data = primitives.as_proto_data()
+    counts = count_allocations(lambda: primitives.parse_proto_into_this(data, reuse=True))
+    assert counts["cpp_allocations"] == 0
+
+    # Errors from the function should be propagated, and counting can't be nested
+    try:
+        count_allocations(lambda: 1 / 0)
+        raise AssertionError("Exception was not propagated")
+    except ZeroDivisionError:
+        pass
+    try:
+        count_allocations(lambda: count_allocations(lambda: None))
+        raise AssertionError("Nested pbcc_count_allocations did not raise")
+    except RuntimeError:
+        pass
+    assert count_allocations(lambda: None)["object_allocations"] == 0
+
+
+@test_case
+def test_usdt_probes() -> None:
+    if not HAS_SDT_HEADER:
+        return
+
+    # Each probe should be described in the module's .note.stapsdt section
+    with open(pbcc_instrumented.__file__, "rb") as f:
+        so_data = f.read()
+    assert b"stapsdt" in so_data
+    for probe_name in (b"parse__start", b"parse__done", b"serialize__start", b"serialize__done", b"unknown__field"):
+        assert probe_name + b"\0" in so_data, probe_name
+
+    # The probes shouldn't affect behavior when nothing is attached
+    msg = pbcc_instrumented.TestPrimitives(f_int32=5)
+    assert pbcc_instrumented.TestPrimitives.from_proto_data(msg.as_proto_data() + b"\xa0\x06\x01").f_int32 == 5
+    try:
+        pbcc_instrumented.TestPrimitives.from_proto_data(b"\x08")
+        raise AssertionError("Parsing truncated data did not raise")
+    except RuntimeError:
+        pass
+
+
+@test_case
+def test_build_cache_and_import_hook() -> None:
+    # The first build (after clearing the cache) generates and compiles the
+    # module, and building it again just copies it from the cache
+    with open("test_modules/cache_test.proto", "wt") as f:
+        f.write('syntax = "proto3";\nmessage CacheTest {\n  int32 f_int = 1;\n  repeated string f_strs = 2;\n}\n')
+    subprocess.check_call(
+        (sys.executable, "-m", "grpc_tools.protoc", "-I.", "test_modules/cache_test.proto", "--python_out=.")
+    )
+    cache_dir = "test_modules/build_cache_clear"
+
+    def build_cache_test(*args: str) -> str:
+        return subprocess.check_output(
+            (
+                sys.executable,
+                "compile.py",
+                "test_modules.cache_test_pb2",
+                "--output-basename",
+                "test_modules/cache_test_pbcc",
+                "--cache-dir",
+                cache_dir,
+                *args,
+            ),
+            text=True,
+        )
+
+    output = build_cache_test("--clear-cache")
+    assert "Generating" in output, output
+    assert "Stored" in output, output
+    output = build_cache_test()
+    assert "from build cache" in output, output
+    assert "Generating" not in output, output
+    import test_modules.cache_test_pbcc as cache_test_pbcc
+
+    msg = cache_test_pbcc.CacheTest(f_int=7, f_strs=["a", "b"])
+    assert cache_test_pbcc.CacheTest.from_proto_data(msg.as_proto_data()) == msg
+
+    # --clear-cache can also be used on its own
+    subprocess.check_call((sys.executable, "compile.py", "--cache-dir", cache_dir, "--clear-cache"))
+    assert not os.path.exists(cache_dir)
+
+    # When the cache is too large, the least recently used entries and
+    # precompiled headers are deleted first
+    from compile import prune_build_cache
+
+    prune_dir = "test_modules/build_cache_prune"
+    for i, name in enumerate(("old", "pch/older_pch", "new", "pch/new_pch", ".tmp-in-progress")):
+        os.makedirs(os.path.join(prune_dir, name), exist_ok=True)
+        with open(os.path.join(prune_dir, name, "module.so"), "wb") as f:
+            f.write(b"\0" * 100)
+        os.utime(os.path.join(prune_dir, name), (1000 + i, 1000 + i))
+    os.utime(os.path.join(prune_dir, "pch/older_pch"), (999, 999))
+    prune_build_cache(prune_dir, 250)
+    assert sorted(os.listdir(prune_dir)) == [".tmp-in-progress", "new", "pch"]
+    assert os.listdir(os.path.join(prune_dir, "pch")) == ["new_pch"]
+    prune_build_cache(prune_dir, 0)
+    assert sorted(os.listdir(prune_dir)) == [".tmp-in-progress", "pch"]
+
+    # The import hook builds test_modules.hook_test_pbcc from a .proto file
+    # through the cache, only the first time it's imported (or the first time
+    # the tests are run), and loads it from the cache entry
+    with open("test_modules/hook_test.proto", "wt") as f:
+        f.write('syntax = "proto3";\nmessage HookTest {\n  int32 f_int = 1;\n  repeated string f_strs = 2;\n}\n')
+    script = f"""
+import import_hook
+import_hook.install(cache_dir={BUILD_CACHE_DIR!r}, verbose=True)
+import test_modules.hook_test_pbcc as hook_test_pbcc
+assert hook_test_pbcc.__file__.startswith({os.path.abspath(BUILD_CACHE_DIR)!r}), hook_test_pbcc.__file__
+msg = hook_test_pbcc.HookTest(f_int=7, f_strs=["a", "b"])
+assert hook_test_pbcc.HookTest.from_proto_data(msg.as_proto_data()) == msg
+"""
+    subprocess.check_call((sys.executable, "-c", script))
+    result = subprocess.run((sys.executable, "-c", script), check=True, stderr=subprocess.PIPE, text=True)
+    assert "Generating" not in result.stderr, result.stderr
+
+
+@test_case
+def test_shared_runtime() -> None:
+    # With --shared-runtime, the module links against libpbcc_runtime, which
+    # is stored next to it in the cache entry and found via its rpath. The
+    # field parsing and serializing templates are instantiated in the library,
+    # so the module only references them
+    with open("test_modules/hook_test.proto", "wt") as f:
+        f.write(
+            'syntax = "proto3";\nmessage HookTest {\n  int32 f_int = 1;\n  repeated string f_strs = 2;\n'
+            "  map<string, int64> f_map = 3;\n  oneof f_oneof {\n    bytes f_bytes = 4;\n    double f_double = 5;\n  }\n}\n"
+        )
+    script = f"""
+import glob, os, subprocess
+import import_hook
+from compile import Feature
+import_hook.install(cache_dir={BUILD_CACHE_DIR!r}, features=[Feature.SHARED_RUNTIME])
+import test_modules.hook_test_pbcc as hook_test_pbcc
+assert glob.glob(os.path.join(os.path.dirname(hook_test_pbcc.__file__), "libpbcc_runtime.*.so"))
+with open("/proc/self/maps") as f:
+    assert "libpbcc_runtime." in f.read()
+undefined = subprocess.check_output(("nm", "-DC", "--undefined-only", hook_test_pbcc.__file__), text=True)
+for name in ("parse_singular_field<", "serialize_repeated_with_tag<", "parse_map<", "serialize_oneof_field_with_tag<"):
+    assert name in undefined, name
+msg = hook_test_pbcc.HookTest(f_int=7, f_strs=["a", "b"], f_map={{"x": 3}}, f_oneof=2.5)
+assert hook_test_pbcc.HookTest.from_proto_data(msg.as_proto_data()) == msg
+assert repr(msg).endswith(".HookTest(f_int=7, f_strs=['a', 'b'], f_map={{'x': 3}}, f_oneof=2.5)"), repr(msg)
+"""
+    subprocess.check_call((sys.executable, "-c", script))
+
+
+@test_case
+def test_pgo_build_profile() -> None:
+    # The pgo profile builds the module three times, running the given training
+    # data through the instrumented build; the result behaves like any other
+    # build. A small schema is used, since the test module takes a long time
+    # to build even once
+    with open("test_modules/pgo_test.proto", "wt") as f:
+        f.write(
+            'syntax = "proto3";\n'
+            "message PGOTest {\n  int32 f_int = 1;\n  repeated string f_strs = 2;\n  map<string, int64> f_map = 3;\n}\n"
+        )
+    subprocess.check_call(
+        (sys.executable, "-m", "grpc_tools.protoc", "-I.", "test_modules/pgo_test.proto", "--python_out=.")
+    )
+    corpus_filename = "test_modules/pgo_test_corpus.bin"
+    subprocess.check_call(
+        (
+            sys.executable,
+            "corpus.py",
+            "--module",
+            "test_modules.pgo_test_pb2",
+            "--message",
+            "PGOTest",
+            "--count",
+            "200",
+            "--output",
+            corpus_filename,
+        )
+    )
+    output = subprocess.check_output(
+        (
+            sys.executable,
+            "compile.py",
+            "test_modules.pgo_test_pb2",
+            "--output-basename",
+            "test_modules/pgo_test_pbcc",
+            "--no-cache",
+            "--shards",
+            "1",
+            "--profile",
+            "pgo",
+            "--pgo-training-data",
+            f"pgo_test.PGOTest={corpus_filename}",
+        ),
+        text=True,
+    )
+    assert "Running the training workload (1 message types)" in output, output
+    assert "x speedup)" in output, output
+    assert not os.path.exists("test_modules/pgo_test_pbcc.pgo")
+
+    import test_modules.pgo_test_pb2 as pgo_test_pb
+    import test_modules.pgo_test_pbcc as pgo_test_pbcc
+
+    msg = pgo_test_pbcc.PGOTest(f_int=7, f_strs=["a", "b"], f_map={"c": 3})
+    assert msg.as_proto_data() == pgo_test_pb.PGOTest(f_int=7, f_strs=["a", "b"], f_map={"c": 3}).SerializeToString()
+    assert pgo_test_pbcc.PGOTest.from_proto_data(msg.as_proto_data()) == msg
+
+
 def run_all_tests() -> int:
     num_failures: int = 0
     for name, fn in ALL_TEST_CASES:
@@ -0,0 +1,180 @@
+# -*- coding: utf-8 -*-
+# Generated by the protocol buffer compiler.  DO NOT EDIT!
+# NO CHECKED-IN PROTOBUF GENCODE
+# source: test.proto
+# Protobuf Python Version: 7.35.1
+"""Generated protocol buffer code."""
+from google.protobuf import descriptor as _descriptor
+from google.protobuf import descriptor_pool as _descriptor_pool
+from google.protobuf import runtime_version as _runtime_version
+from google.protobuf import symbol_database as _symbol_database
+from google.protobuf.internal import builder as _builder
+_runtime_version.ValidateProtobufRuntimeVersion(
+    _runtime_version.Domain.PUBLIC,
+    7,
+    35,
+    1,
+    '',
+    'test.proto'
+)
+# @@protoc_insertion_point(imports)
+
+_sym_db = _symbol_database.Default()
+
+
+
+
+DESCRIPTOR = _descriptor_pool.Default().AddSerializedFile(b'\n\ntest.proto\"\xd8\x02\n\x0eTestPrimitives\x12\x0f\n\x07\x66_int32\x18\x01 \x01(\x05\x12\x0f\n\x07\x66_int64\x18\x02 \x01(\x03\x12\x10\n\x08\x66_uint32\x18\x03 \x01(\r\x12\x10\n\x08\x66_uint64\x18\x04 \x01(\x04\x12\x10\n\x08\x66_sint32\x18\x05 \x01(\x11\x12\x10\n\x08\x66_sint64\x18\x06 \x01(\x12\x12\x11\n\tf_fixed32\x18\x07 \x01(\x07\x12\x11\n\tf_fixed64\x18\x08 \x01(\x06\x12\x12\n\nf_sfixed32\x18\t \x01(\x0f\x12\x12\n\nf_sfixed64\x18\n \x01(\x10\x12\x0e\n\x06\x66_bool\x18\x0b \x01(\x08\x12\x1b\n\x07\x66_enum1\x18\x0c \x01(\x0e\x32\n.TestEnum1\x12\x1b\n\x07\x66_enum2\x18\r \x01(\x0e\x32\n.TestEnum2\x12\x0f\n\x07\x66_float\x18\x0e \x01(\x02\x12\x10\n\x08\x66_double\x18\x0f \x01(\x01\x12\x0f\n\x07\x66_bytes\x18\x10 \x01(\x0c\x12\x10\n\x08\x66_string\x18\x11 \x01(\t\"<\n\x17TestFloatPrimitivesOnly\x12\x0f\n\x07\x66_float\x18\x0e \x01(\x02\x12\x10\n\x08\x66_double\x18\x0f \x01(\x01\"\xdc\x02\n\x12TestListPrimitives\x12\x0f\n\x07\x66_int32\x18\x01 \x03(\x05\x12\x0f\n\x07\x66_int64\x18\x02 \x03(\x03\x12\x10\n\x08\x66_uint32\x18\x03 \x03(\r\x12\x10\n\x08\x66_uint64\x18\x04 \x03(\x04\x12\x10\n\x08\x66_sint32\x18\x05 \x03(\x11\x12\x10\n\x08\x66_sint64\x18\x06 \x03(\x12\x12\x11\n\tf_fixed32\x18\x07 \x03(\x07\x12\x11\n\tf_fixed64\x18\x08 \x03(\x06\x12\x12\n\nf_sfixed32\x18\t \x03(\x0f\x12\x12\n\nf_sfixed64\x18\n \x03(\x10\x12\x0e\n\x06\x66_bool\x18\x0b \x03(\x08\x12\x1b\n\x07\x66_enum1\x18\x0c \x03(\x0e\x32\n.TestEnum1\x12\x1b\n\x07\x66_enum2\x18\r \x03(\x0e\x32\n.TestEnum2\x12\x0f\n\x07\x66_float\x18\x0e \x03(\x02\x12\x10\n\x08\x66_double\x18\x0f \x03(\x01\x12\x0f\n\x07\x66_bytes\x18\x10 \x03(\x0c\x12\x10\n\x08\x66_string\x18\x11 \x03(\t\"\x90\x05\n\x16TestOptionalPrimitives\x12\x14\n\x07\x66_int32\x18\x01 \x01(\x05H\x00\x88\x01\x01\x12\x14\n\x07\x66_int64\x18\x02 \x01(\x03H\x01\x88\x01\x01\x12\x15\n\x08\x66_uint32\x18\x03 \x01(\rH\x02\x88\x01\x01\x12\x15\n\x08\x66_uint64\x18\x04 \x01(\x04H\x03\x88\x01\x01\x12\x15\n\x08\x66_sint32\x18\x05 \x01(\x11H\x04\x88\x01\x01\x12\x15\n\x08\x66_sint64\x18\x06 \x01(\x12H\x05\x88\x01\x01\x12\x16\n\tf_fixed32\x18\x07 \x01(\x07H\x06\x88\x01\x01\x12\x16\n\tf_fixed64\x18\x08 \x01(\x06H\x07\x88\x01\x01\x12\x17\n\nf_sfixed32\x18\t \x01(\x0fH\x08\x88\x01\x01\x12\x17\n\nf_sfixed64\x18\n \x01(\x10H\t\x88\x01\x01\x12\x13\n\x06\x66_bool\x18\x0b \x01(\x08H\n\x88\x01\x01\x12 \n\x07\x66_enum1\x18\x0c \x01(\x0e\x32\n.TestEnum1H\x0b\x88\x01\x01\x12 \n\x07\x66_enum2\x18\r \x01(\x0e\x32\n.TestEnum2H\x0c\x88\x01\x01\x12\x14\n\x07\x66_float\x18\x0e \x01(\x02H\r\x88\x01\x01\x12\x15\n\x08\x66_double\x18\x0f \x01(\x01H\x0e\x88\x01\x01\x12\x14\n\x07\x66_bytes\x18\x10 \x01(\x0cH\x0f\x88\x01\x01\x12\x15\n\x08\x66_string\x18\x11 \x01(\tH\x10\x88\x01\x01\x42\n\n\x08_f_int32B\n\n\x08_f_int64B\x0b\n\t_f_uint32B\x0b\n\t_f_uint64B\x0b\n\t_f_sint32B\x0b\n\t_f_sint64B\x0c\n\n_f_fixed32B\x0c\n\n_f_fixed64B\r\n\x0b_f_sfixed32B\r\n\x0b_f_sfixed64B\t\n\x07_f_boolB\n\n\x08_f_enum1B\n\n\x08_f_enum2B\n\n\x08_f_floatB\x0b\n\t_f_doubleB\n\n\x08_f_bytesB\x0b\n\t_f_string\"\x8f\x19\n\x08TestMaps\x12\x33\n\x0e\x66_int32_string\x18\x01 \x03(\x0b\x32\x1b.TestMaps.FInt32StringEntry\x12\x33\n\x0e\x66_int64_string\x18\x02 \x03(\x0b\x32\x1b.TestMaps.FInt64StringEntry\x12\x35\n\x0f\x66_uint32_string\x18\x03 \x03(\x0b\x32\x1c.TestMaps.FUint32StringEntry\x12\x35\n\x0f\x66_uint64_string\x18\x04 \x03(\x0b\x32\x1c.TestMaps.FUint64StringEntry\x12\x35\n\x0f\x66_sint32_string\x18\x05 \x03(\x0b\x32\x1c.TestMaps.FSint32StringEntry\x12\x35\n\x0f\x66_sint64_string\x18\x06 \x03(\x0b\x32\x1c.TestMaps.FSint64StringEntry\x12\x37\n\x10\x66_fixed32_string\x18\x07 \x03(\x0b\x32\x1d.TestMaps.FFixed32StringEntry\x12\x37\n\x10\x66_fixed64_string\x18\x08 \x03(\x0b\x32\x1d.TestMaps.FFixed64StringEntry\x12\x39\n\x11\x66_sfixed32_string\x18\t \x03(\x0b\x32\x1e.TestMaps.FSfixed32StringEntry\x12\x39\n\x11\x66_sfixed64_string\x18\n \x03(\x0b\x32\x1e.TestMaps.FSfixed64StringEntry\x12\x31\n\rf_bool_string\x18\x0b \x03(\x0b\x32\x1a.TestMaps.FBoolStringEntry\x12\x35\n\x0f\x66_string_string\x18\x11 \x03(\x0b\x32\x1c.TestMaps.FStringStringEntry\x12\x33\n\x0e\x66_string_int32\x18\x65 \x03(\x0b\x32\x1b.TestMaps.FStringInt32Entry\x12\x33\n\x0e\x66_string_int64\x18\x66 \x03(\x0b\x32\x1b.TestMaps.FStringInt64Entry\x12\x35\n\x0f\x66_string_uint32\x18g \x03(\x0b\x32\x1c.TestMaps.FStringUint32Entry\x12\x35\n\x0f\x66_string_uint64\x18h \x03(\x0b\x32\x1c.TestMaps.FStringUint64Entry\x12\x35\n\x0f\x66_string_sint32\x18i \x03(\x0b\x32\x1c.TestMaps.FStringSint32Entry\x12\x35\n\x0f\x66_string_sint64\x18j \x03(\x0b\x32\x1c.TestMaps.FStringSint64Entry\x12\x37\n\x10\x66_string_fixed32\x18k \x03(\x0b\x32\x1d.TestMaps.FStringFixed32Entry\x12\x37\n\x10\x66_string_fixed64\x18l \x03(\x0b\x32\x1d.TestMaps.FStringFixed64Entry\x12\x39\n\x11\x66_string_sfixed32\x18m \x03(\x0b\x32\x1e.TestMaps.FStringSfixed32Entry\x12\x39\n\x11\x66_string_sfixed64\x18n \x03(\x0b\x32\x1e.TestMaps.FStringSfixed64Entry\x12\x31\n\rf_string_bool\x18o \x03(\x0b\x32\x1a.TestMaps.FStringBoolEntry\x12\x33\n\x0e\x66_string_enum1\x18p \x03(\x0b\x32\x1b.TestMaps.FStringEnum1Entry\x12\x33\n\x0e\x66_string_enum2\x18q \x03(\x0b\x32\x1b.TestMaps.FStringEnum2Entry\x12\x33\n\x0e\x66_string_float\x18r \x03(\x0b\x32\x1b.TestMaps.FStringFloatEntry\x12\x35\n\x0f\x66_string_double\x18s \x03(\x0b\x32\x1c.TestMaps.FStringDoubleEntry\x12\x33\n\x0e\x66_string_bytes\x18t \x03(\x0b\x32\x1b.TestMaps.FStringBytesEntry\x12\x37\n\x10\x66_string_message\x18v \x03(\x0b\x32\x1d.TestMaps.FStringMessageEntry\x1a\x33\n\x11\x46Int32StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x05\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x33\n\x11\x46Int64StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x03\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x34\n\x12\x46Uint32StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\r\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x34\n\x12\x46Uint64StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x04\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x34\n\x12\x46Sint32StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x11\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x34\n\x12\x46Sint64StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x12\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x35\n\x13\x46\x46ixed32StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x07\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x35\n\x13\x46\x46ixed64StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x06\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x36\n\x14\x46Sfixed32StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x0f\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x36\n\x14\x46Sfixed64StringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x10\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x32\n\x10\x46\x42oolStringEntry\x12\x0b\n\x03key\x18\x01 \x01(\x08\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x34\n\x12\x46StringStringEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\t:\x02\x38\x01\x1a\x33\n\x11\x46StringInt32Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x05:\x02\x38\x01\x1a\x33\n\x11\x46StringInt64Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x03:\x02\x38\x01\x1a\x34\n\x12\x46StringUint32Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\r:\x02\x38\x01\x1a\x34\n\x12\x46StringUint64Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x04:\x02\x38\x01\x1a\x34\n\x12\x46StringSint32Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x11:\x02\x38\x01\x1a\x34\n\x12\x46StringSint64Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x12:\x02\x38\x01\x1a\x35\n\x13\x46StringFixed32Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x07:\x02\x38\x01\x1a\x35\n\x13\x46StringFixed64Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x06:\x02\x38\x01\x1a\x36\n\x14\x46StringSfixed32Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x0f:\x02\x38\x01\x1a\x36\n\x14\x46StringSfixed64Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x10:\x02\x38\x01\x1a\x32\n\x10\x46StringBoolEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x08:\x02\x38\x01\x1a?\n\x11\x46StringEnum1Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\x19\n\x05value\x18\x02 \x01(\x0e\x32\n.TestEnum1:\x02\x38\x01\x1a?\n\x11\x46StringEnum2Entry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\x19\n\x05value\x18\x02 \x01(\x0e\x32\n.TestEnum2:\x02\x38\x01\x1a\x33\n\x11\x46StringFloatEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x02:\x02\x38\x01\x1a\x34\n\x12\x46StringDoubleEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x01:\x02\x38\x01\x1a\x33\n\x11\x46StringBytesEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x0c:\x02\x38\x01\x1a\x46\n\x13\x46StringMessageEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\x1e\n\x05value\x18\x02 \x01(\x0b\x32\x0f.TestPrimitives:\x02\x38\x01\"\xd7\x03\n\x0fTestSubmessages\x12%\n\x0c\x66_primitives\x18\x01 \x01(\x0b\x32\x0f.TestPrimitives\x12.\n\x11\x66_list_primitives\x18\x02 \x01(\x0b\x32\x13.TestListPrimitives\x12\x36\n\x15\x66_optional_primitives\x18\x03 \x01(\x0b\x32\x17.TestOptionalPrimitives\x12\x19\n\x06\x66_maps\x18\x04 \x01(\x0b\x32\t.TestMaps\x12\x44\n\x13\x66_string_primitives\x18\x05 \x03(\x0b\x32\'.TestSubmessages.FStringPrimitivesEntry\x12\x37\n\x19\x66_optional_msg_primitives\x18\x06 \x01(\x0b\x32\x0f.TestPrimitivesH\x00\x88\x01\x01\x12\x32\n\x19\x66_repeated_msg_primitives\x18\x07 \x03(\x0b\x32\x0f.TestPrimitives\x1aI\n\x16\x46StringPrimitivesEntry\x12\x0b\n\x03key\x18\x01 \x01(\t\x12\x1e\n\x05value\x18\x02 \x01(\x0b\x32\x0f.TestPrimitives:\x02\x38\x01\x42\x1c\n\x1a_f_optional_msg_primitives\"\xa3\x02\n\nTestOneofs\x12\x0f\n\x05\x66_int\x18\x01 \x01(\x04H\x00\x12\x11\n\x07\x66_bytes\x18\x02 \x01(\x0cH\x00\x12\x12\n\x08\x66_string\x18\x03 \x01(\tH\x01\x12\x11\n\x07\x66_float\x18\x04 \x01(\x02H\x01\x12\'\n\x0c\x66_primitives\x18\x05 \x01(\x0b\x32\x0f.TestPrimitivesH\x02\x12\x30\n\x11\x66_list_primitives\x18\x06 \x01(\x0b\x32\x13.TestListPrimitivesH\x02\x12\x38\n\x15\x66_optional_primitives\x18\x07 \x01(\x0b\x32\x17.TestOptionalPrimitivesH\x02\x42\x10\n\x0e\x66_int_or_bytesB\x13\n\x11\x66_string_or_floatB\x0e\n\x0c\x66_submessage\"~\n\x11TestFieldOrdering\x12\x12\n\nlast_field\x18\x05 \x01(\t\x12\x13\n\x0b\x66irst_field\x18\x01 \x01(\x05\x12\x14\n\x0cmiddle_field\x18\x03 \x01(\t\x12\x14\n\x0csecond_field\x18\x02 \x01(\x05\x12\x14\n\x0c\x66ourth_field\x18\x04 \x01(\t\"\xab\x01\n\x12TestFixedWidthOnly\x12\x11\n\tf_fixed32\x18\x01 \x01(\x07\x12\x12\n\nf_sfixed64\x18\x02 \x01(\x10\x12\x0f\n\x07\x66_float\x18\x03 \x01(\x02\x12\x10\n\x08\x66_double\x18\x04 \x01(\x01\x12\x1f\n\x12\x66_optional_fixed64\x18\x05 \x01(\x06H\x00\x88\x01\x01\x12\x13\n\nf_sfixed32\x18\xc8\x01 \x01(\x0f\x42\x15\n\x13_f_optional_fixed64\"F\n\x12TestFixedWidthList\x12\"\n\x05items\x18\x01 \x03(\x0b\x32\x13.TestFixedWidthOnly\x12\x0c\n\x04name\x18\x02 \x01(\t\"\x0b\n\tTestEmpty*G\n\tTestEnum1\x12\x12\n\x0eTEST_E1_VALUE1\x10\x00\x12\x12\n\x0eTEST_E1_VALUE2\x10\x05\x12\x12\n\x0eTEST_E1_VALUE3\x10\n*P\n\tTestEnum2\x12\x12\n\x0eTEST_E2_VALUE1\x10\x00\x12\x1b\n\x0eTEST_E2_VALUE2\x10\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\x12\x12\n\x0eTEST_E2_VALUE3\x10\x01\x62\x06proto3')
+
+_globals = globals()
+_builder.BuildMessageAndEnumDescriptors(DESCRIPTOR, _globals)
+_builder.BuildTopDescriptorsAndMessages(DESCRIPTOR, 'test_pb2', _globals)
+if not _descriptor._USE_C_DESCRIPTORS:
+  DESCRIPTOR._loaded_options = None
+  _globals['_TESTMAPS_FINT32STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FINT32STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FINT64STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FINT64STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FUINT32STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FUINT32STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FUINT64STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FUINT64STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSINT32STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSINT32STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSINT64STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSINT64STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FFIXED32STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FFIXED32STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FFIXED64STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FFIXED64STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSFIXED32STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSFIXED32STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSFIXED64STRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSFIXED64STRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FBOOLSTRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FBOOLSTRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGSTRINGENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGSTRINGENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGINT32ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGINT32ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGINT64ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGINT64ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGUINT32ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGUINT32ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGUINT64ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGUINT64ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGSINT32ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGSINT32ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGSINT64ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGSINT64ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGFIXED32ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGFIXED32ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGFIXED64ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGFIXED64ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGSFIXED32ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGSFIXED32ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGSFIXED64ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGSFIXED64ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGBOOLENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGBOOLENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGENUM1ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGENUM1ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGENUM2ENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGENUM2ENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGFLOATENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGFLOATENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGDOUBLEENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGDOUBLEENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGBYTESENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGBYTESENTRY']._serialized_options = b'8\001'
+  _globals['_TESTMAPS_FSTRINGMESSAGEENTRY']._loaded_options = None
+  _globals['_TESTMAPS_FSTRINGMESSAGEENTRY']._serialized_options = b'8\001'
+  _globals['_TESTSUBMESSAGES_FSTRINGPRIMITIVESENTRY']._loaded_options = None
+  _globals['_TESTSUBMESSAGES_FSTRINGPRIMITIVESENTRY']._serialized_options = b'8\001'
+  _globals['_TESTENUM1']._serialized_start=5806
+  _globals['_TESTENUM1']._serialized_end=5877
+  _globals['_TESTENUM2']._serialized_start=5879
+  _globals['_TESTENUM2']._serialized_end=5959
+  _globals['_TESTPRIMITIVES']._serialized_start=15
+  _globals['_TESTPRIMITIVES']._serialized_end=359
+  _globals['_TESTFLOATPRIMITIVESONLY']._serialized_start=361
+  _globals['_TESTFLOATPRIMITIVESONLY']._serialized_end=421
+  _globals['_TESTLISTPRIMITIVES']._serialized_start=424
+  _globals['_TESTLISTPRIMITIVES']._serialized_end=772
+  _globals['_TESTOPTIONALPRIMITIVES']._serialized_start=775
+  _globals['_TESTOPTIONALPRIMITIVES']._serialized_end=1431
+  _globals['_TESTMAPS']._serialized_start=1434
+  _globals['_TESTMAPS']._serialized_end=4649
+  _globals['_TESTMAPS_FINT32STRINGENTRY']._serialized_start=3043
+  _globals['_TESTMAPS_FINT32STRINGENTRY']._serialized_end=3094
+  _globals['_TESTMAPS_FINT64STRINGENTRY']._serialized_start=3096
+  _globals['_TESTMAPS_FINT64STRINGENTRY']._serialized_end=3147
+  _globals['_TESTMAPS_FUINT32STRINGENTRY']._serialized_start=3149
+  _globals['_TESTMAPS_FUINT32STRINGENTRY']._serialized_end=3201
+  _globals['_TESTMAPS_FUINT64STRINGENTRY']._serialized_start=3203
+  _globals['_TESTMAPS_FUINT64STRINGENTRY']._serialized_end=3255
+  _globals['_TESTMAPS_FSINT32STRINGENTRY']._serialized_start=3257
+  _globals['_TESTMAPS_FSINT32STRINGENTRY']._serialized_end=3309
+  _globals['_TESTMAPS_FSINT64STRINGENTRY']._serialized_start=3311
+  _globals['_TESTMAPS_FSINT64STRINGENTRY']._serialized_end=3363
+  _globals['_TESTMAPS_FFIXED32STRINGENTRY']._serialized_start=3365
+  _globals['_TESTMAPS_FFIXED32STRINGENTRY']._serialized_end=3418
+  _globals['_TESTMAPS_FFIXED64STRINGENTRY']._serialized_start=3420
+  _globals['_TESTMAPS_FFIXED64STRINGENTRY']._serialized_end=3473
+  _globals['_TESTMAPS_FSFIXED32STRINGENTRY']._serialized_start=3475
+  _globals['_TESTMAPS_FSFIXED32STRINGENTRY']._serialized_end=3529
+  _globals['_TESTMAPS_FSFIXED64STRINGENTRY']._serialized_start=3531
+  _globals['_TESTMAPS_FSFIXED64STRINGENTRY']._serialized_end=3585
+  _globals['_TESTMAPS_FBOOLSTRINGENTRY']._serialized_start=3587
+  _globals['_TESTMAPS_FBOOLSTRINGENTRY']._serialized_end=3637
+  _globals['_TESTMAPS_FSTRINGSTRINGENTRY']._serialized_start=3639
+  _globals['_TESTMAPS_FSTRINGSTRINGENTRY']._serialized_end=3691
+  _globals['_TESTMAPS_FSTRINGINT32ENTRY']._serialized_start=3693
+  _globals['_TESTMAPS_FSTRINGINT32ENTRY']._serialized_end=3744
+  _globals['_TESTMAPS_FSTRINGINT64ENTRY']._serialized_start=3746
+  _globals['_TESTMAPS_FSTRINGINT64ENTRY']._serialized_end=3797
+  _globals['_TESTMAPS_FSTRINGUINT32ENTRY']._serialized_start=3799
+  _globals['_TESTMAPS_FSTRINGUINT32ENTRY']._serialized_end=3851
+  _globals['_TESTMAPS_FSTRINGUINT64ENTRY']._serialized_start=3853
+  _globals['_TESTMAPS_FSTRINGUINT64ENTRY']._serialized_end=3905
+  _globals['_TESTMAPS_FSTRINGSINT32ENTRY']._serialized_start=3907
+  _globals['_TESTMAPS_FSTRINGSINT32ENTRY']._serialized_end=3959
+  _globals['_TESTMAPS_FSTRINGSINT64ENTRY']._serialized_start=3961
+  _globals['_TESTMAPS_FSTRINGSINT64ENTRY']._serialized_end=4013
+  _globals['_TESTMAPS_FSTRINGFIXED32ENTRY']._serialized_start=4015
+  _globals['_TESTMAPS_FSTRINGFIXED32ENTRY']._serialized_end=4068
+  _globals['_TESTMAPS_FSTRINGFIXED64ENTRY']._serialized_start=4070
+  _globals['_TESTMAPS_FSTRINGFIXED64ENTRY']._serialized_end=4123
+  _globals['_TESTMAPS_FSTRINGSFIXED32ENTRY']._serialized_start=4125
+  _globals['_TESTMAPS_FSTRINGSFIXED32ENTRY']._serialized_end=4179
+  _globals['_TESTMAPS_FSTRINGSFIXED64ENTRY']._serialized_start=4181
+  _globals['_TESTMAPS_FSTRINGSFIXED64ENTRY']._serialized_end=4235
+  _globals['_TESTMAPS_FSTRINGBOOLENTRY']._serialized_start=4237
+  _globals['_TESTMAPS_FSTRINGBOOLENTRY']._serialized_end=4287
+  _globals['_TESTMAPS_FSTRINGENUM1ENTRY']._serialized_start=4289
+  _globals['_TESTMAPS_FSTRINGENUM1ENTRY']._serialized_end=4352
+  _globals['_TESTMAPS_FSTRINGENUM2ENTRY']._serialized_start=4354
+  _globals['_TESTMAPS_FSTRINGENUM2ENTRY']._serialized_end=4417
+  _globals['_TESTMAPS_FSTRINGFLOATENTRY']._serialized_start=4419
+  _globals['_TESTMAPS_FSTRINGFLOATENTRY']._serialized_end=4470
+  _globals['_TESTMAPS_FSTRINGDOUBLEENTRY']._serialized_start=4472
+  _globals['_TESTMAPS_FSTRINGDOUBLEENTRY']._serialized_end=4524
+  _globals['_TESTMAPS_FSTRINGBYTESENTRY']._serialized_start=4526
+  _globals['_TESTMAPS_FSTRINGBYTESENTRY']._serialized_end=4577
+  _globals['_TESTMAPS_FSTRINGMESSAGEENTRY']._serialized_start=4579
+  _globals['_TESTMAPS_FSTRINGMESSAGEENTRY']._serialized_end=4649
+  _globals['_TESTSUBMESSAGES']._serialized_start=4652
+  _globals['_TESTSUBMESSAGES']._serialized_end=5123
+  _globals['_TESTSUBMESSAGES_FSTRINGPRIMITIVESENTRY']._serialized_start=5020
+  _globals['_TESTSUBMESSAGES_FSTRINGPRIMITIVESENTRY']._serialized_end=5093
+  _globals['_TESTONEOFS']._serialized_start=5126
+  _globals['_TESTONEOFS']._serialized_end=5417
+  _globals['_TESTFIELDORDERING']._serialized_start=5419
+  _globals['_TESTFIELDORDERING']._serialized_end=5545
+  _globals['_TESTFIXEDWIDTHONLY']._serialized_start=5548
+  _globals['_TESTFIXEDWIDTHONLY']._serialized_end=5719
+  _globals['_TESTFIXEDWIDTHLIST']._serialized_start=5721
+  _globals['_TESTFIXEDWIDTHLIST']._serialized_end=5791
+  _globals['_TESTEMPTY']._serialized_start=5793
+  _globals['_TESTEMPTY']._serialized_end=5804
+# @@protoc_insertion_point(module_scope)
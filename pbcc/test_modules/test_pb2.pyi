@@ -0,0 +1,498 @@
+from google.protobuf.internal import containers as _containers
+from google.protobuf.internal import enum_type_wrapper as _enum_type_wrapper
+from google.protobuf import descriptor as _descriptor
+from google.protobuf import message as _message
+from collections.abc import Iterable as _Iterable, Mapping as _Mapping
+from typing import ClassVar as _ClassVar, Optional as _Optional, Union as _Union
+
+DESCRIPTOR: _descriptor.FileDescriptor
+
+class TestEnum1(int, metaclass=_enum_type_wrapper.EnumTypeWrapper):
+    __slots__ = ()
+    TEST_E1_VALUE1: _ClassVar[TestEnum1]
+    TEST_E1_VALUE2: _ClassVar[TestEnum1]
+    TEST_E1_VALUE3: _ClassVar[TestEnum1]
+
+class TestEnum2(int, metaclass=_enum_type_wrapper.EnumTypeWrapper):
+    __slots__ = ()
+    TEST_E2_VALUE1: _ClassVar[TestEnum2]
+    TEST_E2_VALUE2: _ClassVar[TestEnum2]
+    TEST_E2_VALUE3: _ClassVar[TestEnum2]
+TEST_E1_VALUE1: TestEnum1
+TEST_E1_VALUE2: TestEnum1
+TEST_E1_VALUE3: TestEnum1
+TEST_E2_VALUE1: TestEnum2
+TEST_E2_VALUE2: TestEnum2
+TEST_E2_VALUE3: TestEnum2
+
+class TestPrimitives(_message.Message):
+    __slots__ = ("f_int32", "f_int64", "f_uint32", "f_uint64", "f_sint32", "f_sint64", "f_fixed32", "f_fixed64", "f_sfixed32", "f_sfixed64", "f_bool", "f_enum1", "f_enum2", "f_float", "f_double", "f_bytes", "f_string")
+    F_INT32_FIELD_NUMBER: _ClassVar[int]
+    F_INT64_FIELD_NUMBER: _ClassVar[int]
+    F_UINT32_FIELD_NUMBER: _ClassVar[int]
+    F_UINT64_FIELD_NUMBER: _ClassVar[int]
+    F_SINT32_FIELD_NUMBER: _ClassVar[int]
+    F_SINT64_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_BOOL_FIELD_NUMBER: _ClassVar[int]
+    F_ENUM1_FIELD_NUMBER: _ClassVar[int]
+    F_ENUM2_FIELD_NUMBER: _ClassVar[int]
+    F_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_DOUBLE_FIELD_NUMBER: _ClassVar[int]
+    F_BYTES_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FIELD_NUMBER: _ClassVar[int]
+    f_int32: int
+    f_int64: int
+    f_uint32: int
+    f_uint64: int
+    f_sint32: int
+    f_sint64: int
+    f_fixed32: int
+    f_fixed64: int
+    f_sfixed32: int
+    f_sfixed64: int
+    f_bool: bool
+    f_enum1: TestEnum1
+    f_enum2: TestEnum2
+    f_float: float
+    f_double: float
+    f_bytes: bytes
+    f_string: str
+    def __init__(self, f_int32: _Optional[int] = ..., f_int64: _Optional[int] = ..., f_uint32: _Optional[int] = ..., f_uint64: _Optional[int] = ..., f_sint32: _Optional[int] = ..., f_sint64: _Optional[int] = ..., f_fixed32: _Optional[int] = ..., f_fixed64: _Optional[int] = ..., f_sfixed32: _Optional[int] = ..., f_sfixed64: _Optional[int] = ..., f_bool: _Optional[bool] = ..., f_enum1: _Optional[_Union[TestEnum1, str]] = ..., f_enum2: _Optional[_Union[TestEnum2, str]] = ..., f_float: _Optional[float] = ..., f_double: _Optional[float] = ..., f_bytes: _Optional[bytes] = ..., f_string: _Optional[str] = ...) -> None: ...
+
+class TestFloatPrimitivesOnly(_message.Message):
+    __slots__ = ("f_float", "f_double")
+    F_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_DOUBLE_FIELD_NUMBER: _ClassVar[int]
+    f_float: float
+    f_double: float
+    def __init__(self, f_float: _Optional[float] = ..., f_double: _Optional[float] = ...) -> None: ...
+
+class TestListPrimitives(_message.Message):
+    __slots__ = ("f_int32", "f_int64", "f_uint32", "f_uint64", "f_sint32", "f_sint64", "f_fixed32", "f_fixed64", "f_sfixed32", "f_sfixed64", "f_bool", "f_enum1", "f_enum2", "f_float", "f_double", "f_bytes", "f_string")
+    F_INT32_FIELD_NUMBER: _ClassVar[int]
+    F_INT64_FIELD_NUMBER: _ClassVar[int]
+    F_UINT32_FIELD_NUMBER: _ClassVar[int]
+    F_UINT64_FIELD_NUMBER: _ClassVar[int]
+    F_SINT32_FIELD_NUMBER: _ClassVar[int]
+    F_SINT64_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_BOOL_FIELD_NUMBER: _ClassVar[int]
+    F_ENUM1_FIELD_NUMBER: _ClassVar[int]
+    F_ENUM2_FIELD_NUMBER: _ClassVar[int]
+    F_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_DOUBLE_FIELD_NUMBER: _ClassVar[int]
+    F_BYTES_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FIELD_NUMBER: _ClassVar[int]
+    f_int32: _containers.RepeatedScalarFieldContainer[int]
+    f_int64: _containers.RepeatedScalarFieldContainer[int]
+    f_uint32: _containers.RepeatedScalarFieldContainer[int]
+    f_uint64: _containers.RepeatedScalarFieldContainer[int]
+    f_sint32: _containers.RepeatedScalarFieldContainer[int]
+    f_sint64: _containers.RepeatedScalarFieldContainer[int]
+    f_fixed32: _containers.RepeatedScalarFieldContainer[int]
+    f_fixed64: _containers.RepeatedScalarFieldContainer[int]
+    f_sfixed32: _containers.RepeatedScalarFieldContainer[int]
+    f_sfixed64: _containers.RepeatedScalarFieldContainer[int]
+    f_bool: _containers.RepeatedScalarFieldContainer[bool]
+    f_enum1: _containers.RepeatedScalarFieldContainer[TestEnum1]
+    f_enum2: _containers.RepeatedScalarFieldContainer[TestEnum2]
+    f_float: _containers.RepeatedScalarFieldContainer[float]
+    f_double: _containers.RepeatedScalarFieldContainer[float]
+    f_bytes: _containers.RepeatedScalarFieldContainer[bytes]
+    f_string: _containers.RepeatedScalarFieldContainer[str]
+    def __init__(self, f_int32: _Optional[_Iterable[int]] = ..., f_int64: _Optional[_Iterable[int]] = ..., f_uint32: _Optional[_Iterable[int]] = ..., f_uint64: _Optional[_Iterable[int]] = ..., f_sint32: _Optional[_Iterable[int]] = ..., f_sint64: _Optional[_Iterable[int]] = ..., f_fixed32: _Optional[_Iterable[int]] = ..., f_fixed64: _Optional[_Iterable[int]] = ..., f_sfixed32: _Optional[_Iterable[int]] = ..., f_sfixed64: _Optional[_Iterable[int]] = ..., f_bool: _Optional[_Iterable[bool]] = ..., f_enum1: _Optional[_Iterable[_Union[TestEnum1, str]]] = ..., f_enum2: _Optional[_Iterable[_Union[TestEnum2, str]]] = ..., f_float: _Optional[_Iterable[float]] = ..., f_double: _Optional[_Iterable[float]] = ..., f_bytes: _Optional[_Iterable[bytes]] = ..., f_string: _Optional[_Iterable[str]] = ...) -> None: ...
+
+class TestOptionalPrimitives(_message.Message):
+    __slots__ = ("f_int32", "f_int64", "f_uint32", "f_uint64", "f_sint32", "f_sint64", "f_fixed32", "f_fixed64", "f_sfixed32", "f_sfixed64", "f_bool", "f_enum1", "f_enum2", "f_float", "f_double", "f_bytes", "f_string")
+    F_INT32_FIELD_NUMBER: _ClassVar[int]
+    F_INT64_FIELD_NUMBER: _ClassVar[int]
+    F_UINT32_FIELD_NUMBER: _ClassVar[int]
+    F_UINT64_FIELD_NUMBER: _ClassVar[int]
+    F_SINT32_FIELD_NUMBER: _ClassVar[int]
+    F_SINT64_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_BOOL_FIELD_NUMBER: _ClassVar[int]
+    F_ENUM1_FIELD_NUMBER: _ClassVar[int]
+    F_ENUM2_FIELD_NUMBER: _ClassVar[int]
+    F_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_DOUBLE_FIELD_NUMBER: _ClassVar[int]
+    F_BYTES_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FIELD_NUMBER: _ClassVar[int]
+    f_int32: int
+    f_int64: int
+    f_uint32: int
+    f_uint64: int
+    f_sint32: int
+    f_sint64: int
+    f_fixed32: int
+    f_fixed64: int
+    f_sfixed32: int
+    f_sfixed64: int
+    f_bool: bool
+    f_enum1: TestEnum1
+    f_enum2: TestEnum2
+    f_float: float
+    f_double: float
+    f_bytes: bytes
+    f_string: str
+    def __init__(self, f_int32: _Optional[int] = ..., f_int64: _Optional[int] = ..., f_uint32: _Optional[int] = ..., f_uint64: _Optional[int] = ..., f_sint32: _Optional[int] = ..., f_sint64: _Optional[int] = ..., f_fixed32: _Optional[int] = ..., f_fixed64: _Optional[int] = ..., f_sfixed32: _Optional[int] = ..., f_sfixed64: _Optional[int] = ..., f_bool: _Optional[bool] = ..., f_enum1: _Optional[_Union[TestEnum1, str]] = ..., f_enum2: _Optional[_Union[TestEnum2, str]] = ..., f_float: _Optional[float] = ..., f_double: _Optional[float] = ..., f_bytes: _Optional[bytes] = ..., f_string: _Optional[str] = ...) -> None: ...
+
+class TestMaps(_message.Message):
+    __slots__ = ("f_int32_string", "f_int64_string", "f_uint32_string", "f_uint64_string", "f_sint32_string", "f_sint64_string", "f_fixed32_string", "f_fixed64_string", "f_sfixed32_string", "f_sfixed64_string", "f_bool_string", "f_string_string", "f_string_int32", "f_string_int64", "f_string_uint32", "f_string_uint64", "f_string_sint32", "f_string_sint64", "f_string_fixed32", "f_string_fixed64", "f_string_sfixed32", "f_string_sfixed64", "f_string_bool", "f_string_enum1", "f_string_enum2", "f_string_float", "f_string_double", "f_string_bytes", "f_string_message")
+    class FInt32StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FInt64StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FUint32StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FUint64StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FSint32StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FSint64StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FFixed32StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FFixed64StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FSfixed32StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FSfixed64StringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: int
+        value: str
+        def __init__(self, key: _Optional[int] = ..., value: _Optional[str] = ...) -> None: ...
+    class FBoolStringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: bool
+        value: str
+        def __init__(self, key: _Optional[bool] = ..., value: _Optional[str] = ...) -> None: ...
+    class FStringStringEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: str
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[str] = ...) -> None: ...
+    class FStringInt32Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringInt64Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringUint32Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringUint64Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringSint32Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringSint64Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringFixed32Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringFixed64Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringSfixed32Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringSfixed64Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: int
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[int] = ...) -> None: ...
+    class FStringBoolEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: bool
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[bool] = ...) -> None: ...
+    class FStringEnum1Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: TestEnum1
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[_Union[TestEnum1, str]] = ...) -> None: ...
+    class FStringEnum2Entry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: TestEnum2
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[_Union[TestEnum2, str]] = ...) -> None: ...
+    class FStringFloatEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: float
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[float] = ...) -> None: ...
+    class FStringDoubleEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: float
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[float] = ...) -> None: ...
+    class FStringBytesEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: bytes
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[bytes] = ...) -> None: ...
+    class FStringMessageEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: TestPrimitives
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[_Union[TestPrimitives, _Mapping]] = ...) -> None: ...
+    F_INT32_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_INT64_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_UINT32_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_UINT64_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_SINT32_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_SINT64_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED32_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_FIXED64_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED32_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED64_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_BOOL_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_INT32_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_INT64_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_UINT32_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_UINT64_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_SINT32_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_SINT64_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_SFIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_SFIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_BOOL_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_ENUM1_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_ENUM2_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_DOUBLE_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_BYTES_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_MESSAGE_FIELD_NUMBER: _ClassVar[int]
+    f_int32_string: _containers.ScalarMap[int, str]
+    f_int64_string: _containers.ScalarMap[int, str]
+    f_uint32_string: _containers.ScalarMap[int, str]
+    f_uint64_string: _containers.ScalarMap[int, str]
+    f_sint32_string: _containers.ScalarMap[int, str]
+    f_sint64_string: _containers.ScalarMap[int, str]
+    f_fixed32_string: _containers.ScalarMap[int, str]
+    f_fixed64_string: _containers.ScalarMap[int, str]
+    f_sfixed32_string: _containers.ScalarMap[int, str]
+    f_sfixed64_string: _containers.ScalarMap[int, str]
+    f_bool_string: _containers.ScalarMap[bool, str]
+    f_string_string: _containers.ScalarMap[str, str]
+    f_string_int32: _containers.ScalarMap[str, int]
+    f_string_int64: _containers.ScalarMap[str, int]
+    f_string_uint32: _containers.ScalarMap[str, int]
+    f_string_uint64: _containers.ScalarMap[str, int]
+    f_string_sint32: _containers.ScalarMap[str, int]
+    f_string_sint64: _containers.ScalarMap[str, int]
+    f_string_fixed32: _containers.ScalarMap[str, int]
+    f_string_fixed64: _containers.ScalarMap[str, int]
+    f_string_sfixed32: _containers.ScalarMap[str, int]
+    f_string_sfixed64: _containers.ScalarMap[str, int]
+    f_string_bool: _containers.ScalarMap[str, bool]
+    f_string_enum1: _containers.ScalarMap[str, TestEnum1]
+    f_string_enum2: _containers.ScalarMap[str, TestEnum2]
+    f_string_float: _containers.ScalarMap[str, float]
+    f_string_double: _containers.ScalarMap[str, float]
+    f_string_bytes: _containers.ScalarMap[str, bytes]
+    f_string_message: _containers.MessageMap[str, TestPrimitives]
+    def __init__(self, f_int32_string: _Optional[_Mapping[int, str]] = ..., f_int64_string: _Optional[_Mapping[int, str]] = ..., f_uint32_string: _Optional[_Mapping[int, str]] = ..., f_uint64_string: _Optional[_Mapping[int, str]] = ..., f_sint32_string: _Optional[_Mapping[int, str]] = ..., f_sint64_string: _Optional[_Mapping[int, str]] = ..., f_fixed32_string: _Optional[_Mapping[int, str]] = ..., f_fixed64_string: _Optional[_Mapping[int, str]] = ..., f_sfixed32_string: _Optional[_Mapping[int, str]] = ..., f_sfixed64_string: _Optional[_Mapping[int, str]] = ..., f_bool_string: _Optional[_Mapping[bool, str]] = ..., f_string_string: _Optional[_Mapping[str, str]] = ..., f_string_int32: _Optional[_Mapping[str, int]] = ..., f_string_int64: _Optional[_Mapping[str, int]] = ..., f_string_uint32: _Optional[_Mapping[str, int]] = ..., f_string_uint64: _Optional[_Mapping[str, int]] = ..., f_string_sint32: _Optional[_Mapping[str, int]] = ..., f_string_sint64: _Optional[_Mapping[str, int]] = ..., f_string_fixed32: _Optional[_Mapping[str, int]] = ..., f_string_fixed64: _Optional[_Mapping[str, int]] = ..., f_string_sfixed32: _Optional[_Mapping[str, int]] = ..., f_string_sfixed64: _Optional[_Mapping[str, int]] = ..., f_string_bool: _Optional[_Mapping[str, bool]] = ..., f_string_enum1: _Optional[_Mapping[str, TestEnum1]] = ..., f_string_enum2: _Optional[_Mapping[str, TestEnum2]] = ..., f_string_float: _Optional[_Mapping[str, float]] = ..., f_string_double: _Optional[_Mapping[str, float]] = ..., f_string_bytes: _Optional[_Mapping[str, bytes]] = ..., f_string_message: _Optional[_Mapping[str, TestPrimitives]] = ...) -> None: ...
+
+class TestSubmessages(_message.Message):
+    __slots__ = ("f_primitives", "f_list_primitives", "f_optional_primitives", "f_maps", "f_string_primitives", "f_optional_msg_primitives", "f_repeated_msg_primitives")
+    class FStringPrimitivesEntry(_message.Message):
+        __slots__ = ("key", "value")
+        KEY_FIELD_NUMBER: _ClassVar[int]
+        VALUE_FIELD_NUMBER: _ClassVar[int]
+        key: str
+        value: TestPrimitives
+        def __init__(self, key: _Optional[str] = ..., value: _Optional[_Union[TestPrimitives, _Mapping]] = ...) -> None: ...
+    F_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_LIST_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_OPTIONAL_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_MAPS_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_OPTIONAL_MSG_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_REPEATED_MSG_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    f_primitives: TestPrimitives
+    f_list_primitives: TestListPrimitives
+    f_optional_primitives: TestOptionalPrimitives
+    f_maps: TestMaps
+    f_string_primitives: _containers.MessageMap[str, TestPrimitives]
+    f_optional_msg_primitives: TestPrimitives
+    f_repeated_msg_primitives: _containers.RepeatedCompositeFieldContainer[TestPrimitives]
+    def __init__(self, f_primitives: _Optional[_Union[TestPrimitives, _Mapping]] = ..., f_list_primitives: _Optional[_Union[TestListPrimitives, _Mapping]] = ..., f_optional_primitives: _Optional[_Union[TestOptionalPrimitives, _Mapping]] = ..., f_maps: _Optional[_Union[TestMaps, _Mapping]] = ..., f_string_primitives: _Optional[_Mapping[str, TestPrimitives]] = ..., f_optional_msg_primitives: _Optional[_Union[TestPrimitives, _Mapping]] = ..., f_repeated_msg_primitives: _Optional[_Iterable[_Union[TestPrimitives, _Mapping]]] = ...) -> None: ...
+
+class TestOneofs(_message.Message):
+    __slots__ = ("f_int", "f_bytes", "f_string", "f_float", "f_primitives", "f_list_primitives", "f_optional_primitives")
+    F_INT_FIELD_NUMBER: _ClassVar[int]
+    F_BYTES_FIELD_NUMBER: _ClassVar[int]
+    F_STRING_FIELD_NUMBER: _ClassVar[int]
+    F_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_LIST_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    F_OPTIONAL_PRIMITIVES_FIELD_NUMBER: _ClassVar[int]
+    f_int: int
+    f_bytes: bytes
+    f_string: str
+    f_float: float
+    f_primitives: TestPrimitives
+    f_list_primitives: TestListPrimitives
+    f_optional_primitives: TestOptionalPrimitives
+    def __init__(self, f_int: _Optional[int] = ..., f_bytes: _Optional[bytes] = ..., f_string: _Optional[str] = ..., f_float: _Optional[float] = ..., f_primitives: _Optional[_Union[TestPrimitives, _Mapping]] = ..., f_list_primitives: _Optional[_Union[TestListPrimitives, _Mapping]] = ..., f_optional_primitives: _Optional[_Union[TestOptionalPrimitives, _Mapping]] = ...) -> None: ...
+
+class TestFieldOrdering(_message.Message):
+    __slots__ = ("last_field", "first_field", "middle_field", "second_field", "fourth_field")
+    LAST_FIELD_FIELD_NUMBER: _ClassVar[int]
+    FIRST_FIELD_FIELD_NUMBER: _ClassVar[int]
+    MIDDLE_FIELD_FIELD_NUMBER: _ClassVar[int]
+    SECOND_FIELD_FIELD_NUMBER: _ClassVar[int]
+    FOURTH_FIELD_FIELD_NUMBER: _ClassVar[int]
+    last_field: str
+    first_field: int
+    middle_field: str
+    second_field: int
+    fourth_field: str
+    def __init__(self, last_field: _Optional[str] = ..., first_field: _Optional[int] = ..., middle_field: _Optional[str] = ..., second_field: _Optional[int] = ..., fourth_field: _Optional[str] = ...) -> None: ...
+
+class TestFixedWidthOnly(_message.Message):
+    __slots__ = ("f_fixed32", "f_sfixed64", "f_float", "f_double", "f_optional_fixed64", "f_sfixed32")
+    F_FIXED32_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_FLOAT_FIELD_NUMBER: _ClassVar[int]
+    F_DOUBLE_FIELD_NUMBER: _ClassVar[int]
+    F_OPTIONAL_FIXED64_FIELD_NUMBER: _ClassVar[int]
+    F_SFIXED32_FIELD_NUMBER: _ClassVar[int]
+    f_fixed32: int
+    f_sfixed64: int
+    f_float: float
+    f_double: float
+    f_optional_fixed64: int
+    f_sfixed32: int
+    def __init__(self, f_fixed32: _Optional[int] = ..., f_sfixed64: _Optional[int] = ..., f_float: _Optional[float] = ..., f_double: _Optional[float] = ..., f_optional_fixed64: _Optional[int] = ..., f_sfixed32: _Optional[int] = ...) -> None: ...
+
+class TestFixedWidthList(_message.Message):
+    __slots__ = ("items", "name")
+    ITEMS_FIELD_NUMBER: _ClassVar[int]
+    NAME_FIELD_NUMBER: _ClassVar[int]
+    items: _containers.RepeatedCompositeFieldContainer[TestFixedWidthOnly]
+    name: str
+    def __init__(self, items: _Optional[_Iterable[_Union[TestFixedWidthOnly, _Mapping]]] = ..., name: _Optional[str] = ...) -> None: ...
+
+class TestEmpty(_message.Message):
+    __slots__ = ()
+    def __init__(self) -> None: ...
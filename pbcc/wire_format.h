@@ -0,0 +1,461 @@
+// Protobuf wire format primitives: a byte string reader and writer, wire
+// types and data types, tags, varints, and skipping fields. Nothing here
+// depends on Python, so these can be tested and benchmarked on their own (see
+// bench_codec.cc). pymodule.in.cc includes this file.
+
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+static constexpr bool is_in_u32_range(uint64_t v) {
+  return (v & 0xFFFFFFFF00000000LL) == 0;
+}
+static constexpr bool is_in_s32_range(int64_t v) {
+  return ((v >= -0x80000000LL) && (v <= 0x7FFFFFFFLL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// String reader/writer (from phosg)
+
+__attribute__((format(printf, 1, 2))) inline std::string string_printf(const char* fmt, ...) {
+  va_list va;
+  va_start(va, fmt);
+  char* result = nullptr;
+  int length = vasprintf(&result, fmt, va);
+  if (result == nullptr) {
+    throw std::bad_alloc();
+  }
+  // NOTE: It's not great that we copy the string again here, but this is only
+  // used in error cases so it's probably not a big deal
+  std::string ret(result, length);
+  free(result);
+  va_end(va);
+  return ret;
+}
+
+// Try to determine endianess from GCC defines first. If they aren't available,
+// use some constants to try to figure it out
+// clang-format off
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // OK; system is little-endian
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  #error pbcc cannot be compiled on big-endian systems (for now)  
+#else
+  #define LITTLE_ENDIAN_VALUE 0x31323334UL
+  #define BIG_ENDIAN_VALUE    0x34333231UL
+  #define ENDIAN_ORDER_VALUE  ('1234')
+  #if ENDIAN_ORDER_VALUE == LITTLE_ENDIAN_VALUE
+  // OK; system is little-endian
+  #elif ENDIAN_ORDER_VALUE == BIG_ENDIAN_VALUE
+    #error pbcc cannot be compiled on big-endian systems (for now)
+  #else
+    #error "Unrecognized host system endianness"
+  #endif
+  #undef LITTLE_ENDIAN_VALUE
+  #undef BIG_ENDIAN_VALUE
+  #undef ENDIAN_ORDER_VALUE
+#endif
+// clang-format on
+
+class StringReader {
+public:
+  StringReader()
+      : data(nullptr),
+        length(0),
+        offset(0) {}
+  StringReader(const void* data, size_t size, size_t offset = 0)
+      : data(reinterpret_cast<const uint8_t*>(data)),
+        length(size),
+        offset(offset) {}
+  virtual ~StringReader() = default;
+
+  size_t where() const {
+    return this->offset;
+  }
+  size_t size() const {
+    return this->length;
+  }
+  size_t remaining() const {
+    return this->length - this->offset;
+  }
+  inline void go(size_t offset) {
+    this->offset = offset;
+  }
+  inline void skip(size_t bytes) {
+    this->offset += bytes;
+    if (this->offset > this->length) {
+      this->offset = this->length;
+      throw std::out_of_range("skip beyond end of string");
+    }
+  }
+  inline bool eof() const {
+    return (this->offset >= this->length);
+  }
+
+  StringReader subx(size_t offset) const {
+    if (offset > this->length) {
+      throw std::out_of_range("sub-reader begins beyond end of data");
+    }
+    return StringReader(
+        reinterpret_cast<const char*>(this->data) + offset,
+        this->length - offset);
+  }
+  StringReader subx(size_t offset, size_t size) const {
+    if (offset + size > this->length) {
+      throw std::out_of_range("sub-reader begins or extends beyond end of data");
+    }
+    return StringReader(reinterpret_cast<const char*>(this->data) + offset, size);
+  }
+
+  std::string preadx(size_t offset, size_t size) const {
+    if (offset + size > this->length) {
+      throw std::out_of_range("not enough data to read");
+    }
+    return std::string(reinterpret_cast<const char*>(this->data + offset), size);
+  }
+
+  inline const void* pgetv(size_t offset, size_t size) const {
+    if (offset + size > this->length) {
+      throw std::out_of_range("end of string");
+    }
+    return this->data + offset;
+  }
+#if defined(__x86_64__) || defined(_M_X64)
+  template <typename T>
+  const T& pget(size_t offset, size_t size = sizeof(T)) const {
+    return *reinterpret_cast<const T*>(this->pgetv(offset, size));
+  }
+#else
+  template <typename T>
+  T pget(size_t offset, size_t size = sizeof(T)) const {
+    T ret;
+    memcpy(&ret, this->pgetv(offset, size), size);
+    return ret;
+  }
+#endif
+
+  inline const void* getv(size_t size, bool advance = true) {
+    const void* ret = this->pgetv(this->offset, size);
+    if (advance) {
+      this->offset += size;
+    }
+    return ret;
+  }
+
+#if defined(__x86_64__) || defined(_M_X64)
+  template <typename T>
+  const T& get(bool advance = true, size_t size = sizeof(T)) {
+    const T& ret = this->pget<T>(this->offset, size);
+    if (advance) {
+      this->offset += size;
+    }
+    return ret;
+  }
+#else
+  template <typename T>
+  T get(bool advance = true, size_t size = sizeof(T)) {
+    T ret = this->pget<T>(this->offset, size);
+    if (advance) {
+      this->offset += size;
+    }
+    return ret;
+  }
+#endif
+
+  // TODO: These should use the le_ types if we ever build this on big-endian systems
+  inline uint8_t get_u8(bool advance = true) { return this->get<uint8_t>(advance); }
+  inline int8_t get_s8(bool advance = true) { return this->get<int8_t>(advance); }
+  inline uint16_t get_u16l(bool advance = true) { return this->get<uint16_t>(advance); }
+  inline int16_t get_s16l(bool advance = true) { return this->get<int16_t>(advance); }
+  inline uint32_t get_u32l(bool advance = true) { return this->get<uint32_t>(advance); }
+  inline int32_t get_s32l(bool advance = true) { return this->get<int32_t>(advance); }
+  inline uint64_t get_u64l(bool advance = true) { return this->get<uint64_t>(advance); }
+  inline int64_t get_s64l(bool advance = true) { return this->get<int64_t>(advance); }
+  inline float get_f32l(bool advance = true) { return this->get<float>(advance); }
+  inline double get_f64l(bool advance = true) { return this->get<double>(advance); }
+
+private:
+  const uint8_t* data;
+  size_t length;
+  size_t offset;
+};
+
+class StringWriter {
+public:
+  StringWriter() = default;
+  ~StringWriter() = default;
+
+  inline size_t size() const {
+    return this->data.size();
+  }
+
+  inline void write(const void* data, size_t size) {
+    this->data.append(reinterpret_cast<const char*>(data), size);
+  }
+  inline void write(const std::string& data) {
+    this->data.append(data);
+  }
+  inline void insert(size_t offset, const std::string& data) {
+    this->data.insert(offset, data);
+  }
+  inline void truncate(size_t size) {
+    this->data.resize(size);
+  }
+
+  template <typename T>
+  void put(const T& v) {
+    this->write(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  // TODO: These should use the le_ types if we ever build this on big-endian systems
+  inline void put_u8(uint8_t v) { this->data.push_back(static_cast<char>(v)); }
+  inline void put_s8(int8_t v) { this->data.push_back(v); }
+  inline void put_u16l(uint16_t v) { this->put<uint16_t>(v); }
+  inline void put_s16l(int16_t v) { this->put<int16_t>(v); }
+  inline void put_u32l(uint32_t v) { this->put<uint32_t>(v); }
+  inline void put_s32l(int32_t v) { this->put<int32_t>(v); }
+  inline void put_u64l(uint64_t v) { this->put<uint64_t>(v); }
+  inline void put_s64l(int64_t v) { this->put<int64_t>(v); }
+  inline void put_f32l(float v) { this->put<float>(v); }
+  inline void put_f64l(double v) { this->put<double>(v); }
+
+  inline std::string& str() {
+    return this->data;
+  }
+  inline const std::string& str() const {
+    return this->data;
+  }
+
+private:
+  std::string data;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Wire types and data types
+
+enum class WireType {
+  UNKNOWN = -1,
+
+  // Field contents are another varint-encoded integer, zigzag-encoded if the
+  // type is signed (sint32 or sint64).
+  // Used for int32, int64, uint32, uint64, sint32, sint64, bool, enum
+  VARINT = 0,
+  // Field contents are 8 bytes, little-endian.
+  // Used for fixed64, sfixed64, double
+  INT64 = 1,
+  // Field contents are a varint specifying how many data bytes follow,
+  // followed immediately by the data bytes. The number of items in a packed
+  // repeated field is not specified; the parser should continue parsing items
+  // until it reads the entire data string.
+  // Used for string, bytes, embedded messages, packed repeated fields
+  LENGTH = 2,
+  // We don't support groups, since they're deprecated.
+  GROUP_START = 3,
+  GROUP_END = 4,
+  // Field contents are 4 bytes, little-endian.
+  // Used for fixed32, sfixed32, float
+  INT32 = 5,
+};
+
+inline const char* name_for_wire_type(WireType t) {
+  switch (t) {
+    case WireType::VARINT:
+      return "VARINT";
+    case WireType::INT64:
+      return "INT64";
+    case WireType::LENGTH:
+      return "LENGTH";
+    case WireType::GROUP_START:
+      return "GROUP_START";
+    case WireType::GROUP_END:
+      return "GROUP_END";
+    case WireType::INT32:
+      return "INT32";
+    default:
+      return "__UNKNOWN__";
+  }
+}
+
+enum class DataType {
+  UNKNOWN = -1,
+  FLOAT,
+  DOUBLE,
+  INT32,
+  UINT32,
+  SINT32,
+  INT64,
+  UINT64,
+  SINT64,
+  FIXED32,
+  SFIXED32,
+  FIXED64,
+  SFIXED64,
+  BOOL,
+  ENUM,
+  STRING,
+  BYTES,
+  MAP, // message_constructor required in parse()
+  MESSAGE, // message_constructor required in parse()
+};
+
+constexpr bool is_uint_data_type(DataType t) {
+  return ((t == DataType::UINT32) ||
+      (t == DataType::UINT64) ||
+      (t == DataType::BOOL) ||
+      (t == DataType::ENUM) ||
+      (t == DataType::FIXED32) ||
+      (t == DataType::FIXED64));
+}
+constexpr bool is_sint_data_type(DataType t) {
+  return ((t == DataType::INT32) ||
+      (t == DataType::SINT32) ||
+      (t == DataType::INT64) ||
+      (t == DataType::SINT64) ||
+      (t == DataType::SFIXED32) ||
+      (t == DataType::SFIXED64));
+}
+constexpr bool is_float_data_type(DataType t) {
+  return ((t == DataType::FLOAT) ||
+      (t == DataType::DOUBLE));
+}
+
+constexpr bool is_varint_data_type(DataType t) {
+  return ((t == DataType::INT32) ||
+      (t == DataType::UINT32) ||
+      (t == DataType::SINT32) ||
+      (t == DataType::INT64) ||
+      (t == DataType::UINT64) ||
+      (t == DataType::SINT64) ||
+      (t == DataType::BOOL) ||
+      (t == DataType::ENUM));
+}
+constexpr bool is_int32_data_type(DataType t) {
+  return ((t == DataType::FLOAT) ||
+      (t == DataType::FIXED32) ||
+      (t == DataType::SFIXED32));
+}
+constexpr bool is_int64_data_type(DataType t) {
+  return ((t == DataType::DOUBLE) ||
+      (t == DataType::FIXED64) ||
+      (t == DataType::SFIXED64));
+}
+constexpr bool is_string_data_type(DataType t) {
+  return ((t == DataType::STRING) ||
+      (t == DataType::BYTES));
+}
+constexpr bool is_message_data_type(DataType t) {
+  return ((t == DataType::MAP) ||
+      (t == DataType::MESSAGE));
+}
+constexpr bool can_use_packed_repeated_format(DataType t) {
+  // String data types can't be serialized in the packed format, since they
+  // couldn't be distinguished on the wire from non-packed string data types if
+  // that were allowed
+  return (!is_string_data_type(t) && (t != DataType::MAP) && (t != DataType::MESSAGE));
+}
+
+static constexpr WireType wire_type_for_data_type(DataType t) {
+  switch (t) {
+    case DataType::FIXED32:
+    case DataType::SFIXED32:
+    case DataType::FLOAT:
+      return WireType::INT32;
+    case DataType::FIXED64:
+    case DataType::SFIXED64:
+    case DataType::DOUBLE:
+      return WireType::INT64;
+    case DataType::INT32:
+    case DataType::UINT32:
+    case DataType::SINT32:
+    case DataType::INT64:
+    case DataType::UINT64:
+    case DataType::SINT64:
+    case DataType::BOOL:
+    case DataType::ENUM:
+      return WireType::VARINT;
+    case DataType::STRING:
+    case DataType::BYTES:
+    case DataType::MAP:
+    case DataType::MESSAGE:
+      return WireType::LENGTH;
+    default:
+      return WireType::UNKNOWN;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tags and varints
+
+static inline WireType wire_type_for_tag(uint64_t tag) {
+  return static_cast<WireType>(tag & 7);
+}
+static inline uint64_t field_num_for_tag(uint64_t tag) {
+  return tag >> 3;
+}
+static inline uint64_t encode_tag(uint64_t field_num, WireType type) {
+  return (field_num << 3) | static_cast<uint64_t>(type);
+}
+
+inline uint64_t decode_varint(StringReader& r) {
+  uint8_t shift = 0;
+  uint64_t ret = 0;
+  for (;;) {
+    if (shift >= 64) {
+      throw std::runtime_error("varint has more than 10 7-bit digits");
+    }
+    uint8_t v = r.get_u8();
+    ret |= (static_cast<uint64_t>(v & 0x7F) << shift);
+    if (!(v & 0x80)) {
+      return ret;
+    }
+    shift += 7;
+  }
+}
+
+inline void encode_varint(StringWriter& w, uint64_t v) {
+  while (v > 0x7F) {
+    w.put_u8((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  // v cannot be zero here unless it was already zero before the loop
+  w.put_u8(v);
+}
+
+inline int64_t decode_varint_signed(StringReader& r) {
+  uint64_t v = decode_varint(r);
+  return (v >> 1) ^ ((v & 1) ? -1 : 0);
+}
+inline void encode_varint_signed32(StringWriter& w, int32_t n) {
+  encode_varint(w, static_cast<uint32_t>((n << 1) ^ (n >> 31)));
+}
+inline void encode_varint_signed64(StringWriter& w, int64_t n) {
+  encode_varint(w, (n << 1) ^ (n >> 63));
+}
+
+// Skip a field's data without parsing it
+inline void skip_field(StringReader& r, WireType type) {
+  switch (type) {
+    case WireType::VARINT:
+      decode_varint(r);
+      break;
+    case WireType::INT64:
+      r.skip(8);
+      break;
+    case WireType::LENGTH:
+      r.skip(decode_varint(r));
+      break;
+    case WireType::INT32:
+      r.skip(4);
+      break;
+    default:
+      throw std::runtime_error(string_printf("Unknown field type %02hhX", static_cast<uint8_t>(type)));
+  }
+}